@@ -0,0 +1,41 @@
+#!/bin/bash
+# Measures how the cost of a call depends on the number of functions
+# in a program. For every count, a program is generated where `main`
+# calls the last function in the symbol table 2'000'000 times. It runs
+# at -O0, since the assembler otherwise drops every function but the
+# one `main` calls. Builds from before -O existed don't drop anything,
+# so for those, set YVM_FLAGS to nothing.
+#
+# Usage: [YVM_FLAGS=...] bench/CallCost.sh [path to yvm] [function counts...]
+
+YVM=${1:-./yvm}
+YVM_FLAGS=${YVM_FLAGS--O0}
+shift
+COUNTS=${@:-1 16 256 4096}
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+
+Generate() {
+    local count=$1
+    local last=$((count - 1))
+
+    for ((i = 0; i != count; ++i)); do
+        printf '[registers=1]\nfunction f%d() {\n    ret\n}\n\n' "$i"
+    done
+
+    printf '[registers=3]\nfunction main() {\n'
+    printf '    ldconst R0, 0\n    ldconst R1, 1\n    ldconst R2, 2000000\n'
+    printf 'loop:\n    call f%d\n    u64add R0, R1\n    cmp R0, R2\n    jlt loop\n    ret\n}\n' "$last"
+}
+
+printf '%10s %10s\n' "Functions" "Seconds"
+for count in $COUNTS; do
+    Generate "$count" > "$TMPDIR/Calls$count.yun"
+
+    start=$(date +%s.%N)
+    "$YVM" $YVM_FLAGS "$TMPDIR/Calls$count.yun" || exit 1
+    stop=$(date +%s.%N)
+
+    printf '%10d %10.3f\n' "$count" "$(echo "$stop - $start" | awk '{ print $1 - $3 }')"
+done
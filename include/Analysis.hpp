@@ -0,0 +1,222 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+// C header files
+#include <cstddef>
+#include <cstdint>
+// C++ header files
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+// My header files
+#include "Emit.hpp"
+
+namespace Yun::VM::Analysis {
+
+// Index of the instruction a jump lands on, relative to the jump's function.
+// Offsets are in bytes, like in the serialized form
+[[nodiscard]] constexpr auto JumpTarget(const Emit::Instruction& instruction, size_t index) noexcept -> int64_t {
+    return static_cast<int64_t>(index) + instruction.Destination() / 4;
+}
+
+// Instructions of a single function, in the form the emitter produced them
+[[nodiscard]] auto Decode(const uint32_t* begin, const uint32_t* end) -> std::vector<Emit::Instruction>;
+
+class BasicBlock {
+    public:
+        size_t              Begin;        // First instruction
+        size_t              End;          // One past the last instruction
+        std::vector<size_t> Successors;
+        std::vector<size_t> Predecessors;
+};
+
+// Types of every register right before and right after every instruction
+// of a function, as inferred by the `Verifier`
+class RegisterTypes {
+    public:
+        std::vector<std::vector<Primitives::Type>> Before;
+        std::vector<std::vector<Primitives::Type>> After;
+};
+
+// Control flow graph of a single function. Block 0 is always the entry block
+class ControlFlowGraph {
+    public:
+        ControlFlowGraph(const std::vector<Emit::Instruction>&);
+
+    public:
+        [[nodiscard]] auto Blocks() const noexcept -> const std::vector<BasicBlock>&;
+        [[nodiscard]] auto BlockOf(size_t) const -> size_t;
+        [[nodiscard]] auto Count() const noexcept -> size_t;
+
+    private:
+        std::vector<BasicBlock> _blocks;
+        std::vector<size_t>     _blockOf;
+};
+
+// A register is live after an instruction if some path from there
+// reads it before writing it. Only covers the registers of the frame
+class Liveness {
+    public:
+        Liveness(const std::vector<Emit::Instruction>&, const ControlFlowGraph&, const Containers::Symbol&, const Containers::SymbolTable&);
+
+    public:
+        [[nodiscard]] auto LiveAfter(size_t) const -> std::vector<bool>;
+        [[nodiscard]] auto LiveBefore(size_t) const -> std::vector<bool>;
+
+    private:
+        auto Transfer(const Emit::Instruction&, std::vector<bool>&) const -> void;
+
+    private:
+        const std::vector<Emit::Instruction>& _instructions;
+        const ControlFlowGraph&               _graph;
+        const Containers::Symbol&             _function;
+        const Containers::SymbolTable&        _symbols;
+        std::vector<std::vector<bool>>        _liveOut;
+};
+
+// Registers an instruction reads, and the one it writes or -1, as `Liveness` sees them
+[[nodiscard]] auto Reads(const Emit::Instruction&, const Containers::Symbol&, const Containers::SymbolTable&) -> std::vector<uint32_t>;
+[[nodiscard]] auto Writes(const Emit::Instruction&, const Containers::Symbol&, const Containers::SymbolTable&) -> int64_t;
+
+// Which blocks every path from the entry block goes through. Blocks
+// nothing leads to are left out, and dominate nothing
+class Dominators {
+    public:
+        Dominators(const ControlFlowGraph&);
+
+    public:
+        [[nodiscard]] auto Reachable(size_t) const -> bool;
+        [[nodiscard]] auto Dominates(size_t, size_t) const -> bool;
+        // Reachable blocks in reverse postorder, the entry block first
+        [[nodiscard]] auto Order() const noexcept -> const std::vector<size_t>&;
+
+    private:
+        std::vector<size_t> _order;
+        std::vector<size_t> _position;    // In `_order`
+        std::vector<size_t> _immediate;
+};
+
+// Blocks of every loop by its header, found through the back edges that lead to it
+[[nodiscard]] auto NaturalLoops(const ControlFlowGraph&, const Dominators&) -> std::map<size_t, std::vector<bool>>;
+
+// What a register holds somewhere in a function, see `SsaForm`
+struct SsaValue {
+    enum class Origin : uint8_t {
+        Entry, Instruction, Phi
+    };
+
+    Origin   Kind;
+    size_t   At;         // The instruction that wrote it, or the block of a phi
+    uint32_t Register;
+};
+
+// A function in static single assignment form: every write to a register is a value of its
+// own, and so is what every register holds when the function starts and where paths meet,
+// unless all of them bring the same value. The instructions themselves stay as they are.
+// Values with the same number are always equal, and values are typed as far as that's known
+class SsaForm {
+    public:
+        static constexpr size_t None = SIZE_MAX;
+
+        SsaForm(const std::vector<Emit::Instruction>&, const ControlFlowGraph&, const Dominators&,
+                const Containers::Symbol&, const Containers::SymbolTable&, const Containers::ConstantPool&);
+
+    public:
+        // Value a register holds right before a reachable instruction
+        [[nodiscard]] auto Before(size_t, uint32_t) const -> size_t;
+        // Value an instruction writes, or `None`
+        [[nodiscard]] auto Defined(size_t) const -> size_t;
+        [[nodiscard]] auto At(size_t) const -> const SsaValue&;
+        // Operands of a phi, one for every reachable predecessor of its block in the order of
+        // `BasicBlock::Predecessors`, after what the function starts with for block 0
+        [[nodiscard]] auto Operands(size_t) const -> std::vector<size_t>;
+        [[nodiscard]] auto Number(size_t) const -> size_t;
+        [[nodiscard]] auto TypeOf(size_t) const -> Primitives::Type;
+        // Whether the numbering settled. If it didn't, nothing but `Before` and `Defined` can be trusted
+        [[nodiscard]] auto Numbered() const noexcept -> bool;
+        // Whether a reachable instruction does nothing but write its destination. Such an
+        // instruction can be removed, or run where it didn't, without anyone noticing
+        [[nodiscard]] auto Harmless(size_t) const -> bool;
+
+    private:
+        using Key = std::tuple<Instructions::Opcode, size_t, size_t, uint64_t>;
+
+        auto Build(const Dominators&) -> void;
+        auto RemoveTrivialPhis() -> void;
+        auto NumberValues(const Dominators&) -> void;
+        [[nodiscard]] auto Evaluate(size_t, std::map<Key, size_t>&) const -> std::pair<size_t, Primitives::Type>;
+        [[nodiscard]] auto Resolve(size_t) const -> size_t;
+
+    private:
+        const std::vector<Emit::Instruction>& _instructions;
+        const ControlFlowGraph&               _graph;
+        const Containers::Symbol&             _function;
+        const Containers::SymbolTable&        _symbols;
+        const Containers::ConstantPool&       _constants;
+        std::vector<SsaValue>                 _values;
+        std::vector<std::vector<size_t>>      _operands;   // Of phis, one for every way into their block
+        std::vector<size_t>                   _replaced;   // Trivial phis by the value they stand for
+        std::vector<std::vector<size_t>>      _phis;       // Of every block, by register
+        std::vector<std::vector<size_t>>      _before;     // Of every instruction, by register
+        std::vector<size_t>                   _defined;
+        std::vector<size_t>                   _numbers;
+        std::vector<Primitives::Type>         _types;
+        bool                                  _numbered;
+};
+
+// Which `load`, `store` and `advance` instructions of a function can't go out of range. The index
+// an array was advanced to must have been compared by `cmp` against the `arraycount` of the same array,
+// on the only way into a block that dominates the `advance`, or be a phi whose every way in is such a
+// comparison. Copies and narrowing conversions of both sides count as well. Only arrays made outside
+// of any cycle count, so every value that comes from one refers to the same array. Operands of the
+// wrong type make all of these instructions fault, so this holds for functions the `Verifier` didn't
+// prove as well, as long as the accesses still check the types. Nothing is in range in a function
+// that names registers its frame doesn't have
+class ArrayBounds {
+    public:
+        ArrayBounds(const std::vector<Emit::Instruction>&, const ControlFlowGraph&, const Dominators&, const SsaForm&, const Containers::Symbol&);
+
+    public:
+        [[nodiscard]] auto InBounds(size_t) const -> bool;
+        // Index and array of an access, as far as they can be traced, or `SsaForm::None`
+        [[nodiscard]] auto Access(size_t) const -> std::pair<size_t, size_t>;
+        // The count of the array that a way from one block into another shows an index to be below, or `SsaForm::None`
+        [[nodiscard]] auto Guard(size_t, size_t, size_t, size_t) const -> size_t;
+
+    private:
+        [[nodiscard]] auto Below(size_t, size_t, size_t) const -> bool;
+        [[nodiscard]] auto Strip(size_t) const -> size_t;
+        [[nodiscard]] auto ArrayOf(size_t) const -> size_t;
+        [[nodiscard]] auto CountOf(size_t) const -> size_t;
+        [[nodiscard]] auto Cyclic(size_t) const -> bool;
+        [[nodiscard]] auto Ways(size_t) const -> std::vector<size_t>;
+
+    private:
+        const std::vector<Emit::Instruction>& _instructions;
+        const ControlFlowGraph&               _graph;
+        const Dominators&                     _dominators;
+        const SsaForm&                        _ssa;
+        std::vector<bool>                     _inBounds;
+};
+
+// Whether the callee's frame can start at the arguments of a call, which leaves
+// the callee's values in them. `live` holds the registers live after the call
+[[nodiscard]] auto CanShareArguments(const std::vector<bool>& live, const Containers::Symbol& function, const Containers::Symbol& callee) -> bool;
+
+// How a call to a function can be answered with what an earlier one with the same arguments returned, see `PureFunctions`
+enum class Purity : uint8_t {
+    None,
+    SetsFlags,   // It compares on every way through, so the flags it leaves depend on the arguments as well
+    KeepsFlags,  // It never compares, so the caller's flags are still there after it returns
+};
+
+// Which functions return a value that only depends on their arguments. They touch no arrays, print
+// nothing and don't halt, write every register past their parameters before reading it, compare
+// before they look at the flags, and only call functions like them. Functions that didn't decode
+// have no instructions in `bodies`, and aren't pure. Arguments that refer to arrays are left to the caller
+[[nodiscard]] auto PureFunctions(const std::vector<std::vector<Emit::Instruction>>& bodies, const Containers::SymbolTable&) -> std::vector<Purity>;
+
+}
+
+#endif
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "VM.hpp"
 #include "Emit.hpp"
 #include "Instructions.hpp"
+#include "Optimizer.hpp"
 #include "Value.hpp"
 
 namespace Yun::ASM {
@@ -29,6 +30,9 @@ class FunctionUnit {
 
         [[nodiscard]] auto At(size_t) -> VM::Emit::Instruction&;
 
+        [[nodiscard]] auto Body() const noexcept -> const std::vector<VM::Emit::Instruction>&;
+        auto Replace(std::vector<VM::Emit::Instruction>) -> void;
+
         [[nodiscard]] auto Symbol() -> VM::Containers::Symbol&;
         
         [[nodiscard]] auto CallMap() const -> const std::map<uint32_t, std::string>&;
@@ -44,7 +48,7 @@ class FunctionBuilder {
         FunctionBuilder() = default;
 
     public:
-        auto NewFunction(std::string, uint16_t, uint16_t, bool) -> void; 
+        auto NewFunction(std::string, uint16_t, uint16_t, bool, bool) -> void; 
 
     public:
         auto AddLabel(std::string) -> void;
@@ -68,6 +72,7 @@ class FunctionBuilder {
         uint16_t                        _registerCount;
         uint16_t                        _argumentCount;
         bool                            _doesReturn;
+        bool                            _memoize;
         VM::Emit::Emitter               _emitter;
 
         std::map<int32_t, std::string>  _jumps;
@@ -77,10 +82,10 @@ class FunctionBuilder {
 
 class Assembler {
     public:
-        Assembler() noexcept = default;
+        Assembler(OptimizerOptions = {  }) noexcept;
     
     public:
-        auto BeginFunction(std::string, uint16_t, uint16_t, bool) -> void;
+        auto BeginFunction(std::string, uint16_t, uint16_t, bool, bool) -> void;
         auto EndFunction() -> void;
 
     public:
@@ -98,6 +103,8 @@ class Assembler {
         template<typename T>
         auto LoadConstant(uint16_t destination, T&& value) -> void {
             auto index = _constants.FindOrAdd<T>(VM::Primitives::Value(std::forward<T>(value)));
+            if (index == VM::Containers::ConstantPool::Capacity)
+                throw Error::AssemblerError{ "Too many constants: the pool holds at most " + std::to_string(index) };
             _builder.AddBinary(VM::Instructions::Opcode::ldconst, destination, index);
         }
 
@@ -108,6 +115,12 @@ class Assembler {
     
     private:
         auto CheckCall(const VM::Containers::Symbol&, const VM::Containers::Symbol&) const -> void;
+        [[nodiscard]] auto IsTailCall(FunctionUnit&, size_t, const VM::Containers::Symbol&) const -> bool;
+        auto PrintStatistics(const std::vector<std::pair<std::string, size_t>>&) -> void;
+        auto RemoveUnreachable() -> bool;
+        auto Rearrange(const std::vector<int32_t>&) -> void;
+        auto ApplyProfile(const std::map<std::string, FunctionProfile>&) -> void;
+        [[nodiscard]] auto ReadProfile() const -> std::map<std::string, FunctionProfile>;
     
     private:
         VM::Containers::SymbolTable       _symbolTable;
@@ -115,6 +128,7 @@ class Assembler {
         FunctionBuilder                   _builder;
         std::vector<FunctionUnit>         _functions;
         bool                              _isBuildingAFunction;
+        OptimizerOptions                  _options;
 };
 
 }
@@ -1,6 +1,7 @@
 #ifndef CONTAINERS_HPP
 #define CONTAINERS_HPP
 
+#include <cstring>
 #include <memory>
 #include <queue>
 #include "Value.hpp"
@@ -9,20 +10,39 @@
 
 namespace Yun::ASM {
 class Assembler;
+class Optimizer;
 }
 
 namespace Yun::VM::Containers {
 class ArrayHeap;
 
+// The registers of a frame, starting at one of the `RegisterArray`
+struct RegisterWindow {
+    Primitives::Payload* Payloads;
+    Primitives::Type*    Types;
+
+    [[nodiscard]] constexpr auto operator[](size_t index) const noexcept -> Primitives::Register {
+        return { Payloads[index], Types[index] };
+    }
+};
+
+// Payloads and types are kept in separate arrays, so that scans
+// for references only have to go through the types
 class RegisterArray {
     public:
         RegisterArray(size_t count = 1024) noexcept;
 
     public:
         auto Allocate(std::size_t) -> void;
+        auto Reserve(std::size_t) -> void;
         auto Deallocate(std::size_t, ArrayHeap&) noexcept -> void;
         auto Copy(std::size_t, std::size_t, ArrayHeap&) noexcept -> void;
-        auto SaveReturnValue(std::size_t, ArrayHeap&) noexcept -> void;
+        auto SaveReturnValue(std::size_t, std::size_t, ArrayHeap&) noexcept -> void;
+        auto Reuse(std::size_t, std::size_t, std::size_t, ArrayHeap&) -> void;
+
+        [[nodiscard]] constexpr auto Count() const noexcept -> std::size_t {
+            return _index;
+        }
 
         [[nodiscard]] 
         #if __has_cpp_attribute(__cpp_lib_constexpr_vector)
@@ -30,24 +50,35 @@ class RegisterArray {
         #else
         inline
         #endif
-        auto operator[](size_t index) noexcept -> Primitives::Value& {
-            return _registers[index];
+        auto operator[](size_t index) noexcept -> Primitives::Register {
+            return { _payloads[index], _types[index] };
+        }
+
+        [[nodiscard]] YUN_INLINE auto Window(size_t index) noexcept -> RegisterWindow {
+            return { _payloads.data() + index, _types.data() + index };
         }
 
     public:
         auto Print() const -> void;
 
     private:
-        std::size_t                    _index;
-        std::vector<Primitives::Value> _registers;
+        auto Resize(std::size_t) -> void;
+
+    private:
+        std::size_t                       _index;
+        std::vector<Primitives::Payload>  _payloads;
+        std::vector<Primitives::Type>     _types;
 };
 
 class ConstantPool {
     public:
         ConstantPool() = default;
+
+        // `ldconst` holds the index in 12 bits
+        static constexpr size_t Capacity = 0x1000;
     
     public:
-        [[nodiscard]] auto Read(size_t) const -> Primitives::Value;
+        [[nodiscard]] auto Read(size_t) const -> const Primitives::Value&;
         [[nodiscard]] auto Has(size_t) const noexcept -> bool;
 
     public:
@@ -55,13 +86,17 @@ class ConstantPool {
 
     private:
         friend ASM::Assembler;
+        friend ASM::Optimizer;
         [[nodiscard]] auto Add(Primitives::Value) -> size_t;
 
+        // Capacity if the value isn't there and the pool is full
         template<typename T>
         [[nodiscard]] auto FindOrAdd(Primitives::Value value) -> size_t {
             for (size_t i = 0; i != _constants.size(); ++i)
                 if (_constants[i].Typeof() == value.Typeof() && _constants[i].As<T>() == value.As<T>())
                     return i;
+            if (_constants.size() == Capacity)
+                return Capacity;
             return Add(value);
         }
 
@@ -99,6 +134,7 @@ class Symbol {
         uint32_t    Start;
         uint32_t    End;
         bool        DoesReturn;
+        bool        Memoize;     // Asked for its results to be remembered, see `VM::Memoize`
 };
 
 class SymbolTable {
@@ -125,18 +161,20 @@ class SymbolTable {
 class Frame {
     public:
         constexpr Frame() noexcept
-            :ReturnAddress{ 0 }, RegisterCount{ 0 }, KeepReturnValue{ 0 }, End{ 0 } {
+            :ReturnAddress{ 0 }, RegisterCount{ 0 }, Shared{ 0 }, KeepReturnValue{ 0 }, End{ 0 }, Function{ 0 } {
         }
 
         constexpr Frame(uint32_t returnAddress, uint16_t registerCount, bool keepReturnValue, uint32_t end) noexcept
-            :ReturnAddress{ returnAddress }, RegisterCount{ registerCount }, KeepReturnValue{ keepReturnValue }, End{ end } {
+            :ReturnAddress{ returnAddress }, RegisterCount{ registerCount }, Shared{ 0 }, KeepReturnValue{ keepReturnValue }, End{ end }, Function{ 0 } {
         }
 
     public:
         uint32_t ReturnAddress;
         uint16_t RegisterCount;
+        uint16_t Shared;          // Last registers that are also the first ones of the callee's frame
         bool     KeepReturnValue;
         uint32_t End;
+        uint32_t Function;        // Symbol table index of the function running in the frame
 };
 
 class CallStack {
@@ -146,6 +184,7 @@ class CallStack {
     public:
         auto Push(Frame) -> void;
         [[nodiscard]] auto Pop() -> Frame;
+        [[nodiscard]] auto Top() const -> const Frame&;
         [[nodiscard]] constexpr auto Count() const noexcept -> size_t {
             return _count;
         }
@@ -175,9 +214,38 @@ class Array {
         [[nodiscard]] constexpr auto Count() const noexcept -> size_t {
             return _count;
         }
-        [[nodiscard]] auto Load(size_t) -> Primitives::Value;
-        auto Store(size_t, Primitives::Value) -> void;
-        auto Advance(Primitives::Reference&, uint32_t) -> void;
+        // These return faults instead of throwing, see `Value`. With `Checked` set to false,
+        // they skip the range check - the index must be known to be below `Count` then
+        template<bool Checked = true>
+        [[nodiscard]] auto Load(size_t index, Primitives::Value& value) const noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (index >= _count)
+                    return Error::Fault::IndexOutOfRange;
+
+            value = Primitives::Value{ _elementType };
+            std::memcpy(value.AsPtr(), &_elements[index], sizeof(uint64_t));
+            return Error::Fault::None;
+        }
+        template<bool Checked = true>
+        [[nodiscard]] auto Store(size_t index, const Primitives::Value& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (index >= _count)
+                    return Error::Fault::IndexOutOfRange;
+            if (_elementType != value.Typeof())
+                return Error::Fault::IncompatibleElement;
+
+            std::memcpy(&_elements[index], value.AsPtr(), sizeof(uint64_t));
+            return Error::Fault::None;
+        }
+        template<bool Checked = true>
+        [[nodiscard]] auto Advance(Primitives::Reference& reference, uint32_t offset) const noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (offset > _count) // Can cast this safely
+                    return Error::Fault::IndexOutOfRange;
+
+            reference.ArrayIndex = offset;
+            return Error::Fault::None;
+        }
 
     private:
         Primitives::Type            _elementType;
@@ -196,7 +264,7 @@ class ArrayHeap {
         ArrayHeap(size_t initialSize = 1024);
 
     public:
-        [[nodiscard]] auto NewArray(uint32_t, uint32_t) -> Primitives::Reference;
+        [[nodiscard]] auto NewArray(uint32_t, uint32_t, Primitives::Reference&) -> Error::Fault;
         auto Notify(uint32_t, bool) noexcept -> void;
         [[nodiscard]] auto GetArray(uint32_t) noexcept -> Array*;
 
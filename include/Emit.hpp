@@ -6,6 +6,7 @@
 // C++ header files
 #include <span>
 #include <string>
+#include <vector>
 // My header files
 #include "Instructions.hpp"
 #include "Exceptions.hpp"
@@ -34,6 +35,7 @@ class Instruction {
 
     public:
         auto Serialize(uint32_t*) const noexcept -> void;
+        [[nodiscard]] static auto Deserialize(uint32_t) -> Instruction;
 
         [[nodiscard]] constexpr auto Opcode() const noexcept -> Instructions::Opcode {
             return _opcode;
@@ -46,7 +48,7 @@ class Instruction {
         }
 
         constexpr auto PatchOffset(int32_t offset) -> void {
-            if (!Instructions::IsJump(_opcode) && _opcode != Instructions::Opcode::call)
+            if (!Instructions::IsJump(_opcode) && !Instructions::IsCall(_opcode))
                 throw Error::InstructionError{ "Opcode isn't a jump or a call: ", _opcode };
             _dest = offset;
         }
@@ -74,6 +76,9 @@ class Emitter {
 
         [[nodiscard]] auto Count() const noexcept -> size_t;
 
+        [[nodiscard]] auto Body() const noexcept -> const std::vector<Instruction>&;
+        auto Replace(std::vector<Instruction>) -> void;
+
         auto Serialize() const -> Containers::InstructionBuffer;
 
         [[nodiscard]] auto Serialize(uint32_t*) const -> size_t;
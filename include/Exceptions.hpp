@@ -9,12 +9,51 @@
 // My header files
 #include "Instructions.hpp"
 
-namespace Yun::VM::Primitives {
-    enum class Type : uint8_t;
-}
-
 namespace Yun::Error {
 
+// What went wrong in an instruction. Checked operations on values and arrays
+// return these instead of throwing, so the interpreter's handlers stay small and
+// only the cold `VM::Trap` has to know how to describe a fault
+enum class Fault : uint8_t {
+    None,
+    IncompatibleTypes,
+    NotNegatable,
+    NotIntegral,
+    NotComparable,
+    InvalidConversion,
+    DivisionByZero,
+    RemainderByZero,
+    ExpectedReference,
+    ExpectedUint32,
+    InvalidElementType,
+    IndexOutOfRange,
+    IncompatibleElement,
+    InvalidInstruction,
+};
+
+[[nodiscard]] auto FaultToString(Fault) noexcept -> const char*;
+
+// A fault of a running program, along with the function and the byte offset
+// of the instruction that caused it, as shown by the disassembler
+class RuntimeError : public std::exception {
+    public:
+        RuntimeError(Fault, std::string function, uint32_t offset, std::string operands);
+
+        ~RuntimeError() noexcept = default;
+
+    public:
+        [[nodiscard]] auto what() const noexcept -> const char* override;
+        [[nodiscard]] auto Cause() const noexcept -> Fault;
+        [[nodiscard]] auto Function() const noexcept -> const std::string&;
+        [[nodiscard]] auto Offset() const noexcept -> uint32_t;
+
+    private:
+        Fault       _fault;
+        std::string _function;
+        uint32_t    _offset;
+        std::string _message;
+};
+
 class InstructionError : public std::exception {
     public:
         InstructionError(std::string message);
@@ -5,427 +5,260 @@
 #include <cstddef>
 #include <cstdint>
 // C++ header files
+#include <iterator>
 #include <utility>
+// My header files
+#include "Types.hpp"
+
+// Every opcode, in the order of their encoding, described once:
+// X(mnemonic, operand count, destination type, source type, result type, flags)
+// Types are what the verifier expects of the operands and leaves in the destination,
+// `Any` ones aren't checked. Everything that needs to know about opcodes - the enum,
+// the descriptor table below, the lexer, the disassembler, the verifier and
+// the interpreter's dispatch table - is generated from this list
+#define YUN_OPCODES(X) \
+    /* Arithmetic */ \
+    X(i32neg,       1, Int32,     Any,       Int32,     Writes) \
+    X(i32add,       2, Int32,     Int32,     Int32,     Writes) \
+    X(i32sub,       2, Int32,     Int32,     Int32,     Writes) \
+    X(i32mul,       2, Int32,     Int32,     Int32,     Writes) \
+    X(i32div,       2, Int32,     Int32,     Int32,     Writes | Faults) \
+    X(i32rem,       2, Int32,     Int32,     Int32,     Writes | Faults) \
+    X(i32and,       2, Int32,     Int32,     Int32,     Writes) \
+    X(i32or,        2, Int32,     Int32,     Int32,     Writes) \
+    X(i32xor,       2, Int32,     Int32,     Int32,     Writes) \
+    X(i32shl,       2, Int32,     Uint32,    Int32,     Writes) \
+    X(i32shr,       2, Int32,     Uint32,    Int32,     Writes) \
+    X(i64neg,       1, Int64,     Any,       Int64,     Writes) \
+    X(i64add,       2, Int64,     Int64,     Int64,     Writes) \
+    X(i64sub,       2, Int64,     Int64,     Int64,     Writes) \
+    X(i64mul,       2, Int64,     Int64,     Int64,     Writes) \
+    X(i64div,       2, Int64,     Int64,     Int64,     Writes | Faults) \
+    X(i64rem,       2, Int64,     Int64,     Int64,     Writes | Faults) \
+    X(i64and,       2, Int64,     Int64,     Int64,     Writes) \
+    X(i64or,        2, Int64,     Int64,     Int64,     Writes) \
+    X(i64xor,       2, Int64,     Int64,     Int64,     Writes) \
+    X(i64shl,       2, Int64,     Uint32,    Int64,     Writes) \
+    X(i64shr,       2, Int64,     Uint32,    Int64,     Writes) \
+    X(u32add,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32sub,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32mul,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32div,       2, Uint32,    Uint32,    Uint32,    Writes | Faults) \
+    X(u32rem,       2, Uint32,    Uint32,    Uint32,    Writes | Faults) \
+    X(u32and,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32or,        2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32xor,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32shl,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u32shr,       2, Uint32,    Uint32,    Uint32,    Writes) \
+    X(u64add,       2, Uint64,    Uint64,    Uint64,    Writes) \
+    X(u64sub,       2, Uint64,    Uint64,    Uint64,    Writes) \
+    X(u64mul,       2, Uint64,    Uint64,    Uint64,    Writes) \
+    X(u64div,       2, Uint64,    Uint64,    Uint64,    Writes | Faults) \
+    X(u64rem,       2, Uint64,    Uint64,    Uint64,    Writes | Faults) \
+    X(u64and,       2, Uint64,    Uint64,    Uint64,    Writes) \
+    X(u64or,        2, Uint64,    Uint64,    Uint64,    Writes) \
+    X(u64xor,       2, Uint64,    Uint64,    Uint64,    Writes) \
+    X(u64shl,       2, Uint64,    Uint32,    Uint64,    Writes) \
+    X(u64shr,       2, Uint64,    Uint32,    Uint64,    Writes) \
+    X(f32neg,       1, Float32,   Any,       Float32,   Writes) \
+    X(f32add,       2, Float32,   Float32,   Float32,   Writes) \
+    X(f32sub,       2, Float32,   Float32,   Float32,   Writes) \
+    X(f32mul,       2, Float32,   Float32,   Float32,   Writes) \
+    X(f32div,       2, Float32,   Float32,   Float32,   Writes) \
+    X(f32rem,       2, Float32,   Float32,   Float32,   Writes) \
+    X(f64neg,       1, Float64,   Any,       Float64,   Writes) \
+    X(f64add,       2, Float64,   Float64,   Float64,   Writes) \
+    X(f64sub,       2, Float64,   Float64,   Float64,   Writes) \
+    X(f64mul,       2, Float64,   Float64,   Float64,   Writes) \
+    X(f64div,       2, Float64,   Float64,   Float64,   Writes) \
+    X(f64rem,       2, Float64,   Float64,   Float64,   Writes) \
+    X(bnot,         1, Any,       Any,       Any,       Writes) \
+    /* Conversion */ \
+    X(convi32toi8,  1, Int32,     Any,       Int8,      Writes) \
+    X(convi32toi16, 1, Int32,     Any,       Int16,     Writes) \
+    X(convu32tou8,  1, Uint32,    Any,       Uint8,     Writes) \
+    X(convu32tou16, 1, Uint32,    Any,       Uint16,    Writes) \
+    X(convi32toi64, 1, Int32,     Any,       Int64,     Writes) \
+    X(convi32tou64, 1, Int32,     Any,       Uint64,    Writes) \
+    X(convi32tou32, 1, Int32,     Any,       Uint32,    Writes) \
+    X(convi32tof32, 1, Int32,     Any,       Float32,   Writes) \
+    X(convi32tof64, 1, Int32,     Any,       Float64,   Writes) \
+    X(convi64toi32, 1, Int64,     Any,       Int32,     Writes) \
+    X(convi64tou32, 1, Int64,     Any,       Uint32,    Writes) \
+    X(convi64tou64, 1, Int64,     Any,       Uint64,    Writes) \
+    X(convi64tof32, 1, Int64,     Any,       Float32,   Writes) \
+    X(convi64tof64, 1, Int64,     Any,       Float64,   Writes) \
+    X(convu32toi64, 1, Uint32,    Any,       Int64,     Writes) \
+    X(convu32tou64, 1, Uint32,    Any,       Uint64,    Writes) \
+    X(convu32toi32, 1, Uint32,    Any,       Int32,     Writes) \
+    X(convu32tof32, 1, Uint32,    Any,       Float32,   Writes) \
+    X(convu32tof64, 1, Uint32,    Any,       Float64,   Writes) \
+    X(convu64toi64, 1, Uint64,    Any,       Int64,     Writes) \
+    X(convu64tou32, 1, Uint64,    Any,       Uint32,    Writes) \
+    X(convu64toi32, 1, Uint64,    Any,       Int32,     Writes) \
+    X(convu64tof32, 1, Uint64,    Any,       Float32,   Writes) \
+    X(convu64tof64, 1, Uint64,    Any,       Float64,   Writes) \
+    X(convf32toi32, 1, Float32,   Any,       Int32,     Writes) \
+    X(convf32toi64, 1, Float32,   Any,       Int64,     Writes) \
+    X(convf32tou32, 1, Float32,   Any,       Uint32,    Writes) \
+    X(convf32tof64, 1, Float32,   Any,       Float64,   Writes) \
+    X(convf32tou64, 1, Float32,   Any,       Uint64,    Writes) \
+    X(convf64toi32, 1, Float64,   Any,       Int32,     Writes) \
+    X(convf64toi64, 1, Float64,   Any,       Int64,     Writes) \
+    X(convf64tou32, 1, Float64,   Any,       Uint32,    Writes) \
+    X(convf64tou64, 1, Float64,   Any,       Uint64,    Writes) \
+    X(convf64tof32, 1, Float64,   Any,       Float32,   Writes) \
+    /* Logic - the verifier checks these on its own, since each takes two types */ \
+    X(cmp,          2, Any,       Any,       Any,       SetsFlags) \
+    X(icmp,         2, Any,       Any,       Any,       SetsFlags) \
+    X(fcmp,         2, Any,       Any,       Any,       SetsFlags) \
+    /* Jumps */ \
+    X(jmp,          1, Any,       Any,       Any,       Jump | Ends) \
+    X(je,           1, Any,       Any,       Any,       Jump | Conditional) \
+    X(jne,          1, Any,       Any,       Any,       Jump | Conditional) \
+    X(jgt,          1, Any,       Any,       Any,       Jump | Conditional) \
+    X(jge,          1, Any,       Any,       Any,       Jump | Conditional) \
+    X(jlt,          1, Any,       Any,       Any,       Jump | Conditional) \
+    X(jle,          1, Any,       Any,       Any,       Jump | Conditional) \
+    /* Routine calls */ \
+    X(call,         1, Any,       Any,       Any,       Call) \
+    /* Only emitted by the assembler, for a `call` that's followed by a `ret` */ \
+    X(tailcall,     1, Any,       Any,       Any,       Call | Ends | Internal) \
+    X(ret,          0, Any,       Any,       Any,       Ends) \
+    /* Constants - for now, only numbers. The type comes from the constant or the source */ \
+    X(ldconst,      2, Any,       Any,       Any,       Writes) \
+    X(mov,          2, Any,       Any,       Any,       Writes) \
+    /* Selects - a `mov` that only happens if the flags say so, like the jump of the same name */ \
+    X(cmove,        2, Any,       Any,       Any,       Writes | Selects) \
+    X(cmovne,       2, Any,       Any,       Any,       Writes | Selects) \
+    X(cmovgt,       2, Any,       Any,       Any,       Writes | Selects) \
+    X(cmovge,       2, Any,       Any,       Any,       Writes | Selects) \
+    X(cmovlt,       2, Any,       Any,       Any,       Writes | Selects) \
+    X(cmovle,       2, Any,       Any,       Any,       Writes | Selects) \
+    /* Array instructions */ \
+    X(newarray,     2, Uint32,    Uint32,    Reference, Writes | Memory | Faults) \
+    X(arraycount,   2, Any,       Reference, Uint64,    Writes | Memory) \
+    X(load,         2, Any,       Reference, Any,       Writes | Memory | Faults) \
+    X(store,        2, Reference, Any,       Reference, Memory | Faults) \
+    X(advance,      2, Reference, Uint32,    Reference, Writes | Faults) \
+    /* Misc */ \
+    X(printreg,     1, Any,       Any,       Any,       Output) \
+    X(nop,          0, Any,       Any,       Any,       None) \
+    X(hlt,          0, Any,       Any,       Any,       Output)
 
 namespace Yun::VM::Instructions {
 
+#define YUN_OPCODE_ENUM(name, ...) name,
 enum class Opcode : uint8_t {
-    // Arithmetic
-    i32neg, i32add, i32sub, i32mul, i32div, i32rem, i32and, i32or, i32xor, i32shl, i32shr,
-    i64neg, i64add, i64sub, i64mul, i64div, i64rem, i64and, i64or, i64xor, i64shl, i64shr,
-
-    u32add, u32sub, u32mul, u32div, u32rem, u32and, u32or, u32xor, u32shl, u32shr,
-    u64add, u64sub, u64mul, u64div, u64rem, u64and, u64or, u64xor, u64shl, u64shr,
-
-    f32neg, f32add, f32sub, f32mul, f32div, f32rem,
-    f64neg, f64add, f64sub, f64mul, f64div, f64rem,
+    YUN_OPCODES(YUN_OPCODE_ENUM)
+};
+#undef YUN_OPCODE_ENUM
 
-    bnot,
+// What an instruction does besides reading its operands, as bits of `OpcodeInfo::Flags`
+namespace Flag {
+    constexpr uint16_t None        = 0;
+    constexpr uint16_t Writes      = 1 << 0;  // Overwrites its destination register
+    constexpr uint16_t SetsFlags   = 1 << 1;  // Leaves a comparison for the conditional jumps and selects
+    constexpr uint16_t Jump        = 1 << 2;
+    constexpr uint16_t Conditional = 1 << 3;  // Jumps only if the flags say so
+    constexpr uint16_t Call        = 1 << 4;  // Its operand is an index into the symbol table
+    constexpr uint16_t Ends        = 1 << 5;  // Never falls through to the next instruction
+    constexpr uint16_t Memory      = 1 << 6;  // Reads or writes arrays
+    constexpr uint16_t Faults      = 1 << 7;  // Might trap, even in verified code
+    constexpr uint16_t Output      = 1 << 8;  // Talks to the outside world
+    constexpr uint16_t Internal    = 1 << 9;  // Only the assembler emits it, YASN can't name it
+    constexpr uint16_t Selects     = 1 << 10; // Reads the flags, and keeps its destination unless they say so
+}
 
-    // Conversion
-    convi32toi8,  convi32toi16,
-    convu32tou8,  convu32tou16,
-    convi32toi64, convi32tou64, convi32tou32, convi32tof32, convi32tof64,
-    convi64toi32, convi64tou32, convi64tou64, convi64tof32, convi64tof64,
-    convu32toi64, convu32tou64, convu32toi32, convu32tof32, convu32tof64,
-    convu64toi64, convu64tou32, convu64toi32, convu64tof32, convu64tof64,
-    convf32toi32, convf32toi64, convf32tou32, convf32tof64, convf32tou64,
-    convf64toi32, convf64toi64, convf64tou32, convf64tou64, convf64tof32,
+// Operand types of `YUN_OPCODES`
+namespace Operand {
+    using Primitives::Type;
+    constexpr auto Int32     = Type::Int32;
+    constexpr auto Int64     = Type::Int64;
+    constexpr auto Uint32    = Type::Uint32;
+    constexpr auto Uint64    = Type::Uint64;
+    constexpr auto Float32   = Type::Float32;
+    constexpr auto Float64   = Type::Float64;
+    constexpr auto Int8      = Type::Int8;
+    constexpr auto Int16     = Type::Int16;
+    constexpr auto Uint8     = Type::Uint8;
+    constexpr auto Uint16    = Type::Uint16;
+    constexpr auto Reference = Type::Reference;
+    constexpr auto Any       = static_cast<Type>(0xFF);
+}
 
-    // Logic
-    cmp, icmp, fcmp,
+struct OpcodeInfo {
+    const char*      Mnemonic;
+    int8_t           Operands;   // -1 for invalid opcodes
+    Primitives::Type Dest;
+    Primitives::Type Src;
+    Primitives::Type Result;
+    uint16_t         Flags;
+};
 
-    // Jumps
-    jmp,
-    je, jne,
-    jgt, jge, jlt, jle,
+namespace Detail {
+    using namespace Flag;
+    using namespace Operand;
 
-    // Routine calls
-    call,
-    ret,
+    #define YUN_OPCODE_INFO(name, operands, dest, src, result, flags) { #name, operands, dest, src, result, flags },
+    constexpr OpcodeInfo Opcodes[] = {
+        YUN_OPCODES(YUN_OPCODE_INFO)
+    };
+    #undef YUN_OPCODE_INFO
 
-    // Constants - for now, only numbers
-    ldconst,
-    mov,
+    constexpr OpcodeInfo Invalid{ "<err>", -1, Any, Any, Any, None };
+}
 
-    // Array instructions
-    newarray,
-    arraycount,
-    load,
-    store,
-    advance,
+// How many opcodes there are. Anything from here up to 0xFF is invalid
+constexpr size_t OpcodeTotal = std::size(Detail::Opcodes);
 
-    // Misc
-    printreg,
-    nop,
-    hlt
-};
+[[nodiscard]] constexpr auto Info(Opcode op) noexcept -> const OpcodeInfo& {
+    const auto index = static_cast<size_t>(op);
+    return index < OpcodeTotal? Detail::Opcodes[index] : Detail::Invalid;
+}
 
 [[nodiscard]] constexpr auto OpcodeCount(Opcode op) noexcept -> int {
-    switch (op) {
-    case Opcode::i32add:
-    case Opcode::i32sub:
-    case Opcode::i32mul:
-    case Opcode::i32div:
-    case Opcode::i32rem:
-    case Opcode::i32and:
-    case Opcode::i32or:
-    case Opcode::i32xor:
-    case Opcode::i32shl:
-    case Opcode::i32shr:
-    case Opcode::i64add:
-    case Opcode::i64sub:
-    case Opcode::i64mul:
-    case Opcode::i64div:
-    case Opcode::i64rem:
-    case Opcode::i64and:
-    case Opcode::i64or:
-    case Opcode::i64xor:
-    case Opcode::i64shl:
-    case Opcode::i64shr:
-    case Opcode::u32add:
-    case Opcode::u32sub:
-    case Opcode::u32mul:
-    case Opcode::u32div:
-    case Opcode::u32rem:
-    case Opcode::u32and:
-    case Opcode::u32or:
-    case Opcode::u32xor:
-    case Opcode::u32shl:
-    case Opcode::u32shr:
-    case Opcode::u64add:
-    case Opcode::u64sub:
-    case Opcode::u64mul:
-    case Opcode::u64div:
-    case Opcode::u64rem:
-    case Opcode::u64and:
-    case Opcode::u64or:
-    case Opcode::u64xor:
-    case Opcode::u64shl:
-    case Opcode::u64shr:
-    case Opcode::f32add:
-    case Opcode::f32sub:
-    case Opcode::f32mul:
-    case Opcode::f32div:
-    case Opcode::f32rem:
-    case Opcode::f64add:
-    case Opcode::f64sub:
-    case Opcode::f64mul:
-    case Opcode::f64div:
-    case Opcode::f64rem:
-    case Opcode::cmp:
-    case Opcode::icmp:
-    case Opcode::fcmp:
-    case Opcode::ldconst:
-    case Opcode::mov:
-    case Opcode::newarray:
-    case Opcode::load:
-    case Opcode::store:
-    case Opcode::advance:
-    case Opcode::arraycount:
-        return 2;
-    case Opcode::bnot:
-    case Opcode::i32neg:
-    case Opcode::i64neg:
-    case Opcode::f32neg:
-    case Opcode::f64neg:
-    case Opcode::convi32toi8:
-    case Opcode::convi32toi16:
-    case Opcode::convu32tou8:
-    case Opcode::convu32tou16:
-    case Opcode::convi32toi64:
-    case Opcode::convi32tou64:
-    case Opcode::convi32tou32:
-    case Opcode::convi32tof32:
-    case Opcode::convi32tof64:
-    case Opcode::convi64toi32:
-    case Opcode::convi64tou32:
-    case Opcode::convi64tou64:
-    case Opcode::convi64tof32:
-    case Opcode::convi64tof64:
-    case Opcode::convu32toi64:
-    case Opcode::convu32tou64:
-    case Opcode::convu32toi32:
-    case Opcode::convu32tof32:
-    case Opcode::convu32tof64:
-    case Opcode::convu64toi64:
-    case Opcode::convu64tou32:
-    case Opcode::convu64toi32:
-    case Opcode::convu64tof32:
-    case Opcode::convu64tof64:
-    case Opcode::convf32toi32:
-    case Opcode::convf32toi64:
-    case Opcode::convf32tou32:
-    case Opcode::convf32tof64:
-    case Opcode::convf32tou64:
-    case Opcode::convf64toi32:
-    case Opcode::convf64toi64:
-    case Opcode::convf64tou32:
-    case Opcode::convf64tou64:
-    case Opcode::convf64tof32:
-    case Opcode::jmp:
-    case Opcode::je:
-    case Opcode::jne:
-    case Opcode::jgt:
-    case Opcode::jge:
-    case Opcode::jlt:
-    case Opcode::jle:
-    case Opcode::call:
-    case Opcode::printreg:
-        return 1;
-    case Opcode::nop:
-    case Opcode::hlt:
-    case Opcode::ret:
-        return 0;
-    default:
-        return -1;
-    }
+    return Info(op).Operands;
 }
 
 [[nodiscard]] constexpr auto IsJump(Opcode op) noexcept -> bool {
+    return Info(op).Flags & Flag::Jump;
+}
+
+[[nodiscard]] constexpr auto IsCall(Opcode op) noexcept -> bool {
+    return Info(op).Flags & Flag::Call;
+}
+
+[[nodiscard]] constexpr auto IsSelect(Opcode op) noexcept -> bool {
+    return Info(op).Flags & Flag::Selects;
+}
+
+// Whether a jump or a select goes ahead, given the flags of the last comparison
+[[nodiscard]] constexpr auto Passes(Opcode op, int32_t flags) noexcept -> bool {
     switch (op) {
-    case Opcode::jmp:
-    case Opcode::je:
-    case Opcode::jne:
-    case Opcode::jgt:
-    case Opcode::jge:
-    case Opcode::jlt:
-    case Opcode::jle:
-        return true;
-    default:
-        return false;
+    case Opcode::je:  case Opcode::cmove:  return flags == 0;
+    case Opcode::jne: case Opcode::cmovne: return flags != 0;
+    case Opcode::jgt: case Opcode::cmovgt: return flags > 0;
+    case Opcode::jge: case Opcode::cmovge: return flags >= 0;
+    case Opcode::jlt: case Opcode::cmovlt: return flags < 0;
+    case Opcode::jle: case Opcode::cmovle: return flags <= 0;
+    default:                               return true;
     }
 }
 
+// Only writes its destination, so in verified code, where it can't fault,
+// nothing else can tell whether it ran
+[[nodiscard]] constexpr auto IsPure(Opcode op) noexcept -> bool {
+    return Info(op).Flags == Flag::Writes;
+}
+
 [[nodiscard]] constexpr auto OpcodeToString(Opcode op) noexcept -> const char* {
-    switch (op) {
-    case Opcode::i32neg:
-        return "i32neg";
-    case Opcode::i32add:
-        return "i32add";
-    case Opcode::i32sub:
-        return "i32sub";
-    case Opcode::i32mul:
-        return "i32mul";
-    case Opcode::i32div:
-        return "i32div";
-    case Opcode::i32rem:
-        return "i32rem";
-    case Opcode::i32and:
-        return "i32and";
-    case Opcode::i32or:
-        return "i32or";
-    case Opcode::i32xor:
-        return "i32xor";
-    case Opcode::i32shl:
-        return "i32shl";
-    case Opcode::i32shr:
-        return "i32shr";
-    case Opcode::i64neg:
-        return "i64neg";
-    case Opcode::i64add:
-        return "i64add";
-    case Opcode::i64sub:
-        return "i64sub";
-    case Opcode::i64mul:
-        return "i64mul";
-    case Opcode::i64div:
-        return "i64div";
-    case Opcode::i64rem:
-        return "i64rem";
-    case Opcode::i64and:
-        return "i64and";
-    case Opcode::i64or:
-        return "i64or";
-    case Opcode::i64xor:
-        return "i64xor";
-    case Opcode::i64shl:
-        return "i64shl";
-    case Opcode::i64shr:
-        return "i64shr";
-    case Opcode::u32add:
-        return "u32add";
-    case Opcode::u32sub:
-        return "u32sub";
-    case Opcode::u32mul:
-        return "u32mul";
-    case Opcode::u32div:
-        return "u32div";
-    case Opcode::u32rem:
-        return "u32rem";
-    case Opcode::u32and:
-        return "u32and";
-    case Opcode::u32or:
-        return "u32or";
-    case Opcode::u32xor:
-        return "u32xor";
-    case Opcode::u32shl:
-        return "u32shl";
-    case Opcode::u32shr:
-        return "u32shr";
-    case Opcode::u64add:
-        return "u64add";
-    case Opcode::u64sub:
-        return "u64sub";
-    case Opcode::u64mul:
-        return "u64mul";
-    case Opcode::u64div:
-        return "u64div";
-    case Opcode::u64rem:
-        return "u64rem";
-    case Opcode::u64and:
-        return "u64and";
-    case Opcode::u64or:
-        return "u64or";
-    case Opcode::u64xor:
-        return "u64xor";
-    case Opcode::u64shl:
-        return "u64shl";
-    case Opcode::u64shr:
-        return "u64shr";
-    case Opcode::f32neg:
-        return "f32neg";
-    case Opcode::f32add:
-        return "f32add";
-    case Opcode::f32sub:
-        return "f32sub";
-    case Opcode::f32mul:
-        return "f32mul";
-    case Opcode::f32div:
-        return "f32div";
-    case Opcode::f32rem:
-        return "f32rem";
-    case Opcode::f64neg:
-        return "f64neg";
-    case Opcode::f64add:
-        return "f64add";
-    case Opcode::f64sub:
-        return "f64sub";
-    case Opcode::f64mul:
-        return "f64mul";
-    case Opcode::f64div:
-        return "f64div";
-    case Opcode::f64rem:
-        return "f64rem";
-    case Opcode::bnot:
-        return "bnot";
-    case Opcode::convi32toi8:
-        return "convi32toi8";
-    case Opcode::convi32toi16:
-        return "convi32toi16";
-    case Opcode::convu32tou8:
-        return "convu32tou8";
-    case Opcode::convu32tou16:
-        return "convu32tou16";
-    case Opcode::convi32toi64:
-        return "convi32toi64";
-    case Opcode::convi32tou64:
-        return "convi32tou64";
-    case Opcode::convi32tou32:
-        return "convi32tou32";
-    case Opcode::convi32tof32:
-        return "convi32tof32";
-    case Opcode::convi32tof64:
-        return "convi32tof64";
-    case Opcode::convi64toi32:
-        return "convi64toi32";
-    case Opcode::convi64tou32:
-        return "convi64tou32";
-    case Opcode::convi64tou64:
-        return "convi64tou64";
-    case Opcode::convi64tof32:
-        return "convi64tof32";
-    case Opcode::convi64tof64:
-        return "convi64tof64";
-    case Opcode::convu32toi64:
-        return "convu32toi64";
-    case Opcode::convu32tou64:
-        return "convu32tou64";
-    case Opcode::convu32toi32:
-        return "convu32toi32";
-    case Opcode::convu32tof32:
-        return "convu32tof32";
-    case Opcode::convu32tof64:
-        return "convu32tof64";
-    case Opcode::convu64toi64:
-        return "convu64toi64";
-    case Opcode::convu64tou32:
-        return "convu64tou32";
-    case Opcode::convu64toi32:
-        return "convu64toi32";
-    case Opcode::convu64tof32:
-        return "convu64tof32";
-    case Opcode::convu64tof64:
-        return "convu64tof64";
-    case Opcode::convf32toi32:
-        return "convf32toi32";
-    case Opcode::convf32toi64:
-        return "convf32toi64";
-    case Opcode::convf32tou32:
-        return "convf32tou32";
-    case Opcode::convf32tof64:
-        return "convf32tof64";
-    case Opcode::convf32tou64:
-        return "convf32tou64";
-    case Opcode::convf64toi32:
-        return "convf64toi32";
-    case Opcode::convf64toi64:
-        return "convf64toi64";
-    case Opcode::convf64tou32:
-        return "convf64tou32";
-    case Opcode::convf64tou64:
-        return "convf64tou64";
-    case Opcode::convf64tof32:
-        return "convf64tof32";
-    case Opcode::cmp:
-        return "cmp";
-    case Opcode::icmp:
-        return "icmp";
-    case Opcode::fcmp:
-        return "fcmp";
-    case Opcode::jmp:
-        return "jmp";
-    case Opcode::je:
-        return "je";
-    case Opcode::jne:
-        return "jne";
-    case Opcode::jgt:
-        return "jgt";
-    case Opcode::jge:
-        return "jge";
-    case Opcode::jlt:
-        return "jlt";
-    case Opcode::jle:
-        return "jle";
-    case Opcode::call:
-        return "call";
-    case Opcode::ret:
-        return "ret";
-    case Opcode::ldconst:
-        return "ldconst";
-    case Opcode::mov:
-        return "mov";
-    case Opcode::newarray:
-        return "newarray";
-    case Opcode::arraycount:
-        return "arraycount";
-    case Opcode::load:
-        return "load";
-    case Opcode::store:
-        return "store";
-    case Opcode::advance:
-        return "advance";
-    case Opcode::printreg:
-        return "printreg";
-    case Opcode::nop:
-        return "nop";
-    case Opcode::hlt:
-        return "hlt";
-    default:
-        return "<err>";
-    }
+    return Info(op).Mnemonic;
 }
 
+static_assert(OpcodeTotal == static_cast<size_t>(Opcode::hlt) + 1);
+static_assert(OpcodeCount(Opcode::u64add) == 2 && IsJump(Opcode::jle) && IsCall(Opcode::tailcall) && IsSelect(Opcode::cmovle));
+
 }
 
-#endif
\ No newline at end of file
+#endif
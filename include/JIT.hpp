@@ -0,0 +1,135 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+// C header files
+#include <cstddef>
+#include <cstdint>
+// C++ header files
+#include <utility>
+#include <vector>
+// My header files
+#include "Containers.hpp"
+#include "Emit.hpp"
+#include "Value.hpp"
+
+// Native code is only generated on x86-64 Linux, everywhere else YVM just interprets
+#if defined(__x86_64__) && defined(__linux__)
+    #define YUN_JIT
+#endif
+
+namespace Yun::VM {
+
+class VM;
+class ExecutionUnit;
+struct FunctionDescriptor;
+
+namespace Analysis {
+class RegisterTypes;
+}
+
+// Compiled functions get the base of their frame, as payloads and types, and how
+// many of its registers are shared with the caller. They return the register count
+// of the frame they end in, which tail calls may have changed
+using NativeFunction = uint32_t (*)(Primitives::Payload*, Primitives::Type*, uint32_t);
+
+}
+
+namespace Yun::VM::JIT {
+
+// Everything native code doesn't do inline, it leaves to these functions of the VM.
+// Exceptions can't unwind through native frames, so these jump over them instead,
+// back to where the interpreter entered native code - see `VM::EnterNative`
+struct Runtime {
+    VM*      Context;
+    int32_t* Flags;
+
+    // Runs a compiled function on top of the caller's frame and returns the caller's registers
+    Containers::RegisterWindow (*Call)(VM*, const FunctionDescriptor*, uint32_t callerRegisters, uint32_t shared);
+    // Turns the current frame into the callee's one and returns its registers
+    Containers::RegisterWindow (*TailCall)(VM*, const FunctionDescriptor*, uint32_t currentRegisters);
+    // Runs a single instruction on a pair of registers, or a register and a constant.
+    // The instruction's index in the code is above the opcode, in case it faults
+    void (*Execute)(VM*, uint32_t instruction, Primitives::Payload*, Primitives::Type*, const Primitives::Payload*, const Primitives::Type*);
+    // Counts a reference up or down, if the register holds one
+    void (*Notify)(VM*, const Primitives::Payload*, const Primitives::Type*, bool increment);
+};
+
+// One instruction on the path a trace took while it was being recorded
+struct TraceStep {
+    uint32_t         Index;     // Into the decoded code
+    uint16_t         Depth;     // How many calls deep into the trace it ran
+    bool             Shared;    // For calls, whether the callee's frame started at the arguments
+    Primitives::Type Dest;      // Types of the operands right before it ran
+    Primitives::Type Src;
+    Primitives::Type Result;    // Type of the destination right after it ran
+};
+
+// Where the interpreter picks up after leaving a trace. The frames of the calls
+// the trace inlined on the way there don't exist yet, so the VM pushes them first
+struct TraceExit {
+    uint32_t              Resume;
+    std::vector<uint32_t> Calls;    // Indices of the inlined `call`s, outermost first
+};
+
+// Traces get the base of the frame they start in and return the index of the exit they took
+using TraceFunction = uint32_t (*)(Primitives::Payload*, Primitives::Type*);
+
+struct Trace {
+    TraceFunction          Code;       // nullptr if there's no trace
+    std::vector<TraceExit> Exits;
+    uint32_t               Registers;  // Used by inlined calls, past the end of the frame
+};
+
+// Pages holding native code, one mapping per batch of compiled functions.
+// They can't be written to once they're executable
+class ExecutableMemory {
+    public:
+        ExecutableMemory() noexcept;
+        ExecutableMemory(const ExecutableMemory&) = delete;
+        auto operator=(const ExecutableMemory&) -> ExecutableMemory& = delete;
+        ~ExecutableMemory();
+
+    public:
+        [[nodiscard]] auto Load(const std::vector<uint8_t>&) -> const uint8_t*;
+
+    private:
+        std::vector<std::pair<void*, size_t>> _mappings;
+};
+
+// Baseline compiler: every instruction is translated on its own, by a fixed
+// template. Registers stay in the `RegisterArray`, so compiled and interpreted
+// frames look the same. A function is only compiled together with everything
+// it calls, since native code can't go back to the interpreter.
+// Functions the verifier has proven go through an optimizing compiler instead,
+// which keeps values of known types in machine registers between calls.
+// Traces are made of the same templates, but they follow a single path and
+// know the types along it, so they leave out most of the type checks
+class Compiler {
+    public:
+        Compiler(const ExecutionUnit&, const Runtime&) noexcept;
+
+    public:
+        // Compiles a function along with every function it reaches that isn't native
+        // yet, sets their `Native` and returns their indices, along with whether they
+        // were optimized - or nothing, if any of them can't be compiled. Functions that
+        // aren't `proven` keep their type checks, and the ones that are get optimized
+        // with their `types`. The targets of backward jumps get an entry in `entries`,
+        // indexed like the decoded code, that takes over a running frame at that instruction
+        auto Compile(size_t, std::vector<FunctionDescriptor>&, const std::vector<bool>& proven, const std::vector<Analysis::RegisterTypes>& types, ExecutableMemory&, std::vector<NativeFunction>& entries) -> std::vector<std::pair<size_t, bool>>;
+
+        // Compiles the loop recorded in `steps`, which starts and ends in a frame of
+        // `function`. Returns a trace without code if it can't be compiled
+        auto CompileTrace(const std::vector<TraceStep>& steps, size_t function, ExecutableMemory&) -> Trace;
+
+    private:
+        [[nodiscard]] auto CanCompile(size_t, const std::vector<Emit::Instruction>&) const -> bool;
+        auto Translate(size_t, const std::vector<Emit::Instruction>&, bool, const std::vector<FunctionDescriptor>&, std::vector<uint8_t>&) const -> std::vector<std::pair<size_t, size_t>>;
+
+    private:
+        const ExecutionUnit& _unit;
+        Runtime              _runtime;
+};
+
+}
+
+#endif
\ No newline at end of file
@@ -35,6 +35,7 @@ namespace Yun::Interpreter {
         RegistersAttribute,
         ReturnsAttribute,
         ParametersAttribute,
+        MemoizeAttribute,
         EndOfFile
     };
 
@@ -84,6 +85,8 @@ namespace Yun::Interpreter {
             return "ReturnsAttribute";
         case TokenType::ParametersAttribute:
             return "ParametersAttribute";
+        case TokenType::MemoizeAttribute:
+            return "MemoizeAttribute";
         case TokenType::EndOfFile:
             return "EndOfFile";
         default:
@@ -0,0 +1,105 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+// C header files
+#include <cstddef>
+#include <cstdint>
+// C++ header files
+#include <map>
+#include <utility>
+#include <vector>
+// My header files
+#include "Analysis.hpp"
+#include "Containers.hpp"
+#include "Emit.hpp"
+
+namespace Yun::ASM {
+
+// How hard the `Assembler` works on the functions, chosen with `-O`
+struct OptimizerOptions {
+    constexpr OptimizerOptions() noexcept
+        :Level{ 1 }, Statistics{ false }, Profile{ nullptr } {
+    }
+
+    uint8_t     Level;       // 0 leaves the code alone, 1 runs the peephole pass, 2 inlines and runs the global passes too
+    bool        Statistics;  // Print how many instructions every function had before and after
+    const char* Profile;     // File to lay the functions out by, recorded by the VM at the same level, or null
+};
+
+// How one function behaved in a profiled run, see `VM::WriteProfile`. Conditional jumps are
+// numbered by where they were in the function, which only holds if it still has `Size` instructions
+struct FunctionProfile {
+    uint64_t                                        Calls;
+    size_t                                          Size;
+    std::map<size_t, std::pair<uint64_t, uint64_t>> Branches;  // Times taken and not taken, by jump
+};
+
+// Rewrites the bodies of functions before the `Assembler` serializes them.
+// Calls must already refer to their callees by an index into the symbol table,
+// and jumps hold offsets in bytes, like in the serialized form
+class Optimizer {
+    public:
+        Optimizer(const VM::Containers::SymbolTable&, VM::Containers::ConstantPool&) noexcept;
+
+    public:
+        // Replaces short sequences of instructions with cheaper ones until none are left.
+        // Returns whether anything changed
+        auto Peephole(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+
+        // Turns conditional jumps over a few copies, and diamonds of them, into selects, so
+        // short min, max and clamp sequences don't branch at all. Returns whether anything changed
+        static auto IfConvert(std::vector<VM::Emit::Instruction>&) -> bool;
+
+        // Copies small loops that check their index against the count of an array only at the bottom,
+        // and enters the copy after checking it before the first round as well, so the VM can skip
+        // the range checks in there. Returns whether anything changed
+        auto VersionLoops(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+
+        // Puts a function in SSA form and removes redundant and dead computations
+        // and copies, then moves invariant ones out of loops, until none are left.
+        // Returns whether anything changed
+        auto Global(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+
+        // Splices small functions that call nothing into their callers, under a budget that grows
+        // with the loops around the call. Callers take in the callees' registers, which their
+        // symbols account for. Returns whether anything changed
+        auto Inline(std::vector<VM::Containers::Symbol>&, std::vector<std::vector<VM::Emit::Instruction>>&) -> bool;
+
+        // Clones functions for the constant arguments they're called with, and calls the clones instead
+        // wherever folding those constants makes them smaller. Clones are added after the other functions,
+        // with symbols of their own. Returns whether anything changed
+        auto Specialize(std::vector<VM::Containers::Symbol>&, std::vector<std::vector<VM::Emit::Instruction>>&) -> bool;
+
+        // Gives registers whose values are never live at the same time the same number, and shrinks
+        // the frame in the symbol to the registers that are left. Returns whether anything changed
+        auto CompactRegisters(size_t, std::vector<VM::Emit::Instruction>&, VM::Containers::Symbol&) -> bool;
+
+        // Reorders the blocks of a function so every block is followed by the one it went on to most
+        // often, and blocks that (almost) never ran end up last. Returns whether anything changed
+        static auto Layout(std::vector<VM::Emit::Instruction>&, const FunctionProfile&) -> bool;
+
+    private:
+        static auto JumpsStayInside(const std::vector<VM::Emit::Instruction>&) -> bool;
+        auto IsInlinable(const VM::Containers::Symbol&, const std::vector<VM::Emit::Instruction>&) const -> bool;
+        auto Retarget(std::vector<VM::Emit::Instruction>&) const -> bool;
+        auto Rewrite(size_t, std::vector<VM::Emit::Instruction>&, std::vector<bool>&) -> bool;
+        auto FoldConversion(const VM::Emit::Instruction&, const VM::Emit::Instruction&) -> int64_t;
+        auto ReduceStrength(VM::Emit::Instruction&, VM::Emit::Instruction&) -> bool;
+        auto FoldOperation(VM::Instructions::Opcode, size_t, size_t) -> int64_t;
+
+        auto FoldConstants(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+        auto RemoveRedundancies(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+        auto EliminateDeadCode(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+        auto HoistInvariants(size_t, std::vector<VM::Emit::Instruction>&) -> bool;
+
+        static auto Compact(std::vector<VM::Emit::Instruction>&, const std::vector<bool>&,
+                            const std::vector<std::vector<VM::Emit::Instruction>>& = {}, const std::vector<bool>& = {}) -> void;
+
+    private:
+        const VM::Containers::SymbolTable& _symbols;
+        VM::Containers::ConstantPool&      _constants;
+};
+
+}
+
+#endif
@@ -10,18 +10,19 @@
 namespace Yun::Interpreter {
     struct State {
         State() noexcept
-            :KeepReturnValue{ 0 }, RegisterCount{ 0 }, ArgCount{ 0 }, Name{ "" } {
+            :KeepReturnValue{ 0 }, RegisterCount{ 0 }, ArgCount{ 0 }, Name{ "" }, Memoize{ false } {
         }
 
         bool             KeepReturnValue;
         int16_t          RegisterCount;
         int16_t          ArgCount;
         std::string      Name;
+        bool             Memoize;
     };
 
     class Parser {
         public:
-            Parser(std::vector<Token>) noexcept;
+            Parser(std::vector<Token>, ASM::OptimizerOptions = {  }) noexcept;
         
         public:
             [[nodiscard]] constexpr auto HadError() const noexcept -> bool {
@@ -41,6 +42,7 @@ namespace Yun::Interpreter {
             auto RegistersAttribute() -> void;
             auto ParametersAttribute() -> void;
             auto ReturnsAttribute() -> void;
+            auto MemoizeAttribute() -> void;
             auto Block() -> void;
             auto Line() -> void;
 
@@ -0,0 +1,57 @@
+#ifndef TYPES_HPP
+#define TYPES_HPP
+
+// C header files
+#include <cstdint>
+
+namespace Yun::VM::Primitives {
+
+enum class Type : uint8_t {
+    Uninit,
+    Int8,
+    Int16,
+    Int32,
+    Int64,
+    Uint8,
+    Uint16,
+    Uint32,
+    Uint64,
+    Float32,
+    Float64,
+    Reference,
+};
+
+[[nodiscard]] constexpr auto TypeToString(Type type) noexcept -> const char* {
+    switch (type) {
+    case Type::Uninit:
+        return "<uninit>";
+    case Type::Int8:
+        return "Int8";
+    case Type::Int16:
+        return "Int16";
+    case Type::Int32:
+        return "Int32";
+    case Type::Int64:
+        return "Int64";
+    case Type::Uint8:
+        return "Uint8";
+    case Type::Uint16:
+        return "Uint16";
+    case Type::Uint32:
+        return "Uint32";
+    case Type::Uint64:
+        return "Uint64";
+    case Type::Float32:
+        return "Float32";
+    case Type::Float64:
+        return "Float64";
+    case Type::Reference:
+        return "Reference";
+    default:
+        return "<err>";
+    }
+}
+
+}
+
+#endif
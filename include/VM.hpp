@@ -1,10 +1,18 @@
 #ifndef VM_HPP
 #define VM_HPP
 
+// C header files
+#include <csetjmp>
 // C++ header files
+#include <chrono>
+#include <exception>
+#include <string>
+#include <string_view>
 #include <vector>
 // My header files
+#include "Analysis.hpp"
 #include "Containers.hpp"
+#include "JIT.hpp"
 #include "Value.hpp"
 
 namespace Yun::VM {
@@ -17,9 +25,11 @@ class ExecutionUnit {
         [[nodiscard]] auto Name() const noexcept -> std::string_view;
         [[nodiscard]] auto StartPC() const noexcept -> const uint32_t*;
         [[nodiscard]] auto StopPC() const noexcept -> const uint32_t*;
-        [[nodiscard]] auto ConstantLookup(size_t) const -> Primitives::Value;
+        [[nodiscard]] auto ConstantLookup(size_t) const -> const Primitives::Value&;
         [[nodiscard]] auto SymbolLookup(size_t) const -> const Containers::Symbol&;
         [[nodiscard]] auto SymbolLookup(const std::string&) const -> const Containers::Symbol&;
+        [[nodiscard]] auto Symbols() const noexcept -> const Containers::SymbolTable&;
+        [[nodiscard]] auto Constants() const noexcept -> const Containers::ConstantPool&;
         
     public:
         auto Disassemble() const noexcept -> void;
@@ -32,23 +42,254 @@ class ExecutionUnit {
         Containers::InstructionBuffer _buffer;
 };
 
+struct FunctionDescriptor;
+
+// Decoded opcode of every instruction that isn't a valid `Instructions::Opcode`
+constexpr uint16_t InvalidOpcode = static_cast<uint16_t>(Instructions::OpcodeTotal);
+
+// Pairs of adjacent instructions fused together at load time. They only exist
+// in the decoded form, so their numbering continues after `InvalidOpcode`.
+// Run `yvm -p` to see which pairs are worth fusing
+enum class Superinstruction : uint16_t {
+    cmp_je = InvalidOpcode + 1, cmp_jne, cmp_jgt, cmp_jge, cmp_jlt, cmp_jle,
+    icmp_je,  icmp_jne, icmp_jgt, icmp_jge, icmp_jlt, icmp_jle,
+    fcmp_je,  fcmp_jne, fcmp_jgt, fcmp_jge, fcmp_jlt, fcmp_jle,
+
+    cmp_cmove,  cmp_cmovne,  cmp_cmovgt,  cmp_cmovge,  cmp_cmovlt,  cmp_cmovle,
+    icmp_cmove, icmp_cmovne, icmp_cmovgt, icmp_cmovge, icmp_cmovlt, icmp_cmovle,
+    fcmp_cmove, fcmp_cmovne, fcmp_cmovgt, fcmp_cmovge, fcmp_cmovlt, fcmp_cmovle,
+
+    ldconst_cmp,    ldconst_icmp,
+    ldconst_i64add, ldconst_i64sub,
+    ldconst_u64add, ldconst_u64sub,
+
+    mov_i64add, mov_i64sub, mov_i64mul,
+    mov_u64add, mov_u64sub, mov_u64mul,
+
+    // Not a pair, but just as decoded-only: a `call` whose callee's frame
+    // starts at the arguments, so they don't have to be copied
+    call_shared,
+
+    // Nor are these: array accesses whose index is known to be in range, see `Analysis::ArrayBounds`
+    load_inbounds, store_inbounds, advance_inbounds,
+
+    // Calls that look for the result in the callee's `MemoTable` first, and
+    // the `ret`s of memoized functions that leave it there, see `VM::Memoize`
+    call_memoized, call_shared_memoized, ret_memoized,
+
+    Count
+};
+
+// Functions proven to be well-typed by the `Verifier` have this added to every
+// decoded opcode. The handlers above it skip the runtime type checks
+constexpr uint16_t UncheckedOffset = static_cast<uint16_t>(Superinstruction::Count);
+
+// Type-specialized forms of generic instructions. The first time a generic
+// instruction runs, it rewrites itself into its quick form if its operands
+// have the types the quick form expects. A quick instruction only checks that
+// the types are still the same and otherwise goes back to the generic form for good.
+// Only the 64-bit comparisons are specialized, since these are what YASN literals produce
+enum class QuickInstruction : uint16_t {
+    cmp_u64 = 2 * UncheckedOffset, icmp_i64, fcmp_f64,
+
+    cmp_u64_je,  cmp_u64_jne,  cmp_u64_jgt,  cmp_u64_jge,  cmp_u64_jlt,  cmp_u64_jle,
+    icmp_i64_je, icmp_i64_jne, icmp_i64_jgt, icmp_i64_jge, icmp_i64_jlt, icmp_i64_jle,
+    fcmp_f64_je, fcmp_f64_jne, fcmp_f64_jgt, fcmp_f64_jge, fcmp_f64_jlt, fcmp_f64_jle,
+
+    // Neither operand of the select holds a reference either
+    cmp_u64_cmove,  cmp_u64_cmovne,  cmp_u64_cmovgt,  cmp_u64_cmovge,  cmp_u64_cmovlt,  cmp_u64_cmovle,
+    icmp_i64_cmove, icmp_i64_cmovne, icmp_i64_cmovgt, icmp_i64_cmovge, icmp_i64_cmovlt, icmp_i64_cmovle,
+    fcmp_f64_cmove, fcmp_f64_cmovne, fcmp_f64_cmovgt, fcmp_f64_cmovge, fcmp_f64_cmovlt, fcmp_f64_cmovle,
+
+    ldconst_cmp_u64, ldconst_icmp_i64,
+
+    // Neither register holds a reference, so no reference counts change
+    ldconst_scalar,
+    mov_scalar,
+    load_scalar,
+
+    Count
+};
+
+// The form in which instructions are actually executed. It's produced at load
+// time from the 32-bit instructions of an `ExecutionUnit`, so the interpreter
+// doesn't have to decode anything on its own. Only quickening changes it later
+struct alignas(32) DecodedInstruction {
+    const void*                   Handler;      // Only used by threaded dispatch
+    union {
+        DecodedInstruction*       Target;       // Jumps
+        FunctionDescriptor*       Callee;       // `call`
+        const Primitives::Value*  Constant;     // `ldconst`
+    };
+    uint32_t                      Dest;         // Relative to the current frame
+    uint32_t                      Src;          // Relative to the current frame
+    uint16_t                      Opcode;       // `Instructions::Opcode`, `Superinstruction` or `QuickInstruction`
+    uint16_t                      Dest2;        // Operands of the second instruction
+    uint16_t                      Src2;         // of a superinstruction
+    bool                          KeepGeneric;  // Don't quicken
+};
+
+// Every function starts out in the generic interpreter, where nothing quickens.
+// Once it's hot, its instructions specialize for the types they see from then on,
+// and with `VMOptions::JIT`, it's compiled once it gets hot again - by the
+// optimizing compiler, if the verifier has proven it
+enum class Tier : uint8_t {
+    Generic, Specialized, Native, Optimized
+};
+
+// How many calls, or backward jumps taken, make a function hot
+constexpr uint32_t HotCalls     = 1000;
+constexpr uint32_t HotBackEdges = 10000;
+
+// How many backward jumps to the same instruction make it worth recording a
+// trace from there, and how long and how many calls deep that trace may get
+constexpr uint32_t HotLoop        = 1000;
+constexpr size_t   MaxTraceLength = 1000;
+constexpr uint16_t MaxTraceDepth  = 8;
+
+struct FunctionDescriptor {
+    DecodedInstruction*       Entry;
+    uint16_t                  Registers;
+    uint16_t                  Arguments;
+    bool                      DoesReturn;
+    uint32_t                  End;
+    NativeFunction            Native;       // Only set if the function was compiled
+    Tier                      Level;
+    uint32_t                  Calls;        // Since the last tier-up
+    uint32_t                  BackEdges;    // Since the last tier-up
+    bool                      Memoized;     // Calls go through its `MemoTable`, and it's never compiled
+};
+
+// How many results every memoized function keeps at most
+constexpr size_t MemoSlots = 4096;
+
+// Results of a memoized function by the arguments it got. Every set of arguments
+// has a single slot, and a new result evicts whatever was there before.
+// The slots are only allocated once the function is first called
+struct MemoTable {
+    std::vector<uint64_t>          Hashes;     // Of the arguments in every slot, 0 for an empty one
+    std::vector<Primitives::Value> Arguments;  // `FunctionDescriptor::Arguments` of them for every slot
+    std::vector<Primitives::Value> Results;
+    std::vector<int32_t>           Flags;      // The function left for its caller
+    bool                           SetsFlags;  // Otherwise, the caller's flags are left alone
+    uint64_t                       Hits;
+    uint64_t                       Misses;
+};
+
+// A call to a memoized function that missed, waiting for the callee to return.
+// Its arguments are kept on a stack of their own
+struct MemoCall {
+    size_t   Depth;     // Of the call stack while the callee runs
+    size_t   Function;
+    uint64_t Hash;
+};
+
+struct VMOptions {
+    constexpr VMOptions() noexcept
+        :ProfilePairs{ false }, JIT{ false }, Traces{ false }, ReportTiers{ false }, RecordProfile{ false }, Memoize{ false } {
+    }
+
+    // Whether every instruction goes through the profiler, which sees them as they were written
+    [[nodiscard]] constexpr auto Profiles() const noexcept -> bool {
+        return ProfilePairs || RecordProfile;
+    }
+
+    bool ProfilePairs;  // Count pairs of executed instructions, disables superinstructions and tiering
+    bool JIT;           // Compile hot functions to native code, where possible
+    bool Traces;        // Record and compile traces of hot loops in interpreted functions
+    bool ReportTiers;   // Keep track of when functions tier up
+    bool RecordProfile; // Count calls and which way conditional jumps go for `VM::WriteProfile`, disables the same
+    bool Memoize;       // Memoize every pure function, not just the ones that ask for it
+};
+
+// A trace being recorded, see `VM::Record`
+struct TraceRecording {
+    bool                        Active;
+    uint32_t                    Anchor;     // Where the loop starts, and the trace
+    uint32_t                    Function;   // Where the anchor is
+    std::vector<JIT::TraceStep> Steps;
+    size_t                      Finished;   // Steps whose results are recorded
+    std::vector<uint32_t>       Next;       // Where the next step can be
+    std::vector<uint32_t>       Calls;      // Calls entered and not returned from
+};
+
+// A function that reached its next tier, for `VM::PrintTierReport`
+struct TierEvent {
+    size_t   Function;
+    Tier     Level;
+    size_t   Cause;         // The hot function, which might have taken this one along to native code
+    bool     ByBackEdges;
+    double   Milliseconds;  // Since the program started
+};
+
 class VM final {
     public:
-        VM(ExecutionUnit) noexcept;
+        VM(ExecutionUnit, VMOptions = {  }) noexcept;
     
     public:
         auto Run() -> void;
+        auto PrintPairProfile() const -> void;
+        auto PrintTierReport() const -> void;
+        auto PrintMemoReport() const -> void;
+        auto WriteProfile(const std::string&) const -> void;
     
     private:
-        auto ReportError(std::string_view) const -> void;
+        auto Load(const void* const*) -> void;
+        auto ShareArguments(const void* const*) -> void;
+        auto SkipRangeChecks(const void* const*) -> void;
+        auto Memoize(const void* const*) -> void;
+        auto Recall(const FunctionDescriptor*, Containers::RegisterWindow, const Containers::Frame&) -> bool;
+        auto Remember(Containers::RegisterWindow) -> void;
+        auto TierUp(FunctionDescriptor&, bool byBackEdges) -> void;
+        auto CountTransfer(const DecodedInstruction*, const DecodedInstruction*) -> void;
+        auto Record(const DecodedInstruction*, Containers::RegisterWindow, const Containers::Frame&) -> bool;
+        auto LeaveTrace(const JIT::TraceExit&, Containers::Frame&) -> DecodedInstruction*;
+        auto NativeRuntime() noexcept -> JIT::Runtime;
+        [[noreturn]] auto ReportError(std::string_view) const -> void;
+        [[noreturn]] YUN_COLD auto Trap(Error::Fault, size_t, const Primitives::Type*, const Primitives::Type*) const -> void;
+
+        // Runs native code, and rethrows whatever it left behind, see `LeaveNative`
+        template<typename Code>
+        YUN_NOINLINE auto EnterNative(Code&&);
+        [[noreturn]] auto LeaveNative() -> void;
+
+    private:
+        // Called from native code, see `JIT::Runtime`
+        static auto NativeCall(VM*, const FunctionDescriptor*, uint32_t, uint32_t) -> Containers::RegisterWindow;
+        static auto NativeTailCall(VM*, const FunctionDescriptor*, uint32_t) -> Containers::RegisterWindow;
+        static auto NativeExecute(VM*, uint32_t, Primitives::Payload*, Primitives::Type*, const Primitives::Payload*, const Primitives::Type*) -> void;
+        static auto NativeNotify(VM*, const Primitives::Payload*, const Primitives::Type*, bool) -> void;
+
+    private:
+        using Clock = std::chrono::steady_clock;
 
     private:
-        ExecutionUnit             _unit;
-        Containers::RegisterArray _registers;
-        Containers::CallStack     _callStack;
-        Containers::ArrayHeap     _heap;
-        int32_t                   _flags;
-        bool                      _hadError;
+        ExecutionUnit                   _unit;
+        std::vector<DecodedInstruction> _code;
+        std::vector<FunctionDescriptor> _functions;
+        Containers::RegisterArray       _registers;
+        Containers::CallStack           _callStack;
+        Containers::ArrayHeap           _heap;
+        int32_t                         _flags;
+        VMOptions                       _options;
+        std::vector<uint64_t>           _pairCounts;
+        std::vector<uint64_t>           _callCounts;   // By function
+        std::vector<uint64_t>           _jumpCounts;   // Times taken and not taken, two for every instruction
+        JIT::ExecutableMemory           _native;
+        std::vector<NativeFunction>     _loopEntries;  // Native code taking over a frame at a loop header
+        std::vector<JIT::Trace>         _traces;       // By the instruction they start at
+        std::vector<uint32_t>           _loopCounts;   // Backward jumps to every instruction
+        TraceRecording                  _recording;
+        std::vector<bool>               _proven;
+        std::vector<Analysis::RegisterTypes> _types;  // Of proven functions, for the optimizing compiler
+        std::vector<TierEvent>          _tierEvents;
+        std::vector<MemoTable>          _memos;          // By function
+        std::vector<MemoCall>           _memoCalls;
+        std::vector<Primitives::Value>  _memoArguments;  // Of `_memoCalls`
+        Clock::time_point               _start;
+        std::jmp_buf*                   _nativeExit;   // Where native code goes back to when something throws
+        std::exception_ptr              _nativeError;  // What it threw
+        bool                            _hadError;
 };
 
 
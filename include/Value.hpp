@@ -10,55 +10,23 @@
 #include <type_traits>
 // My header files
 #include "Exceptions.hpp"
+#include "Types.hpp"
+
+// Operations on registers are small, but there are many copies of the interpreter's
+// handlers calling them, so GCC would rather not inline them at -Os. What runs
+// when they fault is the opposite, and should stay out of the way of the handlers
+#if defined(__GNUC__)
+    #define YUN_INLINE   [[gnu::always_inline]] inline
+    #define YUN_NOINLINE [[gnu::noinline]]
+    #define YUN_COLD     [[gnu::cold]]
+#else
+    #define YUN_INLINE   inline
+    #define YUN_NOINLINE
+    #define YUN_COLD
+#endif
 
 namespace Yun::VM::Primitives {
 
-enum class Type : uint8_t {
-    Uninit,
-    Int8,
-    Int16,
-    Int32,
-    Int64,
-    Uint8,
-    Uint16,
-    Uint32,
-    Uint64,
-    Float32,
-    Float64,
-    Reference,
-};
-
-[[nodiscard]] constexpr auto TypeToString(Type type) noexcept -> const char* {
-    switch (type) {
-    case Type::Uninit:
-        return "<uninit>";
-    case Type::Int8:
-        return "Int8";
-    case Type::Int16:
-        return "Int16";
-    case Type::Int32:
-        return "Int32";
-    case Type::Int64:
-        return "Int64";
-    case Type::Uint8:
-        return "Uint8";
-    case Type::Uint16:
-        return "Uint16";
-    case Type::Uint32:
-        return "Uint32";
-    case Type::Uint64:
-        return "Uint64";
-    case Type::Float32:
-        return "Float32";
-    case Type::Float64:
-        return "Float64";
-    case Type::Reference:
-        return "Reference";
-    default:
-        return "<err>";
-    }
-}
-
 template<typename T>
 [[nodiscard]] constexpr auto TAsEnum() noexcept -> Type {
     if constexpr (std::is_same_v<T, int8_t>)
@@ -91,143 +59,268 @@ class Reference {
         uint32_t ArrayIndex;
 };
 
-class Value {
-    public:  // Special member functions
-        constexpr Value() noexcept
-            :_as{  }, _type{ Type::Uninit } {
-        }
+// Payload of a value, whatever its type
+union Payload {
+    int8_t    int8;
+    int16_t   int16;
+    int32_t   int32;
+    int64_t   int64;   // These are the defaults
+    uint8_t   uint8;
+    uint16_t  uint16;
+    uint32_t  uint32;
+    uint64_t  uint64;  // These are the defaults
+    float     float32;
+    double    float64; // These are the defaults
+    Reference ref;
+};
 
-        template<typename T>
-        constexpr Value(T value) noexcept
-            :_type{ TAsEnum<T>() } {
-            As<T>() = value;
+// A value that keeps its payload and type together, like a constant or an element of an array
+class Inline {
+    protected:
+        constexpr Inline(Type type) noexcept
+            :_as{  }, _type{ type } {
         }
 
-        constexpr Value(Type type) noexcept
-            :_as{  }, _type{ type } {
+    protected:
+        Payload _as;
+        Type    _type;
+};
+
+// A register, whose payload and type live in separate arrays of the `RegisterArray`
+class Split {
+    protected:
+        constexpr Split(Payload& as, Type& type) noexcept
+            :_as{ as }, _type{ type } {
         }
 
+    protected:
+        Payload& _as;
+        Type&    _type;
+};
+
+// Operations shared by both kinds of values. Operands may be of either kind
+template<typename Storage>
+class BasicValue : public Storage {
+    protected:
+        template<typename>
+        friend class BasicValue;
+
+        using Storage::Storage;
+        using Storage::_as;
+        using Storage::_type;
+
     public:  // As<T>
 
         template<typename T>
-        [[nodiscard]] constexpr auto As() noexcept -> T&;
+        [[nodiscard]] constexpr auto As() noexcept -> T& {
+            return const_cast<T&>(static_cast<const BasicValue&>(*this).template As<T>());
+        }
 
         template<typename T>
-        [[nodiscard]] constexpr auto As() const noexcept -> const T&;
+        [[nodiscard]] constexpr auto As() const noexcept -> const T& {
+            if constexpr (std::is_same_v<T, int8_t>)
+                return _as.int8;
+            else if constexpr (std::is_same_v<T, int16_t>)
+                return _as.int16;
+            else if constexpr (std::is_same_v<T, int32_t>)
+                return _as.int32;
+            else if constexpr (std::is_same_v<T, int64_t>)
+                return _as.int64;
+            else if constexpr (std::is_same_v<T, uint8_t>)
+                return _as.uint8;
+            else if constexpr (std::is_same_v<T, uint16_t>)
+                return _as.uint16;
+            else if constexpr (std::is_same_v<T, uint32_t>)
+                return _as.uint32;
+            else if constexpr (std::is_same_v<T, uint64_t>)
+                return _as.uint64;
+            else if constexpr (std::is_same_v<T, float>)
+                return _as.float32;
+            else if constexpr (std::is_same_v<T, double>)
+                return _as.float64;
+            else
+                return _as.ref;
+        }
 
         [[nodiscard]] constexpr auto AsPtr() noexcept -> void* {
             return &_as;
         }
 
+        [[nodiscard]] constexpr auto AsPtr() const noexcept -> const void* {
+            return &_as;
+        }
+
+        [[nodiscard]] constexpr auto TypePtr() const noexcept -> const Type* {
+            return &_type;
+        }
+
         [[nodiscard]] constexpr auto Typeof() const noexcept -> Type {
             return _type;
         }
 
-        auto Assign(const Value& value) noexcept -> void {
-            if (this == &value)
+        template<typename Other>
+        YUN_INLINE auto Assign(const BasicValue<Other>& value) noexcept -> void {
+            if (&_as == &value._as)
                 return;
             _type = value._type;
             std::memcpy(&_as, &value._as, sizeof(_as));
         }
 
-        template<typename T, typename = typename std::enable_if_t<std::is_signed_v<T> || std::is_floating_point_v<T>, T>>
-        constexpr auto Negate() -> void {
-            if (_type != TAsEnum<T>())
-                throw Error::TypeError{ "Value of this type can't be negated: ", _type };
+        // Operations with `Checked` set to false skip the type checks - they're
+        // only used for code that the verifier has proven to be well-typed.
+        // Faults are returned rather than thrown, see `VM::Trap`
+
+        template<typename T, bool Checked = true, typename = typename std::enable_if_t<std::is_signed_v<T> || std::is_floating_point_v<T>, T>>
+        constexpr auto Negate() noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != TAsEnum<T>())
+                    return Error::Fault::NotNegatable;
             As<T>() = -As<T>();
+            return Error::Fault::None;
         } 
 
-        template<typename T>
-        constexpr auto Add(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
-            As<T>() += value.As<T>();
+        template<typename T, bool Checked = true, typename Other>
+        YUN_INLINE constexpr auto Add(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
+            As<T>() += value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T>
-        constexpr auto Subtract(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
-            As<T>() -= value.As<T>();
+        template<typename T, bool Checked = true, typename Other>
+        YUN_INLINE constexpr auto Subtract(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
+            As<T>() -= value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T>
-        constexpr auto Multiply(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
-            As<T>() *= value.As<T>();
+        template<typename T, bool Checked = true, typename Other>
+        YUN_INLINE constexpr auto Multiply(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
+            As<T>() *= value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T>
-        constexpr auto Divide(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
+        template<typename T, bool Checked = true, typename Other>
+        constexpr auto Divide(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
             if constexpr (std::is_integral_v<T>)
-                if (value.As<T>() == 0)
-                    throw Error::IntegerArithmeticError{ "Division by zero" };
-            As<T>() /= value.As<T>();
+                if (value.template As<T>() == 0)
+                    return Error::Fault::DivisionByZero;
+            As<T>() /= value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T>
-        constexpr auto Remainder(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
+        template<typename T, bool Checked = true, typename Other>
+        constexpr auto Remainder(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
             if constexpr (std::is_integral_v<T>) {
-                if (value.As<T>() == 0)
-                    throw Error::IntegerArithmeticError{ "Remainder by zero" };
-                As<T>() %= value.As<T>();
-                return;
+                if (value.template As<T>() == 0)
+                    return Error::Fault::RemainderByZero;
+                As<T>() %= value.template As<T>();
+                return Error::Fault::None;
             }
-            As<T>() = std::remainder(As<T>(), value.As<T>());
+            As<T>() = std::remainder(As<T>(), value.template As<T>());
+            return Error::Fault::None;
         }
 
-        template<typename T, typename = std::enable_if_t<std::is_integral_v<T>, T>>
-        constexpr auto AND(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
-            As<T>() &= value.As<T>();
+        template<typename T, bool Checked = true, typename = std::enable_if_t<std::is_integral_v<T>, T>, typename Other>
+        constexpr auto AND(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
+            As<T>() &= value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T, typename = std::enable_if_t<std::is_integral_v<T>, T>>
-        constexpr auto OR(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
-            As<T>() |= value.As<T>();
+        template<typename T, bool Checked = true, typename = std::enable_if_t<std::is_integral_v<T>, T>, typename Other>
+        constexpr auto OR(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
+            As<T>() |= value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T, typename = std::enable_if_t<std::is_integral_v<T>, T>>
-        constexpr auto XOR(const Value& value) -> void {
-            if (_type != value._type || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
-            As<T>() ^= value.As<T>();
+        template<typename T, bool Checked = true, typename = std::enable_if_t<std::is_integral_v<T>, T>, typename Other>
+        constexpr auto XOR(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != value._type || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
+            As<T>() ^= value.template As<T>();
+            return Error::Fault::None;
         }
 
-        template<typename T, typename = std::enable_if_t<std::is_integral_v<T>, T>>
-        constexpr auto ShiftLeft(const Value& value) -> void {
-            if (value._type != Type::Uint32 || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
+        template<typename T, bool Checked = true, typename = std::enable_if_t<std::is_integral_v<T>, T>, typename Other>
+        constexpr auto ShiftLeft(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (value._type != Type::Uint32 || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
             As<T>() <<= value._as.uint32;
+            return Error::Fault::None;
         }
 
-        template<typename T, typename = std::enable_if_t<std::is_integral_v<T>, T>>
-        constexpr auto ShiftRight(const Value& value) -> void {
-            if (value._type != Type::Uint32 || _type != TAsEnum<T>())
-                throw Error::TypeError{ "Incompatible types: ", _type, value._type };
+        template<typename T, bool Checked = true, typename = std::enable_if_t<std::is_integral_v<T>, T>, typename Other>
+        constexpr auto ShiftRight(const BasicValue<Other>& value) noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (value._type != Type::Uint32 || _type != TAsEnum<T>())
+                    return Error::Fault::IncompatibleTypes;
             As<T>() >>= value._as.uint32;
+            return Error::Fault::None;
         }
 
-        constexpr auto NOT() -> void {
-            if (!IsIntegral())
-                throw Error::TypeError{ "Non-intergral type: ", _type };
+        template<bool Checked = true>
+        constexpr auto NOT() noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (!IsIntegral())
+                    return Error::Fault::NotIntegral;
             _as.uint64 = ~_as.uint64;
+            return Error::Fault::None;
         }
 
-        template<typename T, typename = typename std::enable_if_t<std::is_arithmetic_v<T>, T>>
-        [[nodiscard]] constexpr auto Compare(const Value& value) const -> int32_t {
+        // Whether `Compare<T>` can be used on these values
+        template<typename T, typename = typename std::enable_if_t<std::is_arithmetic_v<T>, T>, typename Other>
+        [[nodiscard]] YUN_INLINE constexpr auto Comparable(const BasicValue<Other>& value) const noexcept -> Error::Fault {
             if (_type != value._type)
-                throw Error::TypeError{ "Incompatible types for comparison: ", _type, value._type };
+                return Error::Fault::IncompatibleTypes;
+            else if constexpr (std::is_floating_point_v<T>)
+                return IsFloatingPoint()? Error::Fault::None : Error::Fault::NotComparable;
+            else if constexpr (std::is_signed_v<T>)
+                return IsSigned()? Error::Fault::None : Error::Fault::NotComparable;
+            else
+                return _type == Type::Uint32 || _type == Type::Uint64? Error::Fault::None : Error::Fault::NotComparable;
+        }
 
-            if constexpr (std::is_signed_v<T>) {
+        // Both values must be `Comparable<T>`
+        template<typename T, typename = typename std::enable_if_t<std::is_arithmetic_v<T>, T>, typename Other>
+        [[nodiscard]] YUN_INLINE constexpr auto Compare(const BasicValue<Other>& value) const noexcept -> int32_t {
+            // Floating-point types are signed too, so they must go first
+            if constexpr (std::is_floating_point_v<T>) {
+                if (_type == Type::Float32) {
+                    if (_as.float32 < value._as.float32)
+                        return -1;
+                    else if (_as.float32 > value._as.float32)
+                        return 1;
+                    else
+                        return 0;
+                } else {
+                    if (_as.float64 < value._as.float64)
+                        return -1;
+                    else if (_as.float64 > value._as.float64)
+                        return 1;
+                    else
+                        return 0;
+                }
+            } else if constexpr (std::is_signed_v<T>) {
                 if (_type == Type::Int32) {
                     if (_as.int32 < value._as.int32)
                         return -1;
@@ -235,15 +328,14 @@ class Value {
                         return 1;
                     else
                         return 0;
-                } else if (_type == Type::Int64) {
+                } else {
                     if (_as.int64 < value._as.int64)
                         return -1;
                     else if (_as.int64 > value._as.int64)
                         return 1;
                     else
                         return 0;
-                } else
-                    throw Error::TypeError{ "Can't compare i8 or i16: ", _type };
+                }
             } else if constexpr (std::is_unsigned_v<T>) {
                 if (_type == Type::Uint32) {
                     if (_as.uint32 < value._as.uint32)
@@ -252,40 +344,25 @@ class Value {
                         return 1;
                     else
                         return 0;
-                } else if (_type == Type::Uint64) {
+                } else {
                     if (_as.uint64 < value._as.uint64)
                         return -1;
                     else if (_as.uint64 > value._as.uint64)
                         return 1;
                     else
                         return 0;
-                } else
-                    throw Error::TypeError{ "Can't compare u8 or u16: ", _type };
-            } else if constexpr (std::is_floating_point_v<T>) {
-                if (_type == Type::Float32) {
-                    if (_as.float32 < value._as.float32)
-                        return -1;
-                    else if (_as.float32 > value._as.float32)
-                        return 1;
-                    else
-                        return 0;
-                } else {
-                    if (_as.float64 < value._as.float64)
-                        return -1;
-                    else if (_as.float64 > value._as.float64)
-                        return 1;
-                    else
-                        return 0;
                 }
             }
         }
 
-        template<typename From, typename To>
-        constexpr auto Convert() -> void {
-            if (_type != TAsEnum<From>())
-                throw Error::TypeError{ "Invalid type for conversion", _type };
+        template<typename From, typename To, bool Checked = true>
+        constexpr auto Convert() noexcept -> Error::Fault {
+            if constexpr (Checked)
+                if (_type != TAsEnum<From>())
+                    return Error::Fault::InvalidConversion;
             _type       = TAsEnum<To>();
             As<From>()  = (To)As<From>();
+            return Error::Fault::None;
         }
         constexpr auto Assign(const Reference& ref) noexcept -> void {
             _type = Primitives::Type::Reference;
@@ -310,111 +387,53 @@ class Value {
             return _type == Type::Float32 ||
                    _type == Type::Float64;
         }
+};
+
+class Value : public BasicValue<Inline> {
+    public:  // Special member functions
+        constexpr Value() noexcept
+            :BasicValue{ Type::Uninit } {
+        }
+
+        template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+        constexpr Value(T value) noexcept
+            :BasicValue{ TAsEnum<T>() } {
+            As<T>() = value;
+        }
+
+        constexpr Value(Type type) noexcept
+            :BasicValue{ type } {
+        }
 
     public:
         [[nodiscard]] auto ToString(bool verbose = true) const -> std::string;
-    
-    private: // Member values
-        union {
-            int8_t    int8;
-            int16_t   int16;
-            int32_t   int32;
-            int64_t   int64;   // These are the defaults
-            uint8_t   uint8;
-            uint16_t  uint16;
-            uint32_t  uint32;
-            uint64_t  uint64;  // These are the defaults
-            float     float32;
-            double    float64; // These are the defaults
-            Reference ref;
-        } _as;
-        Type       _type;
 };
 
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> int16_t& {
-        return _as.int16;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> int32_t& {
-        return _as.int32;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> int64_t& {
-        return _as.int64;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> uint8_t& {
-        return _as.uint8;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> uint16_t& {
-        return _as.uint16;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> uint32_t& {
-        return _as.uint32;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> uint64_t& {
-        return _as.uint64;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> float& {
-        return _as.float32;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> double& {
-        return _as.float64;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() noexcept -> Reference& {
-        return _as.ref;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const int8_t& {
-        return _as.int8;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const int16_t& {
-        return _as.int16;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const int32_t& {
-        return _as.int32;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const int64_t& {
-        return _as.int64;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const uint8_t& {
-        return _as.uint8;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const uint16_t& {
-        return _as.uint16;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const uint32_t& {
-        return _as.uint32;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const uint64_t& {
-        return _as.uint64;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const float& {
-        return _as.float32;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const double& {
-        return _as.float64;
-    }
-    template<>
-    [[nodiscard]] constexpr auto Value::As() const noexcept -> const Reference& {
-        return _as.ref;
-    }
+// A view of a register of the `RegisterArray`, which works like a `Value` in its place
+class Register : public BasicValue<Split> {
+    public:
+        constexpr Register(Payload& as, Type& type) noexcept
+            :BasicValue{ as, type } {
+        }
+
+    public:
+        using BasicValue::Assign;
+
+        // For anything that converts to a `Value`, like the results of array instructions
+        YUN_INLINE auto Assign(const Value& value) noexcept -> void {
+            BasicValue::Assign(value);
+        }
+
+        [[nodiscard]] auto Load() const noexcept -> Value {
+            Value value;
+            value.Assign(*this);
+            return value;
+        }
+
+        [[nodiscard]] auto ToString(bool verbose = true) const -> std::string {
+            return Load().ToString(verbose);
+        }
+};
 
 }
 
@@ -0,0 +1,51 @@
+#ifndef VERIFIER_HPP
+#define VERIFIER_HPP
+
+// C header files
+#include <cstddef>
+// C++ header files
+#include <vector>
+// My header files
+#include "Analysis.hpp"
+#include "Emit.hpp"
+#include "VM.hpp"
+
+namespace Yun::VM {
+
+// Proves at load time that functions never execute a typed instruction on
+// registers of the wrong type, so the VM can run them without type checks.
+// Types are inferred for every register at every point of every function.
+// Argument and return types flow through `call` and `ret` until nothing
+// changes - there are no declared types in the `Symbol`s to lean on
+class Verifier {
+    public:
+        Verifier(const ExecutionUnit&);
+
+    public:
+        // Indexed like the symbol table
+        [[nodiscard]] auto Verify() -> std::vector<bool>;
+        // Only for functions `Verify` has proven
+        [[nodiscard]] auto Types(size_t) -> Analysis::RegisterTypes;
+
+    private:
+        using State = std::vector<Primitives::Type>;
+
+        auto Decode() -> bool;
+        auto Analyze(size_t) -> bool;
+        auto Step(size_t, const Emit::Instruction&, State&) -> bool;
+        static auto Join(State&, const State&) -> bool;
+        static auto Join(Primitives::Type&, Primitives::Type) -> bool;
+
+    private:
+        const ExecutionUnit&                        _unit;
+        std::vector<std::vector<Emit::Instruction>> _bodies;
+        std::vector<Analysis::ControlFlowGraph>     _graphs;
+        std::vector<std::vector<State>>             _entries;     // Of every block, once `Verify` is done
+        std::vector<State>                          _arguments;
+        std::vector<Primitives::Type>               _returns;
+        bool                                        _changed;
+};
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,899 @@
+// My header files
+#include "../include/Analysis.hpp"
+#include <algorithm>
+
+namespace Yun::VM::Analysis {
+
+[[nodiscard]] auto Decode(const uint32_t* begin, const uint32_t* end) -> std::vector<Emit::Instruction> {
+    std::vector<Emit::Instruction> instructions;
+    instructions.reserve(end - begin);
+    for (auto it = begin; it != end; ++it)
+        instructions.push_back(Emit::Instruction::Deserialize(*it));
+    return instructions;
+}
+
+ControlFlowGraph::ControlFlowGraph(const std::vector<Emit::Instruction>& instructions)
+    :_blocks{  }, _blockOf(instructions.size(), 0) {
+    const auto count = instructions.size();
+    if (count == 0)
+        return;
+
+    // Blocks start at the function's entry, at every jump target
+    // and right after every instruction that transfers control
+    std::vector<bool> leaders(count, false);
+    leaders[0] = true;
+    for (size_t i = 0; i != count; ++i) {
+        const auto opcode = instructions[i].Opcode();
+
+        if (Instructions::IsJump(opcode)) {
+            const auto target = JumpTarget(instructions[i], i);
+            if (target < 0 || static_cast<size_t>(target) >= count)
+                throw Error::InstructionError{ "Jump target outside of the function" };
+            leaders[target] = true;
+        } else if (opcode != Instructions::Opcode::ret && opcode != Instructions::Opcode::tailcall)
+            continue;
+
+        if (i + 1 != count)
+            leaders[i + 1] = true;
+    }
+
+    for (size_t i = 0; i != count; ++i) {
+        if (leaders[i])
+            _blocks.push_back({ i, i, {  }, {  } });
+        _blockOf[i] = _blocks.size() - 1;
+        _blocks.back().End = i + 1;
+    }
+
+    for (size_t block = 0; block != _blocks.size(); ++block) {
+        const auto last = _blocks[block].End - 1;
+        const auto opcode = instructions[last].Opcode();
+        auto& successors = _blocks[block].Successors;
+
+        if (Instructions::IsJump(opcode))
+            successors.push_back(_blockOf[JumpTarget(instructions[last], last)]);
+        if (opcode != Instructions::Opcode::jmp && opcode != Instructions::Opcode::ret && opcode != Instructions::Opcode::tailcall && block + 1 != _blocks.size())
+            if (std::find(successors.begin(), successors.end(), block + 1) == successors.end())
+                successors.push_back(block + 1);
+
+        for (auto successor : successors)
+            _blocks[successor].Predecessors.push_back(block);
+    }
+}
+
+[[nodiscard]] auto ControlFlowGraph::Blocks() const noexcept -> const std::vector<BasicBlock>& {
+    return _blocks;
+}
+
+[[nodiscard]] auto ControlFlowGraph::BlockOf(size_t index) const -> size_t {
+    return _blockOf.at(index);
+}
+
+[[nodiscard]] auto ControlFlowGraph::Count() const noexcept -> size_t {
+    return _blocks.size();
+}
+
+Liveness::Liveness(const std::vector<Emit::Instruction>& instructions, const ControlFlowGraph& graph, const Containers::Symbol& function, const Containers::SymbolTable& symbols)
+    :_instructions{ instructions }, _graph{ graph }, _function{ function }, _symbols{ symbols }, _liveOut(graph.Count(), std::vector<bool>(function.Registers, false)) {
+    const auto& blocks = _graph.Blocks();
+
+    // Going through the blocks backwards gets loops done in fewer rounds
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t block = blocks.size(); block-- != 0; ) {
+            auto live = _liveOut[block];
+            for (auto successor : blocks[block].Successors) {
+                auto in = _liveOut[successor];
+                for (size_t i = blocks[successor].End; i-- != blocks[successor].Begin; )
+                    Transfer(_instructions[i], in);
+                for (size_t i = 0; i != live.size(); ++i)
+                    live[i] = live[i] || in[i];
+            }
+
+            if (live != _liveOut[block]) {
+                _liveOut[block] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+}
+
+[[nodiscard]] auto Liveness::LiveAfter(size_t index) const -> std::vector<bool> {
+    const auto block = _graph.BlockOf(index);
+    auto live = _liveOut[block];
+    for (size_t i = _graph.Blocks()[block].End; --i != index; )
+        Transfer(_instructions[i], live);
+    return live;
+}
+
+[[nodiscard]] auto Liveness::LiveBefore(size_t index) const -> std::vector<bool> {
+    auto live = LiveAfter(index);
+    Transfer(_instructions[index], live);
+    return live;
+}
+
+// Turns the registers live after an instruction into the ones live before it
+auto Liveness::Transfer(const Emit::Instruction& instruction, std::vector<bool>& live) const -> void {
+    using Instructions::Opcode;
+
+    const auto opcode = instruction.Opcode();
+    const auto count  = live.size();
+    const auto define = [&](size_t reg) { if (reg < count) live[reg] = false; };
+    const auto use    = [&](size_t reg) { if (reg < count) live[reg] = true; };
+
+    if (Instructions::IsJump(opcode))
+        return;
+
+    switch (opcode) {
+    case Opcode::call:
+    case Opcode::tailcall: {
+        // Arguments are the last registers, the return value goes to the last one
+        const auto& callee = _symbols.At(instruction.Destination());
+        if (opcode == Opcode::call && callee.DoesReturn && count != 0)
+            define(count - 1);
+        for (size_t i = count - std::min<size_t>(callee.Arguments, count); i != count; ++i)
+            use(i);
+        break;
+    }
+    case Opcode::ret:
+        if (_function.DoesReturn)
+            use(0);
+        break;
+    case Opcode::nop:
+    case Opcode::hlt:
+        break;
+    case Opcode::ldconst:
+        define(instruction.Destination());
+        break;
+    case Opcode::mov:
+    case Opcode::load:
+    case Opcode::arraycount:
+        define(instruction.Destination());
+        use(instruction.Source());
+        break;
+    default:
+        // Everything else reads its destination before writing it
+        use(instruction.Destination());
+        if (Instructions::OpcodeCount(opcode) == 2)
+            use(instruction.Source());
+        break;
+    }
+}
+
+[[nodiscard]] auto CanShareArguments(const std::vector<bool>& live, const Containers::Symbol& function, const Containers::Symbol& callee) -> bool {
+    if (callee.Arguments > function.Registers || (callee.DoesReturn && function.Registers == 0))
+        return false;
+
+    // Only the last register gets a value of its own, if the callee returns one
+    for (size_t reg = function.Registers - callee.Arguments; reg != function.Registers; ++reg)
+        if (live[reg] && !(callee.DoesReturn && reg == function.Registers - 1u))
+            return false;
+    return true;
+}
+
+[[nodiscard]] auto Reads(const Emit::Instruction& instruction, const Containers::Symbol& function, const Containers::SymbolTable& symbols) -> std::vector<uint32_t> {
+    using Instructions::Opcode;
+
+    const auto opcode = instruction.Opcode();
+    const auto count  = function.Registers;
+    std::vector<uint32_t> reads{  };
+    const auto read = [&](uint32_t reg) { if (reg < count) reads.push_back(reg); };
+
+    if (Instructions::IsJump(opcode))
+        return reads;
+
+    switch (opcode) {
+    case Opcode::call:
+    case Opcode::tailcall: {
+        const auto& callee = symbols.At(instruction.Destination());
+        for (uint32_t i = count - std::min<uint32_t>(callee.Arguments, count); i != count; ++i)
+            read(i);
+        break;
+    }
+    case Opcode::ret:
+        if (function.DoesReturn)
+            read(0);
+        break;
+    case Opcode::nop:
+    case Opcode::hlt:
+    case Opcode::ldconst:
+        break;
+    case Opcode::mov:
+    case Opcode::load:
+    case Opcode::arraycount:
+        read(instruction.Source());
+        break;
+    default:
+        read(instruction.Destination());
+        if (Instructions::OpcodeCount(opcode) == 2)
+            read(instruction.Source());
+        break;
+    }
+    return reads;
+}
+
+[[nodiscard]] auto Writes(const Emit::Instruction& instruction, const Containers::Symbol& function, const Containers::SymbolTable& symbols) -> int64_t {
+    const auto opcode = instruction.Opcode();
+    if (opcode == Instructions::Opcode::call)
+        return symbols.At(instruction.Destination()).DoesReturn && function.Registers != 0? function.Registers - 1 : -1;
+    else if (!(Instructions::Info(opcode).Flags & Instructions::Flag::Writes))
+        return -1;
+    return instruction.Destination() < function.Registers? instruction.Destination() : -1;
+}
+
+// Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm"
+Dominators::Dominators(const ControlFlowGraph& graph)
+    :_order{  }, _position(graph.Count(), SIZE_MAX), _immediate(graph.Count(), SIZE_MAX) {
+    const auto& blocks = graph.Blocks();
+    if (blocks.empty())
+        return;
+
+    // Postorder first, without recursion: the stack holds blocks and their next successor
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<std::pair<size_t, size_t>> stack{ { 0, 0 } };
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next == blocks[block].Successors.size()) {
+            _order.push_back(block);
+            stack.pop_back();
+            continue;
+        }
+        const auto successor = blocks[block].Successors[next++];
+        if (!visited[successor]) {
+            visited[successor] = true;
+            stack.emplace_back(successor, 0);
+        }
+    }
+    std::reverse(_order.begin(), _order.end());
+    for (size_t i = 0; i != _order.size(); ++i)
+        _position[_order[i]] = i;
+
+    const auto intersect = [&](size_t a, size_t b) {
+        while (a != b) {
+            while (_position[a] > _position[b])
+                a = _immediate[a];
+            while (_position[b] > _position[a])
+                b = _immediate[b];
+        }
+        return a;
+    };
+
+    _immediate[0] = 0;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = 1; i < _order.size(); ++i) {
+            const auto block = _order[i];
+            auto dominator = SIZE_MAX;
+            for (const auto predecessor : blocks[block].Predecessors) {
+                if (_immediate[predecessor] == SIZE_MAX)
+                    continue;
+                dominator = dominator == SIZE_MAX? predecessor : intersect(predecessor, dominator);
+            }
+            if (dominator != _immediate[block]) {
+                _immediate[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+}
+
+[[nodiscard]] auto Dominators::Reachable(size_t block) const -> bool {
+    return _position[block] != SIZE_MAX;
+}
+
+[[nodiscard]] auto Dominators::Dominates(size_t dominator, size_t block) const -> bool {
+    if (!Reachable(dominator) || !Reachable(block))
+        return false;
+    while (block != dominator && block != 0)
+        block = _immediate[block];
+    return block == dominator;
+}
+
+[[nodiscard]] auto Dominators::Order() const noexcept -> const std::vector<size_t>& {
+    return _order;
+}
+
+[[nodiscard]] auto NaturalLoops(const ControlFlowGraph& graph, const Dominators& dominators) -> std::map<size_t, std::vector<bool>> {
+    const auto& blocks = graph.Blocks();
+    std::map<size_t, std::vector<bool>> loops{  };
+    for (const auto block : dominators.Order()) {
+        for (const auto header : blocks[block].Successors) {
+            if (!dominators.Dominates(header, block))
+                continue;
+
+            auto& members = loops.try_emplace(header, blocks.size(), false).first->second;
+            members[header] = true;
+            std::vector<size_t> worklist{ block };
+            while (!worklist.empty()) {
+                const auto current = worklist.back();
+                worklist.pop_back();
+                if (members[current])
+                    continue;
+                members[current] = true;
+                for (const auto predecessor : blocks[current].Predecessors)
+                    if (dominators.Reachable(predecessor))
+                        worklist.push_back(predecessor);
+            }
+        }
+    }
+    return loops;
+}
+
+// Types that aren't known yet, while the values are numbered, and ones that can't be known
+static constexpr auto Pending = static_cast<Primitives::Type>(0xFE);
+static constexpr auto Unknown = Instructions::Operand::Any;
+
+[[nodiscard]] static auto IsInteger(Primitives::Type type) noexcept -> bool {
+    using Primitives::Type;
+    return type == Type::Int32 || type == Type::Int64 || type == Type::Uint32 || type == Type::Uint64;
+}
+
+SsaForm::SsaForm(const std::vector<Emit::Instruction>& instructions, const ControlFlowGraph& graph, const Dominators& dominators,
+                 const Containers::Symbol& function, const Containers::SymbolTable& symbols, const Containers::ConstantPool& constants)
+    :_instructions{ instructions }, _graph{ graph }, _function{ function }, _symbols{ symbols }, _constants{ constants },
+     _values{  }, _operands{  }, _replaced{  }, _phis(graph.Count()), _before(instructions.size()),
+     _defined(instructions.size(), None), _numbers{  }, _types{  }, _numbered{ false } {
+    Build(dominators);
+    RemoveTrivialPhis();
+    NumberValues(dominators);
+}
+
+[[nodiscard]] auto SsaForm::Before(size_t index, uint32_t reg) const -> size_t {
+    return Resolve(_before[index][reg]);
+}
+
+[[nodiscard]] auto SsaForm::Defined(size_t index) const -> size_t {
+    return _defined[index];
+}
+
+[[nodiscard]] auto SsaForm::At(size_t value) const -> const SsaValue& {
+    return _values[value];
+}
+
+[[nodiscard]] auto SsaForm::Operands(size_t phi) const -> std::vector<size_t> {
+    auto operands = _operands[phi];
+    for (auto& operand : operands)
+        operand = Resolve(operand);
+    return operands;
+}
+
+[[nodiscard]] auto SsaForm::Number(size_t value) const -> size_t {
+    return _numbers[Resolve(value)];
+}
+
+[[nodiscard]] auto SsaForm::TypeOf(size_t value) const -> Primitives::Type {
+    return _types[Resolve(value)];
+}
+
+[[nodiscard]] auto SsaForm::Numbered() const noexcept -> bool {
+    return _numbered;
+}
+
+[[nodiscard]] auto SsaForm::Harmless(size_t index) const -> bool {
+    using Instructions::Opcode;
+
+    const auto& instruction = _instructions[index];
+    const auto opcode = instruction.Opcode();
+    const auto& info  = Instructions::Info(opcode);
+
+    if (opcode == Opcode::ldconst || opcode == Opcode::mov)
+        return true;
+    else if (!Instructions::IsPure(opcode))
+        return false;
+
+    // Pure instructions fault only on operands of the wrong type
+    const auto dest = TypeOf(Before(index, instruction.Destination()));
+    if (opcode == Opcode::bnot)
+        return IsInteger(dest);
+    else if (info.Dest != Unknown && dest != info.Dest)
+        return false;
+    return info.Operands < 2 || info.Src == Unknown || TypeOf(Before(index, instruction.Source())) == info.Src;
+}
+
+// Every block that can be reached from more than one place, and the entry block, gets a phi for
+// every register. Phis that turn out to be trivial are dropped afterwards, which leaves
+// the same phis as the minimal SSA form, except for those that are dead
+auto SsaForm::Build(const Dominators& dominators) -> void {
+    const auto& blocks = _graph.Blocks();
+    const auto count = _function.Registers;
+    const auto add = [&](SsaValue value) {
+        _values.push_back(value);
+        _operands.emplace_back();
+        _replaced.push_back(_values.size() - 1);
+        return _values.size() - 1;
+    };
+
+    std::vector<size_t> entry(count);
+    for (uint32_t reg = 0; reg != count; ++reg)
+        entry[reg] = add({ SsaValue::Origin::Entry, 0, reg });
+
+    std::vector<std::vector<size_t>> exits(blocks.size());
+    for (const auto block : dominators.Order()) {
+        std::vector<size_t> predecessors{  };
+        for (const auto predecessor : blocks[block].Predecessors)
+            if (dominators.Reachable(predecessor))
+                predecessors.push_back(predecessor);
+
+        std::vector<size_t> current{  };
+        if (block == 0 && predecessors.empty())
+            current = entry;
+        else if (block != 0 && predecessors.size() == 1)
+            // In reverse postorder, the only way into a block comes before it
+            current = exits[predecessors.front()];
+        else {
+            for (uint32_t reg = 0; reg != count; ++reg)
+                current.push_back(add({ SsaValue::Origin::Phi, block, reg }));
+            _phis[block] = current;
+        }
+
+        for (auto i = blocks[block].Begin; i != blocks[block].End; ++i) {
+            _before[i] = current;
+            if (const auto reg = Writes(_instructions[i], _function, _symbols); reg >= 0)
+                current[static_cast<size_t>(reg)] = _defined[i] = add({ SsaValue::Origin::Instruction, i, static_cast<uint32_t>(reg) });
+        }
+        exits[block] = std::move(current);
+    }
+
+    for (const auto block : dominators.Order()) {
+        for (uint32_t reg = 0; reg != _phis[block].size(); ++reg) {
+            auto& operands = _operands[_phis[block][reg]];
+            if (block == 0)
+                operands.push_back(entry[reg]);
+            for (const auto predecessor : blocks[block].Predecessors)
+                if (dominators.Reachable(predecessor))
+                    operands.push_back(exits[predecessor][reg]);
+        }
+    }
+}
+
+// A phi is trivial if its operands are only itself and one other value
+auto SsaForm::RemoveTrivialPhis() -> void {
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t phi = 0; phi != _values.size(); ++phi) {
+            if (_values[phi].Kind != SsaValue::Origin::Phi || _replaced[phi] != phi)
+                continue;
+
+            auto same = None;
+            bool trivial = true;
+            for (auto operand : _operands[phi]) {
+                operand = Resolve(operand);
+                if (operand == phi || operand == same)
+                    continue;
+                else if (same != None) {
+                    trivial = false;
+                    break;
+                }
+                same = operand;
+            }
+            if (trivial && same != None) {
+                _replaced[phi] = same;
+                changed = true;
+            }
+        }
+    }
+}
+
+// Optimistic value numbering in reverse postorder, after Simpson's thesis: phis first assume
+// all their operands are the same, and the assumptions are checked until none change.
+// Values that come from memory, calls and the function's caller are only equal to themselves
+auto SsaForm::NumberValues(const Dominators& dominators) -> void {
+    const auto& blocks = _graph.Blocks();
+    _numbers.assign(_values.size(), None);
+    _types.assign(_values.size(), Pending);
+    for (size_t value = 0; value != _values.size(); ++value) {
+        if (_values[value].Kind == SsaValue::Origin::Entry) {
+            _numbers[value] = value;
+            _types[value]   = Unknown;
+        }
+    }
+
+    const auto update = [&](size_t value, std::pair<size_t, Primitives::Type> result) {
+        const bool changed = _numbers[value] != result.first || _types[value] != result.second;
+        _numbers[value] = result.first;
+        _types[value]   = result.second;
+        return changed;
+    };
+
+    // Every pass settles at least one more value, but phis of
+    // loops nested deeply enough make this slow, hence the limit
+    const auto passes = 2 * dominators.Order().size() + 8;
+    for (size_t pass = 0; pass != passes && !_numbered; ++pass) {
+        std::map<Key, size_t> table{  };
+        bool changed = false;
+
+        for (const auto block : dominators.Order()) {
+            for (const auto phi : _phis[block]) {
+                if (_replaced[phi] != phi)
+                    continue;
+
+                auto number = None;
+                auto type   = Pending;
+                bool differ = false;
+                for (auto operand : _operands[phi]) {
+                    operand = Resolve(operand);
+                    if (operand == phi || _numbers[operand] == None)
+                        continue;
+                    if (number != None && number != _numbers[operand])
+                        differ = true;
+                    number = _numbers[operand];
+                    type   = type == Pending || type == _types[operand]? _types[operand] : Unknown;
+                }
+                changed |= update(phi, { differ? phi : number, type });
+            }
+
+            for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+                if (_defined[i] != None)
+                    changed |= update(_defined[i], Evaluate(i, table));
+        }
+        _numbered = !changed;
+    }
+}
+
+// Number and type of the value an instruction writes
+[[nodiscard]] auto SsaForm::Evaluate(size_t index, std::map<Key, size_t>& table) const -> std::pair<size_t, Primitives::Type> {
+    using Instructions::Opcode;
+
+    const auto& instruction = _instructions[index];
+    const auto opcode = instruction.Opcode();
+    const auto& info  = Instructions::Info(opcode);
+    const auto self   = _defined[index];
+
+    if (opcode == Opcode::ldconst) {
+        const auto& constant = _constants.Read(static_cast<size_t>(instruction.Source()));
+        const Key key{ opcode, static_cast<size_t>(constant.Typeof()), None, constant.As<uint64_t>() };
+        return { table.try_emplace(key, self).first->second, constant.Typeof() };
+    } else if (opcode == Opcode::mov) {
+        const auto source = Before(index, instruction.Source());
+        return { _numbers[source], _types[source] };
+    } else if (Instructions::IsCall(opcode))
+        return { self, Unknown };
+    else if (Instructions::IsSelect(opcode)) {
+        // Either operand ends up in the destination, so it only has a known value if they agree
+        const auto dest = Before(index, instruction.Destination());
+        const auto src  = Before(index, instruction.Source());
+        if (_numbers[dest] == None || _numbers[src] == None)
+            return { None, Pending };
+        return { _numbers[dest] == _numbers[src]? _numbers[dest] : self, _types[dest] == _types[src]? _types[dest] : Unknown };
+    } else if ((info.Flags & ~Instructions::Flag::Faults) != Instructions::Flag::Writes)
+        return { self, info.Result };
+
+    const auto dest = Before(index, instruction.Destination());
+    const auto src  = info.Operands == 2? Before(index, instruction.Source()) : None;
+    if (_numbers[dest] == None || (src != None && _numbers[src] == None))
+        return { None, Pending };
+
+    const Key key{ opcode, _numbers[dest], src == None? None : _numbers[src], 0 };
+    const auto number = table.try_emplace(key, self).first->second;
+
+    // A result of the wrong type means the instruction faults, so nothing ever sees it
+    const auto destType = _types[dest];
+    const auto srcType  = src == None? Unknown : _types[src];
+    if (opcode == Opcode::bnot)
+        return { number, IsInteger(destType)? destType : Unknown };
+    else if ((info.Dest != Unknown && destType != info.Dest) || (src != None && info.Src != Unknown && srcType != info.Src))
+        return { number, Unknown };
+    return { number, info.Result };
+}
+
+[[nodiscard]] auto SsaForm::Resolve(size_t value) const -> size_t {
+    while (_replaced[value] != value)
+        value = _replaced[value];
+    return value;
+}
+
+ArrayBounds::ArrayBounds(const std::vector<Emit::Instruction>& instructions, const ControlFlowGraph& graph,
+                         const Dominators& dominators, const SsaForm& ssa, const Containers::Symbol& function)
+    :_instructions{ instructions }, _graph{ graph }, _dominators{ dominators }, _ssa{ ssa }, _inBounds(instructions.size(), false) {
+    for (const auto& instruction : instructions) {
+        const auto opcode = instruction.Opcode();
+        const auto& info  = Instructions::Info(opcode);
+        if (info.Operands < 1 || (info.Flags & (Instructions::Flag::Jump | Instructions::Flag::Call)))
+            continue;
+        if (static_cast<uint32_t>(instruction.Destination()) >= function.Registers ||
+            (info.Operands == 2 && opcode != Instructions::Opcode::ldconst && static_cast<uint32_t>(instruction.Source()) >= function.Registers))
+            return;
+    }
+
+    for (size_t i = 0; i != instructions.size(); ++i) {
+        if (!dominators.Reachable(graph.BlockOf(i)))
+            continue;
+
+        const auto opcode = instructions[i].Opcode();
+        if (opcode != Instructions::Opcode::load && opcode != Instructions::Opcode::store && opcode != Instructions::Opcode::advance)
+            continue;
+        const auto [index, array] = Access(i);
+        _inBounds[i] = index != SsaForm::None && array != SsaForm::None && Below(i, index, array);
+    }
+}
+
+[[nodiscard]] auto ArrayBounds::InBounds(size_t index) const -> bool {
+    return _inBounds[index];
+}
+
+// A `load` or `store` uses the index the array was last advanced to
+[[nodiscard]] auto ArrayBounds::Access(size_t index) const -> std::pair<size_t, size_t> {
+    using Instructions::Opcode;
+
+    const auto& instruction = _instructions[index];
+    if (instruction.Opcode() == Opcode::advance)
+        return { Strip(_ssa.Before(index, instruction.Source())), ArrayOf(_ssa.Before(index, instruction.Destination())) };
+
+    auto reference = _ssa.Before(index, instruction.Opcode() == Opcode::load? instruction.Source() : instruction.Destination());
+    while (_ssa.At(reference).Kind == SsaValue::Origin::Instruction) {
+        const auto at = _ssa.At(reference).At;
+        if (_instructions[at].Opcode() == Opcode::advance)
+            return Access(at);
+        else if (_instructions[at].Opcode() != Opcode::mov)
+            break;
+        reference = _ssa.Before(at, _instructions[at].Source());
+    }
+    return { SsaForm::None, SsaForm::None };
+}
+
+// The flags at the end of a block come from its last comparison, unless a call after it changed them
+[[nodiscard]] auto ArrayBounds::Guard(size_t from, size_t to, size_t index, size_t array) const -> size_t {
+    using Instructions::Opcode;
+
+    const auto& blocks = _graph.Blocks();
+    const auto& block  = blocks[from];
+    if (block.Begin == block.End)
+        return SsaForm::None;
+
+    const auto last = block.End - 1;
+    const auto jump = _instructions[last].Opcode();
+    if (!(Instructions::Info(jump).Flags & Instructions::Flag::Conditional))
+        return SsaForm::None;
+    const bool taken = JumpTarget(_instructions[last], last) == static_cast<int64_t>(blocks[to].Begin);
+    const bool falls = block.End == blocks[to].Begin;
+    if (taken == falls)
+        return SsaForm::None;
+
+    // Which operand of the comparison the way in shows to be the smaller one
+    bool destBelow = false;
+    if ((taken && jump == Opcode::jlt) || (falls && jump == Opcode::jge))
+        destBelow = true;
+    else if (!(taken && jump == Opcode::jgt) && !(falls && jump == Opcode::jle))
+        return SsaForm::None;
+
+    for (auto i = last; i-- != block.Begin; ) {
+        const auto& instruction = _instructions[i];
+        if (Instructions::IsCall(instruction.Opcode()))
+            return SsaForm::None;
+        else if (!(Instructions::Info(instruction.Opcode()).Flags & Instructions::Flag::SetsFlags))
+            continue;
+        else if (instruction.Opcode() != Opcode::cmp)
+            return SsaForm::None;
+
+        const auto dest  = _ssa.Before(i, instruction.Destination());
+        const auto src   = _ssa.Before(i, instruction.Source());
+        const auto lower = destBelow? dest : src;
+        const auto upper = destBelow? src : dest;
+        return Strip(lower) == Strip(index) && CountOf(upper) == array? upper : SsaForm::None;
+    }
+    return SsaForm::None;
+}
+
+// Either a way into a block that dominates the access shows the index to be in range, or the
+// index is a phi and every way into its block does. A value never changes once it's there, and
+// neither does the count of an array, so whatever held on the way in still holds at the access
+[[nodiscard]] auto ArrayBounds::Below(size_t at, size_t index, size_t array) const -> bool {
+    const auto block = _graph.BlockOf(at);
+    for (size_t dominator = 0; dominator != _graph.Count(); ++dominator) {
+        if (!_dominators.Dominates(dominator, block))
+            continue;
+        const auto ways = Ways(dominator);
+        if (ways.size() == 1 && Guard(ways.front(), dominator, index, array) != SsaForm::None)
+            return true;
+    }
+
+    const auto& origin = _ssa.At(index);
+    if (origin.Kind != SsaValue::Origin::Phi || origin.At == 0)
+        return false;
+
+    const auto ways     = Ways(origin.At);
+    const auto operands = _ssa.Operands(index);
+    for (size_t i = 0; i != ways.size(); ++i)
+        if (Guard(ways[i], origin.At, operands[i], array) == SsaForm::None)
+            return false;
+    return !ways.empty();
+}
+
+// The value a chain of copies and narrowing conversions starts from. Counts
+// of arrays fit in 32 bits, so these don't change a value that's below one
+[[nodiscard]] auto ArrayBounds::Strip(size_t value) const -> size_t {
+    using Instructions::Opcode;
+
+    while (_ssa.At(value).Kind == SsaValue::Origin::Instruction) {
+        const auto at = _ssa.At(value).At;
+        const auto& instruction = _instructions[at];
+        if (instruction.Opcode() == Opcode::mov)
+            value = _ssa.Before(at, instruction.Source());
+        else if (instruction.Opcode() == Opcode::convu64tou32)
+            value = _ssa.Before(at, instruction.Destination());
+        else
+            break;
+    }
+    return value;
+}
+
+// The value a reference was advanced or copied from, through phis, as long as all of them lead
+// to the same one. It must be written outside of any cycle, so it only ever holds one array
+[[nodiscard]] auto ArrayBounds::ArrayOf(size_t value) const -> size_t {
+    using Instructions::Opcode;
+
+    auto array = SsaForm::None;
+    std::vector<size_t> pending{ value };
+    std::vector<size_t> seen{  };
+    while (!pending.empty()) {
+        const auto current = pending.back();
+        pending.pop_back();
+        if (std::find(seen.begin(), seen.end(), current) != seen.end())
+            continue;
+        seen.push_back(current);
+
+        const auto& origin = _ssa.At(current);
+        if (origin.Kind == SsaValue::Origin::Phi) {
+            for (const auto operand : _ssa.Operands(current))
+                pending.push_back(operand);
+            continue;
+        } else if (origin.Kind == SsaValue::Origin::Instruction) {
+            const auto& instruction = _instructions[origin.At];
+            if (instruction.Opcode() == Opcode::mov || instruction.Opcode() == Opcode::advance) {
+                pending.push_back(_ssa.Before(origin.At, instruction.Opcode() == Opcode::mov? instruction.Source() : instruction.Destination()));
+                continue;
+            } else if (Cyclic(_graph.BlockOf(origin.At)))
+                return SsaForm::None;
+        }
+
+        if (array != SsaForm::None && array != current)
+            return SsaForm::None;
+        array = current;
+    }
+    return array;
+}
+
+[[nodiscard]] auto ArrayBounds::CountOf(size_t value) const -> size_t {
+    const auto& origin = _ssa.At(Strip(value));
+    if (origin.Kind != SsaValue::Origin::Instruction || _instructions[origin.At].Opcode() != Instructions::Opcode::arraycount)
+        return SsaForm::None;
+    return ArrayOf(_ssa.Before(origin.At, _instructions[origin.At].Source()));
+}
+
+// Whether a block can be reached from itself
+[[nodiscard]] auto ArrayBounds::Cyclic(size_t block) const -> bool {
+    const auto& blocks = _graph.Blocks();
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<size_t> pending{ blocks[block].Successors };
+    while (!pending.empty()) {
+        const auto current = pending.back();
+        pending.pop_back();
+        if (current == block)
+            return true;
+        else if (visited[current])
+            continue;
+        visited[current] = true;
+        pending.insert(pending.end(), blocks[current].Successors.begin(), blocks[current].Successors.end());
+    }
+    return false;
+}
+
+// Predecessors of a block that can be reached, like the operands of its phis
+[[nodiscard]] auto ArrayBounds::Ways(size_t block) const -> std::vector<size_t> {
+    std::vector<size_t> ways{  };
+    for (const auto predecessor : _graph.Blocks()[block].Predecessors)
+        if (_dominators.Reachable(predecessor))
+            ways.push_back(predecessor);
+    return ways;
+}
+
+[[nodiscard]] static auto IsPureBody(const std::vector<Emit::Instruction>& body, const Containers::Symbol& function, const Containers::SymbolTable& symbols) -> bool {
+    using namespace Instructions;
+
+    if (!function.DoesReturn || function.Registers == 0 || body.empty() || !(Info(body.back().Opcode()).Flags & Flag::Ends))
+        return false;
+    for (const auto& instruction : body) {
+        const auto opcode = instruction.Opcode();
+        const auto flags  = Info(opcode).Flags;
+        if (OpcodeCount(opcode) < 0 || (flags & (Flag::Memory | Flag::Output)) || opcode == Opcode::hlt)
+            return false;
+        else if (IsCall(opcode)) {
+            if (static_cast<size_t>(instruction.Destination()) >= symbols.Count())
+                return false;
+        } else if (!IsJump(opcode) && OpcodeCount(opcode) != 0) {
+            if (instruction.Destination() >= function.Registers)
+                return false;
+            if (OpcodeCount(opcode) == 2 && opcode != Opcode::ldconst && instruction.Source() >= function.Registers)
+                return false;
+        }
+    }
+
+    try {
+        const ControlFlowGraph graph{ body };
+        const auto entry = Liveness{ body, graph, function, symbols }.LiveBefore(0);
+        for (size_t reg = function.Arguments; reg < function.Registers; ++reg)
+            if (entry[reg])
+                return false;
+    } catch (const Error::InstructionError&) {
+        return false;
+    }
+    return true;
+}
+
+// What a function leaves in the flags, given what its callees do. The flags can hold what the caller
+// compared last, what the function compared itself, or either, depending on the way it took
+[[nodiscard]] static auto FlagsLeft(const std::vector<Emit::Instruction>& body, const std::vector<Purity>& purity) -> Purity {
+    using namespace Instructions;
+    constexpr uint8_t Caller = 1, Own = 2;
+
+    const ControlFlowGraph graph{ body };
+    const auto& blocks = graph.Blocks();
+    std::vector<uint8_t> entries(blocks.size(), 0);
+    std::vector<size_t> worklist{ 0 };
+    entries[0] = Caller;
+
+    uint8_t left = 0;
+    while (!worklist.empty()) {
+        const auto block = worklist.back();
+        worklist.pop_back();
+
+        auto state = entries[block];
+        for (size_t i = blocks[block].Begin; i != blocks[block].End; ++i) {
+            const auto opcode = body[i].Opcode();
+            const auto flags  = Info(opcode).Flags;
+            if ((flags & (Flag::Conditional | Flag::Selects)) && (state & Caller))
+                return Purity::None;
+            else if (flags & Flag::SetsFlags)
+                state = Own;
+            else if (IsCall(opcode)) {
+                const auto callee = purity[body[i].Destination()];
+                if (callee == Purity::None)
+                    return Purity::None;
+                else if (callee == Purity::SetsFlags)
+                    state = Own;
+            }
+
+            if (opcode == Opcode::ret || opcode == Opcode::tailcall)
+                left |= state;
+        }
+
+        for (auto successor : blocks[block].Successors)
+            if ((entries[successor] | state) != entries[successor]) {
+                entries[successor] |= state;
+                worklist.push_back(successor);
+            }
+    }
+
+    if (left == Own)
+        return Purity::SetsFlags;
+    else if (left == Caller)
+        return Purity::KeepsFlags;
+    return Purity::None;
+}
+
+[[nodiscard]] auto PureFunctions(const std::vector<std::vector<Emit::Instruction>>& bodies, const Containers::SymbolTable& symbols) -> std::vector<Purity> {
+    std::vector<Purity> purity(bodies.size(), Purity::None);
+    for (size_t i = 0; i != bodies.size(); ++i)
+        if (IsPureBody(bodies[i], symbols.At(i), symbols))
+            purity[i] = Purity::SetsFlags;
+
+    // Every function starts out assumed to compare, and settles on what its callees leave.
+    // One that keeps changing its mind, like one that's impure, spoils its callers too
+    std::vector<uint8_t> changes(bodies.size(), 0);
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = 0; i != bodies.size(); ++i) {
+            if (purity[i] == Purity::None)
+                continue;
+
+            const auto left = FlagsLeft(bodies[i], purity);
+            if (left != purity[i]) {
+                purity[i] = ++changes[i] > 2? Purity::None : left;
+                changed = true;
+            }
+        }
+    }
+    return purity;
+}
+
+}
@@ -1,8 +1,14 @@
 // My header files
 #include "../include/Assembler.hpp"
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <string>
 
 namespace Yun::ASM {
@@ -27,6 +33,14 @@ FunctionUnit::FunctionUnit(VM::Containers::Symbol symbol, VM::Emit::Emitter emit
     return _emitter.At(index);
 }
 
+[[nodiscard]] auto FunctionUnit::Body() const noexcept -> const std::vector<VM::Emit::Instruction>& {
+    return _emitter.Body();
+}
+
+auto FunctionUnit::Replace(std::vector<VM::Emit::Instruction> body) -> void {
+    _emitter.Replace(std::move(body));
+}
+
 [[nodiscard]] auto FunctionUnit::Symbol() -> VM::Containers::Symbol& {
     return _symbol;
 }
@@ -35,7 +49,7 @@ FunctionUnit::FunctionUnit(VM::Containers::Symbol symbol, VM::Emit::Emitter emit
     return _calls;
 }
 
-auto FunctionBuilder::NewFunction(std::string name, uint16_t registerCount, uint16_t argumentCount, bool doesReturn) -> void {
+auto FunctionBuilder::NewFunction(std::string name, uint16_t registerCount, uint16_t argumentCount, bool doesReturn, bool memoize) -> void {
     if (argumentCount > registerCount)
         throw Error::AssemblerError{ "Not enough registers for arguments: ",  argumentCount, registerCount };
     else if (registerCount == 0 && doesReturn)
@@ -45,6 +59,7 @@ auto FunctionBuilder::NewFunction(std::string name, uint16_t registerCount, uint
     _registerCount = registerCount;
     _argumentCount = argumentCount;
     _doesReturn    = doesReturn;
+    _memoize       = memoize;
     _emitter.Clear();
     _jumps.clear();
     _calls.clear();
@@ -112,7 +127,7 @@ auto FunctionBuilder::Finalize() -> FunctionUnit {
         }
     }
 
-    VM::Containers::Symbol s{ std::move(_name), _registerCount, _argumentCount, 0, static_cast<uint32_t>(_emitter.Count() * 4), _doesReturn };
+    VM::Containers::Symbol s{ std::move(_name), _registerCount, _argumentCount, 0, static_cast<uint32_t>(_emitter.Count() * 4), _doesReturn, _memoize };
 
 
     return { std::move(s), _emitter, _calls };
@@ -132,14 +147,18 @@ auto FunctionBuilder::CheckIfReturns() const -> void {
 auto FunctionBuilder::AddUnary(VM::Instructions::Opcode opcode, int32_t source) -> void {
     if (source >= _registerCount)
         throw Error::AssemblerError{ "Register index out of range: ", static_cast<int>(source) };
-    else if (VM::Instructions::IsJump(opcode) || VM::Instructions::Opcode::call == opcode)
+    else if (VM::Instructions::IsJump(opcode) || VM::Instructions::IsCall(opcode))
         throw Error::AssemblerError{ "Can't add jump or a call directly" };
     _emitter.Emit(opcode, source);
 }
 
-auto Assembler::BeginFunction(std::string name, uint16_t registerCount, uint16_t argumentCount, bool doesReturn) -> void {
+Assembler::Assembler(OptimizerOptions options) noexcept
+    :_symbolTable{  }, _constants{  }, _builder{  }, _functions{  }, _isBuildingAFunction{ false }, _options{ options } {
+}
+
+auto Assembler::BeginFunction(std::string name, uint16_t registerCount, uint16_t argumentCount, bool doesReturn, bool memoize) -> void {
     if (!_isBuildingAFunction) {
-        _builder.NewFunction(name, registerCount, argumentCount, doesReturn);
+        _builder.NewFunction(name, registerCount, argumentCount, doesReturn, memoize);
         _isBuildingAFunction = true;
     } else
         throw Error::AssemblerError{ "Unfinished build of a function: " + _builder.FunctionName() };
@@ -192,21 +211,112 @@ auto Assembler::AddVoid(VM::Instructions::Opcode opcode) -> void {
 }
 
 [[nodiscard]] auto Assembler::Patch(std::string name) -> VM::ExecutionUnit {
+    std::map<std::string, uint32_t> symbolIndices{  };
+
+    // First, number the declared functions. Where they start is only
+    // known once they're optimized, so these symbols don't have it yet
+    const auto declare = [this] {
+        VM::Containers::SymbolTable declared{  };
+        for (auto& function : _functions)
+            declared.Add(function.Symbol());
+        return declared;
+    };
+    for (auto& function : _functions) {
+        const auto& symbol = function.Symbol();
+
+        if (auto it = symbolIndices.find(symbol.Name); it != std::end(symbolIndices))
+            throw Error::AssemblerError{ "Redefinition of function: " + symbol.Name };
+        else
+            symbolIndices.emplace(symbol.Name, symbolIndices.size());
+    }
+    auto declared = declare();
+
+    for (auto& function : _functions) {
+        for (const auto& [relOffst, string] : function.CallMap()) {
+            const auto it = symbolIndices.find(string);
+            if (it == std::end(symbolIndices))
+                throw Error::AssemblerError{ "Call to an undefined function: " + string };
+
+            CheckCall(function.Symbol(), declared.At(it->second));
+
+            // Calls refer to their targets by an index into the symbol table,
+            // so the VM can find the callee without searching for it
+            function.At(relOffst).PatchOffset(it->second);
+        }
+    }
+
+    std::vector<std::pair<std::string, size_t>> before{  };
+    for (auto& function : _functions)
+        before.emplace_back(function.Symbol().Name, function.Body().size());
+
+    // Nothing else needs to be optimized or laid out
+    if (_options.Level >= 1 && RemoveUnreachable())
+        declared = declare();
+
+    // Inlining comes first, so the other passes see through the calls it removes.
+    // Before that, functions are specialized, and the clones get inlined like any other function
+    if (_options.Level >= 2) {
+        std::vector<VM::Containers::Symbol> symbols{  };
+        std::vector<std::vector<VM::Emit::Instruction>> bodies{  };
+        for (auto& function : _functions) {
+            symbols.push_back(function.Symbol());
+            bodies.push_back(function.Body());
+        }
+
+        const auto update = [&] {
+            for (size_t i = 0; i != bodies.size(); ++i) {
+                if (i == _functions.size())
+                    _functions.emplace_back(symbols[i], VM::Emit::Emitter{  }, std::map<uint32_t, std::string>{  });
+                _functions[i].Symbol() = symbols[i];
+                _functions[i].Replace(bodies[i]);
+            }
+            declared = declare();
+        };
+
+        if (Optimizer{ declared, _constants }.Specialize(symbols, bodies))
+            update();
+        if (Optimizer{ declared, _constants }.Inline(symbols, bodies))
+            update();
+
+        // Callees that got inlined or replaced by clones everywhere aren't called anymore
+        if (RemoveUnreachable())
+            declared = declare();
+    }
+
+    // The global passes leave pairs of instructions behind that the peephole pass cleans up, and
+    // so does turning short branches into selects, which the global passes give more of. Loops are versioned once the code
+    // is clean, so the copies are too. Registers are compacted last, since the other passes see the frames as declared
+    Optimizer optimizer{ declared, _constants };
+    for (size_t i = 0; i != _functions.size(); ++i) {
+        auto body = _functions[i].Body();
+
+        bool changed = false;
+        if (_options.Level >= 2)
+            changed |= optimizer.Global(i, body);
+        if (_options.Level >= 1) {
+            changed |= Optimizer::IfConvert(body);
+            changed |= optimizer.Peephole(i, body);
+        }
+        if (_options.Level >= 2) {
+            changed |= optimizer.VersionLoops(i, body);
+            changed |= optimizer.CompactRegisters(i, body, _functions[i].Symbol());
+        }
+        if (changed)
+            _functions[i].Replace(std::move(body));
+    }
+
+    // Layout comes last, since the profile numbers the jumps of the optimized functions
+    if (_options.Profile != nullptr)
+        ApplyProfile(ReadProfile());
+    if (_options.Statistics)
+        PrintStatistics(before);
+
+    // Then calculate the code segment size and fill the symbol table
     size_t codeSegmentSize = 0;
-    std::map<std::string, bool> registeredSymbols{  };
-    
-    // First, calculate the code segment size
     for (auto& function : _functions) {
         auto& symbol = function.Symbol();
-
-        // Fill the symbol table with declared functions
         symbol.Start = codeSegmentSize;
         symbol.End   = codeSegmentSize + function.Size();
-
-        if (auto it = registeredSymbols.find(symbol.Name); it != std::end(registeredSymbols))
-            throw Error::AssemblerError{ "Redefinition of function: " + symbol.Name };
-        else
-            registeredSymbols[symbol.Name] = true;
         _symbolTable.Add(symbol);
 
         codeSegmentSize += function.Size();
@@ -216,20 +326,181 @@ auto Assembler::AddVoid(VM::Instructions::Opcode opcode) -> void {
 
     size_t index = 0;
     for (auto& function : _functions) {
-        const auto& callMap = function.CallMap();
-
-        for (const auto& [relOffst, string] : callMap) {
-            const auto& symbol = _symbolTable.FindByName(string);
-
-            CheckCall(function.Symbol(), symbol);
-
-            function.At(relOffst).PatchOffset(symbol.Start);
+        const auto count = function.Size() / 4;
+        for (size_t i = 0; i != count; ++i) {
+            const auto callee = function.At(i).Destination();
+            if (function.At(i).Opcode() == VM::Instructions::Opcode::call && IsTailCall(function, i, _symbolTable.At(callee)))
+                function.At(i) = VM::Emit::Instruction{ VM::Instructions::Opcode::tailcall, callee };
         }
         index += function.Serialize(buffer.begin() + index);
     }
     return { std::move(name), std::move(_symbolTable), std::move(_constants), std::move(buffer) };
 }
 
+// Instructions of every function before and after the optimizer went through it.
+// Functions that were removed have none left, and clones had none to begin with
+auto Assembler::PrintStatistics(const std::vector<std::pair<std::string, size_t>>& before) -> void {
+    printf("===== Instructions at -O%u =====\n\n", static_cast<unsigned>(_options.Level));
+
+    std::map<std::string, size_t> after{  };
+    for (auto& function : _functions)
+        after.emplace(function.Symbol().Name, function.Size() / 4);
+
+    size_t totalBefore = 0;
+    size_t totalAfter  = 0;
+    for (const auto& [name, count] : before) {
+        const auto it = after.find(name);
+        if (it == std::end(after))
+            printf("  %-20s %8zu -> removed\n", name.c_str(), count);
+        else
+            printf("  %-20s %8zu -> %zu\n", name.c_str(), count, it->second);
+        totalBefore += count;
+    }
+    for (auto& function : _functions) {
+        const auto& name = function.Symbol().Name;
+        if (std::find_if(std::begin(before), std::end(before), [&](const auto& entry) { return entry.first == name; }) == std::end(before))
+            printf("  %-20s %8u -> %zu\n", name.c_str(), 0u, after[name]);
+        totalAfter += after[name];
+    }
+    printf("  %-20s %8zu -> %zu\n\n", "total", totalBefore, totalAfter);
+}
+
+// Keeps only `main` and the functions it calls, directly or through others, and renumbers
+// the calls to them. Returns whether anything was removed. Without a `main`, it's all kept,
+// so the VM gets to report that
+auto Assembler::RemoveUnreachable() -> bool {
+    using VM::Instructions::Opcode;
+
+    const auto entry = std::find_if(std::begin(_functions), std::end(_functions), [](FunctionUnit& function) { return function.Symbol().Name == "main"; });
+    if (entry == std::end(_functions))
+        return false;
+
+    std::vector<bool> reachable(_functions.size(), false);
+    std::vector<size_t> worklist{ static_cast<size_t>(entry - std::begin(_functions)) };
+    reachable[worklist.back()] = true;
+    while (!worklist.empty()) {
+        const auto& body = _functions[worklist.back()].Body();
+        worklist.pop_back();
+        for (const auto& instruction : body) {
+            const auto callee = static_cast<size_t>(instruction.Destination());
+            if (instruction.Opcode() == Opcode::call && !reachable[callee]) {
+                reachable[callee] = true;
+                worklist.push_back(callee);
+            }
+        }
+    }
+    if (std::find(std::begin(reachable), std::end(reachable), false) == std::end(reachable))
+        return false;
+
+    std::vector<int32_t> index(_functions.size(), -1);
+    int32_t kept = 0;
+    for (size_t i = 0; i != _functions.size(); ++i)
+        if (reachable[i])
+            index[i] = kept++;
+    Rearrange(index);
+    return true;
+}
+
+// Puts every function where `index` says, or drops it if that's -1, and renumbers the calls to them
+auto Assembler::Rearrange(const std::vector<int32_t>& index) -> void {
+    using VM::Instructions::Opcode;
+
+    std::vector<size_t> from{  };
+    for (size_t i = 0; i != index.size(); ++i) {
+        if (index[i] == -1)
+            continue;
+        if (from.size() <= static_cast<size_t>(index[i]))
+            from.resize(static_cast<size_t>(index[i]) + 1);
+        from[static_cast<size_t>(index[i])] = i;
+    }
+
+    std::vector<FunctionUnit> arranged{  };
+    for (auto i : from)
+        arranged.push_back(std::move(_functions[i]));
+
+    for (auto& function : arranged)
+        for (size_t i = 0; i != function.Body().size(); ++i)
+            if (function.At(i).Opcode() == Opcode::call)
+                function.At(i).PatchOffset(index[static_cast<size_t>(function.At(i).Destination())]);
+    _functions = std::move(arranged);
+}
+
+// Lays out the blocks of every function the profile knows of, see `Optimizer::Layout`, then orders
+// the functions by how often they were called, so the hottest ones end up next to each other
+auto Assembler::ApplyProfile(const std::map<std::string, FunctionProfile>& profiles) -> void {
+    std::vector<uint64_t> calls(_functions.size(), 0);
+    for (size_t i = 0; i != _functions.size(); ++i) {
+        const auto it = profiles.find(_functions[i].Symbol().Name);
+        if (it == std::end(profiles))
+            continue;
+
+        calls[i] = it->second.Calls;
+        auto body = _functions[i].Body();
+        if (Optimizer::Layout(body, it->second))
+            _functions[i].Replace(std::move(body));
+    }
+
+    std::vector<size_t> order(_functions.size());
+    std::iota(std::begin(order), std::end(order), 0);
+    std::stable_sort(std::begin(order), std::end(order), [&](size_t lhs, size_t rhs) { return calls[lhs] > calls[rhs]; });
+
+    std::vector<int32_t> index(_functions.size());
+    for (size_t k = 0; k != order.size(); ++k)
+        index[order[k]] = static_cast<int32_t>(k);
+    Rearrange(index);
+}
+
+// The profile is a line per function, `function NAME SIZE CALLS`, followed by a line per
+// conditional jump in it that ran, `branch INDEX TAKEN NOT-TAKEN`
+auto Assembler::ReadProfile() const -> std::map<std::string, FunctionProfile> {
+    std::unique_ptr<FILE, int(*)(FILE*)> file{ fopen(_options.Profile, "r"), fclose };
+    if (!file)
+        throw Error::AssemblerError{ std::string("Can't read the profile: ") + _options.Profile };
+
+    std::map<std::string, FunctionProfile> profiles{  };
+    FunctionProfile* current = nullptr;
+    char kind[16];
+    while (fscanf(file.get(), "%15s", kind) == 1) {
+        char name[256];
+        size_t at = 0;
+        uint64_t first = 0;
+        uint64_t second = 0;
+
+        if (!strcmp(kind, "function") && fscanf(file.get(), "%255s %zu %" SCNu64, name, &at, &first) == 3) {
+            current = &profiles[name];
+            current->Size  = at;
+            current->Calls = first;
+        } else if (!strcmp(kind, "branch") && current != nullptr && fscanf(file.get(), "%zu %" SCNu64 " %" SCNu64, &at, &first, &second) == 3)
+            current->Branches[at] = { first, second };
+        else
+            throw Error::AssemblerError{ std::string("Malformed profile: ") + _options.Profile };
+    }
+    return profiles;
+}
+
+// A call can reuse the caller's frame if nothing but returning its result happens after it:
+// - `call; ret` in a function that doesn't return a value,
+//   or whose only register is the one that receives the result
+// - `call; mov R0, Rn; ret`, where Rn is the caller's last register
+[[nodiscard]] auto Assembler::IsTailCall(FunctionUnit& function, size_t offset, const VM::Containers::Symbol& callee) const -> bool {
+    using VM::Instructions::Opcode;
+
+    const auto& caller = function.Symbol();
+    const auto count = function.Size() / 4;
+
+    if (offset + 1 >= count)
+        return false;
+
+    const auto& next = function.At(offset + 1);
+    if (next.Opcode() == Opcode::ret)
+        return !caller.DoesReturn || (callee.DoesReturn && caller.Registers == 1);
+    else if (offset + 2 >= count || function.At(offset + 2).Opcode() != Opcode::ret)
+        return false;
+
+    return caller.DoesReturn && callee.DoesReturn && next.Opcode() == Opcode::mov &&
+           next.Destination() == 0 && next.Source() == caller.Registers - 1;
+}
+
 auto Assembler::CheckCall(const VM::Containers::Symbol& caller, const VM::Containers::Symbol& callee) const -> void {
     if (caller.Registers == 0 && callee.DoesReturn)
         throw Error::AssemblerError{ "Not enough registers to save a return value" };
@@ -1,7 +1,9 @@
 #include "../include/Containers.hpp"
+#include <algorithm>
 #include <bit>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <exception>
 #include <iterator>
 #include <memory>
@@ -11,44 +13,89 @@
 namespace Yun::VM::Containers {
 
 RegisterArray::RegisterArray(size_t count) noexcept
-    :_index{ 0 }, _registers(count) {
+    :_index{ 0 }, _payloads(count), _types(count, Primitives::Type::Uninit) {
+}
+
+auto RegisterArray::Resize(size_t count) -> void {
+    _payloads.resize(count);
+    _types.resize(count, Primitives::Type::Uninit);
 }
 
 auto RegisterArray::Allocate(size_t count) -> void {
-    if (_index + count > _registers.size())
-        _registers.resize(_index * 2);
+    if (_index + count > _types.size())
+        Resize(std::max(_types.size() * 2, _index + count));
     _index += count;
 }
 
+// Makes room for more registers past the last one, without allocating them
+auto RegisterArray::Reserve(size_t count) -> void {
+    if (_index + count > _types.size())
+        Resize(std::max(_types.size() * 2, _index + count));
+}
+
+// Most registers aren't references, so their types are searched for
+// references a chunk at a time rather than one register at a time. The
+// released ones are cleared, or the next frame here would release them again
 auto RegisterArray::Deallocate(size_t count, ArrayHeap& heap) noexcept -> void {
-    for (size_t i = _index - count; i != _index; ++i)
-        if (_registers[i].Typeof() == Primitives::Type::Reference)
-            heap.Notify(_registers[i].As<Primitives::Reference>().HeapID, false);
+    const auto types = reinterpret_cast<const uint8_t*>(_types.data());
+    const auto end = types + _index;
+    for (auto type = end - count; (type = static_cast<const uint8_t*>(std::memchr(type, static_cast<int>(Primitives::Type::Reference), end - type))); ++type) {
+        heap.Notify(_payloads[type - types].ref.HeapID, false);
+        _types[type - types] = Primitives::Type::Uninit;
+    }
     _index -= count;
 }
 
 auto RegisterArray::Copy(std::size_t base, std::size_t count, ArrayHeap& heap) noexcept -> void {
     for (size_t i = 0; i != count; ++i)
-        if (const auto& ref = _registers[_index - base + i] = _registers[_index - base - count + i]; ref.Typeof() == Primitives::Type::Reference)
-            heap.Notify(ref.As<Primitives::Reference>().HeapID, true);
+        if (auto reg = (*this)[_index - base + i]; reg.Assign((*this)[_index - base - count + i]), reg.Typeof() == Primitives::Type::Reference)
+            heap.Notify(reg.As<Primitives::Reference>().HeapID, true);
 }
 
-auto RegisterArray::SaveReturnValue(std::size_t currentFrameCount, ArrayHeap& heap) noexcept -> void {
-    auto& oldLast = _registers[_index - currentFrameCount - 1];
-    const auto& newFirst = _registers[_index - currentFrameCount];
+// With `shared` registers between the frames, the last register of the
+// old frame is somewhere in the current one
+auto RegisterArray::SaveReturnValue(std::size_t currentFrameCount, std::size_t shared, ArrayHeap& heap) noexcept -> void {
+    auto oldLast = (*this)[_index - currentFrameCount + shared - 1];
+    const auto newFirst = (*this)[_index - currentFrameCount];
     if (oldLast.Typeof() == Primitives::Type::Reference)
         heap.Notify(oldLast.As<Primitives::Reference>().HeapID, false);
-    oldLast = newFirst;
+    oldLast.Assign(newFirst);
     if (oldLast.Typeof() == Primitives::Type::Reference)
         heap.Notify(oldLast.As<Primitives::Reference>().HeapID, true);
 }
 
+// Turns the top frame into a frame of another size, whose
+// arguments are the last registers of the old one
+auto RegisterArray::Reuse(std::size_t currentFrameCount, std::size_t count, std::size_t arguments, ArrayHeap& heap) -> void {
+    const auto base = _index - currentFrameCount;
+    const auto first = _index - arguments;
+
+    // Arguments only ever move down, so none is overwritten before it's read
+    if (first != base)
+        for (size_t i = 0; i != arguments; ++i) {
+            auto dest = (*this)[base + i];
+            if (dest.Typeof() == Primitives::Type::Reference)
+                heap.Notify(dest.As<Primitives::Reference>().HeapID, false);
+            dest.Assign((*this)[first + i]);
+            if (dest.Typeof() == Primitives::Type::Reference)
+                heap.Notify(dest.As<Primitives::Reference>().HeapID, true);
+        }
+
+    if (count < currentFrameCount)
+        Deallocate(currentFrameCount - count, heap);
+    else
+        Allocate(count - currentFrameCount);
+}
+
 auto RegisterArray::Print() const -> void {
-    for (size_t i = 0; i != _index; ++i)
-        printf("  0x%zx -> %s\n", i, _registers[i].ToString().data());
+    for (size_t i = 0; i != _index; ++i) {
+        auto payload = _payloads[i];
+        auto type = _types[i];
+        printf("  0x%zx -> %s\n", i, Primitives::Register{ payload, type }.ToString().data());
+    }
 }
 
-[[nodiscard]] auto ConstantPool::Read(size_t index) const -> Primitives::Value {
+[[nodiscard]] auto ConstantPool::Read(size_t index) const -> const Primitives::Value& {
     return _constants.at(index);
 }
 
@@ -106,6 +153,8 @@ InstructionBuffer::InstructionBuffer(size_t size) noexcept {
     retVal.append(DoesReturn? "Value" : "void");
     retVal.append("\n    End: ");
     retVal.append(std::to_string(End) + "\n");
+    if (Memoize)
+        retVal.append("    Memoized\n");
     return retVal;
 }
 
@@ -158,52 +207,31 @@ CallStack::CallStack(size_t count) noexcept
 }
 
 auto CallStack::Push(Frame frame) -> void {
-    _relativeOffset += _count? frame.RegisterCount : 0;
+    _relativeOffset += _count? frame.RegisterCount - frame.Shared : 0;
     _frames[_count++] = frame;
 }
 
 [[nodiscard]] auto CallStack::Pop() -> Frame {
     auto returnValue = _frames[--_count];
-    _relativeOffset -= _count? _frames[_count].RegisterCount : 0;
+    _relativeOffset -= _count? _frames[_count].RegisterCount - _frames[_count].Shared : 0;
     return returnValue;
 }
 
-Array::Array(Primitives::Type type, size_t count) noexcept
-    :_elementType{ type }, _count{ count }, _elements{ std::make_unique<uint64_t[]>(count) } {
+[[nodiscard]] auto CallStack::Top() const -> const Frame& {
+    return _frames[_count - 1];
 }
 
-[[nodiscard]] auto Array::Load(size_t index) -> Primitives::Value {
-    if (index >= _count)
-        throw Error::RangeError{ "Index was higher than count: ", index, _count };
-
-    Primitives::Value retVal{ _elementType };
-    std::memcpy(retVal.AsPtr(), &_elements[index], sizeof(uint64_t));
-    return retVal;
-}
-
-auto Array::Store(size_t index, Primitives::Value value) -> void {
-    if (index >= _count)
-        throw Error::RangeError{ "Index was higher than element count: ", index, _count };
-    else if (_elementType != value.Typeof())
-        throw Error::TypeError{ "Store of value with incompatible type", value.Typeof(), _elementType };
-
-    std::memcpy(&_elements[index], value.AsPtr(), sizeof(uint64_t));
-}
-
-auto Array::Advance(Primitives::Reference& reference, uint32_t offset) -> void {
-    if (offset > _count) // Can cast this safely
-        throw Error::RangeError{ "Index was outside range: " + std::to_string(offset) + " not in [0;" + std::to_string(_count) + "]" };
-    else
-        reference.ArrayIndex = offset;
+Array::Array(Primitives::Type type, size_t count) noexcept
+    :_elementType{ type }, _count{ count }, _elements{ std::make_unique<uint64_t[]>(count) } {
 }
 
 ArrayHeap::ArrayHeap(size_t initialSize)
     :_index{ 0 }, _heapArrays(initialSize), _idsForReuse{  } {
 }
 
-[[nodiscard]] auto ArrayHeap::NewArray(uint32_t size, uint32_t type) -> Primitives::Reference {
+[[nodiscard]] auto ArrayHeap::NewArray(uint32_t size, uint32_t type, Primitives::Reference& reference) -> Error::Fault {
     if (type > static_cast<uint8_t>(Primitives::Type::Float64) || type < 1)
-        throw Error::TypeError{ "Unsupported type id: ", type };
+        return Error::Fault::InvalidElementType;
 
     uint32_t id = 0;
     if (!_idsForReuse.empty()) {
@@ -215,7 +243,8 @@ ArrayHeap::ArrayHeap(size_t initialSize)
         _heapArrays.resize(2 * id);
     
     _heapArrays[id] = HeapRecord{ id, 1, std::make_unique<Array>(static_cast<Primitives::Type>(type), size) }; 
-    return { id, 0 };
+    reference = { id, 0 };
+    return Error::Fault::None;
 }
 
 auto ArrayHeap::Notify(uint32_t id, bool refAddElseSub) noexcept -> void {
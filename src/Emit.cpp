@@ -14,7 +14,7 @@ auto Instruction::Serialize(uint32_t* buffer) const noexcept -> void {
     // Switch on the number of operands
     // and copy the data into the buffer
     // in a safe way.
-    if (auto count = Instructions::OpcodeCount(_opcode); Instructions::IsJump(_opcode) || _opcode == Instructions::Opcode::call)
+    if (auto count = Instructions::OpcodeCount(_opcode); Instructions::IsJump(_opcode) || Instructions::IsCall(_opcode))
         instruction |= _dest & 0x00FFFFFF;
     else if (count == 1) {
         instruction |= (_dest & 0xFFF) << 12;
@@ -25,6 +25,29 @@ auto Instruction::Serialize(uint32_t* buffer) const noexcept -> void {
     *buffer = instruction;
 }
 
+[[nodiscard]] auto Instruction::Deserialize(uint32_t instruction) -> Instruction {
+    const auto op = (instruction >> 24) & 0xFF;
+    if (op > static_cast<uint8_t>(Instructions::Opcode::hlt))
+        throw Error::InstructionError{ "Invalid opcode: " + std::to_string(op) };
+
+    const auto opcode = static_cast<Instructions::Opcode>(op);
+
+    // Jump offsets are signed, call targets aren't
+    if (Instructions::IsJump(opcode))
+        return { opcode, static_cast<int32_t>(instruction << 8) >> 8 };
+    else if (Instructions::IsCall(opcode))
+        return { opcode, static_cast<int32_t>(instruction & 0x00FFFFFF) };
+
+    switch (Instructions::OpcodeCount(opcode)) {
+    case 2:
+        return { opcode, (instruction >> 12) & 0xFFF, instruction & 0xFFF };
+    case 1:
+        return { opcode, static_cast<int32_t>((instruction >> 12) & 0xFFF) };
+    default:
+        return { opcode };
+    }
+}
+
 auto Emitter::Emit(Instruction instruction) -> void {
     _instructions.push_back(instruction);
     _size += 4;
@@ -63,6 +86,15 @@ auto Emitter::Serialize() const -> Containers::InstructionBuffer {
     return _instructions.size();
 }
 
+[[nodiscard]] auto Emitter::Body() const noexcept -> const std::vector<Instruction>& {
+    return _instructions;
+}
+
+auto Emitter::Replace(std::vector<Instruction> instructions) -> void {
+    _instructions = std::move(instructions);
+    _size         = _instructions.size() * 4;
+}
+
 auto Emitter::Clear() -> void {
     _instructions.clear();
     _size = 0;
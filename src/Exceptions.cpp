@@ -1,3 +1,5 @@
+// C header files
+#include <cstdio>
 // C++ header files
 #include <cmath>
 #include <cstddef>
@@ -11,6 +13,67 @@
 
 namespace Yun::Error {
 
+[[nodiscard]] auto FaultToString(Fault fault) noexcept -> const char* {
+    switch (fault) {
+    case Fault::None:
+        return "No fault";
+    case Fault::IncompatibleTypes:
+        return "Incompatible types";
+    case Fault::NotNegatable:
+        return "Value of this type can't be negated";
+    case Fault::NotIntegral:
+        return "Non-integral type";
+    case Fault::NotComparable:
+        return "Values of this type can't be compared";
+    case Fault::InvalidConversion:
+        return "Invalid type for conversion";
+    case Fault::DivisionByZero:
+        return "Division by zero";
+    case Fault::RemainderByZero:
+        return "Remainder by zero";
+    case Fault::ExpectedReference:
+        return "Invalid type (expected a reference)";
+    case Fault::ExpectedUint32:
+        return "Invalid type (expected u32)";
+    case Fault::InvalidElementType:
+        return "Unsupported array element type";
+    case Fault::IndexOutOfRange:
+        return "Index outside of the array";
+    case Fault::IncompatibleElement:
+        return "Store of value with incompatible type";
+    case Fault::InvalidInstruction:
+        return "Invalid instruction";
+    default:
+        return "<err>";
+    }
+}
+
+RuntimeError::RuntimeError(Fault fault, std::string function, uint32_t offset, std::string operands)
+    :_fault{ fault }, _function{ std::move(function) }, _offset{ offset }, _message{ FaultToString(fault) } {
+    if (!operands.empty())
+        _message += " [" + operands + "]";
+
+    char location[16];
+    std::snprintf(location, sizeof(location), "0x%04x", _offset);
+    _message += std::string(" (in ") + _function + " at " + location + ")";
+}
+
+[[nodiscard]] auto RuntimeError::what() const noexcept -> const char* {
+    return _message.c_str();
+}
+
+[[nodiscard]] auto RuntimeError::Cause() const noexcept -> Fault {
+    return _fault;
+}
+
+[[nodiscard]] auto RuntimeError::Function() const noexcept -> const std::string& {
+    return _function;
+}
+
+[[nodiscard]] auto RuntimeError::Offset() const noexcept -> uint32_t {
+    return _offset;
+}
+
 InstructionError::InstructionError(std::string message)
     :_message{ std::move(message) } {
 }
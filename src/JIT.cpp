@@ -0,0 +1,2362 @@
+// My header files
+#include "../include/JIT.hpp"
+#include "../include/Analysis.hpp"
+#include "../include/VM.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+#ifdef YUN_JIT
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace Yun::VM::JIT {
+
+// Templates read payloads and types of registers from arrays of their own
+static_assert(sizeof(Primitives::Payload) == 8 && sizeof(Primitives::Type) == 1);
+
+ExecutableMemory::ExecutableMemory() noexcept
+    :_mappings{  } {
+}
+
+ExecutableMemory::~ExecutableMemory() {
+#ifdef YUN_JIT
+    for (const auto& [memory, size] : _mappings)
+        munmap(memory, size);
+#endif
+}
+
+// Copies the code into fresh pages and makes them executable. Returns nullptr if that fails
+[[nodiscard]] auto ExecutableMemory::Load(const std::vector<uint8_t>& code) -> const uint8_t* {
+#ifdef YUN_JIT
+    if (code.empty())
+        return nullptr;
+
+    const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const auto size = (code.size() + page - 1) / page * page;
+
+    auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+
+    _mappings.emplace_back(memory, size);
+    return static_cast<const uint8_t*>(memory);
+#else
+    static_cast<void>(code);
+    return nullptr;
+#endif
+}
+
+// Condition codes of `jcc rel32`, the second byte after 0x0F
+constexpr uint8_t Always       = 0x00;
+constexpr uint8_t Equal        = 0x84;
+constexpr uint8_t NotEqual     = 0x85;
+constexpr uint8_t Below        = 0x82;
+constexpr uint8_t AboveEqual   = 0x83;
+constexpr uint8_t BelowEqual   = 0x86;
+constexpr uint8_t Above        = 0x87;
+constexpr uint8_t Less         = 0x8C;
+constexpr uint8_t GreaterEqual = 0x8D;
+constexpr uint8_t LessEqual    = 0x8E;
+constexpr uint8_t Greater      = 0x8F;
+
+// The few x86-64 instructions the templates need. Native code keeps the base of
+// the current frame in rbx, the address of the flags in r12, the count of registers
+// shared with the caller in r13d, the VM in r14 and the base of the frame's types
+// in r15. The payload of register `n` of the current frame is at [rbx + n * 8], its
+// type at [r15 + n]
+class CodeBuffer {
+    public:
+        CodeBuffer(std::vector<uint8_t>& code) noexcept
+            :_code{ code } {
+        }
+
+    public:
+        [[nodiscard]] auto Size() const noexcept -> size_t {
+            return _code.size();
+        }
+
+        auto Bytes(std::initializer_list<uint8_t> bytes) -> void {
+            _code.insert(_code.end(), bytes);
+        }
+
+        auto Dword(uint32_t value) -> void {
+            for (size_t i = 0; i != 4; ++i)
+                _code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        auto Qword(uint64_t value) -> void {
+            for (size_t i = 0; i != 8; ++i)
+                _code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        // `opcode` with a [rbx + disp32] operand. `field` is the other register or an opcode extension
+        auto Memory(const std::vector<uint8_t>& opcode, uint8_t field, uint32_t displacement) -> void {
+            _code.insert(_code.end(), opcode.begin(), opcode.end());
+            _code.push_back(0x80 | (field << 3) | 0x03);
+            Dword(displacement);
+        }
+
+        // `opcode` on two general purpose registers, one in the reg field and the
+        // other one in r/m. `wide` picks the 64-bit form
+        auto Register(const std::vector<uint8_t>& opcode, uint8_t reg, uint8_t rm, bool wide) -> void {
+            Rex(wide, reg, rm);
+            _code.insert(_code.end(), opcode.begin(), opcode.end());
+            _code.push_back(0xC0 | (reg & 7) << 3 | (rm & 7));
+        }
+
+        // `opcode` with a [r15 + disp32] operand, for the types of registers
+        auto TagMemory(const std::vector<uint8_t>& opcode, uint8_t field, uint32_t displacement, bool wide = false) -> void {
+            Rex(wide, field, 15);
+            _code.insert(_code.end(), opcode.begin(), opcode.end());
+            _code.push_back(0x80 | (field & 7) << 3 | 0x07);
+            Dword(displacement);
+        }
+
+        // Same as `Memory`, with a register in the reg field
+        auto RegisterMemory(const std::vector<uint8_t>& opcode, uint8_t reg, uint32_t displacement, bool wide) -> void {
+            Rex(wide, reg, 0);
+            _code.insert(_code.end(), opcode.begin(), opcode.end());
+            _code.push_back(0x80 | (reg & 7) << 3 | 0x03);
+            Dword(displacement);
+        }
+
+        // SSE instructions take their mandatory prefix, if any, before the REX prefix
+        auto Sse(uint8_t prefix, uint8_t opcode, uint8_t reg, uint8_t rm) -> void {
+            if (prefix != 0)
+                _code.push_back(prefix);
+            Rex(false, reg, rm);
+            Bytes({ 0x0F, opcode });
+            _code.push_back(0xC0 | (reg & 7) << 3 | (rm & 7));
+        }
+
+        auto SseMemory(uint8_t prefix, uint8_t opcode, uint8_t reg, uint32_t displacement) -> void {
+            if (prefix != 0)
+                _code.push_back(prefix);
+            Rex(false, reg, 0);
+            Bytes({ 0x0F, opcode });
+            _code.push_back(0x80 | (reg & 7) << 3 | 0x03);
+            Dword(displacement);
+        }
+
+        // mov reg, immediate - the 32-bit form clears the upper half
+        auto MoveImmediate(uint8_t reg, uint64_t value, bool wide) -> void {
+            Rex(wide, 0, reg);
+            _code.push_back(0xB8 | (reg & 7));
+            if (wide)
+                Qword(value);
+            else
+                Dword(static_cast<uint32_t>(value));
+        }
+
+        // Returns the position of the offset, to be patched once the target is known
+        [[nodiscard]] auto Jump(uint8_t condition) -> size_t {
+            if (condition == Always)
+                Bytes({ 0xE9 });
+            else
+                Bytes({ 0x0F, condition });
+            Dword(0);
+            return Size() - 4;
+        }
+
+        auto Truncate(size_t size) -> void {
+            _code.resize(size);
+        }
+
+        auto Patch(size_t at, size_t target) noexcept -> void {
+            const auto offset = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+            std::memcpy(&_code[at], &offset, sizeof(offset));
+        }
+
+    public:
+        // Returns the size of the prologue - a tail call jumps right past it
+        [[nodiscard]] auto Prologue(const Runtime& runtime) -> size_t {
+            const auto begin = Size();
+            Bytes({ 0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56 });  // push rbp, rbx, r12, r13, r14
+            Bytes({ 0x41, 0x57, 0x48, 0x83, 0xEC, 0x08 });              // push r15, sub rsp, 8
+            Bytes({ 0x48, 0x89, 0xFB });                                // mov rbx, rdi
+            Bytes({ 0x49, 0x89, 0xF7 });                                // mov r15, rsi
+            Bytes({ 0x41, 0x89, 0xD5 });                                // mov r13d, edx
+            Bytes({ 0x49, 0xBC });                                      // mov r12, flags
+            Qword(reinterpret_cast<uint64_t>(runtime.Flags));
+            Bytes({ 0x49, 0xBE });                                      // mov r14, vm
+            Qword(reinterpret_cast<uint64_t>(runtime.Context));
+            return Size() - begin;
+        }
+
+        auto Return(uint32_t registers) -> void {
+            Bytes({ 0xB8 });                                            // mov eax, registers
+            Dword(registers);
+            Bytes({ 0x48, 0x83, 0xC4, 0x08, 0x41, 0x5F });              // add rsp, 8, pop r15
+            Bytes({ 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D });  // pop r14, r13, r12, rbx, rbp
+            Bytes({ 0xC3 });                                            // ret
+        }
+
+        auto CallAbsolute(const void* function) -> void {
+            Bytes({ 0x48, 0xB8 });                                      // mov rax, function
+            Qword(reinterpret_cast<uint64_t>(function));
+            Bytes({ 0xFF, 0xD0 });                                      // call rax
+        }
+
+        // Execute(vm, index << 8 | opcode, &dest, &dest type, &src or constant, &its type)
+        // `at` is the index of the instruction in the code, so a fault can tell where it happened
+        auto Execute(const Runtime& runtime, Instructions::Opcode opcode, size_t at, uint32_t dest, uint32_t src, const Primitives::Value* constant) -> void {
+            Bytes({ 0x4C, 0x89, 0xF7 });                                // mov rdi, r14
+            Bytes({ 0xBE });                                            // mov esi, index << 8 | opcode
+            Dword(static_cast<uint32_t>(at << 8) | static_cast<uint32_t>(opcode));
+            Memory({ 0x48, 0x8D }, 2, Payload(dest));                   // lea rdx, [dest]
+            TagMemory({ 0x8D }, 1, Tag(dest), true);                    // lea rcx, [r15 + dest]
+            if (constant != nullptr) {
+                Bytes({ 0x49, 0xB8 });                                  // mov r8, constant
+                Qword(reinterpret_cast<uint64_t>(constant->AsPtr()));
+                Bytes({ 0x49, 0xB9 });                                  // mov r9, constant type
+                Qword(reinterpret_cast<uint64_t>(constant->TypePtr()));
+            } else {
+                Memory({ 0x4C, 0x8D }, 0, Payload(src));                // lea r8, [src]
+                TagMemory({ 0x8D }, 9, Tag(src), true);                 // lea r9, [r15 + src]
+            }
+            CallAbsolute(reinterpret_cast<const void*>(runtime.Execute));
+        }
+
+        // Notify(vm, &reg, &reg type, increment)
+        auto Notify(const Runtime& runtime, uint32_t reg, bool increment) -> void {
+            Bytes({ 0x4C, 0x89, 0xF7 });                                // mov rdi, r14
+            Memory({ 0x48, 0x8D }, 6, Payload(reg));                    // lea rsi, [reg]
+            TagMemory({ 0x8D }, 2, Tag(reg), true);                     // lea rdx, [r15 + reg]
+            Bytes({ 0xB9 });                                            // mov ecx, increment
+            Dword(increment);
+            CallAbsolute(reinterpret_cast<const void*>(runtime.Notify));
+        }
+
+        // Call(vm, callee, registers, shared), then reload the frame base
+        auto Call(const Runtime& runtime, const FunctionDescriptor* callee, uint32_t registers, uint32_t shared) -> void {
+            Bytes({ 0x4C, 0x89, 0xF7 });                                // mov rdi, r14
+            Bytes({ 0x48, 0xBE });                                      // mov rsi, callee
+            Qword(reinterpret_cast<uint64_t>(callee));
+            Bytes({ 0xBA });                                            // mov edx, registers
+            Dword(registers);
+            Bytes({ 0xB9 });                                            // mov ecx, shared
+            Dword(shared);
+            CallAbsolute(reinterpret_cast<const void*>(runtime.Call));
+            Bytes({ 0x48, 0x89, 0xC3 });                                // mov rbx, rax
+            Bytes({ 0x49, 0x89, 0xD7 });                                // mov r15, rdx
+        }
+
+        // TailCall(vm, callee, registers), then jump into the callee past its prologue
+        auto TailCall(const Runtime& runtime, const FunctionDescriptor* callee, uint32_t registers, size_t prologue) -> void {
+            Bytes({ 0x4C, 0x89, 0xF7 });                                // mov rdi, r14
+            Bytes({ 0x48, 0xBE });                                      // mov rsi, callee
+            Qword(reinterpret_cast<uint64_t>(callee));
+            Bytes({ 0xBA });                                            // mov edx, registers
+            Dword(registers);
+            CallAbsolute(reinterpret_cast<const void*>(runtime.TailCall));
+            Bytes({ 0x48, 0x89, 0xC3 });                                // mov rbx, rax
+            Bytes({ 0x49, 0x89, 0xD7 });                                // mov r15, rdx
+            Bytes({ 0x48, 0xB8 });                                      // mov rax, &callee->Native
+            Qword(reinterpret_cast<uint64_t>(&callee->Native));
+            Bytes({ 0x48, 0x8B, 0x00 });                                // mov rax, [rax]
+            Bytes({ 0x48, 0x05 });                                      // add rax, prologue
+            Dword(static_cast<uint32_t>(prologue));
+            Bytes({ 0xFF, 0xE0 });                                      // jmp rax
+        }
+
+    public:
+        [[nodiscard]] static constexpr auto Payload(uint32_t reg) noexcept -> uint32_t {
+            return reg * 8;
+        }
+
+        [[nodiscard]] static constexpr auto Tag(uint32_t reg) noexcept -> uint32_t {
+            return reg;
+        }
+
+    private:
+        auto Rex(bool wide, uint8_t reg, uint8_t rm) -> void {
+            const uint8_t rex = 0x40 | (wide? 0x08 : 0) | (reg >= 8? 0x04 : 0) | (rm >= 8? 0x01 : 0);
+            if (rex != 0x40)
+                _code.push_back(rex);
+        }
+
+    private:
+        std::vector<uint8_t>& _code;
+};
+
+// A call into the runtime for whatever the inline template can't handle, placed after the function
+class SlowPath {
+    public:
+        std::vector<size_t>       Entries;      // Jumps that lead here
+        size_t                    Resume;       // Where to continue
+        Instructions::Opcode      Opcode;
+        size_t                    Index;        // Into the code
+        uint32_t                  Dest;
+        uint32_t                  Src;
+        const Primitives::Value*  Constant;
+};
+
+// Type all operands of a 64-bit operation must have
+[[nodiscard]] static constexpr auto OperandType(Instructions::Opcode opcode) noexcept -> Primitives::Type {
+    using Instructions::Opcode;
+    switch (opcode) {
+    case Opcode::i64add:
+    case Opcode::i64sub:
+    case Opcode::i64mul:
+    case Opcode::i64and:
+    case Opcode::i64or:
+    case Opcode::i64xor:
+    case Opcode::icmp:
+        return Primitives::Type::Int64;
+    case Opcode::u64add:
+    case Opcode::u64sub:
+    case Opcode::u64mul:
+    case Opcode::u64and:
+    case Opcode::u64or:
+    case Opcode::u64xor:
+    case Opcode::cmp:
+        return Primitives::Type::Uint64;
+    case Opcode::f64add:
+    case Opcode::f64sub:
+    case Opcode::f64mul:
+    case Opcode::f64div:
+    case Opcode::fcmp:
+        return Primitives::Type::Float64;
+    default:
+        return Primitives::Type::Uninit;
+    }
+}
+
+// Opcode of `op rax, [mem]` or `op xmm0, [mem]`
+[[nodiscard]] static auto Operation(Instructions::Opcode opcode) -> std::vector<uint8_t> {
+    using Instructions::Opcode;
+    switch (opcode) {
+    case Opcode::i64add:
+    case Opcode::u64add:
+        return { 0x48, 0x03 };
+    case Opcode::i64sub:
+    case Opcode::u64sub:
+        return { 0x48, 0x2B };
+    case Opcode::i64mul:
+    case Opcode::u64mul:
+        return { 0x48, 0x0F, 0xAF };
+    case Opcode::i64and:
+    case Opcode::u64and:
+        return { 0x48, 0x23 };
+    case Opcode::i64or:
+    case Opcode::u64or:
+        return { 0x48, 0x0B };
+    case Opcode::i64xor:
+    case Opcode::u64xor:
+        return { 0x48, 0x33 };
+    case Opcode::f64add:
+        return { 0xF2, 0x0F, 0x58 };
+    case Opcode::f64sub:
+        return { 0xF2, 0x0F, 0x5C };
+    case Opcode::f64mul:
+        return { 0xF2, 0x0F, 0x59 };
+    case Opcode::f64div:
+        return { 0xF2, 0x0F, 0x5E };
+    default:
+        return {  };
+    }
+}
+
+// Condition of a jump or select, which tests the flags against zero
+[[nodiscard]] static constexpr auto Condition(Instructions::Opcode opcode) noexcept -> uint8_t {
+    using Instructions::Opcode;
+    switch (opcode) {
+    case Opcode::je:
+    case Opcode::cmove:
+        return Equal;
+    case Opcode::jne:
+    case Opcode::cmovne:
+        return NotEqual;
+    case Opcode::jgt:
+    case Opcode::cmovgt:
+        return Greater;
+    case Opcode::jge:
+    case Opcode::cmovge:
+        return GreaterEqual;
+    case Opcode::jlt:
+    case Opcode::cmovlt:
+        return Less;
+    case Opcode::jle:
+    case Opcode::cmovle:
+        return LessEqual;
+    default:
+        return Always;
+    }
+}
+
+// The /digit of `shl`, `sar` or `shr r/m, cl`
+[[nodiscard]] static constexpr auto ShiftOperation(Instructions::Opcode opcode) noexcept -> uint8_t {
+    using Instructions::Opcode;
+    switch (opcode) {
+    case Opcode::i32shl: case Opcode::i64shl: case Opcode::u32shl: case Opcode::u64shl:
+        return 4;
+    case Opcode::u32shr: case Opcode::u64shr:
+        return 5;
+    case Opcode::i32shr: case Opcode::i64shr:
+        return 7;
+    default:
+        return 0;
+    }
+}
+
+// Type of the value a shift shifts. The count is always a `Uint32`
+[[nodiscard]] static constexpr auto ShiftType(Instructions::Opcode opcode) noexcept -> Primitives::Type {
+    using Instructions::Opcode;
+    using Primitives::Type;
+    switch (opcode) {
+    case Opcode::i32shl: case Opcode::i32shr:
+        return Type::Int32;
+    case Opcode::i64shl: case Opcode::i64shr:
+        return Type::Int64;
+    case Opcode::u32shl: case Opcode::u32shr:
+        return Type::Uint32;
+    case Opcode::u64shl: case Opcode::u64shr:
+        return Type::Uint64;
+    default:
+        return Type::Uninit;
+    }
+}
+
+// The templates shared by functions and traces. Their operands are known to have the right types
+
+// op [dest], [src] for the 64-bit integer and floating point arithmetic
+static auto Arithmetic(CodeBuffer& buffer, Instructions::Opcode opcode, uint32_t dest, uint32_t src) -> void {
+    if (OperandType(opcode) == Primitives::Type::Float64) {
+        buffer.Memory({ 0xF2, 0x0F, 0x10 }, 0, CodeBuffer::Payload(dest));  // movsd xmm0, [dest]
+        buffer.Memory(Operation(opcode), 0, CodeBuffer::Payload(src));      // op xmm0, [src]
+        buffer.Memory({ 0xF2, 0x0F, 0x11 }, 0, CodeBuffer::Payload(dest));  // movsd [dest], xmm0
+    } else {
+        buffer.Memory({ 0x48, 0x8B }, 0, CodeBuffer::Payload(dest));        // mov rax, [dest]
+        buffer.Memory(Operation(opcode), 0, CodeBuffer::Payload(src));      // op rax, [src]
+        buffer.Memory({ 0x48, 0x89 }, 0, CodeBuffer::Payload(dest));        // mov [dest], rax
+    }
+}
+
+// shl, sar or shr [dest] by [src], for the 64-bit shifts
+static auto Shift(CodeBuffer& buffer, Instructions::Opcode opcode, uint32_t dest, uint32_t src) -> void {
+    buffer.Memory({ 0x48, 0x8B }, 0, CodeBuffer::Payload(dest));            // mov rax, [dest]
+    buffer.Memory({ 0x8B }, 1, CodeBuffer::Payload(src));                   // mov ecx, [src]
+    buffer.Bytes({ 0x48, 0xD3, static_cast<uint8_t>(0xC0 | ShiftOperation(opcode) << 3) });    // op rax, cl
+    buffer.Memory({ 0x48, 0x89 }, 0, CodeBuffer::Payload(dest));            // mov [dest], rax
+}
+
+// Sets the flags to -1, 0 or 1. Unordered values compare equal, like in `Value::Compare`
+static auto Compare(CodeBuffer& buffer, Instructions::Opcode opcode, uint32_t dest, uint32_t src) -> void {
+    using Instructions::Opcode;
+    if (opcode == Opcode::fcmp) {
+        buffer.Memory({ 0xF2, 0x0F, 0x10 }, 0, CodeBuffer::Payload(dest));  // movsd xmm0, [dest]
+        buffer.Memory({ 0xF2, 0x0F, 0x10 }, 1, CodeBuffer::Payload(src));   // movsd xmm1, [src]
+        buffer.Bytes({ 0x66, 0x0F, 0x2E, 0xC1 });                           // ucomisd xmm0, xmm1
+        buffer.Bytes({ 0x0F, 0x97, 0xC1 });                                 // seta cl
+        buffer.Bytes({ 0x66, 0x0F, 0x2E, 0xC8 });                           // ucomisd xmm1, xmm0
+        buffer.Bytes({ 0x0F, 0x97, 0xC2 });                                 // seta dl
+    } else {
+        buffer.Memory({ 0x48, 0x8B }, 0, CodeBuffer::Payload(dest));        // mov rax, [dest]
+        buffer.Memory({ 0x48, 0x3B }, 0, CodeBuffer::Payload(src));         // cmp rax, [src]
+        if (opcode == Opcode::cmp)
+            buffer.Bytes({ 0x0F, 0x97, 0xC1, 0x0F, 0x92, 0xC2 });           // seta cl, setb dl
+        else
+            buffer.Bytes({ 0x0F, 0x9F, 0xC1, 0x0F, 0x9C, 0xC2 });           // setg cl, setl dl
+    }
+    buffer.Bytes({ 0x0F, 0xB6, 0xC9, 0x0F, 0xB6, 0xD2 });                   // movzx ecx, cl; movzx edx, dl
+    buffer.Bytes({ 0x29, 0xD1 });                                           // sub ecx, edx
+    buffer.Bytes({ 0x41, 0x89, 0x0C, 0x24 });                               // mov [r12], ecx
+}
+
+// Neither the constant nor the old value of `dest` is a reference
+static auto LoadConstant(CodeBuffer& buffer, uint32_t dest, const Primitives::Value& constant) -> void {
+    buffer.Bytes({ 0x48, 0xB8 });                                           // mov rax, payload
+    buffer.Qword(constant.As<uint64_t>());
+    buffer.Memory({ 0x48, 0x89 }, 0, CodeBuffer::Payload(dest));           // mov [dest], rax
+    buffer.TagMemory({ 0xC6 }, 0, CodeBuffer::Tag(dest));                      // mov byte [r15 + dest], type
+    buffer.Bytes({ static_cast<uint8_t>(constant.Typeof()) });
+}
+
+// Copies a whole register, without any reference counting
+static auto Move(CodeBuffer& buffer, uint32_t dest, uint32_t src) -> void {
+    buffer.Memory({ 0x48, 0x8B }, 0, CodeBuffer::Payload(src));            // mov rax, [src]
+    buffer.Memory({ 0x48, 0x89 }, 0, CodeBuffer::Payload(dest));           // mov [dest], rax
+    buffer.TagMemory({ 0x0F, 0xB6 }, 0, CodeBuffer::Tag(src));                // movzx eax, byte [r15 + src]
+    buffer.TagMemory({ 0x88 }, 0, CodeBuffer::Tag(dest));                      // mov [r15 + dest], al
+}
+
+// Same as `Move` if the flags say so, and leaves the destination alone otherwise, without a branch
+static auto Select(CodeBuffer& buffer, Instructions::Opcode opcode, uint32_t dest, uint32_t src) -> void {
+    const auto move = static_cast<uint8_t>(Condition(opcode) - 0x40);           // cmovcc has the condition of jcc
+    buffer.Bytes({ 0x41, 0x83, 0x3C, 0x24, 0x00 });                             // cmp dword [r12], 0
+    buffer.Memory({ 0x48, 0x8B }, 0, CodeBuffer::Payload(dest));                // mov rax, [dest]
+    buffer.Memory({ 0x48, 0x0F, move }, 0, CodeBuffer::Payload(src));           // cmovcc rax, [src]
+    buffer.Memory({ 0x48, 0x89 }, 0, CodeBuffer::Payload(dest));                // mov [dest], rax
+    buffer.TagMemory({ 0x0F, 0xB6 }, 0, CodeBuffer::Tag(dest));                 // movzx eax, byte [r15 + dest]
+    buffer.TagMemory({ 0x0F, 0xB6 }, 11, CodeBuffer::Tag(src));                 // movzx r11d, byte [r15 + src]
+    buffer.Register({ 0x0F, move }, 0, 11, false);                              // cmovcc eax, r11d
+    buffer.TagMemory({ 0x88 }, 0, CodeBuffer::Tag(dest));                       // mov [r15 + dest], al
+}
+
+// Type of a register nothing is known about, like one a trace hasn't checked or written yet
+constexpr auto Unknown = static_cast<Primitives::Type>(0xFF);
+
+// Old values of registers of an unknown type might be references, which have to be counted down
+[[nodiscard]] static constexpr auto MightBeReference(Primitives::Type type) noexcept -> bool {
+    return type == Primitives::Type::Reference || type == Unknown;
+}
+
+// Registers the optimizing compiler keeps values in. rax, r11, xmm0 and xmm15
+// are left for the templates, and every call into the VM or another function
+// wipes all of them but rbp - the prologue saves that one
+constexpr std::array<uint8_t, 8> Gprs{ 1, 2, 6, 7, 8, 9, 10, 5 };     // rcx, rdx, rsi, rdi, r8 - r10, rbp
+constexpr std::array<uint8_t, 14> Xmms{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 };
+constexpr uint8_t Rax   = 0;
+constexpr uint8_t Rcx   = 1;
+constexpr uint8_t Rbp   = 5;
+constexpr uint8_t R11   = 11;
+constexpr uint8_t Xmm0  = 0;
+constexpr uint8_t Xmm15 = 15;
+
+// Types whose values can leave the `RegisterArray` for a machine register
+[[nodiscard]] static constexpr auto Unboxed(Primitives::Type type) noexcept -> bool {
+    using Primitives::Type;
+    return type == Type::Int32 || type == Type::Int64 || type == Type::Uint32 || type == Type::Uint64 || type == Type::Float64;
+}
+
+[[nodiscard]] static constexpr auto Wide(Primitives::Type type) noexcept -> bool {
+    return type == Primitives::Type::Int64 || type == Primitives::Type::Uint64;
+}
+
+// Integer arithmetic done inline by the optimizing compiler, as `op reg, r/m`
+[[nodiscard]] static auto IntegerOperation(Instructions::Opcode opcode) -> std::vector<uint8_t> {
+    using Instructions::Opcode;
+    switch (opcode) {
+    case Opcode::i32add: case Opcode::i64add: case Opcode::u32add: case Opcode::u64add:
+        return { 0x03 };
+    case Opcode::i32sub: case Opcode::i64sub: case Opcode::u32sub: case Opcode::u64sub:
+        return { 0x2B };
+    case Opcode::i32mul: case Opcode::i64mul: case Opcode::u32mul: case Opcode::u64mul:
+        return { 0x0F, 0xAF };
+    case Opcode::i32and: case Opcode::i64and: case Opcode::u32and: case Opcode::u64and:
+        return { 0x23 };
+    case Opcode::i32or: case Opcode::i64or: case Opcode::u32or: case Opcode::u64or:
+        return { 0x0B };
+    case Opcode::i32xor: case Opcode::i64xor: case Opcode::u32xor: case Opcode::u64xor:
+        return { 0x33 };
+    default:
+        return {  };
+    }
+}
+
+// Second opcode byte of `opsd xmm, xmm/m64`
+[[nodiscard]] static constexpr auto FloatOperation(Instructions::Opcode opcode) noexcept -> uint8_t {
+    using Instructions::Opcode;
+    switch (opcode) {
+    case Opcode::f64add:
+        return 0x58;
+    case Opcode::f64mul:
+        return 0x59;
+    case Opcode::f64sub:
+        return 0x5C;
+    case Opcode::f64div:
+        return 0x5E;
+    default:
+        return 0;
+    }
+}
+
+// Type both operands of an inline arithmetic instruction have
+[[nodiscard]] static constexpr auto ArithmeticType(Instructions::Opcode opcode) noexcept -> Primitives::Type {
+    using Instructions::Opcode;
+    using Primitives::Type;
+    switch (opcode) {
+    case Opcode::i32add: case Opcode::i32sub: case Opcode::i32mul: case Opcode::i32and: case Opcode::i32or: case Opcode::i32xor:
+        return Type::Int32;
+    case Opcode::u32add: case Opcode::u32sub: case Opcode::u32mul: case Opcode::u32and: case Opcode::u32or: case Opcode::u32xor:
+        return Type::Uint32;
+    case Opcode::i64add: case Opcode::i64sub: case Opcode::i64mul: case Opcode::i64and: case Opcode::i64or: case Opcode::i64xor:
+        return Type::Int64;
+    case Opcode::u64add: case Opcode::u64sub: case Opcode::u64mul: case Opcode::u64and: case Opcode::u64or: case Opcode::u64xor:
+        return Type::Uint64;
+    case Opcode::f64add: case Opcode::f64sub: case Opcode::f64mul: case Opcode::f64div:
+        return Type::Float64;
+    default:
+        return Type::Uninit;
+    }
+}
+
+// A value of an optimized function: the definitions of a register that reach
+// some common use, along with these uses. Its type is known if all of them
+// leave the same unboxed type, and then it may live in a machine register
+struct Web {
+    uint32_t         Slot;      // The register of the frame it belongs to
+    Primitives::Type Type;      // `Unknown` if it stays boxed in the frame
+    int16_t          Register;  // -1 if it stays in the frame
+    size_t           Start;     // First and last instruction it's live at
+    size_t           End;
+};
+
+// Where an operand is right now: a machine register or its place in the frame
+struct Place {
+    bool     InRegister;
+    uint32_t Number;
+};
+
+// A detour taken right before an instruction, placed after the function
+struct Detour {
+    size_t   Jump;
+    size_t   Instruction;
+    uint32_t Register;
+    bool     Flags;         // Stores the result of a fused comparison instead of releasing a reference
+    size_t   Target;        // Where the fused jump goes
+};
+
+// Optimizing compiler for functions the verifier has proven. Registers are
+// split into webs - SSA values joined wherever they meet at a use - which
+// get their types from the verifier. Unboxed ones are given machine registers
+// by linear scan and only go back to the frame around calls into the VM and
+// other functions. Everything else stays in the frame, like in the baseline
+class MethodWriter {
+    public:
+        MethodWriter(const ExecutionUnit& unit, const Runtime& runtime, size_t function, const std::vector<Emit::Instruction>& body, const Analysis::RegisterTypes& types, const std::vector<FunctionDescriptor>& functions, CodeBuffer& buffer)
+            :_unit{ unit }, _runtime{ runtime }, _symbol{ unit.Symbols().At(function) }, _symbols{ unit.Symbols() }, _body{ body },
+             _types{ types }, _functions{ functions }, _buffer{ buffer }, _graph{ body }, _liveness{ body, _graph, _symbol, _symbols },
+             _reachable{  }, _uses{  }, _defs{  }, _before{  }, _after{  }, _webs{  }, _inline{  }, _shared{  }, _release{  },
+             _flags{  }, _defined{  }, _offsets{  }, _jumps{  }, _detours{  } {
+        }
+
+    public:
+        // Returns false if the function is left to the baseline compiler
+        [[nodiscard]] auto Analyze() -> bool {
+            using Instructions::Opcode;
+
+            const auto count = _body.size();
+            if (_types.Before.size() != count || _types.After.size() != count)
+                return false;
+
+            // A tail call that turns into an ordinary call returns right after it
+            for (size_t i = 0; i != count; ++i) {
+                if (_body[i].Opcode() != Opcode::tailcall)
+                    continue;
+                else if (i + 1 < count && _body[i + 1].Opcode() == Opcode::ret)
+                    continue;
+                else if (i + 2 < count && _body[i + 1].Opcode() == Opcode::mov && _body[i + 2].Opcode() == Opcode::ret)
+                    continue;
+                return false;
+            }
+
+            FindReachable();
+            FindWebs();
+            Allocate();
+            FindReleases();
+            FindLiveFlags();
+            return true;
+        }
+
+        // Returns where the entries for the targets of backward jumps begin
+        auto Write() -> std::vector<std::pair<size_t, size_t>> {
+            using Instructions::Opcode;
+
+            const auto count = _body.size();
+            const auto prologue = _buffer.Prologue(_runtime);
+            Enter(0);
+
+            std::vector<bool> loopHeaders(count, false);
+            _offsets.assign(count, 0);
+            for (size_t i = 0; i != count; ++i) {
+                _offsets[i] = _buffer.Size();
+                if (!_reachable[i])
+                    continue;
+
+                const auto& instruction = _body[i];
+                const auto opcode = instruction.Opcode();
+                if (Instructions::IsJump(opcode)) {
+                    const auto target = static_cast<size_t>(Analysis::JumpTarget(instruction, i));
+                    if (target <= i)
+                        loopHeaders[target] = true;
+                    if (i != 0 && Fuses(i - 1))
+                        continue;
+
+                    if (opcode != Opcode::jmp)
+                        _buffer.Bytes({ 0x41, 0x83, 0x3C, 0x24, 0x00 });   // cmp dword [r12], 0
+                    _jumps.emplace_back(_buffer.Jump(Condition(opcode)), target);
+                    continue;
+                }
+
+                if (_release[i]) {
+                    _buffer.TagMemory({ 0x80 }, 7, CodeBuffer::Tag(instruction.Destination()));  // cmp byte [r15 + dest], Reference
+                    _buffer.Bytes({ static_cast<uint8_t>(Primitives::Type::Reference) });
+                    _detours.push_back({ _buffer.Jump(Equal), i, static_cast<uint32_t>(instruction.Destination()), false, 0 });
+                    _detours.back().Target = _buffer.Size();
+                }
+
+                switch (opcode) {
+                case Opcode::call:
+                    Call(i);
+                    break;
+                case Opcode::tailcall:
+                    TailCall(i, prologue);
+                    break;
+                case Opcode::ret:
+                    if (_symbol.DoesReturn && _symbol.Registers != 0)
+                        Box(Use(i, 0), 0);
+                    _buffer.Return(_symbol.Registers);
+                    break;
+                case Opcode::nop:
+                    break;
+                default:
+                    if (!_inline[i])
+                        Execute(i);
+                    else if (opcode == Opcode::cmp || opcode == Opcode::icmp || opcode == Opcode::fcmp)
+                        Compare(i);
+                    else if (opcode == Opcode::ldconst)
+                        LoadConstant(i);
+                    else if (opcode == Opcode::mov)
+                        Move(i);
+                    else if (Instructions::IsSelect(opcode))
+                        Select(i);
+                    else if (ShiftType(opcode) != Primitives::Type::Uninit)
+                        Shift(i);
+                    else
+                        Arithmetic(i);
+                    break;
+                }
+            }
+
+            WriteDetours();
+
+            // A loop entry sets up a native frame like the prologue does, then jumps into the loop
+            std::vector<std::pair<size_t, size_t>> entries;
+            for (size_t i = 0; i != count; ++i) {
+                if (!loopHeaders[i])
+                    continue;
+                entries.emplace_back(i, _buffer.Size());
+                static_cast<void>(_buffer.Prologue(_runtime));
+                Enter(i);
+                _jumps.emplace_back(_buffer.Jump(Always), i);
+            }
+
+            for (const auto& [at, target] : _jumps)
+                _buffer.Patch(at, _offsets[target]);
+            return entries;
+        }
+
+    private:
+        // Registers an instruction reads, and the one it writes, if any
+        auto Effects(size_t i, std::vector<uint32_t>& uses) const -> int64_t {
+            using Instructions::Opcode;
+
+            const auto& instruction = _body[i];
+            const auto opcode = instruction.Opcode();
+            const auto dest   = static_cast<uint32_t>(instruction.Destination());
+            const auto src    = static_cast<uint32_t>(instruction.Source());
+            const uint32_t registers = _symbol.Registers;
+            uses.clear();
+
+            if (Instructions::IsJump(opcode))
+                return -1;
+
+            switch (opcode) {
+            case Opcode::call:
+            case Opcode::tailcall: {
+                // Arguments are the last registers, the return value goes to the last one
+                const auto& callee = _symbols.At(dest);
+                for (auto reg = registers - std::min<uint32_t>(callee.Arguments, registers); reg != registers; ++reg)
+                    uses.push_back(reg);
+                return opcode == Opcode::call && callee.DoesReturn && registers != 0? static_cast<int64_t>(registers - 1) : -1;
+            }
+            case Opcode::ret:
+                if (_symbol.DoesReturn && registers != 0)
+                    uses.push_back(0);
+                return -1;
+            case Opcode::nop:
+            case Opcode::hlt:
+                return -1;
+            case Opcode::ldconst:
+                return dest;
+            case Opcode::mov:
+            case Opcode::load:
+            case Opcode::arraycount:
+                uses.push_back(src);
+                return dest;
+            case Opcode::cmp:
+            case Opcode::icmp:
+            case Opcode::fcmp:
+            case Opcode::store:
+                uses.push_back(dest);
+                uses.push_back(src);
+                return -1;
+            case Opcode::printreg:
+                uses.push_back(dest);
+                return -1;
+            default:
+                uses.push_back(dest);
+                if (Instructions::OpcodeCount(opcode) == 2)
+                    uses.push_back(src);
+                return dest;
+            }
+        }
+
+        auto FindReachable() -> void {
+            const auto& blocks = _graph.Blocks();
+            std::vector<bool> reached(blocks.size(), false);
+            std::vector<size_t> worklist{ 0 };
+            reached[0] = true;
+            while (!worklist.empty()) {
+                const auto block = worklist.back();
+                worklist.pop_back();
+                for (auto successor : blocks[block].Successors)
+                    if (!reached[successor]) {
+                        reached[successor] = true;
+                        worklist.push_back(successor);
+                    }
+            }
+
+            _reachable.assign(_body.size(), false);
+            for (size_t block = 0; block != blocks.size(); ++block)
+                for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+                    _reachable[i] = reached[block];
+        }
+
+        // Reaching definitions, joined wherever they reach the same use. Every
+        // register has a definition at the entry: the argument, or whatever the
+        // previous frame left there
+        auto FindWebs() -> void {
+            using Sets = std::vector<std::vector<uint32_t>>;
+
+            const auto& blocks = _graph.Blocks();
+            const auto count = _body.size();
+            const uint32_t registers = _symbol.Registers;
+
+            std::vector<uint32_t> defRegister;
+            std::vector<Primitives::Type> defType;
+            std::vector<int64_t> defOf(count, -1);
+            for (uint32_t reg = 0; reg != registers; ++reg) {
+                defRegister.push_back(reg);
+                defType.push_back(count != 0? _types.Before[0][reg] : Unknown);
+            }
+
+            std::vector<uint32_t> uses;
+            for (size_t i = 0; i != count; ++i) {
+                const auto reg = Effects(i, uses);
+                if (!_reachable[i] || reg < 0)
+                    continue;
+                defOf[i] = defRegister.size();
+                defRegister.push_back(static_cast<uint32_t>(reg));
+                defType.push_back(_types.After[i][reg]);
+            }
+
+            const auto join = [](std::vector<uint32_t>& into, const std::vector<uint32_t>& from) {
+                std::vector<uint32_t> joined;
+                std::set_union(into.begin(), into.end(), from.begin(), from.end(), std::back_inserter(joined));
+                const auto changed = joined.size() != into.size();
+                into = std::move(joined);
+                return changed;
+            };
+
+            std::vector<Sets> in(blocks.size(), Sets(registers));
+            std::vector<Sets> out(blocks.size(), Sets(registers));
+            for (uint32_t reg = 0; reg != registers; ++reg)
+                in[0][reg] = { reg };
+
+            for (bool changed = true; changed; ) {
+                changed = false;
+                for (size_t block = 0; block != blocks.size(); ++block) {
+                    if (!_reachable[blocks[block].Begin])
+                        continue;
+                    for (auto predecessor : blocks[block].Predecessors)
+                        for (uint32_t reg = 0; reg != registers; ++reg)
+                            join(in[block][reg], out[predecessor][reg]);
+
+                    auto state = in[block];
+                    for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+                        if (defOf[i] >= 0)
+                            state[defRegister[defOf[i]]] = { static_cast<uint32_t>(defOf[i]) };
+                    if (state != out[block]) {
+                        out[block] = std::move(state);
+                        changed = true;
+                    }
+                }
+            }
+
+            // Every use joins the definitions that reach it
+            std::vector<uint32_t> parent(defRegister.size());
+            for (size_t d = 0; d != parent.size(); ++d)
+                parent[d] = d;
+            const auto find = [&](uint32_t d) {
+                while (parent[d] != d)
+                    d = parent[d] = parent[parent[d]];
+                return d;
+            };
+
+            const auto walk = [&](auto&& visit) {
+                for (size_t block = 0; block != blocks.size(); ++block) {
+                    if (!_reachable[blocks[block].Begin])
+                        continue;
+                    auto state = in[block];
+                    for (auto i = blocks[block].Begin; i != blocks[block].End; ++i) {
+                        visit(i, state);
+                        if (defOf[i] >= 0)
+                            state[defRegister[defOf[i]]] = { static_cast<uint32_t>(defOf[i]) };
+                    }
+                }
+            };
+            walk([&](size_t i, const Sets& state) {
+                Effects(i, uses);
+                for (const auto reg : uses)
+                    for (const auto d : state[reg])
+                        parent[find(d)] = find(state[reg].front());
+            });
+
+            std::vector<int64_t> webOf(defRegister.size(), -1);
+            for (size_t d = 0; d != defRegister.size(); ++d) {
+                auto& web = webOf[find(d)];
+                if (web < 0) {
+                    web = _webs.size();
+                    _webs.push_back({ defRegister[d], defType[d], -1, count, 0 });
+                } else if (_webs[web].Type != defType[d])
+                    _webs[web].Type = Unknown;
+            }
+            for (auto& web : _webs)
+                if (!Unboxed(web.Type))
+                    web.Type = Unknown;
+
+            const auto webAt = [&](const Sets& state, uint32_t reg) {
+                return static_cast<size_t>(webOf[find(state[reg].front())]);
+            };
+
+            _uses.assign(count, {  });
+            _defs.assign(count, -1);
+            _before.assign(count, {  });
+            _after.assign(count, {  });
+            _defined.assign(registers, false);
+            walk([&](size_t i, const Sets& state) {
+                const auto def = Effects(i, uses);
+                for (const auto reg : uses)
+                    _uses[i].emplace_back(reg, webAt(state, reg));
+                if (defOf[i] >= 0)
+                    _defs[i] = webOf[find(defOf[i])];
+
+                const auto liveAfter = _liveness.LiveAfter(i);
+                auto liveBefore = liveAfter;
+                if (def >= 0)
+                    liveBefore[def] = false;
+                for (const auto reg : uses)
+                    liveBefore[reg] = true;
+
+                for (uint32_t reg = 0; reg != registers; ++reg) {
+                    if (liveBefore[reg])
+                        _before[i].emplace_back(reg, webAt(state, reg));
+                    if (liveAfter[reg])
+                        _after[i].emplace_back(reg, static_cast<int64_t>(reg) == def? _defs[i] : webAt(state, reg));
+                }
+            });
+
+            for (size_t i = 0; i != count; ++i) {
+                const auto extend = [&](size_t web) {
+                    _webs[web].Start = std::min(_webs[web].Start, i);
+                    _webs[web].End   = std::max(_webs[web].End, i);
+                };
+                for (const auto& [reg, web] : _before[i])
+                    extend(web);
+                for (const auto& [reg, web] : _after[i])
+                    extend(web);
+                for (const auto& [reg, web] : _uses[i])
+                    extend(web);
+                if (_defs[i] >= 0)
+                    extend(_defs[i]);
+            }
+        }
+
+        // Linear scan over the live ranges of the unboxed webs. When it runs out
+        // of registers, the web that stays live the longest goes back to the frame
+        auto Allocate() -> void {
+            std::vector<size_t> order;
+            for (size_t web = 0; web != _webs.size(); ++web)
+                if (_webs[web].Type != Unknown && _webs[web].Start <= _webs[web].End)
+                    order.push_back(web);
+            std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+                return _webs[lhs].Start < _webs[rhs].Start;
+            });
+
+            const auto scan = [&](bool floating, const auto& pool) {
+                std::vector<size_t> active;
+                std::vector<bool> used(pool.size(), false);
+                const auto slotOf = [&](int16_t reg) {
+                    return static_cast<size_t>(std::find(pool.begin(), pool.end(), reg) - pool.begin());
+                };
+
+                for (const auto web : order) {
+                    auto& current = _webs[web];
+                    if ((current.Type == Primitives::Type::Float64) != floating)
+                        continue;
+
+                    for (auto it = active.begin(); it != active.end(); ) {
+                        if (_webs[*it].End < current.Start) {
+                            used[slotOf(_webs[*it].Register)] = false;
+                            it = active.erase(it);
+                        } else
+                            ++it;
+                    }
+
+                    const auto free = std::find(used.begin(), used.end(), false);
+                    if (free != used.end()) {
+                        *free = true;
+                        current.Register = pool[free - used.begin()];
+                        active.push_back(web);
+                        continue;
+                    }
+
+                    const auto longest = std::max_element(active.begin(), active.end(), [&](size_t lhs, size_t rhs) {
+                        return _webs[lhs].End < _webs[rhs].End;
+                    });
+                    if (_webs[*longest].End > current.End) {
+                        current.Register = _webs[*longest].Register;
+                        _webs[*longest].Register = -1;
+                        *longest = web;
+                    }
+                }
+            };
+            scan(false, Gprs);
+            scan(true, Xmms);
+        }
+
+        // Whether an instruction is done inline, on unboxed operands
+        [[nodiscard]] auto IsInline(size_t i) const -> bool {
+            using Instructions::Opcode;
+            using Primitives::Type;
+
+            const auto& instruction = _body[i];
+            const auto opcode = instruction.Opcode();
+            const auto& before = _types.Before[i];
+            const auto dest = static_cast<size_t>(instruction.Destination());
+            const auto src  = static_cast<size_t>(instruction.Source());
+
+            switch (opcode) {
+            case Opcode::cmp:
+                return (before[dest] == Type::Uint32 || before[dest] == Type::Uint64) && before[src] == before[dest];
+            case Opcode::icmp:
+                return (before[dest] == Type::Int32 || before[dest] == Type::Int64) && before[src] == before[dest];
+            case Opcode::fcmp:
+                return before[dest] == Type::Float64 && before[src] == Type::Float64;
+            case Opcode::ldconst:
+                return Unboxed(_unit.ConstantLookup(src).Typeof());
+            case Opcode::mov:
+                return Unboxed(before[src]);
+            case Opcode::cmove: case Opcode::cmovne: case Opcode::cmovgt:
+            case Opcode::cmovge: case Opcode::cmovlt: case Opcode::cmovle:
+                return Unboxed(before[dest]) && before[src] == before[dest];
+            case Opcode::i32shl: case Opcode::i32shr: case Opcode::i64shl: case Opcode::i64shr:
+            case Opcode::u32shl: case Opcode::u32shr: case Opcode::u64shl: case Opcode::u64shr:
+                return before[dest] == ShiftType(opcode) && before[src] == Type::Uint32;
+            default: {
+                const auto type = ArithmeticType(opcode);
+                return type != Type::Uninit && before[dest] == type && before[src] == type;
+            }
+            }
+        }
+
+        // Which registers the entry at an instruction empties first: the ones that
+        // aren't live there, that inline instructions write to, and that might hold
+        // a reference. That leaves no reference behind for them to release
+        [[nodiscard]] auto Emptied(size_t i) const -> std::vector<bool> {
+            std::vector<bool> emptied(_symbol.Registers, false);
+            for (uint32_t reg = 0; reg != _symbol.Registers; ++reg)
+                emptied[reg] = _defined[reg] && MightBeReference(_types.Before[i][reg]);
+            for (const auto& [reg, web] : _before[i])
+                emptied[reg] = false;
+            return emptied;
+        }
+
+        // Inline instructions don't count references, so before one of them writes
+        // to a register that might still hold a reference, that reference is released.
+        // The frame only ever gets references from instructions done by the VM and calls
+        auto FindReleases() -> void {
+            using Instructions::Opcode;
+
+            const auto& blocks = _graph.Blocks();
+            const auto count = _body.size();
+            const uint32_t registers = _symbol.Registers;
+
+            _inline.assign(count, false);
+            _shared.assign(count, false);
+            for (size_t i = 0; i != count; ++i) {
+                if (!_reachable[i])
+                    continue;
+                const auto opcode = _body[i].Opcode();
+                if (opcode == Opcode::call) {
+                    const auto& callee = _symbols.At(_body[i].Destination());
+                    _shared[i] = Analysis::CanShareArguments(_liveness.LiveAfter(i), _symbol, callee);
+                } else if (!Instructions::IsJump(opcode) && !Instructions::IsCall(opcode) && opcode != Opcode::ret)
+                    _inline[i] = IsInline(i);
+                if (_inline[i] && opcode != Opcode::cmp && opcode != Opcode::icmp && opcode != Opcode::fcmp)
+                    _defined[_body[i].Destination()] = true;
+            }
+
+            // Entries from the outside: the prologue and the loop entries
+            const auto entry = [&](size_t i) {
+                const auto emptied = Emptied(i);
+                std::vector<bool> state(registers, false);
+                for (uint32_t reg = 0; reg != registers; ++reg)
+                    state[reg] = MightBeReference(_types.Before[i][reg]) && !emptied[reg];
+                return state;
+            };
+
+            std::vector<std::vector<bool>> in(blocks.size(), std::vector<bool>(registers, false));
+            std::vector<std::vector<bool>> out = in;
+            in[0] = entry(0);
+            for (size_t i = 0; i != count; ++i) {
+                if (!_reachable[i] || !Instructions::IsJump(_body[i].Opcode()))
+                    continue;
+                const auto target = static_cast<size_t>(Analysis::JumpTarget(_body[i], i));
+                if (target <= i) {
+                    const auto state = entry(target);
+                    auto& header = in[_graph.BlockOf(target)];
+                    for (uint32_t reg = 0; reg != registers; ++reg)
+                        header[reg] = header[reg] || state[reg];
+                }
+            }
+            const auto external = in;
+
+            const auto transfer = [&](size_t i, std::vector<bool>& state) {
+                const auto& instruction = _body[i];
+                const auto opcode = instruction.Opcode();
+                if (opcode == Opcode::call) {
+                    const auto& callee = _symbols.At(instruction.Destination());
+                    if (_shared[i])
+                        for (auto reg = registers - callee.Arguments; reg != registers; ++reg)
+                            state[reg] = true;
+                    if (_defs[i] >= 0)
+                        state[registers - 1] = MightBeReference(_types.After[i][registers - 1]);
+                } else if (_defs[i] >= 0) {
+                    const auto dest = static_cast<size_t>(instruction.Destination());
+                    state[dest] = !_inline[i] && MightBeReference(_types.After[i][dest]);
+                }
+            };
+
+            for (bool changed = true; changed; ) {
+                changed = false;
+                for (size_t block = 0; block != blocks.size(); ++block) {
+                    if (!_reachable[blocks[block].Begin])
+                        continue;
+                    auto state = external[block];
+                    for (auto predecessor : blocks[block].Predecessors)
+                        for (uint32_t reg = 0; reg != registers; ++reg)
+                            state[reg] = state[reg] || out[predecessor][reg];
+                    in[block] = state;
+                    for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+                        transfer(i, state);
+                    if (state != out[block]) {
+                        out[block] = std::move(state);
+                        changed = true;
+                    }
+                }
+            }
+
+            _release.assign(count, false);
+            for (size_t block = 0; block != blocks.size(); ++block) {
+                if (!_reachable[blocks[block].Begin])
+                    continue;
+                auto state = in[block];
+                for (auto i = blocks[block].Begin; i != blocks[block].End; ++i) {
+                    const auto opcode = _body[i].Opcode();
+                    const auto compare = opcode == Opcode::cmp || opcode == Opcode::icmp || opcode == Opcode::fcmp;
+                    _release[i] = _inline[i] && !compare && state[_body[i].Destination()];
+                    transfer(i, state);
+                }
+            }
+        }
+
+        // Whether the flags a comparison leaves might still be read by a jump or select. The
+        // caller could read them after `ret` too, so they're live there
+        auto FindLiveFlags() -> void {
+            using Instructions::Opcode;
+
+            const auto count = _body.size();
+            _flags.assign(count + 1, false);
+            for (bool changed = true; changed; ) {
+                changed = false;
+                for (size_t i = count; i-- != 0; ) {
+                    if (!_reachable[i])
+                        continue;
+
+                    const auto& instruction = _body[i];
+                    const auto opcode = instruction.Opcode();
+                    bool live = false;
+                    if (opcode == Opcode::ret || opcode == Opcode::tailcall || (Instructions::IsJump(opcode) && opcode != Opcode::jmp) || Instructions::IsSelect(opcode))
+                        live = true;
+                    else if (opcode == Opcode::cmp || opcode == Opcode::icmp || opcode == Opcode::fcmp)
+                        live = false;
+                    else if (opcode == Opcode::jmp)
+                        live = _flags[Analysis::JumpTarget(instruction, i)];
+                    else
+                        live = _flags[i + 1];
+
+                    if (live != _flags[i]) {
+                        _flags[i] = live;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // A comparison right before a conditional jump in the same block sets the
+        // processor flags and jumps on them. The flags of the VM are only written
+        // on the way out, if some other jump can still read them
+        [[nodiscard]] auto Fuses(size_t i) const -> bool {
+            using Instructions::Opcode;
+
+            const auto opcode = _body[i].Opcode();
+            if (!_inline[i] || (opcode != Opcode::cmp && opcode != Opcode::icmp && opcode != Opcode::fcmp))
+                return false;
+            else if (i + 1 == _body.size() || _graph.BlockOf(i + 1) != _graph.BlockOf(i))
+                return false;
+
+            const auto next = _body[i + 1].Opcode();
+            return Instructions::IsJump(next) && next != Opcode::jmp;
+        }
+
+    private:
+        [[nodiscard]] auto PlaceOf(size_t web) const -> Place {
+            const auto& value = _webs[web];
+            if (value.Register >= 0)
+                return { true, static_cast<uint32_t>(value.Register) };
+            return { false, value.Slot };
+        }
+
+        [[nodiscard]] auto Use(size_t i, uint32_t reg) const -> size_t {
+            for (const auto& [used, web] : _uses[i])
+                if (used == reg)
+                    return web;
+            return 0;
+        }
+
+        // Copies a value of `type` into a register
+        auto Load(uint8_t into, Place from, Primitives::Type type) -> void {
+            if (type == Primitives::Type::Float64) {
+                if (!from.InRegister)
+                    _buffer.SseMemory(0xF2, 0x10, into, CodeBuffer::Payload(from.Number));         // movsd xmm, [slot]
+                else if (from.Number != into)
+                    _buffer.Sse(0, 0x28, into, from.Number);                                        // movaps xmm, xmm
+            } else {
+                if (!from.InRegister)
+                    _buffer.RegisterMemory({ 0x8B }, into, CodeBuffer::Payload(from.Number), Wide(type));  // mov reg, [slot]
+                else if (from.Number != into)
+                    _buffer.Register({ 0x8B }, into, from.Number, Wide(type));                     // mov reg, reg
+            }
+        }
+
+        // Copies a value of `type` out of a register. A value that stays in the frame gets its type as well
+        auto Store(Place to, uint8_t from, Primitives::Type type) -> void {
+            if (to.InRegister) {
+                Load(static_cast<uint8_t>(to.Number), { true, from }, type);
+                return;
+            }
+
+            if (type == Primitives::Type::Float64)
+                _buffer.SseMemory(0xF2, 0x11, from, CodeBuffer::Payload(to.Number));               // movsd [slot], xmm
+            else
+                _buffer.RegisterMemory({ 0x89 }, from, CodeBuffer::Payload(to.Number), true);      // mov [slot], reg
+            _buffer.TagMemory({ 0xC6 }, 0, CodeBuffer::Tag(to.Number));                                // mov byte [r15 + slot], type
+            _buffer.Bytes({ static_cast<uint8_t>(type) });
+        }
+
+        // Puts a value back into its register of the frame, where the VM can see it
+        auto Box(size_t web, uint32_t slot) -> void {
+            const auto& value = _webs[web];
+            if (value.Register >= 0)
+                Store({ false, slot }, static_cast<uint8_t>(value.Register), value.Type);
+        }
+
+        // Unboxed values a call into the VM would wipe out, that are still needed after it
+        [[nodiscard]] auto Survivors(size_t i, bool after) const -> std::vector<size_t> {
+            std::vector<size_t> survivors;
+            for (const auto& [reg, web] : _before[i]) {
+                if (_webs[web].Register < 0 || _webs[web].Register == Rbp || static_cast<int64_t>(web) == _defs[i])
+                    continue;
+                const auto live = std::any_of(_after[i].begin(), _after[i].end(), [&, web = web](const auto& other) {
+                    return other.second == web;
+                });
+                if (live || !after)
+                    survivors.push_back(web);
+            }
+            return survivors;
+        }
+
+        auto Save(const std::vector<size_t>& webs) -> void {
+            for (const auto web : webs) {
+                const auto& value = _webs[web];
+                if (value.Type == Primitives::Type::Float64)
+                    _buffer.SseMemory(0xF2, 0x11, value.Register, CodeBuffer::Payload(value.Slot));
+                else
+                    _buffer.RegisterMemory({ 0x89 }, value.Register, CodeBuffer::Payload(value.Slot), true);
+            }
+        }
+
+        auto Restore(const std::vector<size_t>& webs) -> void {
+            for (const auto web : webs)
+                Load(static_cast<uint8_t>(_webs[web].Register), { false, _webs[web].Slot }, _webs[web].Type);
+        }
+
+        // Reloads the result of an instruction done outside, if it's unboxed
+        auto Reload(size_t i) -> void {
+            if (_defs[i] >= 0 && _webs[_defs[i]].Register >= 0)
+                Load(static_cast<uint8_t>(_webs[_defs[i]].Register), { false, _webs[_defs[i]].Slot }, _webs[_defs[i]].Type);
+        }
+
+        // Empties the registers that need it, then loads the unboxed values live at `i`
+        auto Enter(size_t i) -> void {
+            const auto emptied = Emptied(i);
+            for (uint32_t reg = 0; reg != _symbol.Registers; ++reg) {
+                if (!emptied[reg])
+                    continue;
+                _buffer.TagMemory({ 0x80 }, 7, CodeBuffer::Tag(reg));                      // cmp byte [r15 + reg], Reference
+                _buffer.Bytes({ static_cast<uint8_t>(Primitives::Type::Reference) });
+                const auto skip = _buffer.Jump(NotEqual);
+                _buffer.Notify(_runtime, reg, false);
+                _buffer.TagMemory({ 0xC6 }, 0, CodeBuffer::Tag(reg));                      // mov byte [r15 + reg], Uninit
+                _buffer.Bytes({ static_cast<uint8_t>(Primitives::Type::Uninit) });
+                _buffer.Patch(skip, _buffer.Size());
+            }
+
+            for (const auto& [reg, web] : _before[i])
+                if (_webs[web].Register >= 0)
+                    Load(static_cast<uint8_t>(_webs[web].Register), { false, reg }, _webs[web].Type);
+        }
+
+        // Leaves an instruction to the VM, with its operands in the frame
+        auto Execute(size_t i) -> void {
+            const auto& instruction = _body[i];
+            const auto opcode = instruction.Opcode();
+            const auto survivors = Survivors(i, true);
+
+            Save(survivors);
+            for (const auto& [reg, web] : _uses[i])
+                Box(web, reg);
+
+            const auto dest = static_cast<uint32_t>(instruction.Destination());
+            const auto src  = static_cast<uint32_t>(instruction.Source());
+            if (opcode == Instructions::Opcode::ldconst)
+                _buffer.Execute(_runtime, opcode, _symbol.Start / 4 + i, dest, 0, &_unit.ConstantLookup(src));
+            else
+                _buffer.Execute(_runtime, opcode, _symbol.Start / 4 + i, dest, src, nullptr);
+
+            Restore(survivors);
+            Reload(i);
+        }
+
+        auto Call(size_t i) -> void {
+            const auto& callee = _symbols.At(_body[i].Destination());
+            const auto survivors = Survivors(i, true);
+
+            Save(survivors);
+            for (const auto& [reg, web] : _uses[i])
+                Box(web, reg);
+            _buffer.Call(_runtime, &_functions[_body[i].Destination()], _symbol.Registers, _shared[i]? callee.Arguments : 0);
+            Restore(survivors);
+            Reload(i);
+        }
+
+        // Same as in the baseline: a frame that can't shrink enough makes an ordinary call,
+        // and then does what the instructions after it would have done, in the frame
+        auto TailCall(size_t i, size_t prologue) -> void {
+            const auto destination = _body[i].Destination();
+            for (const auto& [reg, web] : _uses[i])
+                Box(web, reg);
+
+            _buffer.Bytes({ 0x41, 0x81, 0xFD });                                        // cmp r13d, registers
+            _buffer.Dword(_symbols.At(destination).Registers);
+            const auto ordinary = _buffer.Jump(Above);
+            _buffer.TailCall(_runtime, &_functions[destination], _symbol.Registers, prologue);
+            _buffer.Patch(ordinary, _buffer.Size());
+            _buffer.Call(_runtime, &_functions[destination], _symbol.Registers, 0);
+
+            const auto& next = _body[i + 1];
+            if (next.Opcode() == Instructions::Opcode::mov)
+                _buffer.Execute(_runtime, Instructions::Opcode::mov, _symbol.Start / 4 + i + 1, next.Destination(), next.Source(), nullptr);
+            _buffer.Return(_symbol.Registers);
+        }
+
+        // Writes the result of an inline instruction from a scratch register
+        auto Define(size_t i, uint8_t from, Primitives::Type type) -> void {
+            const auto web = static_cast<size_t>(_defs[i]);
+            if (_webs[web].Register >= 0)
+                Store(PlaceOf(web), from, type);
+            else
+                Store({ false, _webs[web].Slot }, from, type);
+        }
+
+        auto LoadConstant(size_t i) -> void {
+            const auto& constant = _unit.ConstantLookup(_body[i].Source());
+            const auto type  = constant.Typeof();
+            const auto place = PlaceOf(_defs[i]);
+
+            if (place.InRegister && type != Primitives::Type::Float64) {
+                _buffer.MoveImmediate(static_cast<uint8_t>(place.Number), constant.As<uint64_t>(), Wide(type));
+                return;
+            }
+
+            _buffer.MoveImmediate(Rax, constant.As<uint64_t>(), true);
+            if (place.InRegister) {
+                _buffer.Bytes({ 0x66 });                                                // movq xmm, rax
+                _buffer.Register({ 0x0F, 0x6E }, static_cast<uint8_t>(place.Number), Rax, true);
+            } else {
+                _buffer.RegisterMemory({ 0x89 }, Rax, CodeBuffer::Payload(place.Number), true);
+                _buffer.TagMemory({ 0xC6 }, 0, CodeBuffer::Tag(place.Number));
+                _buffer.Bytes({ static_cast<uint8_t>(type) });
+            }
+        }
+
+        auto Move(size_t i) -> void {
+            const auto type = _types.Before[i][_body[i].Source()];
+            const auto from = PlaceOf(Use(i, static_cast<uint32_t>(_body[i].Source())));
+            if (from.InRegister) {
+                Store(PlaceOf(_defs[i]), static_cast<uint8_t>(from.Number), type);
+                return;
+            }
+
+            const auto scratch = type == Primitives::Type::Float64? Xmm0 : Rax;
+            Load(scratch, from, type);
+            Store(PlaceOf(_defs[i]), scratch, type);
+        }
+
+        // cmov has no SSE form, so doubles go through rax and r11 like integers do
+        auto Select(size_t i) -> void {
+            const auto& instruction = _body[i];
+            const auto type = _types.Before[i][instruction.Destination()];
+            const auto move = static_cast<uint8_t>(Condition(instruction.Opcode()) - 0x40);
+            const auto dest = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Destination())));
+            const auto src  = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Source())));
+
+            if (type == Primitives::Type::Float64) {
+                Load(Xmm0, dest, type);
+                _buffer.Bytes({ 0x66 });                                                // movq rax, xmm0
+                _buffer.Register({ 0x0F, 0x7E }, Xmm0, Rax, true);
+                Load(Xmm0, src, type);
+                _buffer.Bytes({ 0x66 });                                                // movq r11, xmm0
+                _buffer.Register({ 0x0F, 0x7E }, Xmm0, R11, true);
+            } else {
+                Load(Rax, dest, type);
+                Load(R11, src, type);
+            }
+
+            _buffer.Bytes({ 0x41, 0x83, 0x3C, 0x24, 0x00 });                            // cmp dword [r12], 0
+            _buffer.Register({ 0x0F, move }, Rax, R11, true);                           // cmovcc rax, r11
+            if (type == Primitives::Type::Float64) {
+                _buffer.Bytes({ 0x66 });                                                // movq xmm0, rax
+                _buffer.Register({ 0x0F, 0x6E }, Xmm0, Rax, true);
+                Store(PlaceOf(_defs[i]), Xmm0, type);
+            } else
+                Store(PlaceOf(_defs[i]), Rax, type);
+        }
+
+        // op dest, src - in place if both the old and the new value of `dest` live in the same register
+        auto Arithmetic(size_t i) -> void {
+            const auto& instruction = _body[i];
+            const auto opcode = instruction.Opcode();
+            const auto type   = ArithmeticType(opcode);
+            const auto target = PlaceOf(_defs[i]);
+            const auto dest   = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Destination())));
+            const auto src    = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Source())));
+
+            const auto inPlace = target.InRegister && dest.InRegister && target.Number == dest.Number;
+            if (type == Primitives::Type::Float64) {
+                const auto reg = inPlace? static_cast<uint8_t>(target.Number) : Xmm0;
+                if (!inPlace)
+                    Load(reg, dest, type);
+                if (src.InRegister)
+                    _buffer.Sse(0xF2, FloatOperation(opcode), reg, static_cast<uint8_t>(src.Number));
+                else
+                    _buffer.SseMemory(0xF2, FloatOperation(opcode), reg, CodeBuffer::Payload(src.Number));
+                if (!inPlace)
+                    Store(target, reg, type);
+                return;
+            }
+
+            const auto reg = inPlace? static_cast<uint8_t>(target.Number) : Rax;
+            if (!inPlace)
+                Load(reg, dest, type);
+            if (src.InRegister)
+                _buffer.Register(IntegerOperation(opcode), reg, static_cast<uint8_t>(src.Number), Wide(type));
+            else
+                _buffer.RegisterMemory(IntegerOperation(opcode), reg, CodeBuffer::Payload(src.Number), Wide(type));
+            if (!inPlace)
+                Store(target, reg, type);
+        }
+
+        // The count has to be in cl, so whatever rcx holds waits in r11 meanwhile
+        auto Shift(size_t i) -> void {
+            const auto& instruction = _body[i];
+            const auto type = ShiftType(instruction.Opcode());
+            const auto dest = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Destination())));
+            const auto src  = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Source())));
+
+            Load(Rax, dest, type);
+            _buffer.Register({ 0x8B }, R11, Rcx, true);                                 // mov r11, rcx
+            Load(Rcx, src, Primitives::Type::Uint32);
+            _buffer.Register({ 0xD3 }, ShiftOperation(instruction.Opcode()), Rax, Wide(type));     // op rax, cl
+            _buffer.Register({ 0x8B }, Rcx, R11, true);                                 // mov rcx, r11
+            Store(PlaceOf(_defs[i]), Rax, type);
+        }
+
+        // cmp or ucomisd on the operands of a comparison, or on them swapped
+        auto CompareOperands(size_t i, bool swapped) -> void {
+            const auto& instruction = _body[i];
+            const auto type = _types.Before[i][instruction.Destination()];
+            auto lhs = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Destination())));
+            auto rhs = PlaceOf(Use(i, static_cast<uint32_t>(instruction.Source())));
+            if (swapped)
+                std::swap(lhs, rhs);
+
+            if (type == Primitives::Type::Float64) {
+                if (!lhs.InRegister) {
+                    Load(Xmm15, lhs, type);
+                    lhs = { true, Xmm15 };
+                }
+                if (rhs.InRegister)
+                    _buffer.Sse(0x66, 0x2E, static_cast<uint8_t>(lhs.Number), static_cast<uint8_t>(rhs.Number));
+                else
+                    _buffer.SseMemory(0x66, 0x2E, static_cast<uint8_t>(lhs.Number), CodeBuffer::Payload(rhs.Number));
+                return;
+            }
+
+            if (!lhs.InRegister) {
+                Load(Rax, lhs, type);
+                lhs = { true, Rax };
+            }
+            if (rhs.InRegister)
+                _buffer.Register({ 0x3B }, static_cast<uint8_t>(lhs.Number), static_cast<uint8_t>(rhs.Number), Wide(type));
+            else
+                _buffer.RegisterMemory({ 0x3B }, static_cast<uint8_t>(lhs.Number), CodeBuffer::Payload(rhs.Number), Wide(type));
+        }
+
+        // Sets the flags of the VM to -1, 0 or 1, like the baseline does
+        auto Materialize(size_t i) -> void {
+            using Instructions::Opcode;
+
+            const auto opcode = _body[i].Opcode();
+            CompareOperands(i, false);
+            if (opcode == Opcode::fcmp) {
+                _buffer.Bytes({ 0x0F, 0x97, 0xC0 });                                    // seta al
+                CompareOperands(i, true);
+                _buffer.Bytes({ 0x41, 0x0F, 0x97, 0xC3 });                              // seta r11b
+            } else if (opcode == Opcode::cmp)
+                _buffer.Bytes({ 0x0F, 0x97, 0xC0, 0x41, 0x0F, 0x92, 0xC3 });            // seta al, setb r11b
+            else
+                _buffer.Bytes({ 0x0F, 0x9F, 0xC0, 0x41, 0x0F, 0x9C, 0xC3 });            // setg al, setl r11b
+            _buffer.Bytes({ 0x0F, 0xB6, 0xC0, 0x45, 0x0F, 0xB6, 0xDB });                // movzx eax, al; movzx r11d, r11b
+            _buffer.Bytes({ 0x44, 0x29, 0xD8 });                                        // sub eax, r11d
+            _buffer.Bytes({ 0x41, 0x89, 0x04, 0x24 });                                  // mov [r12], eax
+        }
+
+        // A fused comparison jumps on the processor flags. The flags of the VM
+        // are set on the edges that still need them
+        auto Compare(size_t i) -> void {
+            using Instructions::Opcode;
+
+            if (!Fuses(i)) {
+                Materialize(i);
+                return;
+            }
+
+            const auto opcode = _body[i].Opcode();
+            const auto& jump  = _body[i + 1];
+            const auto target = static_cast<size_t>(Analysis::JumpTarget(jump, i + 1));
+            const auto swapped = opcode == Opcode::fcmp && (jump.Opcode() == Opcode::jlt || jump.Opcode() == Opcode::jge);
+            CompareOperands(i, swapped);
+
+            uint8_t condition = Always;
+            const auto type = _types.Before[i][_body[i].Destination()];
+            const auto isSigned = type == Primitives::Type::Int32 || type == Primitives::Type::Int64;
+            switch (jump.Opcode()) {
+            case Opcode::je:
+                condition = Equal;
+                break;
+            case Opcode::jne:
+                condition = NotEqual;
+                break;
+            case Opcode::jgt:
+                condition = isSigned? Greater : Above;
+                break;
+            case Opcode::jge:
+                condition = opcode == Opcode::fcmp? BelowEqual : isSigned? GreaterEqual : AboveEqual;
+                break;
+            case Opcode::jlt:
+                condition = opcode == Opcode::fcmp? Above : isSigned? Less : Below;
+                break;
+            case Opcode::jle:
+                condition = isSigned? LessEqual : BelowEqual;
+                break;
+            default:
+                break;
+            }
+
+            if (_flags[target])
+                _detours.push_back({ _buffer.Jump(condition), i, 0, true, target });
+            else
+                _jumps.emplace_back(_buffer.Jump(condition), target);
+            if (_flags[i + 2])
+                Materialize(i);
+        }
+
+        auto WriteDetours() -> void {
+            for (const auto& detour : _detours) {
+                _buffer.Patch(detour.Jump, _buffer.Size());
+                if (detour.Flags) {
+                    Materialize(detour.Instruction);
+                    _jumps.emplace_back(_buffer.Jump(Always), detour.Target);
+                    continue;
+                }
+
+                // Values in the register that's released are dead anyway
+                std::vector<size_t> survivors;
+                for (const auto web : Survivors(detour.Instruction, false))
+                    if (_webs[web].Slot != detour.Register)
+                        survivors.push_back(web);
+
+                Save(survivors);
+                _buffer.Notify(_runtime, detour.Register, false);
+                _buffer.TagMemory({ 0xC6 }, 0, CodeBuffer::Tag(detour.Register));         // mov byte [r15 + reg], Uninit
+                _buffer.Bytes({ static_cast<uint8_t>(Primitives::Type::Uninit) });
+                Restore(survivors);
+                _buffer.Patch(_buffer.Jump(Always), detour.Target);
+            }
+        }
+
+    private:
+        const ExecutionUnit&                   _unit;
+        const Runtime&                         _runtime;
+        const Containers::Symbol&              _symbol;
+        const Containers::SymbolTable&         _symbols;
+        const std::vector<Emit::Instruction>&  _body;
+        const Analysis::RegisterTypes&         _types;
+        const std::vector<FunctionDescriptor>& _functions;
+        CodeBuffer&                            _buffer;
+        const Analysis::ControlFlowGraph       _graph;
+        const Analysis::Liveness               _liveness;
+
+        std::vector<bool>                                        _reachable;
+        std::vector<std::vector<std::pair<uint32_t, size_t>>>    _uses;       // Registers each instruction reads, with their webs
+        std::vector<int64_t>                                     _defs;       // Web each instruction writes, or -1
+        std::vector<std::vector<std::pair<uint32_t, size_t>>>    _before;     // Webs live right before and right after each instruction
+        std::vector<std::vector<std::pair<uint32_t, size_t>>>    _after;
+        std::vector<Web>                                         _webs;
+        std::vector<bool>                                        _inline;     // Whether each instruction is done inline
+        std::vector<bool>                                        _shared;     // Whether each call starts the callee's frame at its arguments
+        std::vector<bool>                                        _release;    // Whether each instruction might have to release a reference first
+        std::vector<bool>                                        _flags;      // Whether the flags of the VM are live right before each instruction
+        std::vector<bool>                                        _defined;    // Whether each register is written by inline instructions
+
+        std::vector<size_t>                    _offsets;
+        std::vector<std::pair<size_t, size_t>> _jumps;
+        std::vector<Detour>                    _detours;
+};
+
+Compiler::Compiler(const ExecutionUnit& unit, const Runtime& runtime) noexcept
+    :_unit{ unit }, _runtime{ runtime } {
+}
+
+auto Compiler::Compile(size_t function, std::vector<FunctionDescriptor>& functions, const std::vector<bool>& proven, const std::vector<Analysis::RegisterTypes>& types, ExecutableMemory& memory, std::vector<NativeFunction>& entries) -> std::vector<std::pair<size_t, bool>> {
+#ifdef YUN_JIT
+    const auto& symbols = _unit.Symbols();
+    const size_t size = _unit.StopPC() - _unit.StartPC();
+
+    // Native code can only call native code, so everything the function reaches
+    // that isn't native yet goes into the same batch. Memoized functions answer their
+    // calls from a table only the interpreter looks at, so they keep their callers there
+    std::vector<size_t> batch{ function };
+    std::vector<std::vector<Emit::Instruction>> bodies;
+    std::vector<bool> queued(symbols.Count(), false);
+    queued[function] = true;
+
+    for (size_t i = 0; i != batch.size(); ++i) {
+        const auto& symbol = symbols.At(batch[i]);
+        if (functions[batch[i]].Memoized || symbol.Start >= symbol.End || symbol.End / 4 > size)
+            return {  };
+
+        try {
+            bodies.push_back(Analysis::Decode(_unit.StartPC() + symbol.Start / 4, _unit.StartPC() + symbol.End / 4));
+            if (!CanCompile(batch[i], bodies.back()))
+                return {  };
+        } catch (const std::exception&) {
+            // Left to the interpreter, which reports it if it ever runs
+            return {  };
+        }
+
+        for (const auto& instruction : bodies.back()) {
+            if (!Instructions::IsCall(instruction.Opcode()))
+                continue;
+
+            const auto callee = static_cast<size_t>(instruction.Destination());
+            if (!queued[callee] && functions[callee].Native == nullptr) {
+                queued[callee] = true;
+                batch.push_back(callee);
+            }
+        }
+    }
+
+    // Proven functions go through the optimizing compiler, unless it gives up on them
+    std::vector<uint8_t> code;
+    std::vector<size_t> offsets(batch.size(), 0);
+    std::vector<std::vector<std::pair<size_t, size_t>>> headers(batch.size());
+    std::vector<std::pair<size_t, bool>> compiled;
+    for (size_t i = 0; i != batch.size(); ++i) {
+        offsets[i] = code.size();
+        if (proven[batch[i]] && !types[batch[i]].Before.empty()) {
+            CodeBuffer buffer{ code };
+            MethodWriter writer{ _unit, _runtime, batch[i], bodies[i], types[batch[i]], functions, buffer };
+            if (writer.Analyze()) {
+                headers[i] = writer.Write();
+                compiled.emplace_back(batch[i], true);
+                continue;
+            }
+        }
+
+        headers[i] = Translate(batch[i], bodies[i], !proven[batch[i]], functions, code);
+        compiled.emplace_back(batch[i], false);
+    }
+
+    const auto base = memory.Load(code);
+    if (base == nullptr)
+        return {  };
+
+    for (size_t i = 0; i != batch.size(); ++i) {
+        functions[batch[i]].Native = reinterpret_cast<NativeFunction>(base + offsets[i]);
+        for (const auto& [instruction, offset] : headers[i])
+            entries[symbols.At(batch[i]).Start / 4 + instruction] = reinterpret_cast<NativeFunction>(base + offset);
+    }
+    return compiled;
+#else
+    static_cast<void>(function);
+    static_cast<void>(functions);
+    static_cast<void>(proven);
+    static_cast<void>(types);
+    static_cast<void>(memory);
+    static_cast<void>(entries);
+    return {  };
+#endif
+}
+
+// Anything the interpreter would have to catch at run time stays interpreted
+auto Compiler::CanCompile(size_t function, const std::vector<Emit::Instruction>& body) const -> bool {
+    const auto& symbols = _unit.Symbols();
+    const auto& symbol  = symbols.At(function);
+
+    const auto last = body.back().Opcode();
+    if (last != Instructions::Opcode::ret && last != Instructions::Opcode::jmp && last != Instructions::Opcode::tailcall)
+        return false;
+
+    for (size_t i = 0; i != body.size(); ++i) {
+        const auto& instruction = body[i];
+        const auto opcode = instruction.Opcode();
+
+        if (Instructions::IsJump(opcode)) {
+            const auto target = Analysis::JumpTarget(instruction, i);
+            if (target < 0 || static_cast<size_t>(target) >= body.size())
+                return false;
+        } else if (Instructions::IsCall(opcode)) {
+            const auto callee = static_cast<size_t>(instruction.Destination());
+            if (callee >= symbols.Count())
+                return false;
+            else if (symbol.Registers < symbols.At(callee).Arguments || (symbol.Registers == 0 && symbols.At(callee).DoesReturn))
+                return false;
+        } else if (opcode == Instructions::Opcode::ldconst) {
+            if (static_cast<uint32_t>(instruction.Destination()) >= symbol.Registers)
+                return false;
+            static_cast<void>(_unit.ConstantLookup(instruction.Source()));
+        } else if (Instructions::OpcodeCount(opcode) >= 1) {
+            if (static_cast<uint32_t>(instruction.Destination()) >= symbol.Registers)
+                return false;
+            else if (Instructions::OpcodeCount(opcode) == 2 && static_cast<uint32_t>(instruction.Source()) >= symbol.Registers)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Returns where the entries for the targets of backward jumps begin in `code`
+auto Compiler::Translate(size_t function, const std::vector<Emit::Instruction>& body, bool checked, const std::vector<FunctionDescriptor>& functions, std::vector<uint8_t>& code) const -> std::vector<std::pair<size_t, size_t>> {
+    using Instructions::Opcode;
+
+    const auto& symbols = _unit.Symbols();
+    const auto& symbol  = symbols.At(function);
+    const Analysis::ControlFlowGraph graph{ body };
+    const Analysis::Liveness liveness{ body, graph, symbol, symbols };
+
+    CodeBuffer buffer{ code };
+    const auto prologue = buffer.Prologue(_runtime);
+
+    std::vector<size_t> offsets(body.size(), 0);
+    std::vector<std::pair<size_t, size_t>> jumps;
+    std::vector<SlowPath> slowPaths;
+    std::vector<bool> loopHeaders(body.size(), false);
+
+    for (size_t i = 0; i != body.size(); ++i) {
+        offsets[i] = buffer.Size();
+
+        const auto& instruction = body[i];
+        const auto opcode = instruction.Opcode();
+        const auto dest   = static_cast<uint32_t>(instruction.Destination());
+        const auto src    = static_cast<uint32_t>(instruction.Source());
+
+        // Jumps to the slow path if a register doesn't hold the expected type
+        const auto guard = [&](uint32_t reg, Primitives::Type type, uint8_t condition) {
+            buffer.TagMemory({ 0x80 }, 7, CodeBuffer::Tag(reg));   // cmp byte [r15 + reg], type
+            buffer.Bytes({ static_cast<uint8_t>(type) });
+            slowPaths.back().Entries.push_back(buffer.Jump(condition));
+        };
+        const auto slowPath = [&](const Primitives::Value* constant) {
+            slowPaths.push_back({ {  }, 0, opcode, symbol.Start / 4 + i, dest, src, constant });
+        };
+
+        switch (opcode) {
+        case Opcode::jmp:
+        case Opcode::je:
+        case Opcode::jne:
+        case Opcode::jgt:
+        case Opcode::jge:
+        case Opcode::jlt:
+        case Opcode::jle: {
+            const auto target = static_cast<size_t>(Analysis::JumpTarget(instruction, i));
+            if (target <= i)
+                loopHeaders[target] = true;
+
+            if (opcode != Opcode::jmp)
+                buffer.Bytes({ 0x41, 0x83, 0x3C, 0x24, 0x00 });   // cmp dword [r12], 0
+            jumps.emplace_back(buffer.Jump(Condition(opcode)), target);
+            break;
+        }
+
+        case Opcode::i64add:
+        case Opcode::i64sub:
+        case Opcode::i64mul:
+        case Opcode::i64and:
+        case Opcode::i64or:
+        case Opcode::i64xor:
+        case Opcode::u64add:
+        case Opcode::u64sub:
+        case Opcode::u64mul:
+        case Opcode::u64and:
+        case Opcode::u64or:
+        case Opcode::u64xor:
+            if (checked) {
+                slowPath(nullptr);
+                guard(dest, OperandType(opcode), NotEqual);
+                guard(src, OperandType(opcode), NotEqual);
+            }
+            Arithmetic(buffer, opcode, dest, src);
+            if (checked)
+                slowPaths.back().Resume = buffer.Size();
+            break;
+
+        case Opcode::f64add:
+        case Opcode::f64sub:
+        case Opcode::f64mul:
+        case Opcode::f64div:
+            if (checked) {
+                slowPath(nullptr);
+                guard(dest, Primitives::Type::Float64, NotEqual);
+                guard(src, Primitives::Type::Float64, NotEqual);
+            }
+            Arithmetic(buffer, opcode, dest, src);
+            if (checked)
+                slowPaths.back().Resume = buffer.Size();
+            break;
+
+        case Opcode::i64shl:
+        case Opcode::i64shr:
+        case Opcode::u64shl:
+        case Opcode::u64shr:
+            if (checked) {
+                slowPath(nullptr);
+                guard(dest, ShiftType(opcode), NotEqual);
+                guard(src, Primitives::Type::Uint32, NotEqual);
+            }
+            Shift(buffer, opcode, dest, src);
+            if (checked)
+                slowPaths.back().Resume = buffer.Size();
+            break;
+
+        // Verified code knows that both sides have the same type, not that it's a 64-bit one
+        case Opcode::cmp:
+        case Opcode::icmp:
+        case Opcode::fcmp:
+            slowPath(nullptr);
+            guard(dest, OperandType(opcode), NotEqual);
+            guard(src, OperandType(opcode), NotEqual);
+            Compare(buffer, opcode, dest, src);
+            slowPaths.back().Resume = buffer.Size();
+            break;
+
+        // Only references need reference counting, everything else is a plain copy
+        case Opcode::ldconst: {
+            const auto& constant = _unit.ConstantLookup(src);
+            if (constant.Typeof() == Primitives::Type::Reference) {
+                buffer.Execute(_runtime, opcode, symbol.Start / 4 + i, dest, 0, &constant);
+                break;
+            }
+
+            slowPath(&constant);
+            guard(dest, Primitives::Type::Reference, Equal);
+            LoadConstant(buffer, dest, constant);
+            slowPaths.back().Resume = buffer.Size();
+            break;
+        }
+        case Opcode::mov:
+            slowPath(nullptr);
+            guard(dest, Primitives::Type::Reference, Equal);
+            guard(src, Primitives::Type::Reference, Equal);
+            Move(buffer, dest, src);
+            slowPaths.back().Resume = buffer.Size();
+            break;
+        case Opcode::cmove:
+        case Opcode::cmovne:
+        case Opcode::cmovgt:
+        case Opcode::cmovge:
+        case Opcode::cmovlt:
+        case Opcode::cmovle:
+            slowPath(nullptr);
+            guard(dest, Primitives::Type::Reference, Equal);
+            guard(src, Primitives::Type::Reference, Equal);
+            Select(buffer, opcode, dest, src);
+            slowPaths.back().Resume = buffer.Size();
+            break;
+
+        case Opcode::call: {
+            const auto& callee = symbols.At(dest);
+            const auto shared = Analysis::CanShareArguments(liveness.LiveAfter(i), symbol, callee)? callee.Arguments : 0;
+            buffer.Call(_runtime, &functions[dest], symbol.Registers, shared);
+            break;
+        }
+        case Opcode::tailcall: {
+            // Same as in the interpreter: a frame that can't shrink enough makes an ordinary call
+            buffer.Bytes({ 0x41, 0x81, 0xFD });                                     // cmp r13d, registers
+            buffer.Dword(symbols.At(dest).Registers);
+            const auto ordinary = buffer.Jump(Above);
+            buffer.TailCall(_runtime, &functions[dest], symbol.Registers, prologue);
+            buffer.Patch(ordinary, buffer.Size());
+            buffer.Call(_runtime, &functions[dest], symbol.Registers, 0);
+            break;
+        }
+        case Opcode::ret:
+            buffer.Return(symbol.Registers);
+            break;
+
+        case Opcode::nop:
+            break;
+
+        default:
+            buffer.Execute(_runtime, opcode, symbol.Start / 4 + i, dest, src, nullptr);
+            break;
+        }
+    }
+
+    for (const auto& path : slowPaths) {
+        for (auto entry : path.Entries)
+            buffer.Patch(entry, buffer.Size());
+        buffer.Execute(_runtime, path.Opcode, path.Index, path.Dest, path.Src, path.Constant);
+        buffer.Patch(buffer.Jump(Always), path.Resume);
+    }
+
+    // A loop entry sets up a native frame like the prologue does, then jumps into the loop
+    std::vector<std::pair<size_t, size_t>> entries;
+    for (size_t i = 0; i != body.size(); ++i) {
+        if (!loopHeaders[i])
+            continue;
+        entries.emplace_back(i, buffer.Size());
+        static_cast<void>(buffer.Prologue(_runtime));
+        jumps.emplace_back(buffer.Jump(Always), i);
+    }
+
+    for (const auto& [at, target] : jumps)
+        buffer.Patch(at, offsets[target]);
+    return entries;
+}
+
+// A frame a trace is in. Frames of inlined calls lie past the end of the
+// frame the trace started in, right where the interpreter would put them
+struct TraceFrame {
+    uint32_t Base;          // Relative to the frame the trace started in
+    uint32_t Registers;
+    uint32_t Shared;
+    uint32_t Call;          // Index of the inlined `call`
+    bool     DoesReturn;
+};
+
+// Translates the recorded steps, knowing the type of every register that
+// was written or checked before. Any other path leaves through an exit
+class TraceWriter {
+    public:
+        TraceWriter(const ExecutionUnit& unit, const Runtime& runtime, const std::vector<TraceStep>& steps, size_t function, CodeBuffer& buffer) noexcept
+            :Exits{  }, Registers{ 0 }, _unit{ unit }, _runtime{ runtime }, _steps{ steps }, _function{ function },
+             _buffer{ buffer }, _frames{  }, _exitJumps{  }, _mark{  } {
+        }
+
+    public:
+        // One pass over the steps. Returns false if some step can't be translated
+        [[nodiscard]] auto Iteration(std::vector<Primitives::Type>& types) -> bool {
+            using Instructions::Opcode;
+
+            const auto& symbols = _unit.Symbols();
+            const auto& symbol  = symbols.At(_function);
+            _frames = { { 0, symbol.Registers, 0, 0, symbol.DoesReturn } };
+            if (types.size() < symbol.Registers)
+                types.resize(symbol.Registers, Unknown);
+
+            for (size_t k = 0; k != _steps.size(); ++k) {
+                const auto& step = _steps[k];
+                const auto next  = _steps[(k + 1) % _steps.size()].Index;
+                if (step.Depth + 1u != _frames.size())
+                    return false;
+
+                const auto instruction = Emit::Instruction::Deserialize(_unit.StartPC()[step.Index]);
+                const auto opcode = instruction.Opcode();
+                const auto frame  = _frames.back();
+
+                // Operands as registers of the first frame
+                uint32_t dest = 0;
+                uint32_t src  = 0;
+                if (Instructions::OpcodeCount(opcode) >= 1 && !Instructions::IsJump(opcode) && !Instructions::IsCall(opcode)) {
+                    if (static_cast<uint32_t>(instruction.Destination()) >= frame.Registers)
+                        return false;
+                    dest = frame.Base + instruction.Destination();
+                }
+                if (Instructions::OpcodeCount(opcode) == 2 && opcode != Opcode::ldconst) {
+                    if (static_cast<uint32_t>(instruction.Source()) >= frame.Registers)
+                        return false;
+                    src = frame.Base + instruction.Source();
+                }
+
+                // A register that's read gets the type it had while recording, unless that's known already
+                const auto expect = [&](uint32_t reg, Primitives::Type recorded) {
+                    return types[reg] != Unknown? types[reg] : recorded;
+                };
+
+                switch (opcode) {
+                case Opcode::jmp:
+                case Opcode::je:
+                case Opcode::jne:
+                case Opcode::jgt:
+                case Opcode::jge:
+                case Opcode::jlt:
+                case Opcode::jle: {
+                    const auto target = Analysis::JumpTarget(instruction, step.Index);
+                    if (opcode == Opcode::jmp || target == step.Index + 1) {
+                        if (next != target)
+                            return false;
+                        break;
+                    }
+
+                    _buffer.Bytes({ 0x41, 0x83, 0x3C, 0x24, 0x00 });       // cmp dword [r12], 0
+                    if (next == target)
+                        ExitIf(Condition(opcode) ^ 1, step.Index + 1);     // Odd codes negate even ones
+                    else if (next == step.Index + 1)
+                        ExitIf(Condition(opcode), static_cast<uint32_t>(target));
+                    else
+                        return false;
+                    break;
+                }
+
+                case Opcode::i64add:
+                case Opcode::i64sub:
+                case Opcode::i64mul:
+                case Opcode::i64and:
+                case Opcode::i64or:
+                case Opcode::i64xor:
+                case Opcode::u64add:
+                case Opcode::u64sub:
+                case Opcode::u64mul:
+                case Opcode::u64and:
+                case Opcode::u64or:
+                case Opcode::u64xor:
+                case Opcode::f64add:
+                case Opcode::f64sub:
+                case Opcode::f64mul:
+                case Opcode::f64div:
+                    if (!Require(types, dest, OperandType(opcode), step.Index) || !Require(types, src, OperandType(opcode), step.Index))
+                        return false;
+                    Arithmetic(_buffer, opcode, dest, src);
+                    break;
+
+                case Opcode::i64shl:
+                case Opcode::i64shr:
+                case Opcode::u64shl:
+                case Opcode::u64shr:
+                    if (!Require(types, dest, ShiftType(opcode), step.Index) || !Require(types, src, Primitives::Type::Uint32, step.Index))
+                        return false;
+                    Shift(_buffer, opcode, dest, src);
+                    break;
+
+                // Comparisons of narrower values are left to the VM
+                case Opcode::cmp:
+                case Opcode::icmp:
+                case Opcode::fcmp: {
+                    const auto destType = expect(dest, step.Dest);
+                    const auto srcType  = expect(src, step.Src);
+                    if (!Require(types, dest, destType, step.Index) || !Require(types, src, srcType, step.Index))
+                        return false;
+
+                    if (destType == OperandType(opcode) && srcType == OperandType(opcode))
+                        Compare(_buffer, opcode, dest, src);
+                    else
+                        _buffer.Execute(_runtime, opcode, step.Index, dest, src, nullptr);
+                    break;
+                }
+
+                case Opcode::ldconst: {
+                    const auto& constant = _unit.ConstantLookup(instruction.Source());
+                    if (MightBeReference(types[dest]) || constant.Typeof() == Primitives::Type::Reference)
+                        _buffer.Execute(_runtime, opcode, step.Index, dest, 0, &constant);
+                    else
+                        LoadConstant(_buffer, dest, constant);
+                    types[dest] = constant.Typeof();
+                    break;
+                }
+                case Opcode::mov: {
+                    const auto srcType = expect(src, step.Src);
+                    if (!Require(types, src, srcType, step.Index))
+                        return false;
+
+                    if (MightBeReference(types[dest]) || srcType == Primitives::Type::Reference)
+                        _buffer.Execute(_runtime, opcode, step.Index, dest, src, nullptr);
+                    else
+                        Move(_buffer, dest, src);
+                    types[dest] = srcType;
+                    break;
+                }
+
+                // Which operand the destination ends up with depends on the flags, so their types have to agree
+                case Opcode::cmove:
+                case Opcode::cmovne:
+                case Opcode::cmovgt:
+                case Opcode::cmovge:
+                case Opcode::cmovlt:
+                case Opcode::cmovle: {
+                    const auto type = expect(dest, step.Dest);
+                    if (expect(src, step.Src) != type || !Require(types, dest, type, step.Index) || !Require(types, src, type, step.Index))
+                        return false;
+
+                    if (type == Primitives::Type::Reference)
+                        _buffer.Execute(_runtime, opcode, step.Index, dest, src, nullptr);
+                    else
+                        Select(_buffer, opcode, dest, src);
+                    types[dest] = type;
+                    break;
+                }
+
+                // Elements of an array can have any type, so the trace checks what it loaded
+                case Opcode::load:
+                    if (!Require(types, src, Primitives::Type::Reference, step.Index))
+                        return false;
+                    _buffer.Execute(_runtime, opcode, step.Index, dest, src, nullptr);
+                    types[dest] = Unknown;
+                    if (!Require(types, dest, step.Result, step.Index + 1))
+                        return false;
+                    break;
+                case Opcode::arraycount:
+                    if (!Require(types, src, Primitives::Type::Reference, step.Index))
+                        return false;
+                    _buffer.Execute(_runtime, opcode, step.Index, dest, src, nullptr);
+                    types[dest] = Primitives::Type::Uint32;
+                    break;
+
+                case Opcode::call: {
+                    const auto& callee = symbols.At(instruction.Destination());
+                    const uint32_t shared = step.Shared? callee.Arguments : 0;
+                    if (next != callee.Start / 4 || frame.Registers < callee.Arguments || callee.Registers < callee.Arguments)
+                        return false;
+
+                    const auto base = frame.Base + frame.Registers - shared;
+                    if (types.size() < base + callee.Registers)
+                        types.resize(base + callee.Registers, Unknown);
+                    Registers = std::max(Registers, base + callee.Registers - symbol.Registers);
+
+                    // Same as `RegisterArray::Copy`
+                    for (uint32_t i = shared; i != callee.Arguments; ++i) {
+                        const auto argument = frame.Base + frame.Registers - callee.Arguments + i;
+                        Move(_buffer, base + i, argument);
+                        types[base + i] = types[argument];
+                        if (MightBeReference(types[argument]))
+                            _buffer.Notify(_runtime, base + i, true);
+                    }
+                    for (uint32_t i = callee.Arguments; i != callee.Registers; ++i)
+                        types[base + i] = Unknown;
+
+                    _frames.push_back({ base, callee.Registers, shared, step.Index, callee.DoesReturn });
+                    break;
+                }
+                case Opcode::ret: {
+                    if (_frames.size() == 1 || next != frame.Call + 1)
+                        return false;
+
+                    // Same as `RegisterArray::SaveReturnValue` and `RegisterArray::Deallocate`
+                    if (frame.DoesReturn && frame.Registers != 0 && frame.Shared != 1) {
+                        const auto last = frame.Base + frame.Shared - 1;
+                        if (MightBeReference(types[last]))
+                            _buffer.Notify(_runtime, last, false);
+                        Move(_buffer, last, frame.Base);
+                        types[last] = types[frame.Base];
+                        if (MightBeReference(types[last]))
+                            _buffer.Notify(_runtime, last, true);
+                    }
+                    for (auto i = frame.Base + frame.Shared; i != frame.Base + frame.Registers; ++i)
+                        if (MightBeReference(types[i])) {
+                            _buffer.Notify(_runtime, i, false);
+                            _buffer.TagMemory({ 0xC6 }, 0, CodeBuffer::Tag(i));             // mov byte [r15 + reg], Uninit
+                            _buffer.Bytes({ static_cast<uint8_t>(Primitives::Type::Uninit) });
+                            types[i] = Primitives::Type::Uninit;
+                        }
+
+                    _frames.pop_back();
+                    break;
+                }
+                case Opcode::tailcall:
+                    return false;
+
+                case Opcode::nop:
+                    break;
+
+                // Everything else goes through the VM, and leaves behind what it left while recording
+                default:
+                    if (Instructions::OpcodeCount(opcode) >= 1 && !Require(types, dest, expect(dest, step.Dest), step.Index))
+                        return false;
+                    if (Instructions::OpcodeCount(opcode) == 2 && !Require(types, src, expect(src, step.Src), step.Index))
+                        return false;
+                    _buffer.Execute(_runtime, opcode, step.Index, dest, src, nullptr);
+                    if (Instructions::OpcodeCount(opcode) >= 1)
+                        types[dest] = step.Result;
+                    break;
+                }
+            }
+            return _frames.size() == 1;
+        }
+
+        // Remembers where the code and the exits end, so a failed iteration can be undone
+        auto Mark() noexcept -> void {
+            _mark = { _buffer.Size(), Exits.size(), _exitJumps.size() };
+        }
+
+        auto Rewind() -> void {
+            _buffer.Truncate(_mark[0]);
+            Exits.resize(_mark[1]);
+            _exitJumps.resize(_mark[2]);
+        }
+
+        // Every exit returns its own index
+        auto WriteExits() -> void {
+            std::vector<size_t> stubs(Exits.size(), 0);
+            for (size_t i = 0; i != Exits.size(); ++i) {
+                stubs[i] = _buffer.Size();
+                _buffer.Return(static_cast<uint32_t>(i));
+            }
+            for (const auto& [at, exit] : _exitJumps)
+                _buffer.Patch(at, stubs[exit]);
+        }
+
+    private:
+        // Leaves the trace if the condition holds. The interpreter goes on from `resume`
+        auto ExitIf(uint8_t condition, uint32_t resume) -> void {
+            std::vector<uint32_t> calls;
+            for (size_t i = 1; i < _frames.size(); ++i)
+                calls.push_back(_frames[i].Call);
+
+            auto exit = std::find_if(Exits.begin(), Exits.end(), [&](const TraceExit& other) {
+                return other.Resume == resume && other.Calls == calls;
+            }) - Exits.begin();
+            if (static_cast<size_t>(exit) == Exits.size())
+                Exits.push_back({ resume, std::move(calls) });
+
+            _exitJumps.emplace_back(_buffer.Jump(condition), exit);
+        }
+
+        // Checks the type of a register, unless it's known already
+        [[nodiscard]] auto Require(std::vector<Primitives::Type>& types, uint32_t reg, Primitives::Type type, uint32_t resume) -> bool {
+            if (types[reg] == type)
+                return true;
+            else if (types[reg] != Unknown)
+                return false;
+
+            _buffer.TagMemory({ 0x80 }, 7, CodeBuffer::Tag(reg));             // cmp byte [r15 + reg], type
+            _buffer.Bytes({ static_cast<uint8_t>(type) });
+            ExitIf(NotEqual, resume);
+            types[reg] = type;
+            return true;
+        }
+
+    public:
+        std::vector<TraceExit>                 Exits;
+        uint32_t                               Registers;
+
+    private:
+        const ExecutionUnit&                   _unit;
+        const Runtime&                         _runtime;
+        const std::vector<TraceStep>&          _steps;
+        size_t                                 _function;
+        CodeBuffer&                            _buffer;
+        std::vector<TraceFrame>                _frames;
+        std::vector<std::pair<size_t, size_t>> _exitJumps;
+        std::array<size_t, 3>                  _mark;
+};
+
+auto Compiler::CompileTrace(const std::vector<TraceStep>& steps, size_t function, ExecutableMemory& memory) -> Trace {
+#ifdef YUN_JIT
+    if (steps.empty())
+        return {  };
+
+    try {
+        std::vector<uint8_t> code;
+        CodeBuffer buffer{ code };
+        TraceWriter writer{ _unit, _runtime, steps, function, buffer };
+        static_cast<void>(buffer.Prologue(_runtime));
+
+        // The first iteration checks the types of the registers as it reads them.
+        // The next one starts out knowing them, so unless a type changes from one
+        // iteration to another, it loops to itself without checking them again
+        std::vector<Primitives::Type> types;
+        const auto first = buffer.Size();
+        if (!writer.Iteration(types))
+            return {  };
+
+        const auto known = types;
+        const auto loop  = buffer.Size();
+        writer.Mark();
+
+        const auto agrees = [&] {
+            for (size_t i = 0; i != known.size(); ++i)
+                if (known[i] != Unknown && known[i] != types[i])
+                    return false;
+            return true;
+        };
+        if (writer.Iteration(types) && agrees())
+            buffer.Patch(buffer.Jump(Always), loop);
+        else {
+            writer.Rewind();
+            buffer.Patch(buffer.Jump(Always), first);
+        }
+        writer.WriteExits();
+
+        const auto base = memory.Load(code);
+        if (base == nullptr)
+            return {  };
+        return { reinterpret_cast<TraceFunction>(base), std::move(writer.Exits), writer.Registers };
+    } catch (const std::exception&) {
+        // Left to the interpreter
+        return {  };
+    }
+#else
+    static_cast<void>(steps);
+    static_cast<void>(function);
+    static_cast<void>(memory);
+    return {  };
+#endif
+}
+
+}
\ No newline at end of file
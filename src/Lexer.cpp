@@ -23,125 +23,24 @@ struct MappedValues {
     VM::Instructions::Opcode InstrValue;
 };
 
-const static std::map<std::string, MappedValues> Keywords{
-    { "true",           TokenType::True },
-    { "false",          TokenType::False },
-    { "function",       TokenType::Function },
-    { "registers",      TokenType::RegistersAttribute },
-    { "returns",        TokenType::ReturnsAttribute },
-    { "parameters",     TokenType::ParametersAttribute },
-    { "i32neg",       { TokenType::Instruction, VM::Instructions::Opcode::i32neg } },
-    { "i32add",       { TokenType::Instruction, VM::Instructions::Opcode::i32add } },
-    { "i32sub",       { TokenType::Instruction, VM::Instructions::Opcode::i32sub } },
-    { "i32mul",       { TokenType::Instruction, VM::Instructions::Opcode::i32mul } },
-    { "i32div",       { TokenType::Instruction, VM::Instructions::Opcode::i32div } },
-    { "i32rem",       { TokenType::Instruction, VM::Instructions::Opcode::i32rem } },
-    { "i32and",       { TokenType::Instruction, VM::Instructions::Opcode::i32and } },
-    { "i32or",        { TokenType::Instruction, VM::Instructions::Opcode::i32or  } },
-    { "i32xor",       { TokenType::Instruction, VM::Instructions::Opcode::i32xor } },
-    { "i32shl",       { TokenType::Instruction, VM::Instructions::Opcode::i32shl } },
-    { "i32shr",       { TokenType::Instruction, VM::Instructions::Opcode::i32shr } },
-    { "i64neg",       { TokenType::Instruction, VM::Instructions::Opcode::i64neg } },
-    { "i64add",       { TokenType::Instruction, VM::Instructions::Opcode::i64add } },
-    { "i64sub",       { TokenType::Instruction, VM::Instructions::Opcode::i64sub } },
-    { "i64mul",       { TokenType::Instruction, VM::Instructions::Opcode::i64mul } },
-    { "i64div",       { TokenType::Instruction, VM::Instructions::Opcode::i64div } },
-    { "i64rem",       { TokenType::Instruction, VM::Instructions::Opcode::i64rem } },
-    { "i64and",       { TokenType::Instruction, VM::Instructions::Opcode::i64and } },
-    { "i64or",        { TokenType::Instruction, VM::Instructions::Opcode::i64or } },
-    { "i64xor",       { TokenType::Instruction, VM::Instructions::Opcode::i64xor } },
-    { "i64shl",       { TokenType::Instruction, VM::Instructions::Opcode::i64shl } },
-    { "i64shr",       { TokenType::Instruction, VM::Instructions::Opcode::i64shr } },
-    { "u32add",       { TokenType::Instruction, VM::Instructions::Opcode::u32add } },
-    { "u32sub",       { TokenType::Instruction, VM::Instructions::Opcode::u32sub } },
-    { "u32mul",       { TokenType::Instruction, VM::Instructions::Opcode::u32mul } },
-    { "u32div",       { TokenType::Instruction, VM::Instructions::Opcode::u32div } },
-    { "u32rem",       { TokenType::Instruction, VM::Instructions::Opcode::u32rem } },
-    { "u32and",       { TokenType::Instruction, VM::Instructions::Opcode::u32and } },
-    { "u32or",        { TokenType::Instruction, VM::Instructions::Opcode::u32or } },
-    { "u32xor",       { TokenType::Instruction, VM::Instructions::Opcode::u32xor } },
-    { "u32shl",       { TokenType::Instruction, VM::Instructions::Opcode::u32shl } },
-    { "u32shr",       { TokenType::Instruction, VM::Instructions::Opcode::u32shr } },
-    { "u64add",       { TokenType::Instruction, VM::Instructions::Opcode::u64add } },
-    { "u64sub",       { TokenType::Instruction, VM::Instructions::Opcode::u64sub } },
-    { "u64mul",       { TokenType::Instruction, VM::Instructions::Opcode::u64mul } },
-    { "u64div",       { TokenType::Instruction, VM::Instructions::Opcode::u64div } },
-    { "u64rem",       { TokenType::Instruction, VM::Instructions::Opcode::u64rem } },
-    { "u64and",       { TokenType::Instruction, VM::Instructions::Opcode::u64and } },
-    { "u64or",        { TokenType::Instruction, VM::Instructions::Opcode::u64or } },
-    { "u64xor",       { TokenType::Instruction, VM::Instructions::Opcode::u64xor } },
-    { "u64shl",       { TokenType::Instruction, VM::Instructions::Opcode::u64shl } },
-    { "u64shr",       { TokenType::Instruction, VM::Instructions::Opcode::u64shr } },
-    { "f32neg",       { TokenType::Instruction, VM::Instructions::Opcode::f32neg } },
-    { "f32add",       { TokenType::Instruction, VM::Instructions::Opcode::f32add } },
-    { "f32sub",       { TokenType::Instruction, VM::Instructions::Opcode::f32sub } },
-    { "f32mul",       { TokenType::Instruction, VM::Instructions::Opcode::f32mul } },
-    { "f32div",       { TokenType::Instruction, VM::Instructions::Opcode::f32div } },
-    { "f32rem",       { TokenType::Instruction, VM::Instructions::Opcode::f32rem } },
-    { "f64neg",       { TokenType::Instruction, VM::Instructions::Opcode::f64neg } },
-    { "f64add",       { TokenType::Instruction, VM::Instructions::Opcode::f64add } },
-    { "f64sub",       { TokenType::Instruction, VM::Instructions::Opcode::f64sub } },
-    { "f64mul",       { TokenType::Instruction, VM::Instructions::Opcode::f64mul } },
-    { "f64div",       { TokenType::Instruction, VM::Instructions::Opcode::f64div } },
-    { "f64rem",       { TokenType::Instruction, VM::Instructions::Opcode::f64rem } },
-    { "bnot",         { TokenType::Instruction, VM::Instructions::Opcode::bnot } },
-    { "convi32toi8",  { TokenType::Instruction, VM::Instructions::Opcode::convi32toi8 } },
-    { "convi32toi16", { TokenType::Instruction, VM::Instructions::Opcode::convi32toi16 } },
-    { "convu32tou8",  { TokenType::Instruction, VM::Instructions::Opcode::convu32tou8 } },
-    { "convu32tou16", { TokenType::Instruction, VM::Instructions::Opcode::convu32tou16 } },
-    { "convi32toi64", { TokenType::Instruction, VM::Instructions::Opcode::convi32toi64 } },
-    { "convi32tou64", { TokenType::Instruction, VM::Instructions::Opcode::convi32tou64 } },
-    { "convi32tou32", { TokenType::Instruction, VM::Instructions::Opcode::convi32tou32 } },
-    { "convi32tof32", { TokenType::Instruction, VM::Instructions::Opcode::convi32tof32 } },
-    { "convi32tof64", { TokenType::Instruction, VM::Instructions::Opcode::convi32tof64 } },
-    { "convi64toi32", { TokenType::Instruction, VM::Instructions::Opcode::convi64toi32 } },
-    { "convi64tou32", { TokenType::Instruction, VM::Instructions::Opcode::convi64tou32 } },
-    { "convi64tou64", { TokenType::Instruction, VM::Instructions::Opcode::convi64tou64 } },
-    { "convi64tof32", { TokenType::Instruction, VM::Instructions::Opcode::convi64tof32 } },
-    { "convi64tof64", { TokenType::Instruction, VM::Instructions::Opcode::convi64tof64 } },
-    { "convu32toi64", { TokenType::Instruction, VM::Instructions::Opcode::convu32toi64 } },
-    { "convu32tou64", { TokenType::Instruction, VM::Instructions::Opcode::convu32tou64 } },
-    { "convu32toi32", { TokenType::Instruction, VM::Instructions::Opcode::convu32toi32 } },
-    { "convu32tof32", { TokenType::Instruction, VM::Instructions::Opcode::convu32tof32 } },
-    { "convu32tof64", { TokenType::Instruction, VM::Instructions::Opcode::convu32tof64 } },
-    { "convu64toi64", { TokenType::Instruction, VM::Instructions::Opcode::convu64toi64 } },
-    { "convu64tou32", { TokenType::Instruction, VM::Instructions::Opcode::convu64tou32 } },
-    { "convu64toi32", { TokenType::Instruction, VM::Instructions::Opcode::convu64toi32 } },
-    { "convu64tof32", { TokenType::Instruction, VM::Instructions::Opcode::convu64tof32 } },
-    { "convu64tof64", { TokenType::Instruction, VM::Instructions::Opcode::convu64tof64 } },
-    { "convf32toi32", { TokenType::Instruction, VM::Instructions::Opcode::convf32toi32 } },
-    { "convf32toi64", { TokenType::Instruction, VM::Instructions::Opcode::convf32toi64 } },
-    { "convf32tou32", { TokenType::Instruction, VM::Instructions::Opcode::convf32tou32 } },
-    { "convf32tof64", { TokenType::Instruction, VM::Instructions::Opcode::convf32tof64 } },
-    { "convf32tou64", { TokenType::Instruction, VM::Instructions::Opcode::convf32tou64 } },
-    { "convf64toi32", { TokenType::Instruction, VM::Instructions::Opcode::convf64toi32 } },
-    { "convf64toi64", { TokenType::Instruction, VM::Instructions::Opcode::convf64toi64 } },
-    { "convf64tou32", { TokenType::Instruction, VM::Instructions::Opcode::convf64tou32 } },
-    { "convf64tou64", { TokenType::Instruction, VM::Instructions::Opcode::convf64tou64 } },
-    { "convf64tof32", { TokenType::Instruction, VM::Instructions::Opcode::convf64tof32 } },
-    { "cmp",          { TokenType::Instruction, VM::Instructions::Opcode::cmp } },
-    { "icmp",         { TokenType::Instruction, VM::Instructions::Opcode::icmp } },
-    { "fcmp",         { TokenType::Instruction, VM::Instructions::Opcode::fcmp } },
-    { "jmp",          { TokenType::Instruction, VM::Instructions::Opcode::jmp } },
-    { "je",           { TokenType::Instruction, VM::Instructions::Opcode::je } },
-    { "jne",          { TokenType::Instruction, VM::Instructions::Opcode::jne } },
-    { "jgt",          { TokenType::Instruction, VM::Instructions::Opcode::jgt } },
-    { "jge",          { TokenType::Instruction, VM::Instructions::Opcode::jge } },
-    { "jlt",          { TokenType::Instruction, VM::Instructions::Opcode::jlt } },
-    { "jle",          { TokenType::Instruction, VM::Instructions::Opcode::jle } },
-    { "call",         { TokenType::Instruction, VM::Instructions::Opcode::call } },
-    { "ret",          { TokenType::Instruction, VM::Instructions::Opcode::ret } },
-    { "ldconst",      { TokenType::Instruction, VM::Instructions::Opcode::ldconst } },
-    { "mov",          { TokenType::Instruction, VM::Instructions::Opcode::mov } },
-    { "newarray",     { TokenType::Instruction, VM::Instructions::Opcode::newarray } },
-    { "arraycount",   { TokenType::Instruction, VM::Instructions::Opcode::arraycount } },
-    { "load",         { TokenType::Instruction, VM::Instructions::Opcode::load } },
-    { "store",        { TokenType::Instruction, VM::Instructions::Opcode::store } },
-    { "advance",      { TokenType::Instruction, VM::Instructions::Opcode::advance } },
-    { "printreg",     { TokenType::Instruction, VM::Instructions::Opcode::printreg } },
-    { "nop",          { TokenType::Instruction, VM::Instructions::Opcode::nop } },
-    { "hlt",          { TokenType::Instruction, VM::Instructions::Opcode::hlt } }
-};
+// Instructions are added from the opcode table, except for the ones YASN can't name
+const static auto Keywords = [] {
+    std::map<std::string, MappedValues> keywords{
+        { "true",           TokenType::True },
+        { "false",          TokenType::False },
+        { "function",       TokenType::Function },
+        { "registers",      TokenType::RegistersAttribute },
+        { "returns",        TokenType::ReturnsAttribute },
+        { "parameters",     TokenType::ParametersAttribute },
+        { "memoize",        TokenType::MemoizeAttribute },
+    };
+    for (size_t i = 0; i != VM::Instructions::OpcodeTotal; ++i) {
+        const auto opcode = static_cast<VM::Instructions::Opcode>(i);
+        if (!(VM::Instructions::Info(opcode).Flags & VM::Instructions::Flag::Internal))
+            keywords.emplace(VM::Instructions::OpcodeToString(opcode), MappedValues{ TokenType::Instruction, opcode });
+    }
+    return keywords;
+}();
 
 Token::Token(TokenType type, uint32_t line)
     :Type{ type }, Lexeme{  }, Line{ line } {
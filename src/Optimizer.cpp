@@ -0,0 +1,1595 @@
+// My header files
+#include "../include/Optimizer.hpp"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+
+namespace Yun::ASM {
+
+using VM::Emit::Instruction;
+using VM::Instructions::Opcode;
+using VM::Analysis::SsaForm;
+using VM::Analysis::SsaValue;
+
+// How many times `Global` goes through all of its passes at most
+static constexpr size_t GlobalRounds = 8;
+
+// Callees of up to `InlineSize` instructions are inlined, twice as many for every loop
+// around the call, up to `InlineDepth` loops. Callers stop growing at `MaxInlinedSize`
+static constexpr size_t InlineSize     = 16;
+static constexpr size_t InlineDepth    = 2;
+static constexpr size_t MaxInlinedSize = 4096;
+
+// Functions of up to `SpecializeSize` instructions get at most `MaxSpecializations` clones
+static constexpr size_t SpecializeSize     = 256;
+static constexpr size_t MaxSpecializations = 4;
+
+// A way out of a conditional jump taken less than once in `ColdRatio` times counts as never taken
+static constexpr uint64_t ColdRatio = 100;
+
+// Ways of a branch with up to `SelectSize` copies are turned into selects
+static constexpr size_t SelectSize = 3;
+
+// Innermost loops of up to `VersionSize` instructions are versioned for their array accesses
+static constexpr size_t VersionSize = 64;
+
+// Registers are 12-bit operands
+static constexpr uint32_t MaxRegisters = 0x1000;
+
+// Applies `map` to the registers an instruction names
+template<typename F>
+[[nodiscard]] static auto Renumber(const Instruction& instruction, F map) -> Instruction {
+    using namespace VM::Instructions;
+
+    const auto opcode = instruction.Opcode();
+    const auto& info  = Info(opcode);
+    if (info.Operands < 1 || (info.Flags & (Flag::Jump | Flag::Call)))
+        return instruction;
+
+    const auto dest = map(static_cast<uint32_t>(instruction.Destination()));
+    if (info.Operands == 1)
+        return Instruction{ opcode, static_cast<int32_t>(dest) };
+    const auto src = static_cast<uint32_t>(instruction.Source());
+    return Instruction{ opcode, dest, opcode == Opcode::ldconst? src : map(src) };
+}
+
+Optimizer::Optimizer(const VM::Containers::SymbolTable& symbols, VM::Containers::ConstantPool& constants) noexcept
+    :_symbols{ symbols }, _constants{ constants } {
+}
+
+auto Optimizer::Peephole(size_t function, std::vector<Instruction>& body) -> bool {
+    if (!JumpsStayInside(body))
+        return false;
+
+    // Every rewrite makes the body shorter or cheaper, so this ends
+    bool changed = false;
+    for (bool again = !body.empty(); again; changed |= again) {
+        std::vector<bool> removed(body.size(), false);
+        again  = Retarget(body);
+        again |= Rewrite(function, body, removed);
+        if (std::find(removed.begin(), removed.end(), true) != removed.end())
+            Compact(body, removed);
+    }
+    return changed;
+}
+
+// Every pass puts the function in SSA form anew, which
+// is simpler than keeping it up to date as the code changes
+auto Optimizer::Global(size_t function, std::vector<Instruction>& body) -> bool {
+    if (!JumpsStayInside(body))
+        return false;
+
+    bool changed = false;
+    for (size_t round = 0; round != GlobalRounds; ++round) {
+        bool again = FoldConstants(function, body);
+        again |= RemoveRedundancies(function, body);
+        again |= EliminateDeadCode(function, body);
+        again |= HoistInvariants(function, body);
+        if (!again)
+            break;
+        changed = true;
+    }
+    return changed;
+}
+
+auto Optimizer::Inline(std::vector<VM::Containers::Symbol>& symbols, std::vector<std::vector<Instruction>>& bodies) -> bool {
+    using namespace VM::Instructions;
+
+    // Callees come before their callers, so they've taken in their own callees by then
+    std::vector<size_t> order{  };
+    std::vector<bool> visited(bodies.size(), false);
+    for (size_t root = 0; root != bodies.size(); ++root) {
+        if (visited[root])
+            continue;
+        visited[root] = true;
+
+        std::vector<std::pair<size_t, size_t>> stack{ { root, 0 } };
+        while (!stack.empty()) {
+            auto& [function, next] = stack.back();
+            const auto& body = bodies[function];
+            while (next != body.size() && !IsCall(body[next].Opcode()))
+                ++next;
+            if (next == body.size()) {
+                order.push_back(function);
+                stack.pop_back();
+                continue;
+            }
+
+            const auto callee = static_cast<size_t>(body[next++].Destination());
+            if (!visited[callee]) {
+                visited[callee] = true;
+                stack.emplace_back(callee, 0);
+            }
+        }
+    }
+
+    std::vector<int8_t> inlinable(bodies.size(), -1);
+    bool changed = false;
+    for (const auto caller : order) {
+        auto& body   = bodies[caller];
+        auto& symbol = symbols[caller];
+        if (!JumpsStayInside(body))
+            continue;
+
+        // The callees' registers go right after the caller's parameters and return value.
+        // Calls pass arguments in the last registers, so those have to stay the last ones.
+        // Inlined callees write their registers before reading them, so they can share them
+        const uint32_t base = std::max<uint32_t>(symbol.Arguments, symbol.DoesReturn? 1 : 0);
+        uint32_t reserved = 0;
+
+        for (;;) {
+            const VM::Analysis::ControlFlowGraph graph{ body };
+            const VM::Analysis::Dominators dominators{ graph };
+            std::vector<size_t> depth(graph.Count(), 0);
+            for (const auto& [header, members] : VM::Analysis::NaturalLoops(graph, dominators))
+                for (size_t block = 0; block != members.size(); ++block)
+                    depth[block] += members[block];
+
+            uint32_t top = 0;
+            for (const auto& instruction : body) {
+                if (instruction.Opcode() != Opcode::call)
+                    continue;
+                const auto& callee = symbols[static_cast<size_t>(instruction.Destination())];
+                top = std::max<uint32_t>({ top, callee.Arguments, callee.DoesReturn? 1u : 0u });
+            }
+
+            auto site = body.size();
+            for (size_t i = 0; i != body.size() && site == body.size(); ++i) {
+                if (body[i].Opcode() != Opcode::call || !dominators.Reachable(graph.BlockOf(i)))
+                    continue;
+
+                const auto callee = static_cast<size_t>(body[i].Destination());
+                if (callee == caller)
+                    continue;
+                if (inlinable[callee] < 0)
+                    inlinable[callee] = IsInlinable(symbols[callee], bodies[callee]);
+
+                const auto grow = symbols[callee].Registers > reserved? symbols[callee].Registers - reserved : 0u;
+                if (inlinable[callee] &&
+                    bodies[callee].size() <= InlineSize << std::min(depth[graph.BlockOf(i)], InlineDepth) &&
+                    body.size() + bodies[callee].size() <= MaxInlinedSize &&
+                    symbol.Registers + grow <= MaxRegisters && base + reserved + top <= symbol.Registers)
+                    site = i;
+            }
+            if (site == body.size())
+                break;
+
+            const auto& callee = symbols[static_cast<size_t>(body[site].Destination())];
+            const auto& inlined = bodies[static_cast<size_t>(body[site].Destination())];
+            if (const auto grow = callee.Registers > reserved? callee.Registers - reserved : 0u; grow != 0) {
+                for (auto& instruction : body)
+                    instruction = Renumber(instruction, [&](uint32_t reg) { return reg >= base + reserved? reg + grow : reg; });
+                symbol.Registers += grow;
+                reserved += grow;
+            }
+
+            // The arguments are copied like a call would, and every `ret` copies the return
+            // value like returning would, then jumps past the spliced code
+            const uint32_t count = symbol.Registers;
+            const size_t returns = callee.DoesReturn && callee.Registers != 0? 2 : 1;
+            std::vector<size_t> position(inlined.size(), 0);
+            auto end = static_cast<size_t>(callee.Arguments);
+            for (size_t k = 0; k != inlined.size(); ++k) {
+                position[k] = end;
+                end += inlined[k].Opcode() == Opcode::ret? returns : 1;
+            }
+
+            std::vector<Instruction> spliced{  };
+            for (uint32_t j = 0; j != callee.Arguments; ++j)
+                spliced.emplace_back(Opcode::mov, base + j, count - callee.Arguments + j);
+            for (size_t k = 0; k != inlined.size(); ++k) {
+                auto instruction = inlined[k];
+                if (instruction.Opcode() == Opcode::ret) {
+                    if (returns == 2)
+                        spliced.emplace_back(Opcode::mov, count - 1, base);
+                    spliced.emplace_back(Opcode::jmp, static_cast<int32_t>((end - spliced.size()) * 4));
+                    continue;
+                } else if (IsJump(instruction.Opcode())) {
+                    const auto target = static_cast<size_t>(VM::Analysis::JumpTarget(instruction, k));
+                    instruction.PatchOffset(static_cast<int32_t>((static_cast<int64_t>(position[target]) - static_cast<int64_t>(position[k])) * 4));
+                } else
+                    instruction = Renumber(instruction, [&](uint32_t reg) { return reg + base; });
+                spliced.push_back(instruction);
+            }
+
+            std::vector<bool> removed(body.size(), false);
+            std::vector<std::vector<Instruction>> inserted(body.size());
+            removed[site]  = true;
+            inserted[site] = std::move(spliced);
+            Compact(body, removed, inserted, std::vector<bool>(body.size(), true));
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// A clone starts by loading the constants its arguments are known to hold. Those loads are redundant, but the
+// global passes fold the constants through the clone from there. A clone that doesn't get smaller than its
+// original does isn't worth it. Clones only call the originals, so nothing gets cloned twice
+auto Optimizer::Specialize(std::vector<VM::Containers::Symbol>& symbols, std::vector<std::vector<Instruction>>& bodies) -> bool {
+    const auto count = bodies.size();
+
+    // Clones by the function they're made of and the constants by argument, -1 if it isn't one.
+    // A clone that isn't worth it is the original function itself
+    std::map<std::pair<size_t, std::vector<int64_t>>, size_t> clones{  };
+    std::vector<size_t> made(count, 0);
+    std::vector<size_t> optimized(count, 0);
+
+    // Calls are pointed at the clones only once every caller is done, since
+    // the analyses of the originals only know about the declared functions
+    std::vector<std::tuple<size_t, size_t, size_t>> calls{  };
+    for (size_t caller = 0; caller != count; ++caller) {
+        if (!JumpsStayInside(bodies[caller]))
+            continue;
+
+        // Clones are added as it goes, so these are copies
+        const auto body   = bodies[caller];
+        const auto symbol = symbols[caller];
+        const VM::Analysis::ControlFlowGraph graph{ body };
+        const VM::Analysis::Dominators dominators{ graph };
+        const SsaForm ssa{ body, graph, dominators, symbol, _symbols, _constants };
+        if (!ssa.Numbered())
+            continue;
+
+        for (size_t i = 0; i != body.size(); ++i) {
+            if (body[i].Opcode() != Opcode::call || !dominators.Reachable(graph.BlockOf(i)))
+                continue;
+
+            const auto callee = static_cast<size_t>(body[i].Destination());
+            const auto target = symbols[callee];
+            if (target.Arguments == 0 || target.Arguments > symbol.Registers || bodies[callee].empty() ||
+                bodies[callee].size() > SpecializeSize || !JumpsStayInside(bodies[callee]))
+                continue;
+
+            // Arguments are the caller's last registers
+            std::pair<size_t, std::vector<int64_t>> key{ callee, std::vector<int64_t>(target.Arguments, -1) };
+            bool constant = false;
+            for (uint32_t j = 0; j != target.Arguments; ++j) {
+                const auto number = ssa.Number(ssa.Before(i, symbol.Registers - target.Arguments + j));
+                if (number == SsaForm::None)
+                    continue;
+                const auto& origin = ssa.At(number);
+                if (origin.Kind != SsaValue::Origin::Instruction || body[origin.At].Opcode() != Opcode::ldconst)
+                    continue;
+
+                // The same constant may be in the pool more than once
+                const auto& value = _constants.Read(static_cast<size_t>(body[origin.At].Source()));
+                const auto index = _constants.FindOrAdd<uint64_t>(value);
+                if (index == VM::Containers::ConstantPool::Capacity)
+                    continue;
+                key.second[j] = static_cast<int64_t>(index);
+                constant = true;
+            }
+            if (!constant)
+                continue;
+
+            auto clone = clones.find(key);
+            if (clone == clones.end()) {
+                if (made[callee] == MaxSpecializations)
+                    continue;
+
+                if (optimized[callee] == 0) {
+                    auto original = bodies[callee];
+                    static_cast<void>(Global(callee, original));
+                    optimized[callee] = original.size();
+                }
+
+                std::vector<std::vector<Instruction>> loads(bodies[callee].size());
+                for (uint32_t j = 0; j != target.Arguments; ++j)
+                    if (key.second[j] >= 0)
+                        loads[0].emplace_back(Opcode::ldconst, j, static_cast<uint32_t>(key.second[j]));
+
+                // Jumps back to the start don't load the constants again, the arguments might have changed by then
+                auto specialized = bodies[callee];
+                Compact(specialized, std::vector<bool>(specialized.size(), false), loads);
+                static_cast<void>(Global(callee, specialized));
+
+                if (specialized.size() >= optimized[callee])
+                    clone = clones.emplace(key, callee).first;
+                else {
+                    clone = clones.emplace(key, symbols.size()).first;
+                    symbols.push_back(target);
+                    symbols.back().Name += "." + std::to_string(++made[callee]);
+                    bodies.push_back(std::move(specialized));
+                }
+            }
+
+            if (clone->second != callee)
+                calls.emplace_back(caller, i, clone->second);
+        }
+    }
+
+    for (const auto& [caller, at, clone] : calls)
+        bodies[caller][at] = Instruction{ Opcode::call, static_cast<int32_t>(clone) };
+    return !calls.empty();
+}
+
+// The parameters and the register a function returns in stay where they are, and so do the registers
+// of the area its calls pass arguments in and return to, relative to the end of the frame. The ones in
+// between are colored greedily, a copy preferring the color of what it copies. A register that is read
+// before it's written would see something else once it moves, so functions with one are left alone
+auto Optimizer::CompactRegisters(size_t function, std::vector<Instruction>& body, VM::Containers::Symbol& symbol) -> bool {
+    using namespace VM::Instructions;
+
+    const auto& declared = _symbols.At(function);
+    const uint32_t registers = declared.Registers;
+    if (body.empty() || !JumpsStayInside(body))
+        return false;
+
+    uint32_t top = 0;
+    for (const auto& instruction : body) {
+        const auto& info = Info(instruction.Opcode());
+        if (info.Flags & Flag::Call) {
+            const auto& callee = _symbols.At(instruction.Destination());
+            top = std::max<uint32_t>({ top, callee.Arguments, callee.DoesReturn? 1u : 0u });
+        } else if (info.Operands >= 1 && !(info.Flags & Flag::Jump)) {
+            // Registers the frame doesn't have are left for the VM to report
+            if (static_cast<uint32_t>(instruction.Destination()) >= registers ||
+                (info.Operands == 2 && instruction.Opcode() != Opcode::ldconst && static_cast<uint32_t>(instruction.Source()) >= registers))
+                return false;
+        }
+    }
+
+    const uint32_t low = std::max<uint32_t>(declared.Arguments, declared.DoesReturn? 1 : 0);
+    if (low + top >= registers)
+        return false;
+    const auto middle = registers - top - low;
+
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Liveness liveness{ body, graph, declared, _symbols };
+    const auto entry = liveness.LiveBefore(0);
+    for (auto reg = low; reg != registers; ++reg)
+        if (entry[reg])
+            return false;
+
+    // A write interferes with everything live after it, except for what a copy copies
+    std::vector<bool> interferes(static_cast<size_t>(middle) * middle, false);
+    std::vector<bool> used(middle, false);
+    std::vector<uint32_t> copies(middle, middle);
+    for (size_t i = 0; i != body.size(); ++i) {
+        for (const auto reg : VM::Analysis::Reads(body[i], declared, _symbols))
+            if (reg >= low && reg - low < middle)
+                used[reg - low] = true;
+
+        const auto written = VM::Analysis::Writes(body[i], declared, _symbols);
+        if (written < static_cast<int64_t>(low) || written - low >= middle)
+            continue;
+        const auto def = static_cast<uint32_t>(written - low);
+        used[def] = true;
+
+        auto copied = middle;
+        if (body[i].Opcode() == Opcode::mov && static_cast<uint32_t>(body[i].Source()) >= low && body[i].Source() - low < middle)
+            copied = static_cast<uint32_t>(body[i].Source()) - low;
+        if (copied != middle)
+            copies[def] = copied;
+
+        const auto live = liveness.LiveAfter(i);
+        for (uint32_t reg = 0; reg != middle; ++reg) {
+            if (reg == def || reg == copied || !live[low + reg])
+                continue;
+            interferes[static_cast<size_t>(def) * middle + reg] = true;
+            interferes[static_cast<size_t>(reg) * middle + def] = true;
+        }
+    }
+
+    std::vector<uint32_t> color(middle, middle);
+    uint32_t colors = 0;
+    for (uint32_t reg = 0; reg != middle; ++reg) {
+        if (!used[reg])
+            continue;
+
+        std::vector<bool> taken(colors, false);
+        for (uint32_t other = 0; other != middle; ++other)
+            if (color[other] != middle && interferes[static_cast<size_t>(reg) * middle + other])
+                taken[color[other]] = true;
+
+        const auto preferred = copies[reg] != middle? color[copies[reg]] : middle;
+        if (preferred != middle && !taken[preferred])
+            color[reg] = preferred;
+        else
+            color[reg] = static_cast<uint32_t>(std::find(taken.begin(), taken.end(), false) - taken.begin());
+        colors = std::max(colors, color[reg] + 1);
+    }
+
+    const auto count = low + colors + top;
+    if (count >= registers)
+        return false;
+
+    // Copies between registers that got the same color go
+    std::vector<bool> removed(body.size(), false);
+    for (size_t i = 0; i != body.size(); ++i) {
+        body[i] = Renumber(body[i], [&](uint32_t reg) {
+            if (reg < low)
+                return reg;
+            else if (reg - low < middle)
+                return low + color[reg - low];
+            return reg - registers + count;
+        });
+        removed[i] = body[i].Opcode() == Opcode::mov && body[i].Destination() == body[i].Source() && i + 1 != body.size();
+    }
+    if (std::find(removed.begin(), removed.end(), true) != removed.end())
+        Compact(body, removed);
+
+    symbol.Registers = static_cast<uint16_t>(count);
+    return true;
+}
+
+// The jump that's taken exactly when `opcode` isn't, since they all test the same flags
+[[nodiscard]] static auto Inverse(Opcode opcode) noexcept -> Opcode {
+    switch (opcode) {
+    case Opcode::je:  return Opcode::jne;
+    case Opcode::jne: return Opcode::je;
+    case Opcode::jgt: return Opcode::jle;
+    case Opcode::jge: return Opcode::jlt;
+    case Opcode::jlt: return Opcode::jge;
+    case Opcode::jle: return Opcode::jgt;
+    default:          return opcode;
+    }
+}
+
+// Blocks are chained starting with the entry, each one followed by its likelier successor
+// that isn't placed yet. Blocks that no warm path leads to go after all of them, in the order
+// they were in. A conditional jump whose likelier way got placed right after it is inverted
+// to fall through to it, and a `jmp` to the next block goes, so the common way falls through
+auto Optimizer::Layout(std::vector<Instruction>& body, const FunctionProfile& profile) -> bool {
+    using namespace VM::Instructions;
+
+    // The last instruction can't fall through to a block that might move
+    if (profile.Calls == 0 || profile.Size != body.size() || body.empty() ||
+        !(Info(body.back().Opcode()).Flags & Flag::Ends) || !JumpsStayInside(body))
+        return false;
+
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const auto& blocks = graph.Blocks();
+    const auto count = blocks.size();
+
+    const auto target = [&](size_t block) {
+        const auto last = blocks[block].End - 1;
+        return graph.BlockOf(static_cast<size_t>(VM::Analysis::JumpTarget(body[last], last)));
+    };
+    // How often a block went on to its successors, the one it jumps to first
+    const auto weights = [&](size_t block) -> std::pair<uint64_t, uint64_t> {
+        const auto last = blocks[block].End - 1;
+        const auto it = profile.Branches.find(last);
+        return it == profile.Branches.end()? std::pair<uint64_t, uint64_t>{ 0, 0 } : it->second;
+    };
+    const auto warm = [](uint64_t weight, uint64_t total) {
+        return weight != 0 && weight * ColdRatio >= total;
+    };
+
+    // Successors of a block, likelier first, and only the warm ones
+    const auto successors = [&](size_t block) {
+        const auto opcode = body[blocks[block].End - 1].Opcode();
+        if (!(Info(opcode).Flags & Flag::Conditional) || target(block) == block + 1)
+            return blocks[block].Successors;
+
+        const auto [taken, notTaken] = weights(block);
+        std::vector<std::pair<uint64_t, size_t>> ways{  };
+        if (warm(notTaken, taken + notTaken))
+            ways.emplace_back(notTaken, block + 1);
+        if (warm(taken, taken + notTaken))
+            ways.emplace_back(taken, target(block));
+        std::stable_sort(ways.begin(), ways.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+        std::vector<size_t> likelier{  };
+        for (const auto& way : ways)
+            likelier.push_back(way.second);
+        return likelier;
+    };
+
+    std::vector<bool> hot(count, false);
+    std::vector<size_t> worklist{ 0 };
+    hot[0] = true;
+    while (!worklist.empty()) {
+        const auto block = worklist.back();
+        worklist.pop_back();
+        for (auto successor : successors(block))
+            if (!hot[successor]) {
+                hot[successor] = true;
+                worklist.push_back(successor);
+            }
+    }
+
+    std::vector<size_t> order{  };
+    std::vector<bool> placed(count, false);
+    for (size_t first = 0; first != count; ++first) {
+        for (auto block = first; hot[block] && !placed[block]; ) {
+            placed[block] = true;
+            order.push_back(block);
+
+            const auto next = successors(block);
+            const auto it = std::find_if(next.begin(), next.end(), [&](size_t successor) { return !placed[successor]; });
+            if (it == next.end())
+                break;
+            block = *it;
+        }
+    }
+    for (size_t block = 0; block != count; ++block)
+        if (!placed[block])
+            order.push_back(block);
+
+    // Jumps are pointed at their blocks once all of them are placed
+    std::vector<Instruction> laid{  };
+    std::vector<size_t> start(count, 0);
+    std::vector<std::pair<size_t, size_t>> jumps{  };
+    const auto jump = [&](Opcode opcode, size_t to) {
+        jumps.emplace_back(laid.size(), to);
+        laid.emplace_back(opcode, 0);
+    };
+    for (size_t k = 0; k != count; ++k) {
+        const auto block = order[k];
+        const auto next = k + 1 != count? order[k + 1] : count;
+        start[block] = laid.size();
+
+        laid.insert(laid.end(), body.begin() + blocks[block].Begin, body.begin() + blocks[block].End - 1);
+        const auto& last = body[blocks[block].End - 1];
+        const auto opcode = last.Opcode();
+        if (opcode == Opcode::jmp) {
+            if (target(block) != next)
+                jump(opcode, target(block));
+        } else if (Info(opcode).Flags & Flag::Conditional) {
+            if (target(block) == next && target(block) != block + 1)
+                jump(Inverse(opcode), block + 1);
+            else {
+                jump(opcode, target(block));
+                if (next != block + 1)
+                    jump(Opcode::jmp, block + 1);
+            }
+        } else {
+            laid.push_back(last);
+            if (!(Info(opcode).Flags & Flag::Ends) && next != block + 1)
+                jump(Opcode::jmp, block + 1);
+        }
+    }
+    for (const auto& [at, to] : jumps)
+        laid[at].PatchOffset(static_cast<int32_t>((static_cast<int64_t>(start[to]) - static_cast<int64_t>(at)) * 4));
+
+    if (laid.size() == body.size() && std::is_sorted(order.begin(), order.end()))
+        return false;
+    body = std::move(laid);
+    return true;
+}
+
+// The select that copies exactly when `jump` is taken
+[[nodiscard]] static auto SelectOf(Opcode jump) noexcept -> Opcode {
+    return static_cast<Opcode>(static_cast<uint8_t>(Opcode::cmove) + static_cast<uint8_t>(jump) - static_cast<uint8_t>(Opcode::je));
+}
+
+// Matches `jcc L; mov...; L:` and `jcc L1; mov...; jmp L2; L1: mov...; L2:`, where nothing else
+// jumps into the copies. The copies of each way turn into selects on the condition that led
+// there, and the jumps go. Both ways then test the same flags, so they run one after the other
+auto Optimizer::IfConvert(std::vector<Instruction>& body) -> bool {
+    using namespace VM::Instructions;
+
+    if (!JumpsStayInside(body))
+        return false;
+
+    std::vector<size_t> entries(body.size(), 0);
+    for (size_t i = 0; i != body.size(); ++i)
+        if (IsJump(body[i].Opcode()))
+            ++entries[static_cast<size_t>(VM::Analysis::JumpTarget(body[i], i))];
+
+    // Only the first copy of the way the conditional jump leads to is entered
+    const auto copies = [&](size_t begin, size_t end, size_t entered) {
+        if (end - begin > SelectSize)
+            return false;
+        for (auto k = begin; k != end; ++k)
+            if (body[k].Opcode() != Opcode::mov || entries[k] != (k == begin? entered : 0))
+                return false;
+        return true;
+    };
+
+    std::vector<bool> removed(body.size(), false);
+    bool changed = false;
+    for (size_t i = 0; i != body.size(); ++i) {
+        const auto opcode = body[i].Opcode();
+        if (!(Info(opcode).Flags & Flag::Conditional))
+            continue;
+
+        const auto target = static_cast<size_t>(VM::Analysis::JumpTarget(body[i], i));
+        if (target <= i + 1)
+            continue;
+
+        auto end   = target;
+        auto merge = target;
+        if (body[target - 1].Opcode() == Opcode::jmp) {
+            end   = target - 1;
+            merge = static_cast<size_t>(VM::Analysis::JumpTarget(body[end], end));
+            if (merge < target || entries[end] != 0 || !copies(target, merge, 1))
+                continue;
+        }
+        if (!copies(i + 1, end, 0))
+            continue;
+
+        // mov a, b; mov a, c where a isn't c needs only one select
+        const auto diamond = merge != target;
+        const auto single  = diamond && end == i + 2 && merge == target + 1 &&
+                             body[i + 1].Destination() == body[target].Destination() && body[i + 1].Destination() != body[target].Source();
+
+        const auto select = [&](size_t k, Opcode replacement) {
+            body[k] = Instruction{ replacement, static_cast<uint32_t>(body[k].Destination()), static_cast<uint32_t>(body[k].Source()) };
+        };
+        for (auto k = i + 1; k != end && !single; ++k)
+            select(k, SelectOf(Inverse(opcode)));
+        for (auto k = target; k != merge; ++k)
+            select(k, SelectOf(opcode));
+
+        removed[i] = changed = true;
+        if (end != target)
+            removed[end] = true;
+        i = merge - 1;
+    }
+
+    if (changed)
+        Compact(body, removed);
+    return changed;
+}
+
+// Rotated loops compare their index against the count of the array only at the bottom, so the first
+// round isn't known to stay in range. Such a loop gets a copy of itself, which is only entered after
+// comparing the index once more. Every way into the copy's header is then guarded, so the VM finds
+// its accesses in range, see `Analysis::ArrayBounds`, and the original is left for when the comparison
+// fails. Only innermost loops whose header compares before reading the flags are copied
+auto Optimizer::VersionLoops(size_t function, std::vector<Instruction>& body) -> bool {
+    using namespace VM::Instructions;
+    using VM::Primitives::Type;
+
+    if (!JumpsStayInside(body))
+        return false;
+
+    const auto& symbol = _symbols.At(function);
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Dominators dominators{ graph };
+    const SsaForm ssa{ body, graph, dominators, symbol, _symbols, _constants };
+    if (!ssa.Numbered())
+        return false;
+    const VM::Analysis::ArrayBounds bounds{ body, graph, dominators, ssa, symbol };
+
+    const auto& blocks = graph.Blocks();
+    const auto loops = VM::Analysis::NaturalLoops(graph, dominators);
+
+    // The copies go right before the headers. Their jumps out of the loop, by where they
+    // lead, are pointed at the instructions once it's known where those end up
+    std::vector<std::vector<Instruction>> inserted(body.size());
+    std::vector<std::vector<std::pair<size_t, size_t>>> leaving(body.size());
+    std::vector<bool> entering(body.size(), false);
+    bool changed = false;
+
+    for (const auto& [header, members] : loops) {
+        const auto begin = blocks[header].Begin;
+
+        size_t size = 0;
+        bool innermost = true;
+        for (size_t block = 0; block != blocks.size(); ++block)
+            if (members[block]) {
+                size += blocks[block].End - blocks[block].Begin;
+                innermost &= block == header || loops.count(block) == 0;
+            }
+        if (!innermost || size > VersionSize)
+            continue;
+        if (begin != 0 && members[graph.BlockOf(begin - 1)] && !(Info(body[begin - 1].Opcode()).Flags & Flag::Ends))
+            continue;
+
+        // The comparison in front of the loop can't overwrite flags the header reads
+        bool compares = false;
+        for (auto i = begin; i != blocks[header].End && !compares; ++i) {
+            const auto flags = Info(body[i].Opcode()).Flags;
+            if ((flags & (Flag::Conditional | Flag::Selects | Flag::Call)) || ((flags & Flag::Ends) && !(flags & Flag::Jump)))
+                break;
+            compares = (flags & Flag::SetsFlags) != 0;
+        }
+        if (!compares)
+            continue;
+
+        // The count a phi of the header is below on every way around the loop, or `None`
+        const auto guarded = [&](size_t phi, size_t array) {
+            const auto operands = ssa.Operands(phi);
+            auto count = SsaForm::None;
+            size_t k = header == 0? 1 : 0;
+            for (const auto predecessor : blocks[header].Predecessors) {
+                if (!dominators.Reachable(predecessor))
+                    continue;
+                const auto operand = operands[k++];
+                if (!members[predecessor])
+                    continue;
+                count = bounds.Guard(predecessor, header, operand, array);
+                if (count == SsaForm::None)
+                    return SsaForm::None;
+            }
+            return count;
+        };
+
+        auto index = SsaForm::None;
+        auto count = SsaForm::None;
+        for (size_t i = 0; i != body.size() && index == SsaForm::None; ++i) {
+            const auto opcode = body[i].Opcode();
+            if (!members[graph.BlockOf(i)] || bounds.InBounds(i) || (opcode != Opcode::load && opcode != Opcode::store && opcode != Opcode::advance))
+                continue;
+
+            const auto [value, array] = bounds.Access(i);
+            if (value == SsaForm::None || array == SsaForm::None)
+                continue;
+            const auto& origin = ssa.At(value);
+            if (origin.Kind == SsaValue::Origin::Phi && origin.At == header && (count = guarded(value, array)) != SsaForm::None)
+                index = value;
+        }
+        if (index == SsaForm::None)
+            continue;
+
+        // Both sides of the comparison must already be in registers of the same type, so it can't fault
+        const auto reg = ssa.At(index).Register;
+        auto limit = symbol.Registers;
+        for (uint32_t candidate = 0; candidate != symbol.Registers && limit == symbol.Registers; ++candidate)
+            if (candidate != reg && ssa.Before(begin, candidate) == count)
+                limit = candidate;
+        const auto type = ssa.TypeOf(index);
+        if (limit == symbol.Registers || ssa.TypeOf(count) != type || (type != Type::Uint32 && type != Type::Uint64))
+            continue;
+
+        // The header comes first, so the comparison falls through to it. Blocks that fall through
+        // to one that doesn't follow them in the copy jump there instead
+        std::vector<size_t> order{ header };
+        for (size_t block = 0; block != blocks.size(); ++block)
+            if (members[block] && block != header)
+                order.push_back(block);
+
+        std::vector<Instruction> copy{ Instruction{ Opcode::cmp, reg, limit }, Instruction{ Opcode::jge, 0 } };
+        std::vector<std::pair<size_t, size_t>> inner{  };
+        std::vector<std::pair<size_t, size_t>> outer{  };
+        std::vector<size_t> start(blocks.size(), 0);
+        const auto jump = [&](size_t to) {
+            const auto block = graph.BlockOf(to);
+            if (members[block])
+                inner.emplace_back(copy.size(), block);
+            else
+                outer.emplace_back(copy.size(), to);
+        };
+
+        bool fits = true;
+        for (size_t k = 0; k != order.size() && fits; ++k) {
+            const auto block = order[k];
+            start[block] = copy.size();
+            for (auto i = blocks[block].Begin; i != blocks[block].End; ++i) {
+                if (IsJump(body[i].Opcode()))
+                    jump(static_cast<size_t>(VM::Analysis::JumpTarget(body[i], i)));
+                copy.push_back(body[i]);
+            }
+
+            const auto end = blocks[block].End;
+            if (Info(body[end - 1].Opcode()).Flags & Flag::Ends)
+                continue;
+            fits = end != body.size();
+            if (fits && (k + 1 == order.size() || order[k + 1] != graph.BlockOf(end))) {
+                jump(end);
+                copy.emplace_back(Opcode::jmp, 0);
+            }
+        }
+        if (!fits)
+            continue;
+
+        for (const auto& [at, block] : inner)
+            copy[at].PatchOffset(static_cast<int32_t>((static_cast<int64_t>(start[block]) - static_cast<int64_t>(at)) * 4));
+        inserted[begin] = std::move(copy);
+        leaving[begin]  = std::move(outer);
+
+        // Only the ways into the loop go through the comparison, the original loop stays as it was
+        for (size_t i = 0; i != body.size(); ++i)
+            if (IsJump(body[i].Opcode()) && VM::Analysis::JumpTarget(body[i], i) == static_cast<int64_t>(begin) && !members[graph.BlockOf(i)])
+                entering[i] = true;
+        changed = true;
+    }
+    if (!changed)
+        return false;
+
+    // Where everything ends up, like in `Compact`. Jumps out of a copy into another
+    // loop that got one go through its comparison, like the other ways into it
+    std::vector<int64_t> index(body.size(), 0);
+    std::vector<int64_t> start(body.size(), 0);
+    int64_t position = 0;
+    for (size_t i = 0; i != body.size(); ++i) {
+        start[i] = position;
+        position += static_cast<int64_t>(inserted[i].size());
+        index[i] = position++;
+    }
+    for (size_t begin = 0; begin != body.size(); ++begin) {
+        auto& copy = inserted[begin];
+        if (copy.empty())
+            continue;
+
+        copy[1].PatchOffset(static_cast<int32_t>((index[begin] - start[begin] - 1) * 4));
+        for (const auto& [at, to] : leaving[begin]) {
+            const auto destination = inserted[to].empty()? index[to] : start[to];
+            copy[at].PatchOffset(static_cast<int32_t>((destination - start[begin] - static_cast<int64_t>(at)) * 4));
+        }
+    }
+
+    Compact(body, std::vector<bool>(body.size(), false), inserted, entering);
+    return true;
+}
+
+// A call gives the callee a frame of its own, so a callee that calls something else would
+// pass it the wrong registers once it's inlined. Its registers also start out empty,
+// which only goes unnoticed if it writes each of them before reading it
+auto Optimizer::IsInlinable(const VM::Containers::Symbol& symbol, const std::vector<Instruction>& body) const -> bool {
+    if (body.empty() || !JumpsStayInside(body))
+        return false;
+    for (const auto& instruction : body)
+        if (VM::Instructions::IsCall(instruction.Opcode()))
+            return false;
+
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Liveness liveness{ body, graph, symbol, _symbols };
+    const auto live = liveness.LiveBefore(0);
+    for (size_t reg = symbol.Arguments; reg < symbol.Registers; ++reg)
+        if (live[reg])
+            return false;
+    return true;
+}
+
+// Functions with jumps that leave them are left for the VM to reject
+auto Optimizer::JumpsStayInside(const std::vector<Instruction>& body) -> bool {
+    for (size_t i = 0; i != body.size(); ++i) {
+        if (!VM::Instructions::IsJump(body[i].Opcode()))
+            continue;
+        const auto target = VM::Analysis::JumpTarget(body[i], i);
+        if (target < 0 || static_cast<size_t>(target) >= body.size())
+            return false;
+    }
+    return true;
+}
+
+// Constant folding. An instruction whose operands are all known constants loads its result
+// instead, unless computing it faults. A conditional jump or select after a comparison of constants
+// in the same block either becomes a `jmp` or `mov` or goes, since it always ends up the same way
+auto Optimizer::FoldConstants(size_t function, std::vector<Instruction>& body) -> bool {
+    using namespace VM::Instructions;
+
+    const auto& symbol = _symbols.At(function);
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Dominators dominators{ graph };
+    const SsaForm ssa{ body, graph, dominators, symbol, _symbols, _constants };
+    if (!ssa.Numbered())
+        return false;
+
+    // Index of the constant a register holds right before an instruction, or -1. Instructions folded
+    // already load what they computed, so whatever was computed from them can be folded too
+    const auto constant = [&](size_t i, uint32_t reg) -> int64_t {
+        const auto number = ssa.Number(ssa.Before(i, reg));
+        if (number == SsaForm::None)
+            return -1;
+        const auto& origin = ssa.At(number);
+        if (origin.Kind != SsaValue::Origin::Instruction || body[origin.At].Opcode() != Opcode::ldconst)
+            return -1;
+        return body[origin.At].Source();
+    };
+
+    std::vector<bool> removed(body.size(), false);
+    bool changed = false;
+    for (size_t i = 0; i + 1 < body.size(); ++i) {
+        const auto block = graph.BlockOf(i);
+        if (!dominators.Reachable(block))
+            continue;
+
+        auto& instruction = body[i];
+        const auto opcode = instruction.Opcode();
+        const auto& info  = Info(opcode);
+        if (info.Flags & (Flag::Conditional | Flag::Selects)) {
+            // Calls leave whatever their callee compared last
+            auto k = i;
+            while (k != graph.Blocks()[block].Begin && !(Info(body[k - 1].Opcode()).Flags & (Flag::SetsFlags | Flag::Call)))
+                --k;
+            if (k == graph.Blocks()[block].Begin || IsCall(body[k - 1].Opcode()))
+                continue;
+
+            const auto& comparison = body[k - 1];
+            const auto lhs = constant(k - 1, static_cast<uint32_t>(comparison.Destination()));
+            const auto rhs = constant(k - 1, static_cast<uint32_t>(comparison.Source()));
+            if (lhs < 0 || rhs < 0)
+                continue;
+
+            // Compared exactly like the VM does it, and left alone if that faults
+            const auto& left  = _constants.Read(static_cast<size_t>(lhs));
+            const auto& right = _constants.Read(static_cast<size_t>(rhs));
+            auto fault = Error::Fault::None;
+            int32_t flags = 0;
+            if (comparison.Opcode() == Opcode::cmp && (fault = left.Comparable<unsigned>(right)) == Error::Fault::None)
+                flags = left.Compare<unsigned>(right);
+            else if (comparison.Opcode() == Opcode::icmp && (fault = left.Comparable<signed>(right)) == Error::Fault::None)
+                flags = left.Compare<signed>(right);
+            else if (comparison.Opcode() == Opcode::fcmp && (fault = left.Comparable<float>(right)) == Error::Fault::None)
+                flags = left.Compare<float>(right);
+            if (fault != Error::Fault::None)
+                continue;
+
+            if (Passes(opcode, flags) && IsSelect(opcode))
+                instruction = Instruction{ Opcode::mov, static_cast<uint32_t>(instruction.Destination()), static_cast<uint32_t>(instruction.Source()) };
+            else if (Passes(opcode, flags))
+                instruction = Instruction{ Opcode::jmp, instruction.Destination() };
+            else
+                removed[i] = true;
+            changed = true;
+            continue;
+        } else if (opcode == Opcode::ldconst || opcode == Opcode::mov || info.Operands < 1 || (info.Flags & ~Flag::Faults) != Flag::Writes)
+            continue;
+
+        const auto dest = constant(i, static_cast<uint32_t>(instruction.Destination()));
+        const auto src  = info.Operands == 2? constant(i, static_cast<uint32_t>(instruction.Source())) : 0;
+        if (dest < 0 || src < 0)
+            continue;
+
+        const auto folded = FoldOperation(opcode, static_cast<size_t>(dest), static_cast<size_t>(src));
+        if (folded < 0)
+            continue;
+        instruction = Instruction{ Opcode::ldconst, static_cast<uint32_t>(instruction.Destination()), static_cast<uint32_t>(folded) };
+        changed = true;
+    }
+
+    if (std::find(removed.begin(), removed.end(), true) != removed.end())
+        Compact(body, removed);
+    return changed;
+}
+
+// Global value numbering and copy propagation. An instruction that writes what its
+// destination already holds goes, one that computes what another register holds becomes
+// a copy of it, and operands that are copies are read from where they were copied from
+auto Optimizer::RemoveRedundancies(size_t function, std::vector<Instruction>& body) -> bool {
+    using namespace VM::Instructions;
+
+    const auto& symbol = _symbols.At(function);
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Dominators dominators{ graph };
+    const SsaForm ssa{ body, graph, dominators, symbol, _symbols, _constants };
+    if (!ssa.Numbered())
+        return false;
+
+    // Follows copies back to the first register that still holds the same value
+    const auto original = [&](size_t i, uint32_t reg) {
+        for (size_t steps = 0; steps != symbol.Registers; ++steps) {
+            const auto value = ssa.Before(i, reg);
+            const auto& origin = ssa.At(value);
+            if (origin.Kind != SsaValue::Origin::Instruction || body[origin.At].Opcode() != Opcode::mov)
+                break;
+
+            const auto source = static_cast<uint32_t>(body[origin.At].Source());
+            if (ssa.Number(ssa.Before(i, source)) != ssa.Number(value))
+                break;
+            reg = source;
+        }
+        return reg;
+    };
+
+    std::vector<bool> removed(body.size(), false);
+    bool changed = false;
+    for (size_t i = 0; i + 1 < body.size(); ++i) {
+        if (!dominators.Reachable(graph.BlockOf(i)))
+            continue;
+
+        auto& instruction = body[i];
+        auto dest = static_cast<uint32_t>(instruction.Destination());
+        if (const auto value = ssa.Defined(i); value != SsaForm::None && !IsCall(instruction.Opcode())) {
+            const auto number = ssa.Number(value);
+            if (number == SsaForm::None)
+                continue;
+            else if (number == ssa.Number(ssa.Before(i, dest))) {
+                removed[i] = changed = true;
+                continue;
+            }
+
+            const auto opcode = instruction.Opcode();
+            for (uint32_t reg = 0; reg != symbol.Registers && opcode != Opcode::ldconst && opcode != Opcode::mov; ++reg) {
+                if (reg != dest && ssa.Number(ssa.Before(i, reg)) == number) {
+                    instruction = Instruction{ Opcode::mov, dest, reg };
+                    changed = true;
+                    break;
+                }
+            }
+        }
+
+        const auto opcode = instruction.Opcode();
+        const auto& info  = Info(opcode);
+        if (info.Operands < 1 || (info.Flags & (Flag::Jump | Flag::Call)))
+            continue;
+
+        // Destinations that are written to keep their name
+        auto src = static_cast<uint32_t>(instruction.Source());
+        if (info.Operands == 2 && opcode != Opcode::ldconst)
+            src = original(i, src);
+        if (!(info.Flags & Flag::Writes))
+            dest = original(i, dest);
+
+        if (dest == static_cast<uint32_t>(instruction.Destination()) && (info.Operands == 1 || src == static_cast<uint32_t>(instruction.Source())))
+            continue;
+        instruction = info.Operands == 1? Instruction{ opcode, static_cast<int32_t>(dest) } : Instruction{ opcode, dest, src };
+        changed = true;
+    }
+
+    if (std::find(removed.begin(), removed.end(), true) != removed.end())
+        Compact(body, removed);
+    return changed;
+}
+
+// Drops unreachable code, harmless instructions whose result nobody reads,
+// and comparisons that can't fault whose result no jump reads
+auto Optimizer::EliminateDeadCode(size_t function, std::vector<Instruction>& body) -> bool {
+    using namespace VM::Instructions;
+    using VM::Primitives::Type;
+
+    const auto& symbol = _symbols.At(function);
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Dominators dominators{ graph };
+    const SsaForm ssa{ body, graph, dominators, symbol, _symbols, _constants };
+    const VM::Analysis::Liveness liveness{ body, graph, symbol, _symbols };
+    if (!ssa.Numbered())
+        return false;
+
+    // Whether the flags are read before something compares again. Calls and returns might
+    // hand them over to the callee or back to the caller, which might read them
+    const auto& blocks = graph.Blocks();
+    const auto read = [&](size_t i, bool live) {
+        const auto flags = Info(body[i].Opcode()).Flags;
+        if ((flags & (Flag::Conditional | Flag::Selects)) || ((flags & (Flag::Call | Flag::Ends)) && !(flags & Flag::Jump)))
+            return true;
+        return live && !(flags & Flag::SetsFlags);
+    };
+    std::vector<bool> flagsIn(blocks.size(), false);
+    for (bool again = true; again; ) {
+        again = false;
+        for (size_t block = blocks.size(); block-- != 0; ) {
+            bool live = blocks[block].Successors.empty();
+            for (const auto successor : blocks[block].Successors)
+                live = live || flagsIn[successor];
+            for (auto i = blocks[block].End; i-- != blocks[block].Begin; )
+                live = read(i, live);
+            if (live && !flagsIn[block])
+                flagsIn[block] = again = true;
+        }
+    }
+
+    std::vector<bool> removed(body.size(), false);
+    bool changed = false;
+    for (size_t block = 0; block != blocks.size(); ++block) {
+        bool live = blocks[block].Successors.empty();
+        for (const auto successor : blocks[block].Successors)
+            live = live || flagsIn[successor];
+
+        for (auto i = blocks[block].End; i-- != blocks[block].Begin; ) {
+            const auto after = live;
+            live = read(i, live);
+            if (i + 1 == body.size())
+                continue;
+            else if (!dominators.Reachable(block)) {
+                removed[i] = changed = true;
+                continue;
+            }
+
+            const auto opcode = body[i].Opcode();
+            if (Info(opcode).Flags & Flag::SetsFlags) {
+                // A comparison faults unless both operands are of the same type of the right kind
+                const auto type  = ssa.TypeOf(ssa.Before(i, static_cast<uint32_t>(body[i].Destination())));
+                const auto valid = opcode == Opcode::cmp?  type == Type::Uint32 || type == Type::Uint64 :
+                                   opcode == Opcode::icmp? type == Type::Int32 || type == Type::Int64 :
+                                                           type == Type::Float32 || type == Type::Float64;
+                if (!after && valid && ssa.TypeOf(ssa.Before(i, static_cast<uint32_t>(body[i].Source()))) == type)
+                    removed[i] = changed = true;
+                continue;
+            }
+
+            const auto reg = VM::Analysis::Writes(body[i], symbol, _symbols);
+            if (reg >= 0 && !IsCall(opcode) && (ssa.Harmless(i) || IsSelect(opcode)) && !liveness.LiveAfter(i)[static_cast<size_t>(reg)])
+                removed[i] = changed = true;
+        }
+    }
+
+    if (changed)
+        Compact(body, removed);
+    return changed;
+}
+
+// Loop-invariant code motion. Harmless instructions of a natural loop whose operands come from
+// outside of it, or from instructions moved before them, move in front of the loop's header,
+// where they run once. A register they write must not be live at the header,
+// and what it holds when the moved instructions are done must be all the loop ever sees
+auto Optimizer::HoistInvariants(size_t function, std::vector<Instruction>& body) -> bool {
+    using namespace VM::Instructions;
+
+    const auto& symbol = _symbols.At(function);
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Dominators dominators{ graph };
+    const SsaForm ssa{ body, graph, dominators, symbol, _symbols, _constants };
+    const VM::Analysis::Liveness liveness{ body, graph, symbol, _symbols };
+    if (!ssa.Numbered())
+        return false;
+
+    const auto& blocks = graph.Blocks();
+    auto loops = VM::Analysis::NaturalLoops(graph, dominators);
+
+    // Inner loops first. Once a loop gives something up, the loops around it wait for the next round
+    std::vector<std::pair<size_t, size_t>> order{  };
+    for (const auto& [header, members] : loops)
+        order.emplace_back(std::count(members.begin(), members.end(), true), header);
+    std::sort(order.begin(), order.end());
+
+    std::vector<bool> removed(body.size(), false);
+    std::vector<std::vector<Instruction>> inserted(body.size());
+    std::vector<bool> entering(body.size(), false);
+    bool changed = false;
+
+    for (const auto& [size, header] : order) {
+        const auto& members = loops[header];
+        const auto begin = blocks[header].Begin;
+
+        // The hoisted code goes right before the header, so nothing in the loop may fall into it
+        if (begin != 0 && members[graph.BlockOf(begin - 1)] && !(Info(body[begin - 1].Opcode()).Flags & Flag::Ends))
+            continue;
+
+        std::vector<size_t> indices{  };
+        for (size_t block = 0; block != blocks.size(); ++block)
+            if (members[block])
+                for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+                    indices.push_back(i);
+        if (std::any_of(indices.begin(), indices.end(), [&](size_t i) { return removed[i]; }))
+            continue;
+
+        const auto inside = [&](size_t value) {
+            const auto& origin = ssa.At(value);
+            if (origin.Kind == SsaValue::Origin::Entry)
+                return false;
+            return members[origin.Kind == SsaValue::Origin::Phi? origin.At : graph.BlockOf(origin.At)];
+        };
+
+        // Where the loop can be left, and what's read after that
+        std::vector<std::pair<size_t, std::vector<bool>>> exits{  };
+        for (size_t block = 0; block != blocks.size(); ++block)
+            if (members[block])
+                for (const auto successor : blocks[block].Successors)
+                    if (!members[successor])
+                        exits.emplace_back(block, liveness.LiveBefore(blocks[successor].Begin));
+
+        // Registers that turn out not to keep what the hoisted code leaves in them
+        // rule out everything that writes them, and the search starts over
+        const auto live = liveness.LiveBefore(begin);
+        std::vector<bool> allowed(symbol.Registers, true);
+        std::vector<bool> hoisted(body.size(), false);
+        std::vector<size_t> chosen{  };
+        for (bool retry = true; retry; ) {
+            retry = false;
+            chosen.clear();
+            std::fill(hoisted.begin(), hoisted.end(), false);
+
+            std::vector<int64_t> last(symbol.Registers, -1);
+            for (const auto i : indices) {
+                const auto reg = VM::Analysis::Writes(body[i], symbol, _symbols);
+                if (i + 1 == body.size() || reg < 0 || IsCall(body[i].Opcode()) || !allowed[reg] || live[reg] || !ssa.Harmless(i))
+                    continue;
+
+                bool invariant = true;
+                for (const auto read : VM::Analysis::Reads(body[i], symbol, _symbols)) {
+                    const auto value = ssa.Before(i, read);
+                    invariant &= last[read] >= 0? value == ssa.Defined(static_cast<size_t>(last[read])) : !inside(value);
+                }
+                if (invariant) {
+                    chosen.push_back(i);
+                    hoisted[i] = true;
+                    last[reg] = static_cast<int64_t>(i);
+                }
+            }
+
+            for (uint32_t reg = 0; reg != symbol.Registers; ++reg) {
+                if (last[reg] < 0)
+                    continue;
+
+                // All the writes are in one block, so whenever it runs, the register ends up
+                // with the last value. If that's read after the loop, the block runs every time
+                const auto block = graph.BlockOf(static_cast<size_t>(last[reg]));
+                for (const auto& [exit, after] : exits)
+                    if (after[reg] && !dominators.Dominates(block, exit))
+                        allowed[reg] = false;
+
+                const auto value = ssa.Defined(static_cast<size_t>(last[reg]));
+                for (const auto i : indices) {
+                    if (hoisted[i])
+                        continue;
+                    const auto reads = VM::Analysis::Reads(body[i], symbol, _symbols);
+                    const bool uses  = std::find(reads.begin(), reads.end(), reg) != reads.end();
+                    if (VM::Analysis::Writes(body[i], symbol, _symbols) == reg || (uses && ssa.Before(i, reg) != value))
+                        allowed[reg] = false;
+                }
+                for (const auto i : chosen)
+                    if (VM::Analysis::Writes(body[i], symbol, _symbols) == reg && graph.BlockOf(i) != block)
+                        allowed[reg] = false;
+                if (!allowed[reg])
+                    retry = true;
+            }
+        }
+        if (chosen.empty())
+            continue;
+
+        for (const auto i : chosen) {
+            removed[i] = true;
+            inserted[begin].push_back(body[i]);
+        }
+        // Only the ways into the loop go through the hoisted code
+        for (size_t i = 0; i != body.size(); ++i)
+            if (IsJump(body[i].Opcode()) && VM::Analysis::JumpTarget(body[i], i) == static_cast<int64_t>(begin) && !members[graph.BlockOf(i)])
+                entering[i] = true;
+        changed = true;
+    }
+
+    if (changed)
+        Compact(body, removed, inserted, entering);
+    return changed;
+}
+
+// Jumps to a `jmp` go straight to where it leads, unless the `jmp`s form a loop
+auto Optimizer::Retarget(std::vector<Instruction>& body) const -> bool {
+    bool changed = false;
+    for (size_t i = 0; i != body.size(); ++i) {
+        if (!VM::Instructions::IsJump(body[i].Opcode()))
+            continue;
+
+        const auto first = static_cast<size_t>(VM::Analysis::JumpTarget(body[i], i));
+        std::vector<bool> visited(body.size(), false);
+        visited[i] = true;
+
+        auto target = first;
+        while (body[target].Opcode() == Opcode::jmp && !visited[target]) {
+            visited[target] = true;
+            target = static_cast<size_t>(VM::Analysis::JumpTarget(body[target], target));
+        }
+        if (body[target].Opcode() == Opcode::jmp || target == first)
+            continue;
+
+        body[i].PatchOffset(static_cast<int32_t>((static_cast<int64_t>(target) - static_cast<int64_t>(i)) * 4));
+        changed = true;
+    }
+    return changed;
+}
+
+// Goes through pairs of adjacent instructions of the same basic block. Instructions
+// are only marked as removed here, so the jump offsets stay valid until `Compact`
+auto Optimizer::Rewrite(size_t function, std::vector<Instruction>& body, std::vector<bool>& removed) -> bool {
+    const VM::Analysis::ControlFlowGraph graph{ body };
+    const VM::Analysis::Liveness liveness{ body, graph, _symbols.At(function), _symbols };
+
+    std::vector<bool> leaders(body.size(), false);
+    for (const auto& block : graph.Blocks())
+        leaders[block.Begin] = true;
+
+    bool changed = false;
+    for (size_t i = 0; i != body.size(); ++i) {
+        auto& first = body[i];
+        const auto opcode = first.Opcode();
+        const auto dest   = static_cast<uint32_t>(first.Destination());
+        const auto src    = static_cast<uint32_t>(first.Source());
+
+        if (VM::Instructions::IsJump(opcode) && VM::Analysis::JumpTarget(first, i) == static_cast<int64_t>(i + 1)) {
+            removed[i] = changed = true;
+            continue;
+        } else if ((opcode == Opcode::mov || VM::Instructions::IsSelect(opcode)) && dest == src) {
+            removed[i] = changed = true;
+            continue;
+        } else if (i + 1 == body.size() || leaders[i + 1])
+            continue;
+
+        auto& second = body[i + 1];
+        const auto nextDest = static_cast<uint32_t>(second.Destination());
+        const auto nextSrc  = static_cast<uint32_t>(second.Source());
+
+        if (opcode == Opcode::mov && second.Opcode() == Opcode::mov) {
+            // mov Ra, Rb; mov Rb, Ra
+            if (nextDest == src && nextSrc == dest)
+                removed[i + 1] = true;
+            // mov Ra, Rb; mov Ra, Rc
+            else if (nextDest == dest && nextSrc != dest)
+                removed[i] = true;
+            // mov Ra, Rb; mov Rc, Ra, where Ra isn't read again
+            else if (nextSrc == dest && !liveness.LiveAfter(i + 1)[dest]) {
+                second = Instruction{ Opcode::mov, nextDest, src };
+                removed[i] = true;
+            } else
+                continue;
+        } else if (opcode == Opcode::ldconst && nextDest == dest && second.Opcode() >= Opcode::convi32toi8 && second.Opcode() <= Opcode::convf64tof32) {
+            const auto folded = FoldConversion(first, second);
+            if (folded < 0)
+                continue;
+            first = Instruction{ Opcode::ldconst, dest, static_cast<uint32_t>(folded) };
+            removed[i + 1] = true;
+        } else if (opcode == Opcode::ldconst && VM::Instructions::OpcodeCount(second.Opcode()) == 2 && nextSrc == dest && nextDest != dest) {
+            // The constant is replaced, so nothing else may read it
+            if (liveness.LiveAfter(i + 1)[dest] || !ReduceStrength(first, second))
+                continue;
+        } else
+            continue;
+
+        // The pairs don't overlap, so the liveness stays right for the ones that follow
+        changed = true;
+        ++i;
+    }
+    return changed;
+}
+
+// Index of the constant that `conversion` makes out of the one `ldconst` loads, or -1 if the
+// conversion would fault or the pool is full. The conversion is done exactly like the VM does it
+auto Optimizer::FoldConversion(const Instruction& ldconst, const Instruction& conversion) -> int64_t {
+    auto value = _constants.Read(static_cast<size_t>(ldconst.Source()));
+    auto fault = Error::Fault::None;
+
+    #define FOLD(op, From, To)                   \
+        case Opcode::op:                         \
+            fault = value.Convert<From, To>();   \
+            break;
+
+    switch (conversion.Opcode()) {
+        FOLD(convi32toi8, int32_t, int8_t)
+        FOLD(convi32toi16, int32_t, int16_t)
+        FOLD(convu32tou8, uint32_t, uint8_t)
+        FOLD(convu32tou16, uint32_t, uint16_t)
+        FOLD(convi32toi64, int32_t, int64_t)
+        FOLD(convi32tou64, int32_t, uint64_t)
+        FOLD(convi32tou32, int32_t, uint32_t)
+        FOLD(convi32tof32, int32_t, float)
+        FOLD(convi32tof64, int32_t, double)
+        FOLD(convi64toi32, int64_t, int32_t)
+        FOLD(convi64tou32, int64_t, uint32_t)
+        FOLD(convi64tou64, int64_t, uint64_t)
+        FOLD(convi64tof32, int64_t, float)
+        FOLD(convi64tof64, int64_t, double)
+        FOLD(convu32toi64, uint32_t, int64_t)
+        FOLD(convu32tou64, uint32_t, uint64_t)
+        FOLD(convu32toi32, uint32_t, int32_t)
+        FOLD(convu32tof32, uint32_t, float)
+        FOLD(convu32tof64, uint32_t, double)
+        FOLD(convu64toi64, uint64_t, int64_t)
+        FOLD(convu64tou32, uint64_t, uint32_t)
+        FOLD(convu64toi32, uint64_t, int32_t)
+        FOLD(convu64tof32, uint64_t, float)
+        FOLD(convu64tof64, uint64_t, double)
+        FOLD(convf32toi32, float, int32_t)
+        FOLD(convf32toi64, float, int64_t)
+        FOLD(convf32tou32, float, uint32_t)
+        FOLD(convf32tof64, float, double)
+        FOLD(convf32tou64, float, uint64_t)
+        FOLD(convf64toi32, double, int32_t)
+        FOLD(convf64toi64, double, int64_t)
+        FOLD(convf64tou32, double, uint32_t)
+        FOLD(convf64tou64, double, uint64_t)
+        FOLD(convf64tof32, double, float)
+    default:
+        return -1;
+    }
+
+    #undef FOLD
+
+    if (fault != Error::Fault::None)
+        return -1;
+    const auto index = _constants.FindOrAdd<uint64_t>(value);
+    return index == VM::Containers::ConstantPool::Capacity? -1 : static_cast<int64_t>(index);
+}
+
+// Index of the constant that an operation on the constants `dest` and `src` results in, or -1 if
+// it would fault or the pool is full. It's done exactly like the VM does it, except for what
+// C++ leaves undefined: shifts by the width of the type or more, and signed divisions by -1
+auto Optimizer::FoldOperation(Opcode opcode, size_t dest, size_t src) -> int64_t {
+    using VM::Primitives::Type;
+
+    auto value = _constants.Read(dest);
+    const auto& operand = _constants.Read(src);
+    auto fault = Error::Fault::None;
+
+    const auto width = value.Typeof() == Type::Int32 || value.Typeof() == Type::Uint32? 32u : 64u;
+    if (operand.Typeof() == Type::Uint32 && operand.As<uint32_t>() >= width &&
+        (opcode == Opcode::i32shl || opcode == Opcode::i32shr || opcode == Opcode::i64shl || opcode == Opcode::i64shr ||
+         opcode == Opcode::u32shl || opcode == Opcode::u32shr || opcode == Opcode::u64shl || opcode == Opcode::u64shr))
+        return -1;
+    else if ((operand.Typeof() == Type::Int32 && operand.As<int32_t>() == -1 && (opcode == Opcode::i32div || opcode == Opcode::i32rem)) ||
+             (operand.Typeof() == Type::Int64 && operand.As<int64_t>() == -1 && (opcode == Opcode::i64div || opcode == Opcode::i64rem)))
+        return -1;
+
+    #define FOLD_UNARY(op, method, T)            \
+        case Opcode::op:                         \
+            fault = value.method<T>();           \
+            break;
+
+    #define FOLD_BINARY(op, method, T)           \
+        case Opcode::op:                         \
+            fault = value.method<T>(operand);    \
+            break;
+
+    switch (opcode) {
+        FOLD_UNARY(i32neg, Negate, int32_t)
+        FOLD_BINARY(i32add, Add, int32_t)
+        FOLD_BINARY(i32sub, Subtract, int32_t)
+        FOLD_BINARY(i32mul, Multiply, int32_t)
+        FOLD_BINARY(i32div, Divide, int32_t)
+        FOLD_BINARY(i32rem, Remainder, int32_t)
+        FOLD_BINARY(i32and, AND, int32_t)
+        FOLD_BINARY(i32or, OR, int32_t)
+        FOLD_BINARY(i32xor, XOR, int32_t)
+        FOLD_BINARY(i32shl, ShiftLeft, int32_t)
+        FOLD_BINARY(i32shr, ShiftRight, int32_t)
+        FOLD_UNARY(i64neg, Negate, int64_t)
+        FOLD_BINARY(i64add, Add, int64_t)
+        FOLD_BINARY(i64sub, Subtract, int64_t)
+        FOLD_BINARY(i64mul, Multiply, int64_t)
+        FOLD_BINARY(i64div, Divide, int64_t)
+        FOLD_BINARY(i64rem, Remainder, int64_t)
+        FOLD_BINARY(i64and, AND, int64_t)
+        FOLD_BINARY(i64or, OR, int64_t)
+        FOLD_BINARY(i64xor, XOR, int64_t)
+        FOLD_BINARY(i64shl, ShiftLeft, int64_t)
+        FOLD_BINARY(i64shr, ShiftRight, int64_t)
+
+        FOLD_BINARY(u32add, Add, uint32_t)
+        FOLD_BINARY(u32sub, Subtract, uint32_t)
+        FOLD_BINARY(u32mul, Multiply, uint32_t)
+        FOLD_BINARY(u32div, Divide, uint32_t)
+        FOLD_BINARY(u32rem, Remainder, uint32_t)
+        FOLD_BINARY(u32and, AND, uint32_t)
+        FOLD_BINARY(u32or, OR, uint32_t)
+        FOLD_BINARY(u32xor, XOR, uint32_t)
+        FOLD_BINARY(u32shl, ShiftLeft, uint32_t)
+        FOLD_BINARY(u32shr, ShiftRight, uint32_t)
+        FOLD_BINARY(u64add, Add, uint64_t)
+        FOLD_BINARY(u64sub, Subtract, uint64_t)
+        FOLD_BINARY(u64mul, Multiply, uint64_t)
+        FOLD_BINARY(u64div, Divide, uint64_t)
+        FOLD_BINARY(u64rem, Remainder, uint64_t)
+        FOLD_BINARY(u64and, AND, uint64_t)
+        FOLD_BINARY(u64or, OR, uint64_t)
+        FOLD_BINARY(u64xor, XOR, uint64_t)
+        FOLD_BINARY(u64shl, ShiftLeft, uint64_t)
+        FOLD_BINARY(u64shr, ShiftRight, uint64_t)
+
+        FOLD_UNARY(f32neg, Negate, float)
+        FOLD_BINARY(f32add, Add, float)
+        FOLD_BINARY(f32sub, Subtract, float)
+        FOLD_BINARY(f32mul, Multiply, float)
+        FOLD_BINARY(f32div, Divide, float)
+        FOLD_BINARY(f32rem, Remainder, float)
+        FOLD_UNARY(f64neg, Negate, double)
+        FOLD_BINARY(f64add, Add, double)
+        FOLD_BINARY(f64sub, Subtract, double)
+        FOLD_BINARY(f64mul, Multiply, double)
+        FOLD_BINARY(f64div, Divide, double)
+        FOLD_BINARY(f64rem, Remainder, double)
+
+        case Opcode::bnot:
+            fault = value.NOT();
+            break;
+    default:
+        // Conversions are folded the same way the peephole pass does it
+        return FoldConversion(Instruction{ Opcode::ldconst, 0u, static_cast<uint32_t>(dest) }, Instruction{ opcode, 0 });
+    }
+
+    #undef FOLD_BINARY
+    #undef FOLD_UNARY
+
+    if (fault != Error::Fault::None)
+        return -1;
+    const auto index = _constants.FindOrAdd<uint64_t>(value);
+    return index == VM::Containers::ConstantPool::Capacity? -1 : static_cast<int64_t>(index);
+}
+
+// Multiplies by a power of two become left shifts, unsigned divisions by one become
+// right shifts and unsigned remainders become masks. Signed division rounds towards
+// zero, which a shift doesn't do, so it stays. `ldconst` then loads the shift or the mask
+auto Optimizer::ReduceStrength(Instruction& ldconst, Instruction& operation) -> bool {
+    using VM::Primitives::Type;
+
+    const auto& constant = _constants.Read(static_cast<size_t>(ldconst.Source()));
+
+    Opcode replacement;
+    Type type;
+    switch (operation.Opcode()) {
+    case Opcode::i32mul: replacement = Opcode::i32shl; type = Type::Int32;  break;
+    case Opcode::i64mul: replacement = Opcode::i64shl; type = Type::Int64;  break;
+    case Opcode::u32mul: replacement = Opcode::u32shl; type = Type::Uint32; break;
+    case Opcode::u64mul: replacement = Opcode::u64shl; type = Type::Uint64; break;
+    case Opcode::u32div: replacement = Opcode::u32shr; type = Type::Uint32; break;
+    case Opcode::u64div: replacement = Opcode::u64shr; type = Type::Uint64; break;
+    case Opcode::u32rem: replacement = Opcode::u32and; type = Type::Uint32; break;
+    case Opcode::u64rem: replacement = Opcode::u64and; type = Type::Uint64; break;
+    default:
+        return false;
+    }
+
+    // Anything of another type faults at run time, and so does the rewritten instruction
+    if (constant.Typeof() != type)
+        return false;
+
+    uint64_t factor = 0;
+    switch (type) {
+    case Type::Int32:
+        factor = constant.As<int32_t>() > 0? static_cast<uint64_t>(constant.As<int32_t>()) : 0;
+        break;
+    case Type::Int64:
+        factor = constant.As<int64_t>() > 0? static_cast<uint64_t>(constant.As<int64_t>()) : 0;
+        break;
+    case Type::Uint32:
+        factor = constant.As<uint32_t>();
+        break;
+    default:
+        factor = constant.As<uint64_t>();
+        break;
+    }
+    if (factor == 0 || (factor & (factor - 1)) != 0)
+        return false;
+
+    size_t index = 0;
+    if (replacement == Opcode::u32and)
+        index = _constants.FindOrAdd<uint32_t>(VM::Primitives::Value(static_cast<uint32_t>(factor - 1)));
+    else if (replacement == Opcode::u64and)
+        index = _constants.FindOrAdd<uint64_t>(VM::Primitives::Value(factor - 1));
+    else {
+        uint32_t shift = 0;
+        while ((factor >> shift) != 1)
+            ++shift;
+        index = _constants.FindOrAdd<uint32_t>(VM::Primitives::Value(shift));
+    }
+    if (index == VM::Containers::ConstantPool::Capacity)
+        return false;
+
+    ldconst   = Instruction{ Opcode::ldconst, static_cast<uint32_t>(ldconst.Destination()), static_cast<uint32_t>(index) };
+    operation = Instruction{ replacement, static_cast<uint32_t>(operation.Destination()), static_cast<uint32_t>(operation.Source()) };
+    return true;
+}
+
+// Drops the removed instructions, and puts the inserted ones before the instruction they're listed
+// under. Their jumps are left alone, so they may only jump among themselves or right past them.
+// Jumps to a removed instruction go to the instruction after it. Jumps to one with code
+// inserted before it skip that code, unless they're `entering`
+auto Optimizer::Compact(std::vector<Instruction>& body, const std::vector<bool>& removed,
+                        const std::vector<std::vector<Instruction>>& inserted, const std::vector<bool>& entering) -> void {
+    std::vector<int64_t> index(body.size(), 0);
+    std::vector<int64_t> start(body.size(), 0);
+    int64_t kept = 0;
+    for (size_t i = 0; i != body.size(); ++i) {
+        start[i] = kept;
+        if (!inserted.empty())
+            kept += static_cast<int64_t>(inserted[i].size());
+        index[i] = kept;
+        if (!removed[i])
+            ++kept;
+    }
+
+    std::vector<Instruction> compacted;
+    compacted.reserve(static_cast<size_t>(kept));
+    for (size_t i = 0; i != body.size(); ++i) {
+        if (!inserted.empty())
+            compacted.insert(compacted.end(), inserted[i].begin(), inserted[i].end());
+        if (removed[i])
+            continue;
+
+        auto instruction = body[i];
+        if (VM::Instructions::IsJump(instruction.Opcode())) {
+            const auto target = static_cast<size_t>(VM::Analysis::JumpTarget(instruction, i));
+            const auto destination = !entering.empty() && entering[i]? start[target] : index[target];
+            instruction.PatchOffset(static_cast<int32_t>((destination - index[i]) * 4));
+        }
+        compacted.push_back(instruction);
+    }
+    body = std::move(compacted);
+}
+
+}
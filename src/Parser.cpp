@@ -11,8 +11,8 @@
 
 namespace Yun::Interpreter {
 
-Parser::Parser(std::vector<Token> tokens) noexcept
-    :_assembler{  },     _tokens{ std::move(tokens) }, _current{ 0 },
+Parser::Parser(std::vector<Token> tokens, ASM::OptimizerOptions options) noexcept
+    :_assembler{ options },     _tokens{ std::move(tokens) }, _current{ 0 },
      _hadError{ false }, _buffer{  },                  _isFull{ false },
      _state{  } {
 }
@@ -54,7 +54,7 @@ auto Parser::Putback(Token token) -> void {
 auto Parser::Function() -> void {
     _state = State();
     FunctionDeclaration();
-    _assembler.BeginFunction(_state.Name, _state.RegisterCount, _state.ArgCount, _state.KeepReturnValue);
+    _assembler.BeginFunction(_state.Name, _state.RegisterCount, _state.ArgCount, _state.KeepReturnValue, _state.Memoize);
     Block();
     _assembler.EndFunction();
 }
@@ -93,6 +93,7 @@ auto Parser::Attributes() -> void {
     bool sawRegisters  = false;
     bool sawParameters = false;
     bool sawReturns    = false;
+    bool sawMemoize    = false;
 
     while (true) {
 
@@ -115,6 +116,12 @@ auto Parser::Attributes() -> void {
             ReturnsAttribute();
             sawReturns    = true;
             break;
+        case TokenType::MemoizeAttribute:
+            if (sawMemoize)
+                ReportError("Error: redefinition of attribute 'memoize' is not allowed");
+            MemoizeAttribute();
+            sawMemoize    = true;
+            break;
         default:
             ReportError("Unexpected token: '%s'", t.Lexeme.c_str());
             break;
@@ -173,6 +180,16 @@ auto Parser::ReturnsAttribute() -> void {
     _state.KeepReturnValue = token.Type == TokenType::False? false : true;
 }
 
+auto Parser::MemoizeAttribute() -> void {
+    auto& token = Next();
+    if (token.Type != TokenType::Equals)
+        ReportError("Token mismatch: expected '='");
+    token = Next();
+    if (token.Type != TokenType::False && token.Type != TokenType::True)
+        ReportError("Token mismatch: expected boolean value");
+    _state.Memoize = token.Type == TokenType::True;
+}
+
 auto Parser::Block() -> void {
     auto& t = NextPrintable();
 
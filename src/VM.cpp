@@ -1,14 +1,22 @@
 // My header files
 #include "../include/VM.hpp"
+#include "../include/Analysis.hpp"
+#include "../include/Verifier.hpp"
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
+#include <csetjmp>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <utility>
 
 namespace Yun::VM {
 
@@ -28,18 +36,26 @@ ExecutionUnit::ExecutionUnit(std::string name, Containers::SymbolTable symbols,
     return _buffer.end();
 }
 
-[[nodiscard]] auto ExecutionUnit::ConstantLookup(size_t index) const -> Primitives::Value {
+[[nodiscard]] auto ExecutionUnit::ConstantLookup(size_t index) const -> const Primitives::Value& {
     return _constants.Read(index);
 }
 
 [[nodiscard]] auto ExecutionUnit::SymbolLookup(size_t index) const -> const Containers::Symbol& {
-    return _symbols.FindByLocation(index);
+    return _symbols.At(index);
 }
 
 [[nodiscard]] auto ExecutionUnit::SymbolLookup(const std::string& string) const -> const Containers::Symbol& {
     return _symbols.FindByName(string);
 }
 
+[[nodiscard]] auto ExecutionUnit::Symbols() const noexcept -> const Containers::SymbolTable& {
+    return _symbols;
+}
+
+[[nodiscard]] auto ExecutionUnit::Constants() const noexcept -> const Containers::ConstantPool& {
+    return _constants;
+}
+
 [[nodiscard]] auto ExecutionUnit::DisassembleInstruction(size_t offset) const noexcept -> size_t {
     printf("    0x%04zx | ", offset * 4);
 
@@ -48,23 +64,22 @@ ExecutionUnit::ExecutionUnit(std::string name, Containers::SymbolTable symbols,
     auto dest = (instruction >> 12) & 0xFFF;
     auto src = (instruction) & 0xFFF;
 
-    if (op > static_cast<uint8_t>(Instructions::Opcode::hlt)) {
+    if (op >= Instructions::OpcodeTotal) {
         puts("<err>");
         return offset;
     }
 
     auto opcode = static_cast<Yun::VM::Instructions::Opcode>(op);
-    
 
-    int args = OpcodeCount(opcode);
-    if (args == 1)
-        if (opcode == Instructions::Opcode::call)
-            printf(" %-12s @%s\n", OpcodeToString(opcode), _symbols.FindByLocation(instruction & 0xFFFFFF).Name.c_str());
-        else if (Instructions::IsJump(opcode))
+    const auto& info = Instructions::Info(opcode);
+    if (info.Operands == 1)
+        if (info.Flags & Instructions::Flag::Call)
+            printf(" %-12s @%s\n", OpcodeToString(opcode), _symbols.At(instruction & 0xFFFFFF).Name.c_str());
+        else if (info.Flags & Instructions::Flag::Jump)
             printf(" %-12s 0x%x\n", OpcodeToString(opcode), instruction & 0xFFFFFF);
         else
             printf(" %-12s R%d\n", OpcodeToString(opcode), dest);
-    else if (args == 2)
+    else if (info.Operands == 2)
         if (opcode == Instructions::Opcode::ldconst)
             printf(" %-12s R%d, $0x%d\n", OpcodeToString(opcode), dest, src);
         else
@@ -97,746 +112,2057 @@ auto ExecutionUnit::Disassemble() const noexcept -> void {
     }
 }
 
-VM::VM(ExecutionUnit unit) noexcept
-    :_unit{ std::move(unit) }, _registers{  }, _callStack{  }, _heap{  }, _flags{ 0 } {
+VM::VM(ExecutionUnit unit, VMOptions options) noexcept
+    :_unit{ std::move(unit) }, _code{  },   _functions{  },      _registers{  }, _callStack{  },
+     _heap{  },                _flags{ 0 }, _options{ options }, _pairCounts{  }, _callCounts{  }, _jumpCounts{  }, _native{  },
+     _loopEntries{  },         _traces{  }, _loopCounts{  },     _recording{  },  _proven{  },
+     _types{  },               _tierEvents{  }, _memos{  },  _memoCalls{  }, _memoArguments{  },
+     _start{  },               _nativeExit{ nullptr }, _nativeError{  }, _hadError{ false } {
+}
+
+// Which superinstruction replaces a pair of adjacent instructions, if any
+[[nodiscard]] static constexpr auto Fuse(Instructions::Opcode first, Instructions::Opcode second) noexcept -> uint16_t {
+    using Instructions::Opcode;
+
+    const auto conditionalJump = Instructions::IsJump(second) && second != Opcode::jmp;
+    const auto jumpIndex = static_cast<uint16_t>(second) - static_cast<uint16_t>(Opcode::je);
+    const auto selectIndex = static_cast<uint16_t>(second) - static_cast<uint16_t>(Opcode::cmove);
+
+    switch (first) {
+    case Opcode::cmp:
+        return conditionalJump? static_cast<uint16_t>(Superinstruction::cmp_je) + jumpIndex :
+               Instructions::IsSelect(second)? static_cast<uint16_t>(Superinstruction::cmp_cmove) + selectIndex : 0;
+    case Opcode::icmp:
+        return conditionalJump? static_cast<uint16_t>(Superinstruction::icmp_je) + jumpIndex :
+               Instructions::IsSelect(second)? static_cast<uint16_t>(Superinstruction::icmp_cmove) + selectIndex : 0;
+    case Opcode::fcmp:
+        return conditionalJump? static_cast<uint16_t>(Superinstruction::fcmp_je) + jumpIndex :
+               Instructions::IsSelect(second)? static_cast<uint16_t>(Superinstruction::fcmp_cmove) + selectIndex : 0;
+    case Opcode::ldconst:
+        switch (second) {
+        case Opcode::cmp:
+            return static_cast<uint16_t>(Superinstruction::ldconst_cmp);
+        case Opcode::icmp:
+            return static_cast<uint16_t>(Superinstruction::ldconst_icmp);
+        case Opcode::i64add:
+            return static_cast<uint16_t>(Superinstruction::ldconst_i64add);
+        case Opcode::i64sub:
+            return static_cast<uint16_t>(Superinstruction::ldconst_i64sub);
+        case Opcode::u64add:
+            return static_cast<uint16_t>(Superinstruction::ldconst_u64add);
+        case Opcode::u64sub:
+            return static_cast<uint16_t>(Superinstruction::ldconst_u64sub);
+        default:
+            return 0;
+        }
+    case Opcode::mov:
+        switch (second) {
+        case Opcode::i64add:
+            return static_cast<uint16_t>(Superinstruction::mov_i64add);
+        case Opcode::i64sub:
+            return static_cast<uint16_t>(Superinstruction::mov_i64sub);
+        case Opcode::i64mul:
+            return static_cast<uint16_t>(Superinstruction::mov_i64mul);
+        case Opcode::u64add:
+            return static_cast<uint16_t>(Superinstruction::mov_u64add);
+        case Opcode::u64sub:
+            return static_cast<uint16_t>(Superinstruction::mov_u64sub);
+        case Opcode::u64mul:
+            return static_cast<uint16_t>(Superinstruction::mov_u64mul);
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+auto VM::Load(const void* const* handlers) -> void {
+    const auto& symbols = _unit.Symbols();
+    const size_t count = _unit.StopPC() - _unit.StartPC();
+
+    // Descriptors point into the decoded code, so it can't move from now on
+    _code.resize(count);
+
+    _functions.reserve(symbols.Count());
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        const auto& symbol = symbols.At(i);
+        _functions.push_back({ _code.data() + symbol.Start / 4, symbol.Registers, symbol.Arguments, symbol.DoesReturn, symbol.End, nullptr, Tier::Generic, 0, 0, false });
+    }
+
+    for (size_t i = 0; i != count; ++i) {
+        const auto instruction = _unit.StartPC()[i];
+        auto& decoded = _code[i];
+
+        decoded.Opcode  = std::min<uint16_t>((instruction >> 24) & 0xFF, InvalidOpcode);
+        decoded.Dest    = (instruction >> 12) & 0xFFF;
+        decoded.Src     = instruction & 0xFFF;
+        decoded.Handler = handlers? handlers[decoded.Opcode] : nullptr;
+
+        // Nothing quickens before its function is hot
+        decoded.KeepGeneric = true;
+
+        if (decoded.Opcode == InvalidOpcode)
+            continue;
+
+        const auto opcode = static_cast<Instructions::Opcode>(decoded.Opcode);
+
+        if (Instructions::IsJump(opcode)) {
+            // Sign-extend the 24-bit byte offset
+            const auto target = static_cast<int64_t>(i) + (static_cast<int32_t>(instruction << 8) >> 10);
+            if (target < 0 || static_cast<size_t>(target) >= count)
+                ReportError("Jump target outside of instructions segment");
+            decoded.Target = _code.data() + target;
+        } else if (Instructions::IsCall(opcode)) {
+            const auto index = instruction & 0xFFFFFF;
+            if (index >= _functions.size())
+                ReportError("Call to a function outside of the symbol table");
+            decoded.Callee = _functions.data() + index;
+        } else if (opcode == Instructions::Opcode::ldconst)
+            decoded.Constant = &_unit.ConstantLookup(decoded.Src);
+    }
+
+    // The profilers want to see the original pairs and opcodes
+    if (_options.Profiles())
+        return;
+
+    // A superinstruction takes the place of the first instruction of a pair
+    // and continues after the second one. The second instruction stays as it
+    // was, since a jump can still land on it
+    for (size_t i = 0; i + 1 < count; ++i) {
+        auto& first        = _code[i];
+        const auto& second = _code[i + 1];
+
+        if (first.Opcode == InvalidOpcode || second.Opcode == InvalidOpcode)
+            continue;
+
+        const auto fused = Fuse(static_cast<Instructions::Opcode>(first.Opcode), static_cast<Instructions::Opcode>(second.Opcode));
+        if (fused == 0)
+            continue;
+
+        first.Opcode  = fused;
+        first.Handler = handlers? handlers[fused] : nullptr;
+        first.Dest2   = second.Dest;
+        first.Src2    = second.Src;
+        if (Instructions::IsJump(static_cast<Instructions::Opcode>(second.Opcode)))
+            first.Target = second.Target;
+    }
+
+    ShareArguments(handlers);
+
+    Verifier verifier{ _unit };
+    _proven = verifier.Verify();
+    if (_options.JIT)
+        _types.resize(_proven.size());
+    for (size_t i = 0; i != _proven.size(); ++i) {
+        if (!_proven[i])
+            continue;
+        else if (_options.JIT)
+            _types[i] = verifier.Types(i);
+
+        for (size_t j = symbols.At(i).Start / 4; j != symbols.At(i).End / 4; ++j) {
+            auto& decoded = _code[j];
+            decoded.Opcode += UncheckedOffset;
+            decoded.Handler = handlers? handlers[decoded.Opcode] : nullptr;
+        }
+    }
+    SkipRangeChecks(handlers);
+    Memoize(handlers);
+
+    if (_options.JIT)
+        _loopEntries.assign(count, nullptr);
+    if (_options.Traces && !_options.Profiles()) {
+        _traces.resize(count);
+        _loopCounts.assign(count, 0);
+    }
+}
+
+// A callee's arguments are the caller's last registers, so its frame can just
+// as well start at them, instead of right after the caller's frame. The callee
+// then leaves its own values in there, which is only fine for a call after
+// which the caller doesn't read any of them, except for the return value
+auto VM::ShareArguments(const void* const* handlers) -> void {
+    const auto& symbols = _unit.Symbols();
+    const size_t count = _code.size();
+
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        const auto& symbol = symbols.At(i);
+        const size_t start = symbol.Start / 4;
+        const size_t end = symbol.End / 4;
+
+        const auto isCall = [](const DecodedInstruction& decoded) {
+            return decoded.Opcode == static_cast<uint16_t>(Instructions::Opcode::call);
+        };
+        if (start >= end || end > count || std::none_of(_code.begin() + start, _code.begin() + end, isCall))
+            continue;
+
+        try {
+            const auto body = Analysis::Decode(_unit.StartPC() + start, _unit.StartPC() + end);
+            const Analysis::ControlFlowGraph graph{ body };
+            const Analysis::Liveness liveness{ body, graph, symbol, symbols };
+
+            for (size_t j = start; j != end; ++j) {
+                auto& decoded = _code[j];
+                if (!isCall(decoded))
+                    continue;
+
+                const auto& callee = symbols.At(body[j - start].Destination());
+                if (Analysis::CanShareArguments(liveness.LiveAfter(j - start), symbol, callee)) {
+                    decoded.Opcode  = static_cast<uint16_t>(Superinstruction::call_shared);
+                    decoded.Handler = handlers? handlers[decoded.Opcode] : nullptr;
+                }
+            }
+        } catch (const std::exception&) {
+            // Whatever's wrong with the function gets reported when it runs
+        }
+    }
+}
+
+// Array accesses that `Analysis::ArrayBounds` shows to stay in range don't check the index anymore.
+// Those of proven functions don't check the types either, like the rest of their instructions
+auto VM::SkipRangeChecks(const void* const* handlers) -> void {
+    const auto& symbols = _unit.Symbols();
+    const auto isAccess = [](const DecodedInstruction& decoded) {
+        const auto opcode = static_cast<Instructions::Opcode>(decoded.Opcode % UncheckedOffset);
+        return opcode == Instructions::Opcode::load || opcode == Instructions::Opcode::store || opcode == Instructions::Opcode::advance;
+    };
+
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        const auto& symbol = symbols.At(i);
+        const size_t start = symbol.Start / 4;
+        const size_t end = symbol.End / 4;
+        if (start >= end || end > _code.size() || std::none_of(_code.begin() + start, _code.begin() + end, isAccess))
+            continue;
+
+        try {
+            const auto body = Analysis::Decode(_unit.StartPC() + start, _unit.StartPC() + end);
+            const Analysis::ControlFlowGraph graph{ body };
+            const Analysis::Dominators dominators{ graph };
+            const Analysis::SsaForm ssa{ body, graph, dominators, symbol, symbols, _unit.Constants() };
+            const Analysis::ArrayBounds bounds{ body, graph, dominators, ssa, symbol };
+
+            for (size_t j = start; j != end; ++j) {
+                auto& decoded = _code[j];
+                if (!isAccess(decoded) || !bounds.InBounds(j - start))
+                    continue;
+
+                Superinstruction inBounds = Superinstruction::advance_inbounds;
+                if (body[j - start].Opcode() == Instructions::Opcode::load)
+                    inBounds = Superinstruction::load_inbounds;
+                else if (body[j - start].Opcode() == Instructions::Opcode::store)
+                    inBounds = Superinstruction::store_inbounds;
+                decoded.Opcode  = static_cast<uint16_t>(inBounds) + (_proven[i]? UncheckedOffset : 0);
+                decoded.Handler = handlers? handlers[decoded.Opcode] : nullptr;
+            }
+        } catch (const std::exception&) {
+            // Whatever's wrong with the function gets reported when it runs
+        }
+    }
+}
+
+// Functions that `Analysis::PureFunctions` finds pure are memoized if they ask for it, or if all of them
+// should be. Calls to them look for the result in the callee's `MemoTable` first, and their `ret`s fill it
+// in. Tail calls become ordinary calls, whether they go to a memoized function or come from one, so the
+// frame of a memoized function only ever ends with one of its own `ret`s
+auto VM::Memoize(const void* const* handlers) -> void {
+    const auto& symbols = _unit.Symbols();
+    bool wanted = _options.Memoize;
+    for (size_t i = 0; i != symbols.Count(); ++i)
+        wanted = wanted || symbols.At(i).Memoize;
+    if (!wanted)
+        return;
+
+    std::vector<std::vector<Emit::Instruction>> bodies(symbols.Count());
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        const size_t start = symbols.At(i).Start / 4;
+        const size_t end = symbols.At(i).End / 4;
+        try {
+            if (start < end && end <= _code.size())
+                bodies[i] = Analysis::Decode(_unit.StartPC() + start, _unit.StartPC() + end);
+        } catch (const std::exception&) {
+            // Whatever's wrong with the function gets reported when it runs
+        }
+    }
+
+    const auto purity = Analysis::PureFunctions(bodies, symbols);
+    _memos.resize(symbols.Count());
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        _functions[i].Memoized = purity[i] != Analysis::Purity::None && (_options.Memoize || symbols.At(i).Memoize);
+        _memos[i].SetsFlags    = purity[i] == Analysis::Purity::SetsFlags;
+    }
+
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        const bool memoized = _functions[i].Memoized;
+        for (size_t j = 0; j != bodies[i].size(); ++j) {
+            auto& decoded = _code[symbols.At(i).Start / 4 + j];
+            const uint16_t unchecked = decoded.Opcode >= UncheckedOffset? UncheckedOffset : 0;
+            const uint16_t opcode = decoded.Opcode - unchecked;
+
+            uint16_t replacement = opcode;
+            if (opcode == static_cast<uint16_t>(Instructions::Opcode::ret))
+                replacement = memoized? static_cast<uint16_t>(Superinstruction::ret_memoized) : opcode;
+            else if (opcode == static_cast<uint16_t>(Superinstruction::call_shared))
+                replacement = decoded.Callee->Memoized? static_cast<uint16_t>(Superinstruction::call_shared_memoized) : opcode;
+            else if (opcode == static_cast<uint16_t>(Instructions::Opcode::call) || opcode == static_cast<uint16_t>(Instructions::Opcode::tailcall)) {
+                if (decoded.Callee->Memoized)
+                    replacement = static_cast<uint16_t>(Superinstruction::call_memoized);
+                else if (memoized)
+                    replacement = static_cast<uint16_t>(Instructions::Opcode::call);
+            }
+
+            if (replacement != opcode) {
+                decoded.Opcode  = replacement + unchecked;
+                decoded.Handler = handlers? handlers[decoded.Opcode] : nullptr;
+            }
+        }
+    }
+}
+
+// The bits of a value its type uses. Whatever's above them is left from earlier values
+template<typename V>
+[[nodiscard]] static auto MemoBits(const V& value) noexcept -> uint64_t {
+    switch (value.Typeof()) {
+    case Primitives::Type::Uninit:
+        return 0;
+    case Primitives::Type::Int8:
+    case Primitives::Type::Uint8:
+        return value.template As<uint8_t>();
+    case Primitives::Type::Int16:
+    case Primitives::Type::Uint16:
+        return value.template As<uint16_t>();
+    case Primitives::Type::Int32:
+    case Primitives::Type::Uint32:
+    case Primitives::Type::Float32:
+        return value.template As<uint32_t>();
+    default:
+        return value.template As<uint64_t>();
+    }
+}
+
+// Looks for the result of a call to a memoized function, which takes the caller's last registers
+// as arguments, like any call. A hit leaves the result, and the flags if the callee sets them, as it did the first time.
+// On a miss, the arguments are set aside for `Remember`. Arguments that refer to arrays, and frames
+// too small to hold the arguments and the result, are left out of the table altogether
+auto VM::Recall(const FunctionDescriptor* callee, Containers::RegisterWindow registers, const Containers::Frame& frame) -> bool {
+    const size_t count = frame.RegisterCount;
+    const size_t arguments = callee->Arguments;
+    if (count == 0 || count < arguments)
+        return false;
+
+    uint64_t hash = 0x9E3779B97F4A7C15;
+    for (size_t i = count - arguments; i != count; ++i) {
+        const auto argument = registers[i];
+        if (argument.Typeof() == Primitives::Type::Reference)
+            return false;
+        hash = (hash ^ (static_cast<uint64_t>(argument.Typeof()) << 56) ^ MemoBits(argument)) * 0xFF51AFD7ED558CCD;
+        hash ^= hash >> 32;
+    }
+    hash += hash == 0;
+
+    const size_t function = callee - _functions.data();
+    auto& table = _memos[function];
+    if (table.Hashes.empty()) {
+        table.Hashes.assign(MemoSlots, 0);
+        table.Arguments.resize(MemoSlots * arguments);
+        table.Results.resize(MemoSlots);
+        table.Flags.resize(MemoSlots);
+    }
+
+    const size_t slot = hash & (MemoSlots - 1);
+    bool hit = table.Hashes[slot] == hash;
+    for (size_t i = 0; hit && i != arguments; ++i) {
+        const auto& kept = table.Arguments[slot * arguments + i];
+        const auto argument = registers[count - arguments + i];
+        hit = kept.Typeof() == argument.Typeof() && MemoBits(kept) == MemoBits(argument);
+    }
+
+    if (hit) {
+        auto result = registers[count - 1];
+        if (result.Typeof() == Primitives::Type::Reference)
+            _heap.Notify(result.As<Primitives::Reference>().HeapID, false);
+        result.Assign(table.Results[slot]);
+        if (table.SetsFlags)
+            _flags = table.Flags[slot];
+        ++table.Hits;
+        return true;
+    }
+
+    ++table.Misses;
+    _memoCalls.push_back({ _callStack.Count() + 1, function, hash });
+    for (size_t i = count - arguments; i != count; ++i)
+        _memoArguments.push_back(registers[i].Load());
+    return false;
+}
+
+// Keeps what a memoized function returns, if the call missed the table. The frame is the callee's
+auto VM::Remember(Containers::RegisterWindow registers) -> void {
+    const auto [depth, function, hash] = _memoCalls.back();
+    const size_t arguments = _functions[function].Arguments;
+    _memoCalls.pop_back();
+
+    const auto result = registers[0];
+    if (result.Typeof() != Primitives::Type::Reference) {
+        auto& table = _memos[function];
+        const size_t slot = hash & (MemoSlots - 1);
+        table.Hashes[slot]  = hash;
+        table.Results[slot] = result.Load();
+        table.Flags[slot]   = _flags;
+        std::copy(_memoArguments.end() - arguments, _memoArguments.end(), table.Arguments.begin() + slot * arguments);
+    }
+    _memoArguments.resize(_memoArguments.size() - arguments);
+}
+
+// Counting starts over after every tier-up. A function that can't be compiled
+// stays where it is, and so does everything that calls it
+auto VM::TierUp(FunctionDescriptor& function, bool byBackEdges) -> void {
+    if (_options.Profiles())
+        return;
+
+    const size_t index = &function - _functions.data();
+    const auto milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - _start).count();
+
+    switch (function.Level) {
+    case Tier::Generic:
+        for (auto decoded = function.Entry; decoded != _code.data() + function.End / 4; ++decoded)
+            decoded->KeepGeneric = false;
+
+        function.Level = Tier::Specialized;
+        if (_options.ReportTiers)
+            _tierEvents.push_back({ index, Tier::Specialized, index, byBackEdges, milliseconds });
+        break;
+    case Tier::Specialized: {
+        if (!_options.JIT)
+            return;
+
+        const auto compiled = JIT::Compiler{ _unit, NativeRuntime() }.Compile(index, _functions, _proven, _types, _native, _loopEntries);
+        if (compiled.empty())
+            return;
+
+        for (const auto& [i, optimized] : compiled) {
+            _functions[i].Level = optimized? Tier::Optimized : Tier::Native;
+            if (_options.ReportTiers)
+                _tierEvents.push_back({ i, _functions[i].Level, index, byBackEdges, milliseconds });
+        }
+        break;
+    }
+    case Tier::Native:
+    case Tier::Optimized:
+        return;
+    }
+
+    function.Calls     = 0;
+    function.BackEdges = 0;
+}
+
+auto VM::NativeRuntime() noexcept -> JIT::Runtime {
+    return { this, &_flags, NativeCall, NativeTailCall, NativeExecute, NativeNotify };
+}
+
+// Whether a decoded opcode runs a pair of instructions
+[[nodiscard]] static constexpr auto IsPair(uint16_t opcode) noexcept -> bool {
+    if (opcode >= 2 * UncheckedOffset)
+        return opcode >= static_cast<uint16_t>(QuickInstruction::cmp_u64_je) && opcode < static_cast<uint16_t>(QuickInstruction::ldconst_scalar);
+
+    const auto checked = opcode % UncheckedOffset;
+    return checked > InvalidOpcode && checked < static_cast<uint16_t>(Superinstruction::call_shared);
+}
+
+[[nodiscard]] static constexpr auto IsSharedCall(uint16_t opcode) noexcept -> bool {
+    const auto checked = opcode % UncheckedOffset;
+    return opcode < 2 * UncheckedOffset && (checked == static_cast<uint16_t>(Superinstruction::call_shared) ||
+                                            checked == static_cast<uint16_t>(Superinstruction::call_shared_memoized));
+}
+
+// Runs before every instruction while a trace is being recorded, and notes the
+// instruction along with the types of its operands. Recording stops once the
+// loop is closed, which compiles the trace, or once the path goes somewhere a
+// trace can't follow. Either way, it returns false then
+auto VM::Record(const DecodedInstruction* pc, Containers::RegisterWindow registers, const Containers::Frame& frame) -> bool {
+    auto& recording = _recording;
+    auto& steps = recording.Steps;
+    const uint32_t index = pc - _code.data();
+
+    const auto stop = [&] {
+        recording.Active = false;
+        steps.clear();
+        recording.Finished = 0;
+        recording.Next.clear();
+        recording.Calls.clear();
+        return false;
+    };
+    const auto typeOf = [&](int32_t reg) {
+        return static_cast<uint32_t>(reg) < frame.RegisterCount? registers[reg].Typeof() : Primitives::Type::Uninit;
+    };
+    const auto hasRegisters = [](const Emit::Instruction& instruction) {
+        return Instructions::OpcodeCount(instruction.Opcode()) >= 1 && !Instructions::IsJump(instruction.Opcode()) && !Instructions::IsCall(instruction.Opcode());
+    };
+
+    try {
+        // The steps since the last time are done by now, and their results are in the same frame
+        for (; recording.Finished != steps.size(); ++recording.Finished) {
+            const auto instruction = Emit::Instruction::Deserialize(_unit.StartPC()[steps[recording.Finished].Index]);
+            if (hasRegisters(instruction))
+                steps[recording.Finished].Result = typeOf(instruction.Destination());
+        }
+
+        if (!recording.Next.empty() && std::find(recording.Next.begin(), recording.Next.end(), index) == recording.Next.end())
+            return stop();
+        else if (index == recording.Anchor && recording.Calls.empty() && !steps.empty()) {
+            auto trace = JIT::Compiler{ _unit, NativeRuntime() }.CompileTrace(steps, recording.Function, _native);
+            if (trace.Code != nullptr)
+                _traces[recording.Anchor] = std::move(trace);
+            return stop();
+        } else if (steps.size() >= MaxTraceLength || pc->Opcode == InvalidOpcode)
+            return stop();
+
+        const auto depth = static_cast<uint16_t>(recording.Calls.size());
+        const size_t count = IsPair(pc->Opcode)? 2 : 1;
+        for (size_t i = 0; i != count; ++i) {
+            const auto instruction = Emit::Instruction::Deserialize(_unit.StartPC()[index + i]);
+            const auto registerOperands = hasRegisters(instruction);
+            const auto src = registerOperands && Instructions::OpcodeCount(instruction.Opcode()) == 2 && instruction.Opcode() != Instructions::Opcode::ldconst;
+            steps.push_back({
+                static_cast<uint32_t>(index + i), depth, IsSharedCall(pc->Opcode),
+                registerOperands? typeOf(instruction.Destination()) : Primitives::Type::Uninit,
+                src? typeOf(instruction.Source()) : Primitives::Type::Uninit,
+                Primitives::Type::Uninit
+            });
+        }
+
+        const uint32_t last = index + count - 1;
+        const auto instruction = Emit::Instruction::Deserialize(_unit.StartPC()[last]);
+        switch (instruction.Opcode()) {
+        case Instructions::Opcode::call:
+            // A native callee runs on its own, and a memoized one might not run at all, so there's nothing to record
+            if (pc->Callee->Native != nullptr || pc->Callee->Memoized || recording.Calls.size() == MaxTraceDepth)
+                return stop();
+            recording.Next = { static_cast<uint32_t>(pc->Callee->Entry - _code.data()) };
+            recording.Calls.push_back(index);
+            break;
+        case Instructions::Opcode::ret:
+            if (recording.Calls.empty())
+                return stop();
+            recording.Next = { recording.Calls.back() + 1 };
+            recording.Calls.pop_back();
+            break;
+        case Instructions::Opcode::tailcall:
+            return stop();
+        default:
+            if (Instructions::IsJump(instruction.Opcode()))
+                recording.Next = { static_cast<uint32_t>(Analysis::JumpTarget(instruction, last)), last + 1 };
+            else
+                recording.Next = { last + 1 };
+            break;
+        }
+        return true;
+    } catch (const std::exception&) {
+        return stop();
+    }
+}
+
+// Pushes the frames of the calls a trace inlined on its way to the exit,
+// like `call` would have, and returns where the interpreter goes on from
+auto VM::LeaveTrace(const JIT::TraceExit& exit, Containers::Frame& currentFrame) -> DecodedInstruction* {
+    for (const auto call : exit.Calls) {
+        const auto& decoded = _code[call];
+        const auto callee = decoded.Callee;
+        const uint16_t shared = IsSharedCall(decoded.Opcode)? callee->Arguments : 0;
+
+        currentFrame.ReturnAddress = call + 1;
+        currentFrame.Shared        = shared;
+        _callStack.Push(currentFrame);
+        _registers.Allocate(callee->Registers - shared);
+
+        currentFrame.ReturnAddress   = 0;
+        currentFrame.End             = callee->End;
+        currentFrame.RegisterCount   = callee->Registers;
+        currentFrame.KeepReturnValue = callee->DoesReturn;
+        currentFrame.Function        = callee - _functions.data();
+    }
+    return _code.data() + exit.Resume;
+}
+
+// Native code has no unwind tables, so nothing may be thrown through its frames.
+// The functions it calls catch everything instead and jump back here, which then
+// throws it again. Skipped frames must not have anything to destroy.
+// Only the interpreter enters native code, and nothing native enters the interpreter
+template<typename Code>
+auto VM::EnterNative(Code&& code) {
+    std::jmp_buf exit;
+    _nativeExit = &exit;
+    if (setjmp(exit) != 0) {
+        _nativeExit = nullptr;
+        std::rethrow_exception(std::exchange(_nativeError, nullptr));
+    }
+
+    const auto result = code();
+    _nativeExit = nullptr;
+    return result;
+}
+
+// Same result as `Value::Compare`, for registers that are known to hold `T`s
+template<typename T>
+[[nodiscard]] YUN_INLINE static constexpr auto CompareAs(const Primitives::Register& lhs, const Primitives::Register& rhs) noexcept -> int32_t {
+    return (lhs.As<T>() > rhs.As<T>()) - (lhs.As<T>() < rhs.As<T>());
 }
 
+// Threaded dispatch relies on GCC's labels-as-values extension: every handler
+// ends with its own indirect jump to the next one, instead of going back through
+// a single `switch`. Compilers without it (or builds with YUN_SWITCH_DISPATCH
+// defined) use the portable `switch` loop below.
+#if defined(__GNUC__) && !defined(YUN_SWITCH_DISPATCH)
+    #define YUN_THREADED_DISPATCH
+#endif
+
+// Views of the registers of the current frame, built right here rather than
+// by `RegisterWindow::operator[]`, which the compiler might not inline
+#define REGISTER(index) Primitives::Register{ registers.Payloads[index], registers.Types[index] }
+#define DEST()     REGISTER(pc->Dest)
+#define SRC()      REGISTER(pc->Src)
+#define DEST2()    REGISTER(pc->Dest2)
+#define SRC2()     REGISTER(pc->Src2)
+
+// Faults leave the handlers through `VM::Trap`, which is out of their way. The
+// second instruction of a superinstruction is still decoded right after the first.
+// Operations are variadic arguments, since their template arguments have commas
+#define TRAP(fault, at) Trap((fault), (at) - _code.data(), registers.Types + (at)->Dest, registers.Types + (at)->Src)
+#define CHECK(...)                                                    \
+    if (const auto fault = (__VA_ARGS__); fault != Error::Fault::None) \
+        TRAP(fault, pc);
+#define CHECK2(...)                                                   \
+    if (const auto fault = (__VA_ARGS__); fault != Error::Fault::None) \
+        TRAP(fault, pc + 1);
+
+#ifdef YUN_THREADED_DISPATCH
+    #define TARGET(op)          op_##op:
+    #define FUSED(op)           op_##op:
+    #define UNCHECKED(op)       unchecked_##op:
+    #define UNCHECKED_FUSED(op) unchecked_##op:
+    #define QUICK(op)           quick_##op:
+    #define HANDLER(opcode)     dispatchTable[opcode]
+    #define DISPATCH()          goto *pc->Handler
+    #define RECORD_EVERYTHING() for (auto& decoded : _code) decoded.Handler = &&record
+#else
+    #define TARGET(op)          case static_cast<uint16_t>(Instructions::Opcode::op):
+    #define FUSED(op)           case static_cast<uint16_t>(Superinstruction::op):
+    #define UNCHECKED(op)       case static_cast<uint16_t>(Instructions::Opcode::op) + UncheckedOffset:
+    #define UNCHECKED_FUSED(op) case static_cast<uint16_t>(Superinstruction::op) + UncheckedOffset:
+    #define QUICK(op)           case static_cast<uint16_t>(QuickInstruction::op):
+    #define HANDLER(opcode)     nullptr
+    #define DISPATCH()          continue
+    #define RECORD_EVERYTHING() static_cast<void>(0)
+#endif
+
+// Handlers without any type checks to skip serve verified code as well
+#define SHARED(op) TARGET(op) UNCHECKED(op)
+
+#define IS_REFERENCE(reg) ((reg).Typeof() == Primitives::Type::Reference)
+#define BOTH_ARE(type)    (DEST().Typeof() == (type) && SRC().Typeof() == (type))
+#define BOTH2_ARE(type)   (DEST2().Typeof() == (type) && SRC2().Typeof() == (type))
+
+// The first time a generic instruction runs, it either becomes quick or stays generic for good
+#define QUICKEN(quick, condition)                                          \
+    if (!pc->KeepGeneric) {                                                \
+        if (condition) {                                                   \
+            pc->Opcode  = static_cast<uint16_t>(QuickInstruction::quick);  \
+            pc->Handler = HANDLER(pc->Opcode);                             \
+        } else                                                             \
+            pc->KeepGeneric = true;                                        \
+    }
+
+// A quick instruction that finds unexpected types goes back to its generic
+// form, which either handles them or reports a type error
+#define GUARD(condition, generic)                          \
+    if (!(condition)) {                                    \
+        pc->Opcode      = static_cast<uint16_t>(generic);  \
+        pc->Handler     = HANDLER(pc->Opcode);             \
+        pc->KeepGeneric = true;                            \
+        DISPATCH();                                        \
+    }
+
+// No `do { } while (0)` here: in the `switch` mode DISPATCH() is a `continue`
+#define NEXT()                    \
+    {                             \
+        ++pc;                     \
+        DISPATCH();               \
+    }
+
+// Superinstructions skip the second instruction of their pair
+#define NEXT2()                   \
+    {                             \
+        pc += 2;                  \
+        DISPATCH();               \
+    }
+
+// A shared call starts the callee's frame at its arguments, instead of copying them
+#define CALL(share)                                                               \
+    {                                                                             \
+        const auto callee = pc->Callee;                                           \
+        const uint16_t shared = (share)? callee->Arguments : 0;                   \
+                                                                                  \
+        if (++callee->Calls == HotCalls)                                          \
+            TierUp(*callee, false);                                               \
+        if (callee->Native != nullptr) {                                          \
+            registers = EnterNative([&] { return NativeCall(this, callee, currentFrame.RegisterCount, shared); }); \
+            NEXT();                                                               \
+        }                                                                         \
+                                                                                  \
+        currentFrame.ReturnAddress = pc - _code.data() + 1;                       \
+        currentFrame.Shared        = shared;                                      \
+        _callStack.Push(currentFrame);                                            \
+                                                                                  \
+        _registers.Allocate(callee->Registers - shared);                          \
+        if (!(share) && callee->Arguments != 0)                                   \
+            _registers.Copy(callee->Registers, callee->Arguments, _heap);         \
+                                                                                  \
+        currentFrame.ReturnAddress   = 0;                                         \
+        currentFrame.End             = callee->End;                               \
+        currentFrame.RegisterCount   = callee->Registers;                         \
+        currentFrame.KeepReturnValue = callee->DoesReturn;                        \
+        currentFrame.Function        = callee - _functions.data();                \
+                                                                                  \
+        registers = _registers.Window(_callStack.RelativeOffset());                     \
+        pc = callee->Entry;                                                       \
+        DISPATCH();                                                               \
+    }
+
+// Leaves a frame that ended with `count` registers
+#define RETURN(count)                                                             \
+    {                                                                             \
+        const uint32_t oldCount = (count);                                        \
+        const auto keep = currentFrame.KeepReturnValue;                           \
+        currentFrame = _callStack.Pop();                                          \
+                                                                                  \
+        /* With a single argument, the return value is already where it belongs */ \
+        const auto shared = currentFrame.Shared;                                  \
+        if (keep && oldCount != 0 && shared != 1)                                 \
+            _registers.SaveReturnValue(oldCount, shared, _heap);                  \
+                                                                                  \
+        /* Shared registers are the caller's as well */                           \
+        _registers.Deallocate(oldCount - shared, _heap);                          \
+                                                                                  \
+        if (_callStack.IsEmpty())                                                 \
+            return;                                                               \
+                                                                                  \
+        registers = _registers.Window(_callStack.RelativeOffset());                     \
+        pc = _code.data() + currentFrame.ReturnAddress;                           \
+        DISPATCH();                                                               \
+    }
+
+// Backward jumps count towards the next tier of the function. Once it's native,
+// the rest of the frame runs natively, starting from the target of the jump.
+// Otherwise the target might have a trace, or get hot enough to record one
+#define BRANCH()                                                                  \
+    {                                                                             \
+        if (pc->Target <= pc && !_recording.Active) {                             \
+            auto& function = _functions[currentFrame.Function];                   \
+            if (++function.BackEdges == HotBackEdges)                             \
+                TierUp(function, true);                                           \
+            if (function.Native != nullptr) {                                     \
+                const auto entry = _loopEntries[pc->Target - _code.data()];       \
+                if (entry != nullptr)                                             \
+                    RETURN(EnterNative([&] { return entry(registers.Payloads, registers.Types, _callStack.Top().Shared); })) \
+            } else if (!_traces.empty())                                          \
+                TRACE(pc->Target - _code.data())                                  \
+        }                                                                         \
+        pc = pc->Target;                                                          \
+        DISPATCH();                                                               \
+    }
+
+// Inlined calls of a trace may use registers past the end of the frame
+#define TRACE(anchor)                                                             \
+    {                                                                             \
+        const uint32_t target = (anchor);                                         \
+        if (const auto& trace = _traces[target]; trace.Code != nullptr) {         \
+            _registers.Reserve(trace.Registers);                                  \
+            registers = _registers.Window(_callStack.RelativeOffset());                 \
+            pc = LeaveTrace(trace.Exits[EnterNative([&] { return trace.Code(registers.Payloads, registers.Types); })], currentFrame); \
+            registers = _registers.Window(_callStack.RelativeOffset());                 \
+            DISPATCH();                                                           \
+        } else if (++_loopCounts[target] == HotLoop) {                            \
+            _recording.Active   = true;                                           \
+            _recording.Anchor   = target;                                         \
+            _recording.Function = currentFrame.Function;                          \
+            RECORD_EVERYTHING();                                                  \
+        }                                                                         \
+    }
+
+#define LOAD_CONSTANT(dest, constant)                                            \
+    {                                                                            \
+        auto destRegister = (dest);                                              \
+        if (destRegister.Typeof() == Primitives::Type::Reference)                \
+            _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false); \
+        destRegister.Assign(constant);                                           \
+    }
+
+#define MOVE(dest, src)                                                          \
+    {                                                                            \
+        auto destRegister       = (dest);                                         \
+        const auto srcRegister  = (src);                                          \
+        if (destRegister.Typeof() == Primitives::Type::Reference)                \
+            _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false); \
+        if (srcRegister.Typeof() == Primitives::Type::Reference)                 \
+            _heap.Notify(srcRegister.As<Primitives::Reference>().HeapID, true);  \
+        destRegister.Assign(srcRegister);                                        \
+    }
+
+#define UNARY(op, method, T)            \
+    TARGET(op) {                        \
+        CHECK(DEST().method<T>())       \
+        NEXT();                         \
+    }                                   \
+    UNCHECKED(op) {                     \
+        DEST().method<T, false>();      \
+        NEXT();                         \
+    }
+
+// Division by zero is still checked in verified code
+#define BINARY(op, method, T)                  \
+    TARGET(op) {                               \
+        CHECK(DEST().method<T>(SRC()))         \
+        NEXT();                                \
+    }                                          \
+    UNCHECKED(op) {                            \
+        CHECK(DEST().method<T, false>(SRC()))  \
+        NEXT();                                \
+    }
+
+#define CONVERT(op, From, To)              \
+    TARGET(op) {                           \
+        CHECK(DEST().Convert<From, To>())  \
+        NEXT();                            \
+    }                                      \
+    UNCHECKED(op) {                        \
+        DEST().Convert<From, To, false>(); \
+        NEXT();                            \
+    }
+
+#define COMPARE(op, T, quick, type)                 \
+    TARGET(op) {                                    \
+        QUICKEN(quick, BOTH_ARE(type))              \
+        CHECK(DEST().Comparable<T>(SRC()))          \
+        _flags = DEST().Compare<T>(SRC());          \
+        NEXT();                                     \
+    }                                               \
+    UNCHECKED(op) {                                 \
+        _flags = DEST().Compare<T>(SRC());          \
+        NEXT();                                     \
+    }
+
+#define QUICK_COMPARE(op, T, type, generic)         \
+    QUICK(op) {                                     \
+        GUARD(BOTH_ARE(type), generic)              \
+        _flags = CompareAs<T>(DEST(), SRC());       \
+        NEXT();                                     \
+    }
+
+#define JUMP(op, condition)       \
+    SHARED(op) {                  \
+        if (condition)            \
+            BRANCH()              \
+        NEXT();                   \
+    }
+
+// Scalars are copied from whichever register the flags pick, without branching on them
+#define CHOOSE(dest, src, condition)                                    \
+    if (IS_REFERENCE(REGISTER(dest)) || IS_REFERENCE(REGISTER(src))) {  \
+        if (condition)                                                  \
+            MOVE(REGISTER(dest), REGISTER(src))                         \
+    } else                                                              \
+        REGISTER(dest).Assign(REGISTER((condition)? (src) : (dest)));
+
+#define SELECT(op, condition)                 \
+    SHARED(op) {                              \
+        CHOOSE(pc->Dest, pc->Src, condition)  \
+        NEXT();                               \
+    }
+
+#define COMPARE_JUMP(op, T, quick, type, condition) \
+    FUSED(op) {                                    \
+        QUICKEN(quick, BOTH_ARE(type))             \
+        CHECK(DEST().Comparable<T>(SRC()))         \
+        _flags = DEST().Compare<T>(SRC());         \
+        if (condition)                             \
+            BRANCH()                               \
+        NEXT2();                                   \
+    }                                              \
+    UNCHECKED_FUSED(op) {                          \
+        _flags = DEST().Compare<T>(SRC());         \
+        if (condition)                             \
+            BRANCH()                               \
+        NEXT2();                                   \
+    }
+
+#define QUICK_COMPARE_JUMP(op, T, type, generic, condition) \
+    QUICK(op) {                                            \
+        GUARD(BOTH_ARE(type), generic)                     \
+        _flags = CompareAs<T>(DEST(), SRC());              \
+        if (condition)                                     \
+            BRANCH()                                       \
+        NEXT2();                                           \
+    }
+
+#define COMPARE_SELECT(op, T, quick, type, condition)                                    \
+    FUSED(op) {                                                                          \
+        QUICKEN(quick, BOTH_ARE(type) && !IS_REFERENCE(DEST2()) && !IS_REFERENCE(SRC2())) \
+        CHECK(DEST().Comparable<T>(SRC()))                                               \
+        _flags = DEST().Compare<T>(SRC());                                               \
+        CHOOSE(pc->Dest2, pc->Src2, condition)                                           \
+        NEXT2();                                                                         \
+    }                                                                                    \
+    UNCHECKED_FUSED(op) {                                                                \
+        _flags = DEST().Compare<T>(SRC());                                               \
+        CHOOSE(pc->Dest2, pc->Src2, condition)                                           \
+        NEXT2();                                                                         \
+    }
+
+#define QUICK_COMPARE_SELECT(op, T, type, generic, condition)                             \
+    QUICK(op) {                                                                          \
+        GUARD(BOTH_ARE(type) && !IS_REFERENCE(DEST2()) && !IS_REFERENCE(SRC2()), generic) \
+        _flags = CompareAs<T>(DEST(), SRC());                                            \
+        DEST2().Assign(REGISTER((condition)? pc->Src2 : pc->Dest2));                     \
+        NEXT2();                                                                         \
+    }
+
+// Loading the constant again after going back to the generic form is harmless
+#define LOAD_CONSTANT_COMPARE(op, T, quick, type)     \
+    FUSED(op) {                                       \
+        LOAD_CONSTANT(DEST(), *pc->Constant)          \
+        QUICKEN(quick, BOTH2_ARE(type))               \
+        CHECK2(DEST2().Comparable<T>(SRC2()))         \
+        _flags = DEST2().Compare<T>(SRC2());          \
+        NEXT2();                                      \
+    }                                                 \
+    UNCHECKED_FUSED(op) {                             \
+        LOAD_CONSTANT(DEST(), *pc->Constant)          \
+        _flags = DEST2().Compare<T>(SRC2());          \
+        NEXT2();                                      \
+    }
+
+#define QUICK_LOAD_CONSTANT_COMPARE(op, T, type, generic) \
+    QUICK(op) {                                          \
+        LOAD_CONSTANT(DEST(), *pc->Constant)             \
+        GUARD(BOTH2_ARE(type), generic)                  \
+        _flags = CompareAs<T>(DEST2(), SRC2());          \
+        NEXT2();                                         \
+    }
+
+#define LOAD_CONSTANT_BINARY(op, method, T)  \
+    FUSED(op) {                              \
+        LOAD_CONSTANT(DEST(), *pc->Constant) \
+        CHECK2(DEST2().method<T>(SRC2()))    \
+        NEXT2();                             \
+    }                                        \
+    UNCHECKED_FUSED(op) {                    \
+        LOAD_CONSTANT(DEST(), *pc->Constant) \
+        DEST2().method<T, false>(SRC2());    \
+        NEXT2();                             \
+    }
+
+#define MOVE_BINARY(op, method, T)           \
+    FUSED(op) {                              \
+        MOVE(DEST(), SRC())                  \
+        CHECK2(DEST2().method<T>(SRC2()))    \
+        NEXT2();                             \
+    }                                        \
+    UNCHECKED_FUSED(op) {                    \
+        MOVE(DEST(), SRC())                  \
+        DEST2().method<T, false>(SRC2());    \
+        NEXT2();                             \
+    }
+
+#ifdef YUN_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
 auto VM::Run() -> void {
-    auto pc = _unit.StartPC();
+#ifdef YUN_THREADED_DISPATCH
+    // Handlers of the base opcodes come from the opcode table. The rest must follow
+    // the order of `Superinstruction`, first for checked handlers and then for the
+    // unchecked ones. Quick handlers go last, in the order of `QuickInstruction`
+    #define YUN_CHECKED_HANDLER(mnemonic, ...)   &&op_##mnemonic,
+    #define YUN_UNCHECKED_HANDLER(mnemonic, ...) &&unchecked_##mnemonic,
+    static const void* const dispatchTable[] = {
+        YUN_OPCODES(YUN_CHECKED_HANDLER)
+
+        &&invalid,
+
+        &&op_cmp_je,  &&op_cmp_jne,  &&op_cmp_jgt,  &&op_cmp_jge,  &&op_cmp_jlt,  &&op_cmp_jle,
+        &&op_icmp_je, &&op_icmp_jne, &&op_icmp_jgt, &&op_icmp_jge, &&op_icmp_jlt, &&op_icmp_jle,
+        &&op_fcmp_je, &&op_fcmp_jne, &&op_fcmp_jgt, &&op_fcmp_jge, &&op_fcmp_jlt, &&op_fcmp_jle,
+
+        &&op_cmp_cmove,  &&op_cmp_cmovne,  &&op_cmp_cmovgt,  &&op_cmp_cmovge,  &&op_cmp_cmovlt,  &&op_cmp_cmovle,
+        &&op_icmp_cmove, &&op_icmp_cmovne, &&op_icmp_cmovgt, &&op_icmp_cmovge, &&op_icmp_cmovlt, &&op_icmp_cmovle,
+        &&op_fcmp_cmove, &&op_fcmp_cmovne, &&op_fcmp_cmovgt, &&op_fcmp_cmovge, &&op_fcmp_cmovlt, &&op_fcmp_cmovle,
+
+        &&op_ldconst_cmp,    &&op_ldconst_icmp,
+        &&op_ldconst_i64add, &&op_ldconst_i64sub,
+        &&op_ldconst_u64add, &&op_ldconst_u64sub,
+
+        &&op_mov_i64add, &&op_mov_i64sub, &&op_mov_i64mul,
+        &&op_mov_u64add, &&op_mov_u64sub, &&op_mov_u64mul,
+        &&op_call_shared,
+        &&op_load_inbounds, &&op_store_inbounds, &&op_advance_inbounds,
+        &&op_call_memoized, &&op_call_shared_memoized, &&op_ret_memoized,
+
+        YUN_OPCODES(YUN_UNCHECKED_HANDLER)
+
+        &&invalid,
+
+        &&unchecked_cmp_je,  &&unchecked_cmp_jne,  &&unchecked_cmp_jgt,  &&unchecked_cmp_jge,  &&unchecked_cmp_jlt,  &&unchecked_cmp_jle,
+        &&unchecked_icmp_je, &&unchecked_icmp_jne, &&unchecked_icmp_jgt, &&unchecked_icmp_jge, &&unchecked_icmp_jlt, &&unchecked_icmp_jle,
+        &&unchecked_fcmp_je, &&unchecked_fcmp_jne, &&unchecked_fcmp_jgt, &&unchecked_fcmp_jge, &&unchecked_fcmp_jlt, &&unchecked_fcmp_jle,
+
+        &&unchecked_cmp_cmove,  &&unchecked_cmp_cmovne,  &&unchecked_cmp_cmovgt,  &&unchecked_cmp_cmovge,  &&unchecked_cmp_cmovlt,  &&unchecked_cmp_cmovle,
+        &&unchecked_icmp_cmove, &&unchecked_icmp_cmovne, &&unchecked_icmp_cmovgt, &&unchecked_icmp_cmovge, &&unchecked_icmp_cmovlt, &&unchecked_icmp_cmovle,
+        &&unchecked_fcmp_cmove, &&unchecked_fcmp_cmovne, &&unchecked_fcmp_cmovgt, &&unchecked_fcmp_cmovge, &&unchecked_fcmp_cmovlt, &&unchecked_fcmp_cmovle,
+
+        &&unchecked_ldconst_cmp,    &&unchecked_ldconst_icmp,
+        &&unchecked_ldconst_i64add, &&unchecked_ldconst_i64sub,
+        &&unchecked_ldconst_u64add, &&unchecked_ldconst_u64sub,
+
+        &&unchecked_mov_i64add, &&unchecked_mov_i64sub, &&unchecked_mov_i64mul,
+        &&unchecked_mov_u64add, &&unchecked_mov_u64sub, &&unchecked_mov_u64mul,
+        &&unchecked_call_shared,
+        &&unchecked_load_inbounds, &&unchecked_store_inbounds, &&unchecked_advance_inbounds,
+        &&unchecked_call_memoized, &&unchecked_call_shared_memoized, &&unchecked_ret_memoized,
+
+        &&quick_cmp_u64, &&quick_icmp_i64, &&quick_fcmp_f64,
+
+        &&quick_cmp_u64_je,  &&quick_cmp_u64_jne,  &&quick_cmp_u64_jgt,  &&quick_cmp_u64_jge,  &&quick_cmp_u64_jlt,  &&quick_cmp_u64_jle,
+        &&quick_icmp_i64_je, &&quick_icmp_i64_jne, &&quick_icmp_i64_jgt, &&quick_icmp_i64_jge, &&quick_icmp_i64_jlt, &&quick_icmp_i64_jle,
+        &&quick_fcmp_f64_je, &&quick_fcmp_f64_jne, &&quick_fcmp_f64_jgt, &&quick_fcmp_f64_jge, &&quick_fcmp_f64_jlt, &&quick_fcmp_f64_jle,
+
+        &&quick_cmp_u64_cmove,  &&quick_cmp_u64_cmovne,  &&quick_cmp_u64_cmovgt,  &&quick_cmp_u64_cmovge,  &&quick_cmp_u64_cmovlt,  &&quick_cmp_u64_cmovle,
+        &&quick_icmp_i64_cmove, &&quick_icmp_i64_cmovne, &&quick_icmp_i64_cmovgt, &&quick_icmp_i64_cmovge, &&quick_icmp_i64_cmovlt, &&quick_icmp_i64_cmovle,
+        &&quick_fcmp_f64_cmove, &&quick_fcmp_f64_cmovne, &&quick_fcmp_f64_cmovgt, &&quick_fcmp_f64_cmovge, &&quick_fcmp_f64_cmovlt, &&quick_fcmp_f64_cmovle,
+
+        &&quick_ldconst_cmp_u64, &&quick_ldconst_icmp_i64,
+
+        &&quick_ldconst_scalar,
+        &&quick_mov_scalar,
+        &&quick_load_scalar
+    };
+    static_assert(std::size(dispatchTable) == static_cast<size_t>(QuickInstruction::Count));
+    #undef YUN_CHECKED_HANDLER
+    #undef YUN_UNCHECKED_HANDLER
+
+    Load(dispatchTable);
+
+    // Every instruction goes through the profiler first
+    if (_options.Profiles())
+        for (auto& decoded : _code)
+            decoded.Handler = &&profile;
+#else
+    Load(nullptr);
+#endif
+
+    // Only pairs of instructions that follow each other in the code are
+    // counted - these are the ones that could be fused together
+    const DecodedInstruction* previous = nullptr;
+    if (_options.ProfilePairs)
+        _pairCounts.assign((InvalidOpcode + 1) * (InvalidOpcode + 1), 0);
 
     const auto& entryPoint = _unit.SymbolLookup("main");
 
-    if (entryPoint.Start > (_unit.StopPC() - pc))
+    if (entryPoint.Start > (_unit.StopPC() - _unit.StartPC()) * 4)
         ReportError("Entry point offset outside of instructions segment");
     else if (entryPoint.DoesReturn || entryPoint.Arguments != 0)
         ReportError("Invalid main signature");
-    else
-        pc += entryPoint.Start / 4;
+
+    DecodedInstruction* pc = _code.data() + entryPoint.Start / 4;
     
     Containers::Frame currentFrame{ entryPoint.End - 1, entryPoint.Registers, entryPoint.DoesReturn, entryPoint.End };
+    currentFrame.Function = std::find_if(_functions.begin(), _functions.end(), [&](const FunctionDescriptor& function) {
+        return function.Entry == pc;
+    }) - _functions.begin();
     _callStack.Push(currentFrame);
+    _start = Clock::now();
+    if (_options.RecordProfile) {
+        _callCounts.assign(_functions.size(), 0);
+        _jumpCounts.assign(2 * _code.size(), 0);
+        ++_callCounts[currentFrame.Function];
+    }
     _registers.Allocate(currentFrame.RegisterCount);
 
-    int32_t destIndex;
-    int32_t srcIndex;
-    int32_t size;
-
-    uint8_t rawOp;
-    Instructions::Opcode op;
-
-    do {
-        rawOp = (*pc & 0xFF000000) >> 24;
-        if (rawOp > static_cast<uint8_t>(Instructions::Opcode::hlt))
-            ReportError("Invalid instruction");
-
-        op = static_cast<Instructions::Opcode>(rawOp);
-
-        if (auto res = Instructions::OpcodeCount(op); res == 1) {
-            if (Instructions::IsJump(op) || op == Instructions::Opcode::call) {
-                if (auto int24 = *pc & 0x00FFFFFF; (int24 & 0x800000) && op != Instructions::Opcode::call)
-                    destIndex = int24 | 0xFF000000;
-                else
-                    destIndex = int24;
-                destIndex >>= 2;
-            } else
-                destIndex = ((*pc & 0x00FFF000) >> 12) + _callStack.RelativeOffset();
-            srcIndex  = 0;
-        } else if (res == 2) {
-            destIndex = ((*pc & 0x00FFF000) >> 12) + _callStack.RelativeOffset();
-            if (op == Instructions::Opcode::ldconst)
-                srcIndex  = (*pc & 0x00000FFF);
-            else
-                srcIndex  = (*pc & 0x00000FFF) + _callStack.RelativeOffset();
-        } else {
-            destIndex = 0;
-            srcIndex  = 0;
-        }
+    // Base of the current frame - must be refreshed after every
+    // allocation, since the register array might have moved
+    auto registers = _registers.Window(_callStack.RelativeOffset());
 
-        size = 1;
+#ifdef YUN_THREADED_DISPATCH
+    DISPATCH();
 
-        switch (op) {
-        case Instructions::Opcode::i32neg: {
-            auto& dest = _registers[destIndex];
-            dest.Negate<int32_t>();
-            break;
+    profile:
+        if (_options.ProfilePairs && pc == previous + 1)
+            ++_pairCounts[previous->Opcode * (InvalidOpcode + 1) + pc->Opcode];
+        if (_options.RecordProfile && previous != nullptr)
+            CountTransfer(previous, pc);
+        previous = pc;
+        goto *dispatchTable[pc->Opcode];
+
+    // Every instruction goes through here while a trace is being recorded
+    record:
+        if (!Record(pc, registers, currentFrame))
+            for (auto& decoded : _code)
+                decoded.Handler = dispatchTable[decoded.Opcode];
+        goto *dispatchTable[pc->Opcode];
+#else
+    for (;;) {
+        if (_options.Profiles()) {
+            if (_options.ProfilePairs && pc == previous + 1)
+                ++_pairCounts[previous->Opcode * (InvalidOpcode + 1) + pc->Opcode];
+            if (_options.RecordProfile && previous != nullptr)
+                CountTransfer(previous, pc);
+            previous = pc;
+        }
+        if (_recording.Active)
+            _recording.Active = Record(pc, registers, currentFrame);
+
+        switch (pc->Opcode) {
+#endif
+
+        UNARY(i32neg, Negate, int32_t)
+        BINARY(i32add, Add, int32_t)
+        BINARY(i32sub, Subtract, int32_t)
+        BINARY(i32mul, Multiply, int32_t)
+        BINARY(i32div, Divide, int32_t)
+        BINARY(i32rem, Remainder, int32_t)
+        BINARY(i32and, AND, int32_t)
+        BINARY(i32or, OR, int32_t)
+        BINARY(i32xor, XOR, int32_t)
+        BINARY(i32shl, ShiftLeft, int32_t)
+        BINARY(i32shr, ShiftRight, int32_t)
+        UNARY(i64neg, Negate, int64_t)
+        BINARY(i64add, Add, int64_t)
+        BINARY(i64sub, Subtract, int64_t)
+        BINARY(i64mul, Multiply, int64_t)
+        BINARY(i64div, Divide, int64_t)
+        BINARY(i64rem, Remainder, int64_t)
+        BINARY(i64and, AND, int64_t)
+        BINARY(i64or, OR, int64_t)
+        BINARY(i64xor, XOR, int64_t)
+        BINARY(i64shl, ShiftLeft, int64_t)
+        BINARY(i64shr, ShiftRight, int64_t)
+
+        BINARY(u32add, Add, uint32_t)
+        BINARY(u32sub, Subtract, uint32_t)
+        BINARY(u32mul, Multiply, uint32_t)
+        BINARY(u32div, Divide, uint32_t)
+        BINARY(u32rem, Remainder, uint32_t)
+        BINARY(u32and, AND, uint32_t)
+        BINARY(u32or, OR, uint32_t)
+        BINARY(u32xor, XOR, uint32_t)
+        BINARY(u32shl, ShiftLeft, uint32_t)
+        BINARY(u32shr, ShiftRight, uint32_t)
+        BINARY(u64add, Add, uint64_t)
+        BINARY(u64sub, Subtract, uint64_t)
+        BINARY(u64mul, Multiply, uint64_t)
+        BINARY(u64div, Divide, uint64_t)
+        BINARY(u64rem, Remainder, uint64_t)
+        BINARY(u64and, AND, uint64_t)
+        BINARY(u64or, OR, uint64_t)
+        BINARY(u64xor, XOR, uint64_t)
+        BINARY(u64shl, ShiftLeft, uint64_t)
+        BINARY(u64shr, ShiftRight, uint64_t)
+
+        UNARY(f32neg, Negate, float)
+        BINARY(f32add, Add, float)
+        BINARY(f32sub, Subtract, float)
+        BINARY(f32mul, Multiply, float)
+        BINARY(f32div, Divide, float)
+        BINARY(f32rem, Remainder, float)
+        UNARY(f64neg, Negate, double)
+        BINARY(f64add, Add, double)
+        BINARY(f64sub, Subtract, double)
+        BINARY(f64mul, Multiply, double)
+        BINARY(f64div, Divide, double)
+        BINARY(f64rem, Remainder, double)
+
+        TARGET(bnot) {
+            CHECK(DEST().NOT())
+            NEXT();
         }
-        case Instructions::Opcode::i32add: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Add<int32_t>(src);
-            break;
+        UNCHECKED(bnot) {
+            DEST().NOT<false>();
+            NEXT();
         }
-        case Instructions::Opcode::i32sub: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Subtract<int32_t>(src);
-            break;
+
+        CONVERT(convi32toi8, int32_t, int8_t)
+        CONVERT(convi32toi16, int32_t, int16_t)
+        CONVERT(convu32tou8, uint32_t, uint8_t)
+        CONVERT(convu32tou16, uint32_t, uint16_t)
+        CONVERT(convi32toi64, int32_t, int64_t)
+        CONVERT(convi32tou64, int32_t, uint64_t)
+        CONVERT(convi32tou32, int32_t, uint32_t)
+        CONVERT(convi32tof32, int32_t, float)
+        CONVERT(convi32tof64, int32_t, double)
+        CONVERT(convi64toi32, int64_t, int32_t)
+        CONVERT(convi64tou32, int64_t, uint32_t)
+        CONVERT(convi64tou64, int64_t, uint64_t)
+        CONVERT(convi64tof32, int64_t, float)
+        CONVERT(convi64tof64, int64_t, double)
+        CONVERT(convu32toi64, uint32_t, int64_t)
+        CONVERT(convu32tou64, uint32_t, uint64_t)
+        CONVERT(convu32toi32, uint32_t, int32_t)
+        CONVERT(convu32tof32, uint32_t, float)
+        CONVERT(convu32tof64, uint32_t, double)
+        CONVERT(convu64toi64, uint64_t, int64_t)
+        CONVERT(convu64tou32, uint64_t, uint32_t)
+        CONVERT(convu64toi32, uint64_t, int32_t)
+        CONVERT(convu64tof32, uint64_t, float)
+        CONVERT(convu64tof64, uint64_t, double)
+        CONVERT(convf32toi32, float, int32_t)
+        CONVERT(convf32toi64, float, int64_t)
+        CONVERT(convf32tou32, float, uint32_t)
+        CONVERT(convf32tof64, float, double)
+        CONVERT(convf32tou64, float, uint64_t)
+        CONVERT(convf64toi32, double, int32_t)
+        CONVERT(convf64toi64, double, int64_t)
+        CONVERT(convf64tou32, double, uint32_t)
+        CONVERT(convf64tou64, double, uint64_t)
+        CONVERT(convf64tof32, double, float)
+
+        COMPARE(cmp, unsigned, cmp_u64, Primitives::Type::Uint64)
+        COMPARE(icmp, signed, icmp_i64, Primitives::Type::Int64)
+        COMPARE(fcmp, float, fcmp_f64, Primitives::Type::Float64)
+
+        JUMP(jmp, true)
+        JUMP(je, _flags == 0)
+        JUMP(jne, _flags != 0)
+        JUMP(jgt, _flags > 0)
+        JUMP(jge, _flags >= 0)
+        JUMP(jlt, _flags < 0)
+        JUMP(jle, _flags <= 0)
+
+        SHARED(call) {
+            CALL(false)
         }
-        case Instructions::Opcode::i32mul: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Multiply<int32_t>(src);
-            break;
+        FUSED(call_shared) UNCHECKED_FUSED(call_shared) {
+            CALL(true)
         }
-        case Instructions::Opcode::i32div: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Divide<int32_t>(src);
-            break;
+        // A hit goes on after the call right away, as if the callee had returned
+        FUSED(call_memoized) UNCHECKED_FUSED(call_memoized) {
+            if (Recall(pc->Callee, registers, currentFrame))
+                NEXT();
+            CALL(false)
         }
-        case Instructions::Opcode::i32rem: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Remainder<int32_t>(src);
-            break;
+        FUSED(call_shared_memoized) UNCHECKED_FUSED(call_shared_memoized) {
+            if (Recall(pc->Callee, registers, currentFrame))
+                NEXT();
+            CALL(true)
         }
-        case Instructions::Opcode::i32and: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.AND<int32_t>(src);
-            break;
+        SHARED(tailcall) {
+            const auto callee = pc->Callee;
+
+            // A frame can't get smaller than what it shares with its caller, and
+            // native code can't take over an interpreted frame, so these have to
+            // be ordinary calls, followed by the `ret`
+            if (_callStack.Top().Shared > callee->Registers || callee->Native != nullptr)
+                CALL(false)
+
+            if (++callee->Calls == HotCalls)
+                TierUp(*callee, false);
+
+            // The callee takes over the current frame, including where to return
+            // and whether to keep the return value, so nothing is pushed
+            _registers.Reuse(currentFrame.RegisterCount, callee->Registers, callee->Arguments, _heap);
+
+            currentFrame.End           = callee->End;
+            currentFrame.RegisterCount = callee->Registers;
+            currentFrame.Function      = callee - _functions.data();
+
+            registers = _registers.Window(_callStack.RelativeOffset());
+            pc = callee->Entry;
+            DISPATCH();
+        }
+        SHARED(ret) {
+            RETURN(currentFrame.RegisterCount)
+        }
+        FUSED(ret_memoized) UNCHECKED_FUSED(ret_memoized) {
+            if (!_memoCalls.empty() && _memoCalls.back().Depth == _callStack.Count())
+                Remember(registers);
+            RETURN(currentFrame.RegisterCount)
+        }
+        SHARED(ldconst) {
+            QUICKEN(ldconst_scalar, !IS_REFERENCE(DEST()))
+            LOAD_CONSTANT(DEST(), *pc->Constant)
+            NEXT();
+        }
+        SHARED(mov) {
+            QUICKEN(mov_scalar, !IS_REFERENCE(DEST()) && !IS_REFERENCE(SRC()))
+            MOVE(DEST(), SRC())
+            NEXT();
+        }
+        SELECT(cmove, _flags == 0)
+        SELECT(cmovne, _flags != 0)
+        SELECT(cmovgt, _flags > 0)
+        SELECT(cmovge, _flags >= 0)
+        SELECT(cmovlt, _flags < 0)
+        SELECT(cmovle, _flags <= 0)
+        TARGET(newarray) {
+            auto destRegister = DEST();
+            const auto srcRegister  = SRC();
+            if (destRegister.Typeof() != Primitives::Type::Uint32 || srcRegister.Typeof() != Primitives::Type::Uint32)
+                TRAP(Error::Fault::ExpectedUint32, pc);
+
+            Primitives::Reference reference{  };
+            CHECK(_heap.NewArray(destRegister.As<uint32_t>(), srcRegister.As<uint32_t>(), reference))
+            destRegister.Assign(reference);
+            NEXT();
+        }
+        TARGET(arraycount) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+            if (srcRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
+
+            // The count is taken first, since the destination might hold the last reference to the array
+            const auto count = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID)->Count();
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(count);
+            NEXT();
         }
-        case Instructions::Opcode::i32or: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.OR<int32_t>(src);
-            break;
+        TARGET(load) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+
+            QUICKEN(load_scalar, !IS_REFERENCE(destRegister) && IS_REFERENCE(srcRegister))
+
+            if (srcRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
+
+            Primitives::Value element{  };
+            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Load(srcRegister.As<Primitives::Reference>().ArrayIndex, element))
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(element);
+            NEXT();
         }
-        case Instructions::Opcode::i32xor: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.XOR<int32_t>(src);
-            break;
+        TARGET(store) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+            if (destRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Store(destRegister.As<Primitives::Reference>().ArrayIndex, srcRegister.Load()))
+            NEXT();
         }
-        case Instructions::Opcode::i32shl: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftLeft<int32_t>(src);
-            break;
+        TARGET(advance) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+
+            if (destRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
+            else if (srcRegister.Typeof() != Primitives::Type::Uint32)
+                TRAP(Error::Fault::ExpectedUint32, pc);
+
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+
+            CHECK(arrayPtr->Advance(destRegister.As<Primitives::Reference>(), srcRegister.As<uint32_t>()))
+            NEXT();
         }
-        case Instructions::Opcode::i32shr: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftRight<int32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64neg: {
-            auto& dest = _registers[destIndex];
-            dest.Negate<int64_t>();
-            break;
-        }
-        case Instructions::Opcode::i64add: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Add<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64sub: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Subtract<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64mul: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Multiply<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64div: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Divide<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64rem: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Remainder<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64and: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.AND<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64or: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.OR<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64xor: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.XOR<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64shl: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftLeft<int64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::i64shr: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftRight<int64_t>(src);
-            break;
+
+        // Array instructions of verified code - same as above, minus the type checks.
+        // Indices and element types are only known at run time, so these are still checked,
+        // except for the indices of the accesses `SkipRangeChecks` found to stay in range
+        UNCHECKED(newarray) {
+            auto destRegister = DEST();
+            Primitives::Reference reference{  };
+            CHECK(_heap.NewArray(destRegister.As<uint32_t>(), SRC().As<uint32_t>(), reference))
+            destRegister.Assign(reference);
+            NEXT();
+        }
+        UNCHECKED(arraycount) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+            const auto count = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID)->Count();
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(count);
+            NEXT();
         }
+        UNCHECKED(load) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
 
-        case Instructions::Opcode::u32add: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Add<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32sub: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Subtract<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32mul: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Multiply<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32div: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Divide<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32rem: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Remainder<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32and: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.AND<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32or: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.OR<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32xor: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.XOR<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32shl: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftLeft<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u32shr: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftRight<uint32_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64add: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Add<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64sub: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Subtract<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64mul: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Multiply<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64div: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Divide<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64rem: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Remainder<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64and: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.AND<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64or: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.OR<uint64_t>(src);
-            break;
-        }
-        case Instructions::Opcode::u64xor: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.XOR<uint64_t>(src);
-            break;
+            Primitives::Value element{  };
+            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Load(srcRegister.As<Primitives::Reference>().ArrayIndex, element))
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(element);
+            NEXT();
         }
-        case Instructions::Opcode::u64shl: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftLeft<uint64_t>(src);
-            break;
+        UNCHECKED(store) {
+            auto destRegister = DEST();
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Store(destRegister.As<Primitives::Reference>().ArrayIndex, SRC().Load()))
+            NEXT();
         }
-        case Instructions::Opcode::u64shr: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.ShiftRight<uint64_t>(src);
-            break;
+        UNCHECKED(advance) {
+            auto destRegister = DEST();
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Advance(destRegister.As<Primitives::Reference>(), SRC().As<uint32_t>()))
+            NEXT();
         }
+        // Accesses whose index is known to be in range. Only the types are left to check
+        FUSED(load_inbounds) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+            if (srcRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
 
-        case Instructions::Opcode::f32neg: {
-            auto& dest = _registers[destIndex];
-            dest.Negate<float>();
-            break;
-        }
-        case Instructions::Opcode::f32add: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Add<float>(src);
-            break;
-        }
-        case Instructions::Opcode::f32sub: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Subtract<float>(src);
-            break;
-        }
-        case Instructions::Opcode::f32mul: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Multiply<float>(src);
-            break;
-        }
-        case Instructions::Opcode::f32div: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Divide<float>(src);
-            break;
-        }
-        case Instructions::Opcode::f32rem: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Remainder<float>(src);
-            break;
-        }
-        case Instructions::Opcode::f64neg: {
-            auto& dest = _registers[destIndex];
-            dest.Negate<double>();
-            break;
-        }
-        case Instructions::Opcode::f64add: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Add<double>(src);
-            break;
-        }
-        case Instructions::Opcode::f64sub: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Subtract<double>(src);
-            break;
-        }
-        case Instructions::Opcode::f64mul: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Multiply<double>(src);
-            break;
-        }
-        case Instructions::Opcode::f64div: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Divide<double>(src);
-            break;
-        }
-        case Instructions::Opcode::f64rem: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            dest.Remainder<double>(src);
-            break;
-        }
-        case Instructions::Opcode::bnot: {
-            auto& dest = _registers[destIndex];
-            dest.NOT();
-            break;
-        }
-        case Instructions::Opcode::convi32toi8: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, int8_t>();
-            break;
-        }
-        case Instructions::Opcode::convi32toi16: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, int16_t>();
-            break;
-        }
-        case Instructions::Opcode::convu32tou8: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, uint8_t>();
-            break;
-        }
-        case Instructions::Opcode::convu32tou16: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, uint16_t>();
-            break;
-        }
-        case Instructions::Opcode::convi32toi64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, int64_t>();
-            break;
-        }
-        case Instructions::Opcode::convi32tou64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, uint64_t>();
-            break;
-        }
-        case Instructions::Opcode::convi32tou32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, uint32_t>();
-            break;
-        }
-        case Instructions::Opcode::convi32tof32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, float>();
-            break;
-        }
-        case Instructions::Opcode::convi32tof64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int32_t, double>();
-            break;
-        }
-        case Instructions::Opcode::convi64toi32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int64_t, int32_t>();
-            break;
-        }
-        case Instructions::Opcode::convi64tou32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int64_t, uint32_t>();
-            break;
-        }
-        case Instructions::Opcode::convi64tou64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int64_t, uint64_t>();
-            break;
-        }
-        case Instructions::Opcode::convi64tof32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int64_t, float>();
-            break;
-        }
-        case Instructions::Opcode::convi64tof64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<int64_t, double>();
-            break;
-        }
-        case Instructions::Opcode::convu32toi64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, int64_t>();
-            break;
-        }
-        case Instructions::Opcode::convu32tou64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, uint64_t>();
-            break;
-        }
-        case Instructions::Opcode::convu32toi32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, int32_t>();
-            break;
-        }
-        case Instructions::Opcode::convu32tof32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, float>();
-            break;
-        }
-        case Instructions::Opcode::convu32tof64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint32_t, double>();
-            break;
-        }
-        case Instructions::Opcode::convu64toi64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint64_t, int64_t>();
-            break;
-        }
-        case Instructions::Opcode::convu64tou32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint64_t, uint32_t>();
-            break;
-        }
-        case Instructions::Opcode::convu64toi32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint64_t, int32_t>();
-            break;
-        }
-        case Instructions::Opcode::convu64tof32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint64_t, float>();
-            break;
-        }
-        case Instructions::Opcode::convu64tof64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<uint64_t, double>();
-            break;
-        }
-        case Instructions::Opcode::convf32toi32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<float, int32_t>();
-            break;
-        }
-        case Instructions::Opcode::convf32toi64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<float, int64_t>();
-            break;
-        }
-        case Instructions::Opcode::convf32tou32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<float, uint32_t>();
-            break;
-        }
-        case Instructions::Opcode::convf32tof64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<float, double>();
-            break;
-        }
-        case Instructions::Opcode::convf32tou64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<float, uint64_t>();
-            break;
-        }
-        case Instructions::Opcode::convf64toi32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<double, int32_t>();
-            break;
-        }
-        case Instructions::Opcode::convf64toi64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<double, int64_t>();
-            break;
-        }
-        case Instructions::Opcode::convf64tou32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<double, uint32_t>();
-            break;
-        }
-        case Instructions::Opcode::convf64tou64: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<double, uint64_t>();
-            break;
-        }
-        case Instructions::Opcode::convf64tof32: {
-            auto& dest = _registers[destIndex];
-            dest.Convert<double, float>();
-            break;
-        }
-        case Instructions::Opcode::cmp: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            _flags = dest.Compare<unsigned>(src);
-            break;
+            Primitives::Value element{  };
+            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
+            static_cast<void>(arrayPtr->Load<false>(srcRegister.As<Primitives::Reference>().ArrayIndex, element));
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(element);
+            NEXT();
         }
-        case Instructions::Opcode::icmp: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            _flags = dest.Compare<signed>(src);
-            break;
+        FUSED(store_inbounds) {
+            auto destRegister = DEST();
+            if (destRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Store<false>(destRegister.As<Primitives::Reference>().ArrayIndex, SRC().Load()))
+            NEXT();
         }
-        case Instructions::Opcode::fcmp: {
-            auto& dest = _registers[destIndex];
-            const auto& src  = _registers[srcIndex];
-            _flags = dest.Compare<float>(src);
-            break;
+        FUSED(advance_inbounds) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+            if (destRegister.Typeof() != Primitives::Type::Reference)
+                TRAP(Error::Fault::ExpectedReference, pc);
+            else if (srcRegister.Typeof() != Primitives::Type::Uint32)
+                TRAP(Error::Fault::ExpectedUint32, pc);
+
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            static_cast<void>(arrayPtr->Advance<false>(destRegister.As<Primitives::Reference>(), srcRegister.As<uint32_t>()));
+            NEXT();
         }
-        case Instructions::Opcode::jmp: {
-            size = destIndex;
-            break;
+        // Same as above, for proven functions. A store still checks the element type
+        UNCHECKED_FUSED(load_inbounds) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+
+            Primitives::Value element{  };
+            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
+            static_cast<void>(arrayPtr->Load<false>(srcRegister.As<Primitives::Reference>().ArrayIndex, element));
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(element);
+            NEXT();
         }
-        case Instructions::Opcode::je: {
-            if (_flags == 0)
-                size = destIndex;
-            break;
+        UNCHECKED_FUSED(store_inbounds) {
+            auto destRegister = DEST();
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Store<false>(destRegister.As<Primitives::Reference>().ArrayIndex, SRC().Load()))
+            NEXT();
         }
-        case Instructions::Opcode::jne: {
-            if (_flags != 0)
-                size = destIndex;
-            break;
+        UNCHECKED_FUSED(advance_inbounds) {
+            auto destRegister = DEST();
+            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
+            static_cast<void>(arrayPtr->Advance<false>(destRegister.As<Primitives::Reference>(), SRC().As<uint32_t>()));
+            NEXT();
         }
-        case Instructions::Opcode::jlt: {
-            if (_flags < 0)
-                size = destIndex;
-            break;
+        SHARED(printreg) {
+            const auto dest = DEST();
+
+            puts(dest.ToString(false).c_str());
+            NEXT();
         }
-        case Instructions::Opcode::jle: {
-            if (_flags <= 0)
-                size = destIndex;
-            break;
+        SHARED(nop) {
+            NEXT();
         }
-        case Instructions::Opcode::jgt: {
-            if (_flags > 0)
-                size = destIndex;
-            break;
+        SHARED(hlt) {
+            getchar();
+            NEXT();
         }
-        case Instructions::Opcode::jge: {
-            if (_flags >= 0)
-                size = destIndex;
-            break;
+
+        COMPARE_JUMP(cmp_je, unsigned, cmp_u64_je, Primitives::Type::Uint64, _flags == 0)
+        COMPARE_JUMP(cmp_jne, unsigned, cmp_u64_jne, Primitives::Type::Uint64, _flags != 0)
+        COMPARE_JUMP(cmp_jgt, unsigned, cmp_u64_jgt, Primitives::Type::Uint64, _flags > 0)
+        COMPARE_JUMP(cmp_jge, unsigned, cmp_u64_jge, Primitives::Type::Uint64, _flags >= 0)
+        COMPARE_JUMP(cmp_jlt, unsigned, cmp_u64_jlt, Primitives::Type::Uint64, _flags < 0)
+        COMPARE_JUMP(cmp_jle, unsigned, cmp_u64_jle, Primitives::Type::Uint64, _flags <= 0)
+        COMPARE_JUMP(icmp_je, signed, icmp_i64_je, Primitives::Type::Int64, _flags == 0)
+        COMPARE_JUMP(icmp_jne, signed, icmp_i64_jne, Primitives::Type::Int64, _flags != 0)
+        COMPARE_JUMP(icmp_jgt, signed, icmp_i64_jgt, Primitives::Type::Int64, _flags > 0)
+        COMPARE_JUMP(icmp_jge, signed, icmp_i64_jge, Primitives::Type::Int64, _flags >= 0)
+        COMPARE_JUMP(icmp_jlt, signed, icmp_i64_jlt, Primitives::Type::Int64, _flags < 0)
+        COMPARE_JUMP(icmp_jle, signed, icmp_i64_jle, Primitives::Type::Int64, _flags <= 0)
+        COMPARE_JUMP(fcmp_je, float, fcmp_f64_je, Primitives::Type::Float64, _flags == 0)
+        COMPARE_JUMP(fcmp_jne, float, fcmp_f64_jne, Primitives::Type::Float64, _flags != 0)
+        COMPARE_JUMP(fcmp_jgt, float, fcmp_f64_jgt, Primitives::Type::Float64, _flags > 0)
+        COMPARE_JUMP(fcmp_jge, float, fcmp_f64_jge, Primitives::Type::Float64, _flags >= 0)
+        COMPARE_JUMP(fcmp_jlt, float, fcmp_f64_jlt, Primitives::Type::Float64, _flags < 0)
+        COMPARE_JUMP(fcmp_jle, float, fcmp_f64_jle, Primitives::Type::Float64, _flags <= 0)
+        COMPARE_SELECT(cmp_cmove, unsigned, cmp_u64_cmove, Primitives::Type::Uint64, _flags == 0)
+        COMPARE_SELECT(cmp_cmovne, unsigned, cmp_u64_cmovne, Primitives::Type::Uint64, _flags != 0)
+        COMPARE_SELECT(cmp_cmovgt, unsigned, cmp_u64_cmovgt, Primitives::Type::Uint64, _flags > 0)
+        COMPARE_SELECT(cmp_cmovge, unsigned, cmp_u64_cmovge, Primitives::Type::Uint64, _flags >= 0)
+        COMPARE_SELECT(cmp_cmovlt, unsigned, cmp_u64_cmovlt, Primitives::Type::Uint64, _flags < 0)
+        COMPARE_SELECT(cmp_cmovle, unsigned, cmp_u64_cmovle, Primitives::Type::Uint64, _flags <= 0)
+        COMPARE_SELECT(icmp_cmove, signed, icmp_i64_cmove, Primitives::Type::Int64, _flags == 0)
+        COMPARE_SELECT(icmp_cmovne, signed, icmp_i64_cmovne, Primitives::Type::Int64, _flags != 0)
+        COMPARE_SELECT(icmp_cmovgt, signed, icmp_i64_cmovgt, Primitives::Type::Int64, _flags > 0)
+        COMPARE_SELECT(icmp_cmovge, signed, icmp_i64_cmovge, Primitives::Type::Int64, _flags >= 0)
+        COMPARE_SELECT(icmp_cmovlt, signed, icmp_i64_cmovlt, Primitives::Type::Int64, _flags < 0)
+        COMPARE_SELECT(icmp_cmovle, signed, icmp_i64_cmovle, Primitives::Type::Int64, _flags <= 0)
+        COMPARE_SELECT(fcmp_cmove, float, fcmp_f64_cmove, Primitives::Type::Float64, _flags == 0)
+        COMPARE_SELECT(fcmp_cmovne, float, fcmp_f64_cmovne, Primitives::Type::Float64, _flags != 0)
+        COMPARE_SELECT(fcmp_cmovgt, float, fcmp_f64_cmovgt, Primitives::Type::Float64, _flags > 0)
+        COMPARE_SELECT(fcmp_cmovge, float, fcmp_f64_cmovge, Primitives::Type::Float64, _flags >= 0)
+        COMPARE_SELECT(fcmp_cmovlt, float, fcmp_f64_cmovlt, Primitives::Type::Float64, _flags < 0)
+        COMPARE_SELECT(fcmp_cmovle, float, fcmp_f64_cmovle, Primitives::Type::Float64, _flags <= 0)
+
+        LOAD_CONSTANT_COMPARE(ldconst_cmp, unsigned, ldconst_cmp_u64, Primitives::Type::Uint64)
+        LOAD_CONSTANT_COMPARE(ldconst_icmp, signed, ldconst_icmp_i64, Primitives::Type::Int64)
+        LOAD_CONSTANT_BINARY(ldconst_i64add, Add, int64_t)
+        LOAD_CONSTANT_BINARY(ldconst_i64sub, Subtract, int64_t)
+        LOAD_CONSTANT_BINARY(ldconst_u64add, Add, uint64_t)
+        LOAD_CONSTANT_BINARY(ldconst_u64sub, Subtract, uint64_t)
+
+        MOVE_BINARY(mov_i64add, Add, int64_t)
+        MOVE_BINARY(mov_i64sub, Subtract, int64_t)
+        MOVE_BINARY(mov_i64mul, Multiply, int64_t)
+        MOVE_BINARY(mov_u64add, Add, uint64_t)
+        MOVE_BINARY(mov_u64sub, Subtract, uint64_t)
+        MOVE_BINARY(mov_u64mul, Multiply, uint64_t)
+
+        QUICK_COMPARE(cmp_u64, uint64_t, Primitives::Type::Uint64, Instructions::Opcode::cmp)
+        QUICK_COMPARE(icmp_i64, int64_t, Primitives::Type::Int64, Instructions::Opcode::icmp)
+        QUICK_COMPARE(fcmp_f64, double, Primitives::Type::Float64, Instructions::Opcode::fcmp)
+
+        QUICK_COMPARE_JUMP(cmp_u64_je, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_je, _flags == 0)
+        QUICK_COMPARE_JUMP(cmp_u64_jne, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_jne, _flags != 0)
+        QUICK_COMPARE_JUMP(cmp_u64_jgt, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_jgt, _flags > 0)
+        QUICK_COMPARE_JUMP(cmp_u64_jge, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_jge, _flags >= 0)
+        QUICK_COMPARE_JUMP(cmp_u64_jlt, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_jlt, _flags < 0)
+        QUICK_COMPARE_JUMP(cmp_u64_jle, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_jle, _flags <= 0)
+        QUICK_COMPARE_JUMP(icmp_i64_je, int64_t, Primitives::Type::Int64, Superinstruction::icmp_je, _flags == 0)
+        QUICK_COMPARE_JUMP(icmp_i64_jne, int64_t, Primitives::Type::Int64, Superinstruction::icmp_jne, _flags != 0)
+        QUICK_COMPARE_JUMP(icmp_i64_jgt, int64_t, Primitives::Type::Int64, Superinstruction::icmp_jgt, _flags > 0)
+        QUICK_COMPARE_JUMP(icmp_i64_jge, int64_t, Primitives::Type::Int64, Superinstruction::icmp_jge, _flags >= 0)
+        QUICK_COMPARE_JUMP(icmp_i64_jlt, int64_t, Primitives::Type::Int64, Superinstruction::icmp_jlt, _flags < 0)
+        QUICK_COMPARE_JUMP(icmp_i64_jle, int64_t, Primitives::Type::Int64, Superinstruction::icmp_jle, _flags <= 0)
+        QUICK_COMPARE_JUMP(fcmp_f64_je, double, Primitives::Type::Float64, Superinstruction::fcmp_je, _flags == 0)
+        QUICK_COMPARE_JUMP(fcmp_f64_jne, double, Primitives::Type::Float64, Superinstruction::fcmp_jne, _flags != 0)
+        QUICK_COMPARE_JUMP(fcmp_f64_jgt, double, Primitives::Type::Float64, Superinstruction::fcmp_jgt, _flags > 0)
+        QUICK_COMPARE_JUMP(fcmp_f64_jge, double, Primitives::Type::Float64, Superinstruction::fcmp_jge, _flags >= 0)
+        QUICK_COMPARE_JUMP(fcmp_f64_jlt, double, Primitives::Type::Float64, Superinstruction::fcmp_jlt, _flags < 0)
+        QUICK_COMPARE_JUMP(fcmp_f64_jle, double, Primitives::Type::Float64, Superinstruction::fcmp_jle, _flags <= 0)
+        QUICK_COMPARE_SELECT(cmp_u64_cmove, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_cmove, _flags == 0)
+        QUICK_COMPARE_SELECT(cmp_u64_cmovne, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_cmovne, _flags != 0)
+        QUICK_COMPARE_SELECT(cmp_u64_cmovgt, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_cmovgt, _flags > 0)
+        QUICK_COMPARE_SELECT(cmp_u64_cmovge, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_cmovge, _flags >= 0)
+        QUICK_COMPARE_SELECT(cmp_u64_cmovlt, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_cmovlt, _flags < 0)
+        QUICK_COMPARE_SELECT(cmp_u64_cmovle, uint64_t, Primitives::Type::Uint64, Superinstruction::cmp_cmovle, _flags <= 0)
+        QUICK_COMPARE_SELECT(icmp_i64_cmove, int64_t, Primitives::Type::Int64, Superinstruction::icmp_cmove, _flags == 0)
+        QUICK_COMPARE_SELECT(icmp_i64_cmovne, int64_t, Primitives::Type::Int64, Superinstruction::icmp_cmovne, _flags != 0)
+        QUICK_COMPARE_SELECT(icmp_i64_cmovgt, int64_t, Primitives::Type::Int64, Superinstruction::icmp_cmovgt, _flags > 0)
+        QUICK_COMPARE_SELECT(icmp_i64_cmovge, int64_t, Primitives::Type::Int64, Superinstruction::icmp_cmovge, _flags >= 0)
+        QUICK_COMPARE_SELECT(icmp_i64_cmovlt, int64_t, Primitives::Type::Int64, Superinstruction::icmp_cmovlt, _flags < 0)
+        QUICK_COMPARE_SELECT(icmp_i64_cmovle, int64_t, Primitives::Type::Int64, Superinstruction::icmp_cmovle, _flags <= 0)
+        QUICK_COMPARE_SELECT(fcmp_f64_cmove, double, Primitives::Type::Float64, Superinstruction::fcmp_cmove, _flags == 0)
+        QUICK_COMPARE_SELECT(fcmp_f64_cmovne, double, Primitives::Type::Float64, Superinstruction::fcmp_cmovne, _flags != 0)
+        QUICK_COMPARE_SELECT(fcmp_f64_cmovgt, double, Primitives::Type::Float64, Superinstruction::fcmp_cmovgt, _flags > 0)
+        QUICK_COMPARE_SELECT(fcmp_f64_cmovge, double, Primitives::Type::Float64, Superinstruction::fcmp_cmovge, _flags >= 0)
+        QUICK_COMPARE_SELECT(fcmp_f64_cmovlt, double, Primitives::Type::Float64, Superinstruction::fcmp_cmovlt, _flags < 0)
+        QUICK_COMPARE_SELECT(fcmp_f64_cmovle, double, Primitives::Type::Float64, Superinstruction::fcmp_cmovle, _flags <= 0)
+
+        QUICK_LOAD_CONSTANT_COMPARE(ldconst_cmp_u64, uint64_t, Primitives::Type::Uint64, Superinstruction::ldconst_cmp)
+        QUICK_LOAD_CONSTANT_COMPARE(ldconst_icmp_i64, int64_t, Primitives::Type::Int64, Superinstruction::ldconst_icmp)
+
+        QUICK(ldconst_scalar) {
+            GUARD(!IS_REFERENCE(DEST()), Instructions::Opcode::ldconst)
+            DEST().Assign(*pc->Constant);
+            NEXT();
+        }
+        QUICK(mov_scalar) {
+            GUARD(!IS_REFERENCE(DEST()) && !IS_REFERENCE(SRC()), Instructions::Opcode::mov)
+            DEST().Assign(SRC());
+            NEXT();
+        }
+        QUICK(load_scalar) {
+            auto destRegister = DEST();
+            const auto srcRegister = SRC();
+            GUARD(!IS_REFERENCE(destRegister) && IS_REFERENCE(srcRegister), Instructions::Opcode::load)
+
+            Primitives::Value element{  };
+            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
+            CHECK(arrayPtr->Load(srcRegister.As<Primitives::Reference>().ArrayIndex, element))
+            destRegister.Assign(element);
+            NEXT();
         }
-        case Instructions::Opcode::call: {
-            currentFrame.ReturnAddress = pc - _unit.StartPC() + size;
-            _callStack.Push(currentFrame);
-
-            const auto& symbol = _unit.SymbolLookup(destIndex << 2);
-
-            // Allocate new registers
-            _registers.Allocate(symbol.Registers);
-            
-            if (symbol.Arguments != 0)
-                _registers.Copy(symbol.Registers, symbol.Arguments, _heap);
-
-            currentFrame.ReturnAddress   = 0;
-            currentFrame.End             = symbol.End;
-            currentFrame.RegisterCount   = symbol.Registers;
-            currentFrame.KeepReturnValue = symbol.DoesReturn;
-            
-            size = 0;
-            pc = _unit.StartPC() + destIndex;
-            break;
+
+#ifdef YUN_THREADED_DISPATCH
+    invalid:
+        TRAP(Error::Fault::InvalidInstruction, pc);
+#else
+        default:
+            TRAP(Error::Fault::InvalidInstruction, pc);
         }
-        case Instructions::Opcode::ret: {
-            auto oldFrame = currentFrame;
-            currentFrame = _callStack.Pop();
+    }
+#endif
+}
 
-            if (oldFrame.KeepReturnValue && oldFrame.RegisterCount != 0)
-                _registers.SaveReturnValue(oldFrame.RegisterCount, _heap);
+#ifdef YUN_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
 
-            _registers.Deallocate(oldFrame.RegisterCount, _heap);
+#undef QUICK_LOAD_CONSTANT_COMPARE
+#undef MOVE_BINARY
+#undef LOAD_CONSTANT_BINARY
+#undef LOAD_CONSTANT_COMPARE
+#undef QUICK_COMPARE_SELECT
+#undef COMPARE_SELECT
+#undef QUICK_COMPARE_JUMP
+#undef COMPARE_JUMP
+#undef SELECT
+#undef CHOOSE
+#undef JUMP
+#undef QUICK_COMPARE
+#undef COMPARE
+#undef CONVERT
+#undef BINARY
+#undef UNARY
+#undef MOVE
+#undef LOAD_CONSTANT
+#undef GUARD
+#undef QUICKEN
+#undef BOTH2_ARE
+#undef BOTH_ARE
+#undef IS_REFERENCE
+#undef NEXT2
+#undef TRACE
+#undef BRANCH
+#undef RETURN
+#undef CALL
+#undef NEXT
+#undef DISPATCH
+#undef RECORD_EVERYTHING
+#undef HANDLER
+#undef SHARED
+#undef QUICK
+#undef UNCHECKED_FUSED
+#undef UNCHECKED
+#undef FUSED
+#undef TARGET
+#undef CHECK2
+#undef CHECK
+#undef TRAP
+#undef SRC2
+#undef DEST2
+#undef SRC
+#undef DEST
+#undef REGISTER
 
-            size = 0;
-            pc = _unit.StartPC() + currentFrame.ReturnAddress;
-            break;
-        }
-        case Instructions::Opcode::ldconst: {
-            auto& destRegister = _registers[destIndex];
-            if (destRegister.Typeof() == Primitives::Type::Reference)
-                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
-            destRegister.Assign(_unit.ConstantLookup(srcIndex));
+// Same as `call` followed by the callee's `ret`, except that the callee is native
+// and leaves the call stack alone. The register array might move in the meantime,
+// so it returns where the caller's frame is now
+auto VM::NativeCall(VM* vm, const FunctionDescriptor* callee, uint32_t callerRegisters, uint32_t shared) -> Containers::RegisterWindow {
+    try {
+        auto& registers = vm->_registers;
+        const auto base = registers.Count() - callerRegisters;
+
+        registers.Allocate(callee->Registers - shared);
+        if (shared == 0 && callee->Arguments != 0)
+            registers.Copy(callee->Registers, callee->Arguments, vm->_heap);
+
+        const auto frame = registers.Window(base + callerRegisters - shared);
+        const auto count = callee->Native(frame.Payloads, frame.Types, shared);
+        if (callee->DoesReturn && count != 0 && shared != 1)
+            registers.SaveReturnValue(count, shared, vm->_heap);
+        registers.Deallocate(count - shared, vm->_heap);
+
+        return registers.Window(base);
+    } catch (...) {
+        vm->_nativeError = std::current_exception();
+    }
+    vm->LeaveNative();
+}
+
+auto VM::NativeTailCall(VM* vm, const FunctionDescriptor* callee, uint32_t currentRegisters) -> Containers::RegisterWindow {
+    try {
+        auto& registers = vm->_registers;
+        registers.Reuse(currentRegisters, callee->Registers, callee->Arguments, vm->_heap);
+        return registers.Window(registers.Count() - callee->Registers);
+    } catch (...) {
+        vm->_nativeError = std::current_exception();
+    }
+    vm->LeaveNative();
+}
+
+auto VM::NativeNotify(VM* vm, const Primitives::Payload* payload, const Primitives::Type* type, bool increment) -> void {
+    if (*type == Primitives::Type::Reference)
+        vm->_heap.Notify(payload->ref.HeapID, increment);
+}
+
+#define EXECUTE_UNARY(op, method, T)                         \
+    case Instructions::Opcode::op:                          \
+        fault = destRegister.method<T>();                   \
+        break;
+
+#define EXECUTE_BINARY(op, method, T)                        \
+    case Instructions::Opcode::op:                          \
+        fault = destRegister.method<T>(srcRegister);        \
+        break;
+
+#define EXECUTE_CONVERT(op, From, To)                        \
+    case Instructions::Opcode::op:                          \
+        fault = destRegister.Convert<From, To>();           \
+        break;
+
+#define EXECUTE_COMPARE(op, T)                               \
+    case Instructions::Opcode::op:                          \
+        fault = destRegister.Comparable<T>(srcRegister);    \
+        if (fault == Error::Fault::None)                    \
+            vm->_flags = destRegister.Compare<T>(srcRegister); \
+        break;
+
+// Whatever native code doesn't do inline, done the same way as by the checked handlers
+// The source is only ever read, even though a `Register` can't tell
+auto VM::NativeExecute(VM* vm, uint32_t instruction, Primitives::Payload* destPayload, Primitives::Type* destType, const Primitives::Payload* srcPayload, const Primitives::Type* srcType) -> void {
+    try {
+        Primitives::Register destRegister{ *destPayload, *destType };
+        const Primitives::Register srcRegister{ const_cast<Primitives::Payload&>(*srcPayload), const_cast<Primitives::Type&>(*srcType) };
+        auto& heap = vm->_heap;
+        auto fault = Error::Fault::None;
+
+        switch (static_cast<Instructions::Opcode>(instruction & 0xFF)) {
+        EXECUTE_UNARY(i32neg, Negate, int32_t)
+        EXECUTE_BINARY(i32add, Add, int32_t)
+        EXECUTE_BINARY(i32sub, Subtract, int32_t)
+        EXECUTE_BINARY(i32mul, Multiply, int32_t)
+        EXECUTE_BINARY(i32div, Divide, int32_t)
+        EXECUTE_BINARY(i32rem, Remainder, int32_t)
+        EXECUTE_BINARY(i32and, AND, int32_t)
+        EXECUTE_BINARY(i32or, OR, int32_t)
+        EXECUTE_BINARY(i32xor, XOR, int32_t)
+        EXECUTE_BINARY(i32shl, ShiftLeft, int32_t)
+        EXECUTE_BINARY(i32shr, ShiftRight, int32_t)
+        EXECUTE_UNARY(i64neg, Negate, int64_t)
+        EXECUTE_BINARY(i64add, Add, int64_t)
+        EXECUTE_BINARY(i64sub, Subtract, int64_t)
+        EXECUTE_BINARY(i64mul, Multiply, int64_t)
+        EXECUTE_BINARY(i64div, Divide, int64_t)
+        EXECUTE_BINARY(i64rem, Remainder, int64_t)
+        EXECUTE_BINARY(i64and, AND, int64_t)
+        EXECUTE_BINARY(i64or, OR, int64_t)
+        EXECUTE_BINARY(i64xor, XOR, int64_t)
+        EXECUTE_BINARY(i64shl, ShiftLeft, int64_t)
+        EXECUTE_BINARY(i64shr, ShiftRight, int64_t)
+
+        EXECUTE_BINARY(u32add, Add, uint32_t)
+        EXECUTE_BINARY(u32sub, Subtract, uint32_t)
+        EXECUTE_BINARY(u32mul, Multiply, uint32_t)
+        EXECUTE_BINARY(u32div, Divide, uint32_t)
+        EXECUTE_BINARY(u32rem, Remainder, uint32_t)
+        EXECUTE_BINARY(u32and, AND, uint32_t)
+        EXECUTE_BINARY(u32or, OR, uint32_t)
+        EXECUTE_BINARY(u32xor, XOR, uint32_t)
+        EXECUTE_BINARY(u32shl, ShiftLeft, uint32_t)
+        EXECUTE_BINARY(u32shr, ShiftRight, uint32_t)
+        EXECUTE_BINARY(u64add, Add, uint64_t)
+        EXECUTE_BINARY(u64sub, Subtract, uint64_t)
+        EXECUTE_BINARY(u64mul, Multiply, uint64_t)
+        EXECUTE_BINARY(u64div, Divide, uint64_t)
+        EXECUTE_BINARY(u64rem, Remainder, uint64_t)
+        EXECUTE_BINARY(u64and, AND, uint64_t)
+        EXECUTE_BINARY(u64or, OR, uint64_t)
+        EXECUTE_BINARY(u64xor, XOR, uint64_t)
+        EXECUTE_BINARY(u64shl, ShiftLeft, uint64_t)
+        EXECUTE_BINARY(u64shr, ShiftRight, uint64_t)
+
+        EXECUTE_UNARY(f32neg, Negate, float)
+        EXECUTE_BINARY(f32add, Add, float)
+        EXECUTE_BINARY(f32sub, Subtract, float)
+        EXECUTE_BINARY(f32mul, Multiply, float)
+        EXECUTE_BINARY(f32div, Divide, float)
+        EXECUTE_BINARY(f32rem, Remainder, float)
+        EXECUTE_UNARY(f64neg, Negate, double)
+        EXECUTE_BINARY(f64add, Add, double)
+        EXECUTE_BINARY(f64sub, Subtract, double)
+        EXECUTE_BINARY(f64mul, Multiply, double)
+        EXECUTE_BINARY(f64div, Divide, double)
+        EXECUTE_BINARY(f64rem, Remainder, double)
+
+        case Instructions::Opcode::bnot:
+            destRegister.NOT();
             break;
-        }
-        case Instructions::Opcode::mov: {
-            auto& destRegister = _registers[destIndex];
-            const auto& srcRegister  = _registers[srcIndex];
 
+        EXECUTE_CONVERT(convi32toi8, int32_t, int8_t)
+        EXECUTE_CONVERT(convi32toi16, int32_t, int16_t)
+        EXECUTE_CONVERT(convu32tou8, uint32_t, uint8_t)
+        EXECUTE_CONVERT(convu32tou16, uint32_t, uint16_t)
+        EXECUTE_CONVERT(convi32toi64, int32_t, int64_t)
+        EXECUTE_CONVERT(convi32tou64, int32_t, uint64_t)
+        EXECUTE_CONVERT(convi32tou32, int32_t, uint32_t)
+        EXECUTE_CONVERT(convi32tof32, int32_t, float)
+        EXECUTE_CONVERT(convi32tof64, int32_t, double)
+        EXECUTE_CONVERT(convi64toi32, int64_t, int32_t)
+        EXECUTE_CONVERT(convi64tou32, int64_t, uint32_t)
+        EXECUTE_CONVERT(convi64tou64, int64_t, uint64_t)
+        EXECUTE_CONVERT(convi64tof32, int64_t, float)
+        EXECUTE_CONVERT(convi64tof64, int64_t, double)
+        EXECUTE_CONVERT(convu32toi64, uint32_t, int64_t)
+        EXECUTE_CONVERT(convu32tou64, uint32_t, uint64_t)
+        EXECUTE_CONVERT(convu32toi32, uint32_t, int32_t)
+        EXECUTE_CONVERT(convu32tof32, uint32_t, float)
+        EXECUTE_CONVERT(convu32tof64, uint32_t, double)
+        EXECUTE_CONVERT(convu64toi64, uint64_t, int64_t)
+        EXECUTE_CONVERT(convu64tou32, uint64_t, uint32_t)
+        EXECUTE_CONVERT(convu64toi32, uint64_t, int32_t)
+        EXECUTE_CONVERT(convu64tof32, uint64_t, float)
+        EXECUTE_CONVERT(convu64tof64, uint64_t, double)
+        EXECUTE_CONVERT(convf32toi32, float, int32_t)
+        EXECUTE_CONVERT(convf32toi64, float, int64_t)
+        EXECUTE_CONVERT(convf32tou32, float, uint32_t)
+        EXECUTE_CONVERT(convf32tof64, float, double)
+        EXECUTE_CONVERT(convf32tou64, float, uint64_t)
+        EXECUTE_CONVERT(convf64toi32, double, int32_t)
+        EXECUTE_CONVERT(convf64toi64, double, int64_t)
+        EXECUTE_CONVERT(convf64tou32, double, uint32_t)
+        EXECUTE_CONVERT(convf64tou64, double, uint64_t)
+        EXECUTE_CONVERT(convf64tof32, double, float)
+
+        EXECUTE_COMPARE(cmp, unsigned)
+        EXECUTE_COMPARE(icmp, signed)
+        EXECUTE_COMPARE(fcmp, float)
+
+        case Instructions::Opcode::cmove:
+        case Instructions::Opcode::cmovne:
+        case Instructions::Opcode::cmovgt:
+        case Instructions::Opcode::cmovge:
+        case Instructions::Opcode::cmovlt:
+        case Instructions::Opcode::cmovle:
+            if (!Instructions::Passes(static_cast<Instructions::Opcode>(instruction & 0xFF), vm->_flags))
+                break;
+            [[fallthrough]];
+        case Instructions::Opcode::ldconst:
+        case Instructions::Opcode::mov:
             if (destRegister.Typeof() == Primitives::Type::Reference)
-                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+                heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
             if (srcRegister.Typeof() == Primitives::Type::Reference)
-                _heap.Notify(srcRegister.As<Primitives::Reference>().HeapID, true);
-
+                heap.Notify(srcRegister.As<Primitives::Reference>().HeapID, true);
             destRegister.Assign(srcRegister);
             break;
-        }
+
         case Instructions::Opcode::newarray: {
-            auto& destRegister = _registers[destIndex];
-            const auto& srcRegister  = _registers[srcIndex];
-            if (destRegister.Typeof() !=  Primitives::Type::Uint32)
-                ReportError("Invalid type for array size");
-            else if (srcRegister.Typeof() != Primitives::Type::Uint32)
-                ReportError("Invalid type for array type");
+            if (destRegister.Typeof() != Primitives::Type::Uint32 || srcRegister.Typeof() != Primitives::Type::Uint32) {
+                fault = Error::Fault::ExpectedUint32;
+                break;
+            }
 
-            destRegister.Assign(_heap.NewArray(destRegister.As<uint32_t>(), srcRegister.As<uint32_t>()));
+            Primitives::Reference reference{  };
+            fault = heap.NewArray(destRegister.As<uint32_t>(), srcRegister.As<uint32_t>(), reference);
+            if (fault == Error::Fault::None)
+                destRegister.Assign(reference);
             break;
         }
         case Instructions::Opcode::arraycount: {
-            auto& destRegister = _registers[destIndex];
-            const auto& srcRegister = _registers[srcIndex];
-            if (srcRegister.Typeof() != Primitives::Type::Reference)
-                ReportError("Invalid type for arraycount");
-            if (destRegister.Typeof() == Primitives::Type::Reference)
-                _heap.Notify(srcRegister.As<Primitives::Reference>().HeapID, false);
-
+            if (srcRegister.Typeof() != Primitives::Type::Reference) {
+                fault = Error::Fault::ExpectedReference;
+                break;
+            }
 
-            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
-            destRegister.Assign(arrayPtr->Count());
+            const auto count = heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID)->Count();
+            if (destRegister.Typeof() == Primitives::Type::Reference)
+                heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(count);
             break;
         }
         case Instructions::Opcode::load: {
-            auto& destRegister = _registers[destIndex];
-            const auto& srcRegister = _registers[srcIndex];
+            if (srcRegister.Typeof() != Primitives::Type::Reference) {
+                fault = Error::Fault::ExpectedReference;
+                break;
+            }
 
+            Primitives::Value element{  };
+            fault = heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID)->Load(srcRegister.As<Primitives::Reference>().ArrayIndex, element);
+            if (fault != Error::Fault::None)
+                break;
             if (destRegister.Typeof() == Primitives::Type::Reference)
-                _heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
-            if (srcRegister.Typeof() != Primitives::Type::Reference)
-                ReportError("Invalid type for load (expected a reference)");
-
-            auto arrayPtr = _heap.GetArray(srcRegister.As<Primitives::Reference>().HeapID);
-            destRegister.Assign(arrayPtr->Load(srcRegister.As<Primitives::Reference>().ArrayIndex));
+                heap.Notify(destRegister.As<Primitives::Reference>().HeapID, false);
+            destRegister.Assign(element);
             break;
         }
-        case Instructions::Opcode::store: {
-            auto& destRegister = _registers[destIndex];
-            const auto& srcRegister = _registers[srcIndex];
-            if (destRegister.Typeof() != Primitives::Type::Reference)
-                ReportError("Invalid type for store (expected a reference)");
-            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
-            arrayPtr->Store(destRegister.As<Primitives::Reference>().ArrayIndex, srcRegister);
-            break;
-        }
-        case Instructions::Opcode::advance: {
-            auto& destRegister = _registers[destIndex];
-            const auto& srcRegister = _registers[srcIndex];
+        case Instructions::Opcode::store:
+            if (destRegister.Typeof() != Primitives::Type::Reference) {
+                fault = Error::Fault::ExpectedReference;
+                break;
+            }
 
+            fault = heap.GetArray(destRegister.As<Primitives::Reference>().HeapID)->Store(destRegister.As<Primitives::Reference>().ArrayIndex, srcRegister.Load());
+            break;
+        case Instructions::Opcode::advance:
             if (destRegister.Typeof() != Primitives::Type::Reference)
-                ReportError("Invalid type for advance (expected a reference)");
+                fault = Error::Fault::ExpectedReference;
             else if (srcRegister.Typeof() != Primitives::Type::Uint32)
-                ReportError("Invalid type for advance (expected int32)");
-
-            auto arrayPtr = _heap.GetArray(destRegister.As<Primitives::Reference>().HeapID);
-
-            arrayPtr->Advance(destRegister.As<Primitives::Reference>(), srcRegister.As<uint32_t>());
+                fault = Error::Fault::ExpectedUint32;
+            else
+                fault = heap.GetArray(destRegister.As<Primitives::Reference>().HeapID)->Advance(destRegister.As<Primitives::Reference>(), srcRegister.As<uint32_t>());
             break;
-        }
-        case Instructions::Opcode::printreg: {
-            const auto& dest = _registers[destIndex];
 
-            puts(dest.ToString(false).c_str());
-        }
-        case Instructions::Opcode::nop:
+        case Instructions::Opcode::printreg:
+            puts(destRegister.ToString(false).c_str());
             break;
         case Instructions::Opcode::hlt:
             getchar();
             break;
+
+        default:
+            fault = Error::Fault::InvalidInstruction;
+            break;
         }
 
-        pc += size;
+        if (fault != Error::Fault::None)
+            vm->Trap(fault, instruction >> 8, destType, srcType);
+        return;
+    } catch (...) {
+        vm->_nativeError = std::current_exception();
+    }
+    vm->LeaveNative();
+}
+
+#undef EXECUTE_COMPARE
+#undef EXECUTE_CONVERT
+#undef EXECUTE_BINARY
+#undef EXECUTE_UNARY
+
+// Which function a call went to, or which way a conditional jump went
+auto VM::CountTransfer(const DecodedInstruction* from, const DecodedInstruction* to) -> void {
+    const auto opcode = static_cast<Instructions::Opcode>(from->Opcode);
+    if (Instructions::IsCall(opcode))
+        ++_callCounts[static_cast<size_t>(from->Callee - _functions.data())];
+    else if (Instructions::Info(opcode).Flags & Instructions::Flag::Conditional)
+        ++_jumpCounts[2 * static_cast<size_t>(from - _code.data()) + (to == from->Target? 0 : 1)];
+}
+
+auto VM::PrintPairProfile() const -> void {
+    struct Pair {
+        uint16_t First;
+        uint16_t Second;
+        uint64_t Count;
+    };
+
+    std::vector<Pair> pairs{  };
+    uint64_t total = 0;
+
+    for (size_t i = 0; i != _pairCounts.size(); ++i)
+        if (_pairCounts[i] != 0) {
+            pairs.push_back({ static_cast<uint16_t>(i / (InvalidOpcode + 1)), static_cast<uint16_t>(i % (InvalidOpcode + 1)), _pairCounts[i] });
+            total += _pairCounts[i];
+        }
+
+    std::sort(pairs.begin(), pairs.end(), [](const auto& lhs, const auto& rhs) -> bool {
+        return lhs.Count > rhs.Count;
+    });
+
+    puts("===== Most frequent pairs of adjacent instructions =====\n");
+    for (size_t i = 0; i != pairs.size() && i != 20; ++i) {
+        const auto first  = static_cast<Instructions::Opcode>(pairs[i].First);
+        const auto second = static_cast<Instructions::Opcode>(pairs[i].Second);
+        printf("  %-12s %-12s %12" PRIu64 " (%5.2f%%)\n", Instructions::OpcodeToString(first), Instructions::OpcodeToString(second),
+               pairs[i].Count, 100.0 * pairs[i].Count / total);
+    }
+}
+
+// Only functions that asked for it, or that were memoized, show up
+auto VM::PrintMemoReport() const -> void {
+    const auto& symbols = _unit.Symbols();
+    bool any = false;
+    for (size_t i = 0; i != _functions.size(); ++i)
+        any = any || _functions[i].Memoized || symbols.At(i).Memoize;
+    if (!any)
+        return;
+
+    puts("===== Memoized functions =====\n");
+    for (size_t i = 0; i != _functions.size(); ++i) {
+        if (!_functions[i].Memoized) {
+            if (symbols.At(i).Memoize)
+                printf("  %-20s not pure, runs every time\n", symbols.At(i).Name.c_str());
+            continue;
+        }
+
+        const auto& table = _memos[i];
+        const auto calls = table.Hits + table.Misses;
+        printf("  %-20s %12" PRIu64 " hits %12" PRIu64 " misses", symbols.At(i).Name.c_str(), table.Hits, table.Misses);
+        if (calls != 0)
+            printf("  %6.2f%% hit rate", 100.0 * table.Hits / calls);
+        putchar('\n');
+    }
+}
+
+auto VM::PrintTierReport() const -> void {
+    static constexpr const char* names[] = { "generic", "specialized", "native", "optimized" };
+    const auto& symbols = _unit.Symbols();
 
-    } while (!_callStack.IsEmpty());
+    puts("===== Functions that tiered up =====\n");
+    for (const auto& event : _tierEvents) {
+        printf("  %10.3f ms  %-20s %-12s", event.Milliseconds, symbols.At(event.Function).Name.c_str(), names[static_cast<size_t>(event.Level)]);
+        if (event.Cause != event.Function)
+            printf("along with %s\n", symbols.At(event.Cause).Name.c_str());
+        else
+            printf("after %" PRIu32 " %s\n", event.ByBackEdges? HotBackEdges : HotCalls, event.ByBackEdges? "backward jumps" : "calls");
+    }
+}
+
+// A line per function, `function NAME SIZE CALLS`, followed by a line per conditional jump in it
+// that ran, `branch INDEX TAKEN NOT-TAKEN`, where `INDEX` counts instructions from the function's
+// start. The `Assembler` reads it back, see `OptimizerOptions::Profile`
+auto VM::WriteProfile(const std::string& path) const -> void {
+    std::unique_ptr<FILE, int(*)(FILE*)> file{ fopen(path.c_str(), "w"), fclose };
+    if (!file)
+        ReportError("Can't write the profile: " + path);
+
+    const auto& symbols = _unit.Symbols();
+    for (size_t i = 0; i != symbols.Count(); ++i) {
+        const auto& symbol = symbols.At(i);
+        const size_t start = symbol.Start / 4;
+        const size_t end = symbol.End / 4;
+        fprintf(file.get(), "function %s %zu %" PRIu64 "\n", symbol.Name.c_str(), end - start,
+                i < _callCounts.size()? _callCounts[i] : 0);
+
+        for (size_t j = start; j != end && 2 * j < _jumpCounts.size(); ++j)
+            if (_jumpCounts[2 * j] + _jumpCounts[2 * j + 1] != 0)
+                fprintf(file.get(), "branch %zu %" PRIu64 " %" PRIu64 "\n", j - start, _jumpCounts[2 * j], _jumpCounts[2 * j + 1]);
+    }
 }
 
 auto VM::ReportError(std::string_view message) const -> void {
-    std::puts(message.data());
-    exit(EXIT_FAILURE);
+    throw Error::VMError{ std::string(message) };
+}
+
+// Describes a fault of the instruction at index `at` of the code, with the types
+// of as many of the registers as it has operands
+auto VM::Trap(Error::Fault fault, size_t at, const Primitives::Type* dest, const Primitives::Type* src) const -> void {
+    const auto& symbols = _unit.Symbols();
+    std::string function{ "<unknown>" };
+    for (size_t i = 0; i != symbols.Count(); ++i)
+        if (symbols.At(i).Start / 4 <= at && at < symbols.At(i).End / 4) {
+            function = symbols.At(i).Name;
+            break;
+        }
+
+    std::string operands{  };
+    if (fault != Error::Fault::InvalidInstruction) {
+        const auto opcode = static_cast<Instructions::Opcode>(_unit.StartPC()[at] >> 24);
+        if (Instructions::OpcodeCount(opcode) >= 1)
+            operands += Primitives::TypeToString(*dest);
+        if (Instructions::OpcodeCount(opcode) == 2)
+            operands += std::string(", ") + Primitives::TypeToString(*src);
+    }
+
+    throw Error::RuntimeError{ fault, std::move(function), static_cast<uint32_t>(at * 4), std::move(operands) };
+}
+
+auto VM::LeaveNative() -> void {
+    std::longjmp(*_nativeExit, 1);
 }
 
 }
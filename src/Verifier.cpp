@@ -0,0 +1,267 @@
+// My header files
+#include "../include/Verifier.hpp"
+#include <cstdint>
+#include <exception>
+
+namespace Yun::VM {
+
+using Primitives::Type;
+
+// Two extra points of the type lattice: no value has reached
+// the register yet, or values of different types might have
+static constexpr auto Unreached = static_cast<Type>(0xFE);
+static constexpr auto Unknown   = Instructions::Operand::Any;
+
+// `Unreached` registers only ever show up on paths that can't be taken
+[[nodiscard]] static constexpr auto Satisfies(Type actual, Type expected) noexcept -> bool {
+    return expected == Unknown || expected == Unreached || actual == expected || actual == Unreached;
+}
+
+[[nodiscard]] static constexpr auto SatisfiesEither(Type actual, Type first, Type second) noexcept -> bool {
+    return actual == first || actual == second || actual == Unreached;
+}
+
+Verifier::Verifier(const ExecutionUnit& unit)
+    :_unit{ unit }, _bodies{  }, _graphs{  }, _entries{  }, _arguments{  }, _returns{  }, _changed{ false } {
+}
+
+[[nodiscard]] auto Verifier::Verify() -> std::vector<bool> {
+    const auto count = _unit.Symbols().Count();
+
+    // A single function that can't be analyzed could pass anything
+    // to the others, so none of them can be trusted in that case
+    if (!Decode())
+        return std::vector<bool>(count, false);
+
+    _arguments.clear();
+    _entries.assign(count, {  });
+    _returns.assign(count, Unreached);
+    for (size_t i = 0; i != count; ++i)
+        _arguments.emplace_back(_unit.SymbolLookup(i).Arguments, Unreached);
+
+    do {
+        _changed = false;
+        for (size_t i = 0; i != count; ++i)
+            Analyze(i);
+    } while (_changed);
+
+    std::vector<bool> proven(count, false);
+    for (size_t i = 0; i != count; ++i)
+        proven[i] = Analyze(i);
+    return proven;
+}
+
+// Replays the analysis once more, with the final entry states of the blocks.
+// Nothing changes anymore, so `Step` only tracks the types
+[[nodiscard]] auto Verifier::Types(size_t function) -> Analysis::RegisterTypes {
+    const auto& body   = _bodies[function];
+    const auto& blocks = _graphs[function].Blocks();
+
+    Analysis::RegisterTypes types{ std::vector<State>(body.size()), std::vector<State>(body.size()) };
+    for (size_t block = 0; block != blocks.size(); ++block) {
+        auto state = _entries[function][block];
+        for (auto i = blocks[block].Begin; i != blocks[block].End; ++i) {
+            types.Before[i] = state;
+            Step(function, body[i], state);
+            types.After[i] = state;
+        }
+    }
+    return types;
+}
+
+auto Verifier::Decode() -> bool {
+    const auto& symbols = _unit.Symbols();
+    const size_t size = _unit.StopPC() - _unit.StartPC();
+
+    _bodies.clear();
+    _graphs.clear();
+    try {
+        for (size_t i = 0; i != symbols.Count(); ++i) {
+            const auto& symbol = symbols.At(i);
+            const size_t start = symbol.Start / 4;
+            const size_t end = symbol.End / 4;
+
+            if (start >= end || end > size)
+                return false;
+
+            const auto& body = _bodies.emplace_back(Analysis::Decode(_unit.StartPC() + start, _unit.StartPC() + end));
+            for (const auto& instruction : body) {
+                if (!Instructions::IsCall(instruction.Opcode()))
+                    continue;
+
+                // A bad call would write over registers of some other frame
+                const auto callee = static_cast<size_t>(instruction.Destination());
+                if (callee >= symbols.Count())
+                    return false;
+                else if (symbol.Registers < symbols.At(callee).Arguments || (symbol.Registers == 0 && symbols.At(callee).DoesReturn))
+                    return false;
+            }
+
+            // Falling through to the next function would run it with the wrong frame
+            const auto last = body.back().Opcode();
+            if (last != Instructions::Opcode::ret && last != Instructions::Opcode::jmp && last != Instructions::Opcode::tailcall)
+                return false;
+
+            _graphs.emplace_back(body);
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+auto Verifier::Analyze(size_t function) -> bool {
+    const auto& symbol = _unit.SymbolLookup(function);
+    const auto& body   = _bodies[function];
+    const auto& blocks = _graphs[function].Blocks();
+
+    // Arguments come first, the rest holds whatever the previous frame left there
+    std::vector<State> entries(blocks.size(), State(symbol.Registers, Unreached));
+    for (size_t i = 0; i != symbol.Registers; ++i)
+        entries[0][i] = i < symbol.Arguments? _arguments[function][i] : Unknown;
+
+    std::vector<bool> reached(blocks.size(), false);
+    std::vector<size_t> worklist{ 0 };
+    reached[0] = true;
+
+    while (!worklist.empty()) {
+        const auto block = worklist.back();
+        worklist.pop_back();
+
+        auto state = entries[block];
+        for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+            Step(function, body[i], state);
+
+        for (auto successor : blocks[block].Successors) {
+            if (Join(entries[successor], state) || !reached[successor]) {
+                reached[successor] = true;
+                worklist.push_back(successor);
+            }
+        }
+    }
+
+    // Every block has its final entry state now, so it's time to check
+    _entries[function] = entries;
+    bool proven = true;
+    for (size_t block = 0; block != blocks.size(); ++block) {
+        if (!reached[block])
+            continue;
+
+        auto state = entries[block];
+        for (auto i = blocks[block].Begin; i != blocks[block].End; ++i)
+            proven &= Step(function, body[i], state);
+    }
+    return proven;
+}
+
+// Applies a single instruction to the state. Returns whether the instruction
+// is guaranteed to find its registers in the types it expects
+auto Verifier::Step(size_t function, const Emit::Instruction& instruction, State& state) -> bool {
+    using Instructions::Opcode;
+
+    const auto opcode = instruction.Opcode();
+    const auto dest   = static_cast<size_t>(instruction.Destination());
+    const auto src    = static_cast<size_t>(instruction.Source());
+
+    // Jump targets were checked when decoding
+    const auto& info = Instructions::Info(opcode);
+    if (info.Flags & Instructions::Flag::Jump)
+        return true;
+
+    switch (opcode) {
+    case Opcode::nop:
+    case Opcode::hlt:
+        return true;
+    case Opcode::call: {
+        // Call targets and frame sizes were checked when decoding
+        const auto& callee = _unit.SymbolLookup(dest);
+
+        // Arguments are the last registers of the caller
+        const auto first = state.size() - callee.Arguments;
+        for (size_t i = 0; i != callee.Arguments; ++i)
+            _changed |= Join(_arguments[dest][i], state[first + i]);
+
+        if (callee.DoesReturn && callee.Registers != 0)
+            state.back() = _returns[dest];
+        return true;
+    }
+    case Opcode::tailcall: {
+        const auto& callee = _unit.SymbolLookup(dest);
+
+        const auto first = state.size() - callee.Arguments;
+        for (size_t i = 0; i != callee.Arguments; ++i)
+            _changed |= Join(_arguments[dest][i], state[first + i]);
+
+        // Whatever the callee returns goes straight to our caller
+        if (_unit.SymbolLookup(function).DoesReturn)
+            _changed |= Join(_returns[function], _returns[dest]);
+        return true;
+    }
+    case Opcode::ret:
+        if (_unit.SymbolLookup(function).DoesReturn && !state.empty())
+            _changed |= Join(_returns[function], state[0]);
+        return true;
+    default:
+        break;
+    }
+
+    // Everything else names registers of the current frame
+    const auto operands = info.Operands;
+    if (dest >= state.size() || (operands == 2 && opcode != Opcode::ldconst && src >= state.size()))
+        return false;
+
+    switch (opcode) {
+    case Opcode::ldconst:
+        state[dest] = _unit.ConstantLookup(src).Typeof();
+        return true;
+    case Opcode::mov:
+        state[dest] = state[src];
+        return true;
+    case Opcode::printreg:
+        return true;
+    case Opcode::bnot:
+        return state[dest] == Type::Int32  || state[dest] == Type::Int64 ||
+               state[dest] == Type::Uint32 || state[dest] == Type::Uint64 || state[dest] == Unreached;
+    case Opcode::cmp:
+        return SatisfiesEither(state[dest], Type::Uint32, Type::Uint64) && Satisfies(state[src], state[dest]);
+    case Opcode::icmp:
+        return SatisfiesEither(state[dest], Type::Int32, Type::Int64) && Satisfies(state[src], state[dest]);
+    case Opcode::fcmp:
+        return SatisfiesEither(state[dest], Type::Float32, Type::Float64) && Satisfies(state[src], state[dest]);
+    case Opcode::store:
+        return Satisfies(state[dest], Type::Reference);
+    default:
+        break;
+    }
+
+    // A select leaves either type, like a join of the two ways a jump could have gone
+    if (info.Flags & Instructions::Flag::Selects) {
+        static_cast<void>(Join(state[dest], state[src]));
+        return true;
+    }
+
+    // The rest is described by the opcode table
+    if (!(info.Flags & Instructions::Flag::Writes))
+        return false;
+
+    const auto satisfied = Satisfies(state[dest], info.Dest) && (operands == 1 || Satisfies(state[src], info.Src));
+    state[dest] = info.Result;
+    return satisfied;
+}
+
+auto Verifier::Join(State& into, const State& from) -> bool {
+    bool changed = false;
+    for (size_t i = 0; i != into.size(); ++i)
+        changed |= Join(into[i], from[i]);
+    return changed;
+}
+
+auto Verifier::Join(Type& into, Type from) -> bool {
+    if (from == Unreached || into == from || into == Unknown)
+        return false;
+
+    into = into == Unreached? from : Unknown;
+    return true;
+}
+
+}
\ No newline at end of file
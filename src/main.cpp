@@ -24,6 +24,15 @@ static auto PrintHelp() -> void {
          "  -h    Print this message and exit\n"
          "  -d    Disassemble current file\n"
          "  -t    Print tokens\n"
+         "  -p    Print the most frequent pairs of adjacent executed instructions\n"
+         "  -j    Compile hot functions to native code (x86-64 Linux only)\n"
+         "  -r    Compile traces of hot loops to native code (x86-64 Linux only)\n"
+         "  -v    Print which functions tiered up, and when, and how often memoized ones were spared\n"
+         "  -O<n> Optimization level: 0 for none, 1 for peephole (default), 2 for inlining and global passes too\n"
+         "  -s    Print how many instructions the optimizer left in every function\n"
+         "  -g    Write how often functions were called and jumps were taken to INPUT.profile\n"
+         "  -u    Lay out hot code together, by the profile -g wrote at the same -O level\n"
+         "  -m    Memoize every pure function, and print how often their results were reused\n"
          "Author: Harutekku"
          );
 }
@@ -46,12 +55,22 @@ static auto PrintHelp() -> void {
 
 struct ProgramOptions {
     constexpr ProgramOptions() noexcept
-        :Filename{ nullptr }, Disassemble{ false }, PrintTokens{ false }, ShowHelp{ false } {
+        :Filename{ nullptr }, Disassemble{ false }, PrintTokens{ false }, ShowHelp{ false }, ProfilePairs{ false }, JIT{ false }, Traces{ false }, ReportTiers{ false },
+         RecordProfile{ false }, UseProfile{ false }, Memoize{ false }, Optimizer{  } {
     }
     const char* Filename;
     bool        Disassemble;
     bool        PrintTokens;
     bool        ShowHelp;
+    bool        ProfilePairs;
+    bool        JIT;
+    bool        Traces;
+    bool        ReportTiers;
+    bool        RecordProfile;
+    bool        UseProfile;
+    bool        Memoize;
+
+    Yun::ASM::OptimizerOptions Optimizer;
 };
 
 [[nodiscard]] static auto ParseOptions(const int argc, const char* argv[]) noexcept -> ProgramOptions {
@@ -66,7 +85,7 @@ struct ProgramOptions {
     else if (argc == 3) {
         if (argv[1][0] != '-')
             ReportErrorAndExit("Error: invalid options format\n"
-                               "Usage: yvm [-dht] INPUT");
+                               "Usage: yvm [-dhtpjrvsgumO<n>] INPUT");
         auto len = strlen(argv[1]);
         size_t i = 1;
         for (; i < len; ++i) {
@@ -80,6 +99,35 @@ struct ProgramOptions {
             case 't':
                 options.PrintTokens = true;
                 break;
+            case 'p':
+                options.ProfilePairs = true;
+                break;
+            case 'j':
+                options.JIT = true;
+                break;
+            case 'r':
+                options.Traces = true;
+                break;
+            case 'v':
+                options.ReportTiers = true;
+                break;
+            case 's':
+                options.Optimizer.Statistics = true;
+                break;
+            case 'g':
+                options.RecordProfile = true;
+                break;
+            case 'u':
+                options.UseProfile = true;
+                break;
+            case 'm':
+                options.Memoize = true;
+                break;
+            case 'O':
+                if (i + 1 == len || argv[1][i + 1] < '0' || argv[1][i + 1] > '2')
+                    ReportErrorAndExit("Error: -O takes a level from 0 to 2");
+                options.Optimizer.Level = static_cast<uint8_t>(argv[1][++i] - '0');
+                break;
             default:
                 ReportErrorAndExit("Error: unrecognized option - '%c'", argv[1][i]);
                 break;
@@ -87,10 +135,12 @@ struct ProgramOptions {
         }
         if (i != len)
             ReportErrorAndExit("Error: Failed to parse arguments");
+        else if (options.RecordProfile && options.UseProfile)
+            ReportErrorAndExit("Error: -g records the code as it is without a profile, so it can't be combined with -u");
         options.Filename = argv[2];
     } else
         ReportErrorAndExit("Error: unrecognized trailing options\n"
-                           "Usage: yvm [-dht] INPUT");
+                           "Usage: yvm [-dhtpjrvsgumO<n>] INPUT");
 
     return options;
 }
@@ -111,15 +161,37 @@ auto main(const int argc, const char* argv[]) -> int try {
         for (auto& token : tokens)
             puts(token.ToString().c_str());
 
-    Yun::Interpreter::Parser p{ std::move(tokens) };
+    // Jumps in the profile are numbered as the assembler leaves them, so both runs have to use the same -O level
+    const std::string profile = std::string(options.Filename) + ".profile";
+    if (options.UseProfile)
+        options.Optimizer.Profile = profile.c_str();
+
+    Yun::Interpreter::Parser p{ std::move(tokens), options.Optimizer };
     auto executionUnit = p.Parse();
 
     if (options.Disassemble)
         executionUnit.Disassemble();
 
-    Yun::VM::VM v{ std::move(executionUnit) };
+    Yun::VM::VMOptions vmOptions{  };
+    vmOptions.ProfilePairs  = options.ProfilePairs;
+    vmOptions.JIT           = options.JIT;
+    vmOptions.Traces        = options.Traces;
+    vmOptions.ReportTiers   = options.ReportTiers;
+    vmOptions.RecordProfile = options.RecordProfile;
+    vmOptions.Memoize       = options.Memoize;
+
+    Yun::VM::VM v{ std::move(executionUnit), vmOptions };
 
     v.Run();
+
+    if (options.ProfilePairs)
+        v.PrintPairProfile();
+    if (options.ReportTiers)
+        v.PrintTierReport();
+    if (options.ReportTiers || options.Memoize)
+        v.PrintMemoReport();
+    if (options.RecordProfile)
+        v.WriteProfile(profile);
     return EXIT_SUCCESS;
 } catch (Yun::Error::ParseError&) {
     return EXIT_FAILURE;